@@ -0,0 +1,724 @@
+//
+// stref benchmarks: stref/wstref against std::string and std::string_view
+//
+//   bench [--json] [--reps n] [--filter text]
+//
+// Every benchmark runs a few warmup rounds, then n timed repetitions (15 by default), and reports
+// the minimum, median and 90th percentile time and the median throughput. --json writes the
+// results as JSON (for diffing between versions), otherwise they are printed as a table.
+// The corpora are generated from a fixed seed, so every run measures the same data.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cwctype>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+
+#include "stref.h"
+#include "edit_distance.h"
+#include "line_index.h"
+#include "pattern.h"
+#include "prefix_index.h"
+#include "sort_strefs.h"
+#include "stref_table.h"
+
+using namespace std;
+using namespace tools;
+
+// the results are added to this, so the work isn't optimized away
+static volatile size_t sink;
+
+// stream which discards its output, for timing operator<< without the cost of storing it
+template <typename chT>
+class null_buffer : public basic_streambuf<chT>
+{
+protected:
+    streamsize xsputn(const chT*, streamsize n) override { return n; }
+    typename basic_streambuf<chT>::int_type overflow(typename basic_streambuf<chT>::int_type ch) override { return ch; }
+};
+
+//
+// harness
+//
+
+struct result {
+    string name;        // operation
+    string impl;        // stref, string_view, string...
+    string corpus;
+    size_t bytes;       // processed per repetition
+    vector<double> ns;  // sorted times of the repetitions
+};
+
+class harness
+{
+public:
+    harness(int warmup, int reps, const string& filter) : warmup(warmup), reps(reps), filter(filter) {}
+
+    template <typename F>
+    void run(const string& name, const string& impl, const string& corpus, size_t bytes, F f) {
+        if (!filter.empty() && (name + " " + impl + " " + corpus).find(filter) == string::npos)
+            return;
+        result r = { name, impl, corpus, bytes, vector<double>() };
+        for (int i = 0; i < warmup; ++i)
+            sink += f();
+        for (int i = 0; i < reps; ++i) {
+            auto start = chrono::steady_clock::now();
+            sink += f();
+            r.ns.push_back(chrono::duration<double, nano>(chrono::steady_clock::now() - start).count());
+        }
+        sort(r.ns.begin(), r.ns.end());
+        results.push_back(r);
+    }
+
+    void write_table(ostream& os) const {
+        char line[200];
+        snprintf(line, sizeof(line), "%-22s %-12s %-10s %12s %12s %12s %10s\n", "operation", "impl", "corpus", "min us", "median us", "p90 us", "MB/s");
+        os << line;
+        for (const result& r : results) {
+            snprintf(line, sizeof(line), "%-22s %-12s %-10s %12.1f %12.1f %12.1f %10.1f\n", r.name.c_str(), r.impl.c_str(),
+                     r.corpus.c_str(), r.ns.front() / 1e3, median(r) / 1e3, percentile(r, 90) / 1e3, throughput(r));
+            os << line;
+        }
+    }
+
+    void write_json(ostream& os) const {
+        os << "{\n  \"repetitions\": " << reps << ",\n  \"benchmarks\": [";
+        char line[400];
+        for (size_t i = 0; i < results.size(); ++i) {
+            const result& r = results[i];
+            snprintf(line, sizeof(line),
+                     "%s\n    { \"name\": \"%s\", \"impl\": \"%s\", \"corpus\": \"%s\", \"bytes\": %zu, "
+                     "\"min_ns\": %.0f, \"median_ns\": %.0f, \"p90_ns\": %.0f, \"mb_per_s\": %.1f }",
+                     i == 0 ? "" : ",", r.name.c_str(), r.impl.c_str(), r.corpus.c_str(), r.bytes,
+                     r.ns.front(), median(r), percentile(r, 90), throughput(r));
+            os << line;
+        }
+        os << "\n  ]\n}\n";
+    }
+
+private:
+    static double percentile(const result& r, int p) { return r.ns[(r.ns.size() - 1) * p / 100]; }
+    static double median(const result& r) { return percentile(r, 50); }
+    static double throughput(const result& r) { return r.bytes / median(r) * 1e3; }
+
+    int warmup;
+    int reps;
+    string filter;
+    vector<result> results;
+};
+
+//
+// corpora
+//
+
+struct corpora {
+    vector<string> keys;    // short keys, such as cache or map keys
+    string log;             // log lines
+    wstring csv;            // wide CSV, fields padded with spaces
+
+    explicit corpora(unsigned seed) {
+        mt19937 rng(seed);
+        const char* parts[] = { "user", "session", "cart", "item", "price", "Region", "TTL", "token" };
+        for (int i = 0; i < 100000; ++i) {
+            string key = parts[rng() % 8];
+            key += ':';
+            key += to_string(static_cast<unsigned>(rng() % 100000));
+            if (rng() % 2)
+                key += string(":") + parts[rng() % 8];
+            keys.push_back(key);
+        }
+
+        const char* levels[] = { "INFO", "INFO", "INFO", "DEBUG", "WARN", "ERROR" };
+        const char* paths[] = { "/api/v1/items/", "/api/v1/users/", "/static/img/", "/healthz" };
+        const int statuses[] = { 200, 200, 200, 200, 304, 404, 500 };
+        for (int i = 0; log.length() < (2 << 20); ++i) {
+            // one draw per statement: the order in which arguments are evaluated is unspecified
+            unsigned day = 1 + rng() % 28, hour = rng() % 24, minute = rng() % 60, second = rng() % 60, ms = rng() % 1000;
+            const char* level = levels[rng() % 6];
+            unsigned worker = rng() % 16;
+            const char* path = paths[rng() % 4];
+            unsigned id = rng() % 100000;
+            int status = statuses[rng() % 7];
+            unsigned latency = rng() % 500;
+            char line[256];
+            snprintf(line, sizeof(line), "2024-03-%02u %02u:%02u:%02u.%03u %-5s [worker-%u] GET %s%u status=%d latency_ms=%u\n",
+                     day, hour, minute, second, ms, level, worker, path, id, status, latency);
+            log += line;
+        }
+
+        const wchar_t* words[] = { L"alpha", L"Beta", L"gamma", L"\x3b4\x3ad\x3bb\x3c4\x3b1", L"epsilon", L"Zeta" };
+        for (int row = 0; csv.length() < (1 << 20); ++row) {
+            for (int col = 0; col < 12; ++col) {
+                if (col > 0)
+                    csv += L',';
+                wstring field = col % 3 == 0 ? to_wstring(static_cast<unsigned>(rng() % 1000000)) : wstring(words[rng() % 6]);
+                size_t before = rng() % 3, after = rng() % 3;
+                csv += wstring(before, L' ') + field + wstring(after, L' ');
+            }
+            csv += L'\n';
+        }
+    }
+};
+
+//
+// benchmarks
+//
+
+size_t total_bytes(const vector<string>& keys) {
+    size_t n = 0;
+    for (const string& key : keys)
+        n += key.length();
+    return n;
+}
+
+// case-insensitive comparison the way it's usually written for std::string
+template <typename S>
+int naive_icompare(const S& a, const S& b) {
+    size_t n = min(a.size(), b.size());
+    for (size_t i = 0; i < n; ++i) {
+        int c1 = tolower(static_cast<unsigned char>(a[i])), c2 = tolower(static_cast<unsigned char>(b[i]));
+        if (c1 != c2)
+            return c1 - c2;
+    }
+    return a.size() == b.size() ? 0 : a.size() < b.size() ? -1 : 1;
+}
+
+// split with find(), the usual way for std::string and std::string_view
+template <typename S, typename chT, typename F>
+void naive_split(const S& s, chT sep, F f) {
+    size_t start = 0;
+    for (size_t pos = s.find(sep); pos != S::npos; pos = s.find(sep, start = pos + 1))
+        f(s.substr(start, pos - start));
+    f(s.substr(start));
+}
+
+template <typename S>
+S naive_trim(const S& s) {
+    size_t first = 0, last = s.size();
+    while (first < last && iswspace(s[first]))
+        ++first;
+    while (last > first && iswspace(s[last - 1]))
+        --last;
+    return s.substr(first, last - first);
+}
+
+// wildcard match with * and ?, backtracking to the last *
+bool naive_glob(const stref& p, const stref& s) {
+    size_t i = 0, j = 0, star = stref::npos, resume = 0;
+    while (j < s.length()) {
+        if (i < p.length() && (p[i] == '?' || p[i] == s[j])) {
+            ++i;
+            ++j;
+        }
+        else if (i < p.length() && p[i] == '*') {
+            star = i++;
+            resume = j;
+        }
+        else if (star != stref::npos) {
+            i = star + 1;
+            j = ++resume;
+        }
+        else
+            return false;
+    }
+    while (i < p.length() && p[i] == '*')
+        ++i;
+    return i == p.length();
+}
+
+void narrow_benchmarks(harness& h, const corpora& c) {
+    const vector<string>& keys = c.keys;
+    vector<const char*> cstrs;
+    for (const string& key : keys)
+        cstrs.push_back(key.c_str());
+    vector<stref> srefs(keys.begin(), keys.end());
+    vector<string> upper_keys(keys);
+    for (string& key : upper_keys)
+        transform(key.begin(), key.end(), key.begin(), ::toupper);
+    vector<stref> upper_srefs(upper_keys.begin(), upper_keys.end());
+    size_t key_bytes = total_bytes(keys);
+    stref log(c.log);
+
+    // construct from a C string
+    h.run("construct", "stref", "keys", key_bytes, [&] {
+        size_t n = 0;
+        for (const char* s : cstrs)
+            n += stref(s).length();
+        return n;
+    });
+    h.run("construct", "string", "keys", key_bytes, [&] {
+        size_t n = 0;
+        for (const char* s : cstrs)
+            n += string(s).length();
+        return n;
+    });
+
+    // compare neighbouring keys
+    h.run("compare", "stref", "keys", key_bytes, [&] {
+        size_t n = 0;
+        for (size_t i = 1; i < srefs.size(); ++i)
+            n += srefs[i - 1].compare(srefs[i]) < 0;
+        return n;
+    });
+    h.run("compare", "string", "keys", key_bytes, [&] {
+        size_t n = 0;
+        for (size_t i = 1; i < keys.size(); ++i)
+            n += keys[i - 1].compare(keys[i]) < 0;
+        return n;
+    });
+    h.run("equal", "stref", "keys", key_bytes, [&] {
+        size_t n = 0;
+        for (size_t i = 1; i < srefs.size(); ++i)
+            n += srefs[i - 1] == srefs[i];
+        return n;
+    });
+    h.run("equal", "string", "keys", key_bytes, [&] {
+        size_t n = 0;
+        for (size_t i = 1; i < keys.size(); ++i)
+            n += keys[i - 1] == keys[i];
+        return n;
+    });
+
+    // case-insensitive comparison of each key with its upper case copy, so the whole key is compared
+    h.run("icompare", "stref", "keys", key_bytes, [&] {
+        size_t n = 0;
+        for (size_t i = 0; i < srefs.size(); ++i)
+            n += srefs[i].icompare(upper_srefs[i]) == 0;
+        return n;
+    });
+    h.run("icompare", "string", "keys", key_bytes, [&] {
+        size_t n = 0;
+        for (size_t i = 0; i < keys.size(); ++i)
+            n += naive_icompare(keys[i], upper_keys[i]) == 0;
+        return n;
+    });
+
+    // count lines
+    h.run("find(char)", "stref", "log", log.length(), [&] {
+        size_t n = 0;
+        for (size_t pos = log.find('\n'); pos != stref::npos; pos = log.find('\n', pos + 1))
+            ++n;
+        return n;
+    });
+    h.run("find(char)", "string", "log", log.length(), [&] {
+        size_t n = 0;
+        for (size_t pos = c.log.find('\n'); pos != string::npos; pos = c.log.find('\n', pos + 1))
+            ++n;
+        return n;
+    });
+
+    // find errors
+    h.run("find(string)", "stref", "log", log.length(), [&] {
+        size_t n = 0;
+        for (size_t pos : log.find_all("status=500"))
+            n += pos;
+        return n;
+    });
+    h.run("find(string)", "string", "log", log.length(), [&] {
+        size_t n = 0;
+        for (size_t pos = c.log.find("status=500"); pos != string::npos; pos = c.log.find("status=500", pos + 10))
+            n += pos;
+        return n;
+    });
+
+    // split into lines, then lines into words
+    h.run("split", "stref", "log", log.length(), [&] {
+        size_t n = 0;
+        log.split('\n', [&](const stref& line) { line.split(' ', [&](const stref& word) { n += word.length(); }); });
+        return n;
+    });
+    h.run("split", "string", "log", log.length(), [&] {
+        size_t n = 0;
+        naive_split(c.log, '\n', [&](const string& line) { naive_split(line, ' ', [&](const string& word) { n += word.length(); }); });
+        return n;
+    });
+
+    // what the std::function overloads cost: type erasure on the predicate and the body
+    h.run("split(is_any_of)", "stref", "log", log.length(), [&] {
+        size_t n = 0;
+        log.split(is_any_of<char>(" =\n"), [&](const stref& token) { n += token.length(); });
+        return n;
+    });
+    h.run("split(is_any_of)", "std::function", "log", log.length(), [&] {
+        size_t n = 0;
+        std::function< bool(char) > match = is_any_of<char>(" =\n");
+        std::function< void(const stref&) > body = [&](const stref& token) { n += token.length(); };
+        log.split(match, body);
+        return n;
+    });
+
+    h.run("each", "stref", "log", log.length(), [&] {
+        size_t n = 0;
+        log.each([&](char ch) { n += ch == ' '; });
+        return n;
+    });
+    h.run("each", "string", "log", log.length(), [&] {
+        size_t n = 0;
+        for (char ch : c.log)
+            n += ch == ' ';
+        return n;
+    });
+
+    h.run("operator<<", "stref", "log", log.length(), [&] {
+        null_buffer<char> buffer;
+        ostream os(&buffer);
+        size_t n = 0;
+        log.split('\n', [&](const stref& line) { os << line; ++n; });
+        return n;
+    });
+    h.run("operator<<", "string", "log", log.length(), [&] {
+        null_buffer<char> buffer;
+        ostream os(&buffer);
+        size_t n = 0;
+        naive_split(c.log, '\n', [&](const string& line) { os << line; ++n; });
+        return n;
+    });
+
+    h.run("sort", "stref", "keys", key_bytes, [&] {
+        vector<stref> v(srefs);
+        sort_strefs(v.begin(), v.end());
+        return v[v.size() / 2].length();
+    });
+    h.run("sort", "std::sort", "keys", key_bytes, [&] {
+        vector<stref> v(srefs);
+        sort(v.begin(), v.end());
+        return v[v.size() / 2].length();
+    });
+    h.run("isort", "stref", "keys", key_bytes, [&] {
+        vector<stref> v(srefs);
+        sort_strefs(v.begin(), v.end(), case_insensitive);
+        return v[v.size() / 2].length();
+    });
+    h.run("isort", "std::sort", "keys", key_bytes, [&] {
+        vector<stref> v(srefs);
+        sort(v.begin(), v.end(), [](const stref& a, const stref& b) { return a.iless_than(b); });
+        return v[v.size() / 2].length();
+    });
+    thread_pool pool;
+    h.run("sort", "parallel", "keys", key_bytes, [&] {
+        vector<stref> v(srefs);
+        sort_strefs(pool, v.begin(), v.end());
+        return v[v.size() / 2].length();
+    });
+
+    // wildcard filters over log lines
+    const char* globs[] = { "*ERROR*GET /api/v1/users/*status=500*", "*WARN*latency_ms=4??", "*[[]worker-1?]*/healthz*",
+                            "2024-03-0?*INFO*", "*status=404*", "*GET /static/img/*", "*DEBUG*", "*latency_ms=0" };
+    const char* plain_globs[] = { "*ERROR*GET /api/v1/users/*status=500*", "*WARN*latency_ms=4??", "*worker-1?]*/healthz*",
+                                  "2024-03-0?*INFO*", "*status=404*", "*GET /static/img/*", "*DEBUG*", "*latency_ms=0" };
+    vector<pattern> patterns;
+    for (const char* glob : globs)
+        patterns.push_back(pattern(glob));
+    h.run("glob", "pattern", "log", log.length(), [&] {
+        size_t n = 0;
+        log.split('\n', [&](const stref& line) { n += patterns[0].matches(line); });
+        return n;
+    });
+    h.run("glob", "backtracking", "log", log.length(), [&] {
+        size_t n = 0;
+        log.split('\n', [&](const stref& line) { n += naive_glob(plain_globs[0], line); });
+        return n;
+    });
+    pattern_set filters(begin(globs), end(globs));
+    h.run("glob x8", "pattern_set", "log", log.length(), [&] {
+        size_t n = 0;
+        log.split('\n', [&](const stref& line) { n += filters.matches_any(line); });
+        return n;
+    });
+    h.run("glob x8", "backtracking", "log", log.length(), [&] {
+        size_t n = 0;
+        log.split('\n', [&](const stref& line) {
+            for (const char* glob : plain_globs)
+                if (naive_glob(glob, line)) {
+                    ++n;
+                    break;
+                }
+        });
+        return n;
+    });
+
+    // tokens held as a table of offsets rather than strefs
+    h.run("split+count", "stref_table", "log", log.length(), [&] {
+        stref_table tokens(log, ' ');
+        return tokens.count_equal("INFO");
+    });
+    h.run("split+count", "varint table", "log", log.length(), [&] {
+        stref_table tokens(log, ' ', varint_offsets);
+        return tokens.count_equal("INFO");
+    });
+    h.run("split+count", "vector<stref>", "log", log.length(), [&] {
+        vector<stref> tokens;
+        log.split(' ', [&](const stref& token) { tokens.push_back(token); });
+        return static_cast<size_t>(count(tokens.begin(), tokens.end(), stref("INFO")));
+    });
+    stref_table log_tokens(log, ' ');
+    vector<stref> log_token_vector;
+    log.split(' ', [&](const stref& token) { log_token_vector.push_back(token); });
+    h.run("count", "stref_table", "log", log.length(), [&] { return log_tokens.count_equal("INFO"); });
+    h.run("count", "vector<stref>", "log", log.length(), [&] {
+        return static_cast<size_t>(count(log_token_vector.begin(), log_token_vector.end(), stref("INFO")));
+    });
+
+    // random access to lines
+    line_index log_index(log);
+    h.run("index lines", "line_index", "log", log.length(), [&] { return line_index(log).size(); });
+    h.run("line(n) x100", "line_index", "log", 0, [&] {
+        size_t n = 0;
+        for (size_t i = 0; i < 100; ++i)
+            n += log_index.line(i * 997 % log_index.size()).length();
+        return n;
+    });
+    h.run("line(n) x100", "lines()", "log", 0, [&] {
+        size_t n = 0;
+        for (size_t i = 0; i < 100; ++i) {
+            size_t skip = i * 997 % log_index.size();
+            for (stref line : log.lines())
+                if (skip-- == 0) {
+                    n += line.length();
+                    break;
+                }
+        }
+        return n;
+    });
+
+    // near duplicates of a key among 10000 others, as copies compared by dynamic programming
+    vector<stref> candidates(srefs.begin(), srefs.begin() + 10000);
+    size_t candidate_bytes = total_bytes(vector<string>(keys.begin(), keys.begin() + 10000));
+    string near_key = keys[4321];
+    near_key[near_key.length() / 2] ^= 1;
+    h.run("within 3", "edit_distance", "keys", candidate_bytes, [&] {
+        size_t n = 0;
+        for (const stref& s : candidates)
+            n += within_distance(stref(near_key), s, 3);
+        return n;
+    });
+    h.run("within 3", "edit_distances", "keys", candidate_bytes, [&] {
+        vector<size_t> d = edit_distances(stref(near_key), candidates.begin(), candidates.end(), 3);
+        return static_cast<size_t>(count_if(d.begin(), d.end(), [](size_t x) { return x <= 3; }));
+    });
+    h.run("distances", "edit_distances", "keys", candidate_bytes, [&] {
+        vector<size_t> d = edit_distances(stref(near_key), candidates.begin(), candidates.end());
+        return static_cast<size_t>(count_if(d.begin(), d.end(), [](size_t x) { return x <= 3; }));
+    });
+    h.run("distances", "string dp", "keys", candidate_bytes, [&] {
+        size_t n = 0;
+        vector<size_t> row;
+        for (const stref& s : candidates) {
+            string a(near_key), b(s.data(), s.length());
+            row.resize(b.length() + 1);
+            for (size_t j = 0; j <= b.length(); ++j)
+                row[j] = j;
+            for (size_t i = 1; i <= a.length(); ++i) {
+                size_t diagonal = row[0];
+                row[0] = i;
+                for (size_t j = 1; j <= b.length(); ++j) {
+                    size_t d = min(diagonal + (a[i - 1] != b[j - 1] ? 1 : 0), min(row[j], row[j - 1]) + 1);
+                    diagonal = row[j];
+                    row[j] = d;
+                }
+            }
+            n += row[b.length()] <= 3;
+        }
+        return n;
+    });
+
+    // longest-prefix routing of 10000 keys over 2000 prefixes of others
+    vector<string> prefixes;
+    for (size_t i = 0; i < 2000; ++i)
+        prefixes.push_back(keys[i * 7].substr(0, keys[i * 7].find(':') + 3));
+    vector<stref> lookups(srefs.begin(), srefs.begin() + 10000);
+    size_t lookup_bytes = total_bytes(vector<string>(keys.begin(), keys.begin() + 10000));
+    prefix_index<size_t> routes;
+    for (size_t i = 0; i < prefixes.size(); ++i)
+        routes.insert(prefixes[i], i);
+    h.run("longest_prefix", "prefix_index", "keys", lookup_bytes, [&] {
+        size_t n = 0;
+        for (const stref& s : lookups)
+            n += routes.longest_prefix(s).key.length();
+        return n;
+    });
+    h.run("longest_prefix", "starts_with", "keys", lookup_bytes, [&] {
+        size_t n = 0;
+        for (const stref& s : lookups) {
+            size_t best = 0;
+            for (const string& p : prefixes)
+                if (p.length() > best && s.starts_with(p))
+                    best = p.length();
+            n += best;
+        }
+        return n;
+    });
+
+#if __cplusplus >= 201703L
+    vector<string_view> views(keys.begin(), keys.end()), upper_views(upper_keys.begin(), upper_keys.end());
+    string_view log_view(c.log);
+    h.run("construct", "string_view", "keys", key_bytes, [&] {
+        size_t n = 0;
+        for (const char* s : cstrs)
+            n += string_view(s).length();
+        return n;
+    });
+    h.run("compare", "string_view", "keys", key_bytes, [&] {
+        size_t n = 0;
+        for (size_t i = 1; i < views.size(); ++i)
+            n += views[i - 1].compare(views[i]) < 0;
+        return n;
+    });
+    h.run("equal", "string_view", "keys", key_bytes, [&] {
+        size_t n = 0;
+        for (size_t i = 1; i < views.size(); ++i)
+            n += views[i - 1] == views[i];
+        return n;
+    });
+    h.run("icompare", "string_view", "keys", key_bytes, [&] {
+        size_t n = 0;
+        for (size_t i = 0; i < views.size(); ++i)
+            n += naive_icompare(views[i], upper_views[i]) == 0;
+        return n;
+    });
+    h.run("find(char)", "string_view", "log", log.length(), [&] {
+        size_t n = 0;
+        for (size_t pos = log_view.find('\n'); pos != string_view::npos; pos = log_view.find('\n', pos + 1))
+            ++n;
+        return n;
+    });
+    h.run("find(string)", "string_view", "log", log.length(), [&] {
+        size_t n = 0;
+        for (size_t pos = log_view.find("status=500"); pos != string_view::npos; pos = log_view.find("status=500", pos + 10))
+            n += pos;
+        return n;
+    });
+    h.run("split", "string_view", "log", log.length(), [&] {
+        size_t n = 0;
+        naive_split(log_view, '\n', [&](string_view line) { naive_split(line, ' ', [&](string_view word) { n += word.length(); }); });
+        return n;
+    });
+    h.run("operator<<", "string_view", "log", log.length(), [&] {
+        null_buffer<char> buffer;
+        ostream os(&buffer);
+        size_t n = 0;
+        naive_split(log_view, '\n', [&](string_view line) { os << line; ++n; });
+        return n;
+    });
+#endif
+}
+
+void wide_benchmarks(harness& h, const corpora& c) {
+    wstref csv(c.csv);
+    size_t bytes = csv.length() * sizeof(wchar_t);
+    vector<wstref> fields;
+    csv.split(is_any_of<wchar_t>(L",\n"), [&](const wstref& field) { fields.push_back(field); });
+    vector<wstring> field_strings(fields.begin(), fields.end());
+
+    h.run("find(char)", "wstref", "csv", bytes, [&] {
+        size_t n = 0;
+        for (size_t pos = csv.find(L'\n'); pos != wstref::npos; pos = csv.find(L'\n', pos + 1))
+            ++n;
+        return n;
+    });
+    h.run("find(char)", "wstring", "csv", bytes, [&] {
+        size_t n = 0;
+        for (size_t pos = c.csv.find(L'\n'); pos != wstring::npos; pos = c.csv.find(L'\n', pos + 1))
+            ++n;
+        return n;
+    });
+
+    h.run("split", "wstref", "csv", bytes, [&] {
+        size_t n = 0;
+        csv.split(L'\n', [&](const wstref& row) { row.split(L',', [&](const wstref& field) { n += field.length(); }); });
+        return n;
+    });
+    h.run("split", "wstring", "csv", bytes, [&] {
+        size_t n = 0;
+        naive_split(c.csv, L'\n', [&](const wstring& row) { naive_split(row, L',', [&](const wstring& field) { n += field.length(); }); });
+        return n;
+    });
+
+    h.run("trim", "wstref", "csv", bytes, [&] {
+        size_t n = 0;
+        for (const wstref& field : fields)
+            n += field.trim().length();
+        return n;
+    });
+    h.run("trim", "wstring", "csv", bytes, [&] {
+        size_t n = 0;
+        for (const wstring& field : field_strings)
+            n += naive_trim(field).length();
+        return n;
+    });
+
+    h.run("icompare", "wstref", "csv", bytes, [&] {
+        size_t n = 0;
+        for (size_t i = 1; i < fields.size(); ++i)
+            n += fields[i - 1].icompare(fields[i]) < 0;
+        return n;
+    });
+
+    h.run("each", "wstref", "csv", bytes, [&] {
+        size_t n = 0;
+        csv.each([&](wchar_t ch) { n += ch == L' '; });
+        return n;
+    });
+
+    h.run("operator<<", "wstref", "csv", bytes, [&] {
+        null_buffer<wchar_t> buffer;
+        wostream os(&buffer);
+        for (const wstref& field : fields)
+            os << field;
+        return fields.size();
+    });
+
+#if __cplusplus >= 201703L
+    wstring_view csv_view(c.csv);
+    h.run("find(char)", "wstring_view", "csv", bytes, [&] {
+        size_t n = 0;
+        for (size_t pos = csv_view.find(L'\n'); pos != wstring_view::npos; pos = csv_view.find(L'\n', pos + 1))
+            ++n;
+        return n;
+    });
+    h.run("split", "wstring_view", "csv", bytes, [&] {
+        size_t n = 0;
+        naive_split(csv_view, L'\n', [&](wstring_view row) { naive_split(row, L',', [&](wstring_view field) { n += field.length(); }); });
+        return n;
+    });
+#endif
+}
+
+int main(int argc, char** argv) {
+    bool json = false;
+    int reps = 15;
+    string filter;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--json") == 0)
+            json = true;
+        else if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc)
+            reps = max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+            filter = argv[++i];
+        else {
+            cerr << "usage: bench [--json] [--reps n] [--filter text]" << endl;
+            return 2;
+        }
+    }
+
+    corpora c(20120101);
+    harness h(3, reps, filter);
+    narrow_benchmarks(h, c);
+    wide_benchmarks(h, c);
+    if (json)
+        h.write_json(cout);
+    else
+        h.write_table(cout);
+    return 0;
+}
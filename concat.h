@@ -0,0 +1,211 @@
+/*
+    Copyright (C) 2012, Ferruccio Barletta (ferruccio.barletta@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person
+    obtaining a copy of this software and associated documentation
+    files (the "Software"), to deal in the Software without
+    restriction, including without limitation the rights to use,
+    copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the
+    Software is furnished to do so, subject to the following
+    conditions:
+
+    The above copyright notice and this permission notice shall be
+    included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+    OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef CONCAT_H
+#define CONCAT_H
+
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "stref.h"
+
+namespace tools {
+
+    //
+    // concatenation with a single allocation
+    //
+    // concat(a, b, c, ...) adds up the lengths of its parts, allocates the result once and copies
+    // each part into place. The parts can be strefs, std::basic_strings, C strings and single
+    // characters, of the same character type. concat_append() appends to an existing string
+    // (reusing its capacity), concat_to() writes into a caller supplied buffer.
+    //
+    // join(range, sep) does the same for the strings in a range (it is traversed twice: once for
+    // the length and once to copy, so it can't be a single-pass input range).
+    //
+
+    namespace detail {
+
+        template <typename TT> const typename TT::char_type* piece_data(const basic_stref<TT>& s) { return s.data(); }
+        template <typename TT> size_t piece_length(const basic_stref<TT>& s) { return s.length(); }
+
+        template <typename chT, typename Tr, typename A>
+        const chT* piece_data(const std::basic_string<chT, Tr, A>& s) { return s.data(); }
+        template <typename chT, typename Tr, typename A>
+        size_t piece_length(const std::basic_string<chT, Tr, A>& s) { return s.size(); }
+
+        template <typename chT> const chT* piece_data(const chT* s) { return s; }
+        template <typename chT> size_t piece_length(const chT* s) { return std::char_traits<chT>::length(s); }
+
+        inline const char* piece_data(const char& c) { return &c; }
+        inline size_t piece_length(char) { return 1; }
+        inline const wchar_t* piece_data(const wchar_t& c) { return &c; }
+        inline size_t piece_length(wchar_t) { return 1; }
+
+        // the character type of a part
+        template <typename T>
+        struct piece_char {
+            typedef typename std::remove_const<typename std::remove_pointer<
+                decltype(piece_data(std::declval<const T&>()))>::type>::type type;
+        };
+
+        template <typename First, typename... Rest>
+        struct first_piece_char : piece_char<First> {};
+
+        inline size_t concat_length() { return 0; }
+
+        template <typename Part, typename... Parts>
+        size_t concat_length(const Part& part, const Parts&... parts) {
+            return piece_length(part) + concat_length(parts...);
+        }
+
+        template <typename chT>
+        chT* concat_to(chT* out) { return out; }
+
+        template <typename chT, typename Part, typename... Parts>
+        chT* concat_to(chT* out, const Part& part, const Parts&... parts) {
+            size_t n = piece_length(part);
+            std::char_traits<chT>::copy(out, piece_data(part), n);
+            return concat_to(out + n, parts...);
+        }
+
+        // true if a part lies (partly) in [first, last), such as a view of the string appended to
+        template <typename chT>
+        bool overlaps(const chT*, const chT*) { return false; }
+
+        template <typename chT, typename Part, typename... Parts>
+        bool overlaps(const chT* first, const chT* last, const Part& part, const Parts&... parts) {
+            const chT* p = piece_data(part);
+            std::less<const chT*> less;
+            return (less(p, last) && less(first, p + piece_length(part))) || overlaps(first, last, parts...);
+        }
+
+    }
+
+    // the length of the concatenation of the parts
+    template <typename... Parts>
+    size_t concat_length(const Parts&... parts) {
+        return detail::concat_length(parts...);
+    }
+
+    // copy the parts one after the other to out, which has room for concat_length(parts...)
+    // characters; returns the end of what was written (nothing is written after it, not even a 0)
+    template <typename chT, typename... Parts>
+    chT* concat_to(chT* out, const Parts&... parts) {
+        return detail::concat_to(out, parts...);
+    }
+
+    // append the parts to s, growing it at most once (parts may refer to s itself: those are
+    // concatenated apart first, as growing s could move them)
+    template <typename chT, typename Tr, typename A, typename... Parts>
+    std::basic_string<chT, Tr, A>& concat_append(std::basic_string<chT, Tr, A>& s, const Parts&... parts) {
+        size_t n = s.size();
+        if (detail::overlaps<chT>(s.data(), s.data() + n, parts...)) {
+            std::basic_string<chT, Tr, A> tail(detail::concat_length(parts...), chT());
+            if (!tail.empty())
+                detail::concat_to(&tail[0], parts...);
+            return s.append(tail);
+        }
+        s.resize(n + detail::concat_length(parts...));
+        if (n != s.size())
+            detail::concat_to(&s[n], parts...);
+        return s;
+    }
+
+    template <typename... Parts>
+    std::basic_string<typename detail::first_piece_char<Parts...>::type> concat(const Parts&... parts) {
+        std::basic_string<typename detail::first_piece_char<Parts...>::type> s;
+        concat_append(s, parts...);
+        return s;
+    }
+
+    namespace detail {
+
+        // the length of the strings in range separated by sep, noting whether any of them (or sep)
+        // lies in [first, last)
+        template <typename chT, typename Range, typename Sep>
+        size_t join_length(const Range& range, const Sep& sep, const chT* first, const chT* last, bool& aliased) {
+            size_t n = 0, count = 0;
+            aliased = overlaps(first, last, sep);
+            for (const auto& part : range) {
+                n += piece_length(part);
+                aliased = aliased || overlaps(first, last, part);
+                ++count;
+            }
+            return count == 0 ? 0 : n + (count - 1) * piece_length(sep);
+        }
+
+    }
+
+    // the length of the strings in range separated by sep
+    template <typename Range, typename Sep>
+    size_t join_length(const Range& range, const Sep& sep) {
+        typedef typename detail::piece_char<Sep>::type chT;
+        bool aliased;
+        return detail::join_length<chT>(range, sep, nullptr, nullptr, aliased);
+    }
+
+    // copy the strings in range to out, separated by sep; returns the end of what was written
+    template <typename chT, typename Range, typename Sep>
+    chT* join_to(chT* out, const Range& range, const Sep& sep) {
+        bool first = true;
+        for (const auto& part : range) {
+            out = first ? detail::concat_to(out, part) : detail::concat_to(out, sep, part);
+            first = false;
+        }
+        return out;
+    }
+
+    // append the strings in range, separated by sep, to s, growing it at most once (or joining
+    // them apart first if any of them refers to s itself, like concat_append())
+    template <typename chT, typename Tr, typename A, typename Range, typename Sep>
+    std::basic_string<chT, Tr, A>& join_append(std::basic_string<chT, Tr, A>& s, const Range& range, const Sep& sep) {
+        size_t n = s.size();
+        bool aliased;
+        size_t length = detail::join_length(range, sep, s.data(), s.data() + n, aliased);
+        if (aliased) {
+            std::basic_string<chT, Tr, A> tail(length, chT());
+            if (!tail.empty())
+                join_to(&tail[0], range, sep);
+            return s.append(tail);
+        }
+        s.resize(n + length);
+        if (n != s.size())
+            join_to(&s[n], range, sep);
+        return s;
+    }
+
+    template <typename Range, typename Sep>
+    std::basic_string<typename detail::piece_char<Sep>::type> join(const Range& range, const Sep& sep) {
+        std::basic_string<typename detail::piece_char<Sep>::type> s;
+        join_append(s, range, sep);
+        return s;
+    }
+
+}
+
+#endif
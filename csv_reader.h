@@ -0,0 +1,302 @@
+/*
+    Copyright (C) 2012, Ferruccio Barletta (ferruccio.barletta@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person
+    obtaining a copy of this software and associated documentation
+    files (the "Software"), to deal in the Software without
+    restriction, including without limitation the rights to use,
+    copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the
+    Software is furnished to do so, subject to the following
+    conditions:
+
+    The above copyright notice and this permission notice shall be
+    included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+    OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef CSV_READER_H
+#define CSV_READER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "stref.h"
+
+namespace tools {
+
+    template <typename TT> class basic_csv_reader;
+
+    namespace detail {
+
+        // the positions of the structural characters in a block of 64 code units, one bit each
+        struct csv_masks {
+            std::uint64_t quotes;
+            std::uint64_t separators;   // field separators and newlines
+        };
+
+        template <typename chT>
+        csv_masks csv_scan_scalar(const chT* p, size_t n, chT quote, chT sep) {
+            csv_masks m = { 0, 0 };
+            for (size_t i = 0; i < n; ++i) {
+                std::uint64_t bit = std::uint64_t(1) << i;
+                if (p[i] == quote)
+                    m.quotes |= bit;
+                else if (p[i] == sep || p[i] == chT('\n'))
+                    m.separators |= bit;
+            }
+            return m;
+        }
+
+#if defined(STREF_X86)
+        STREF_TARGET("sse2") inline std::uint64_t eq_mask64_sse2(const __m128i* v, char ch) {
+            const __m128i c = _mm_set1_epi8(ch);
+            std::uint64_t m = 0;
+            for (int i = 0; i < 4; ++i)
+                m |= std::uint64_t(static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(v[i], c))) & 0xffff) << (16 * i);
+            return m;
+        }
+
+        STREF_TARGET("sse2") inline csv_masks csv_scan_sse2(const char* p, char quote, char sep) {
+            __m128i v[4];
+            for (int i = 0; i < 4; ++i)
+                v[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * i));
+            csv_masks m;
+            m.quotes = eq_mask64_sse2(v, quote);
+            m.separators = eq_mask64_sse2(v, sep) | eq_mask64_sse2(v, '\n');
+            return m;
+        }
+
+        STREF_TARGET("avx2") inline std::uint64_t eq_mask64_avx2(const __m256i* v, char ch) {
+            const __m256i c = _mm256_set1_epi8(ch);
+            std::uint64_t lo = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v[0], c)));
+            std::uint64_t hi = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v[1], c)));
+            return lo | (hi << 32);
+        }
+
+        STREF_TARGET("avx2") inline csv_masks csv_scan_avx2(const char* p, char quote, char sep) {
+            __m256i v[2];
+            v[0] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            v[1] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+            csv_masks m;
+            m.quotes = eq_mask64_avx2(v, quote);
+            m.separators = eq_mask64_avx2(v, sep) | eq_mask64_avx2(v, '\n');
+            return m;
+        }
+#endif
+
+        // masks for the n <= 64 code units at p
+        inline csv_masks csv_scan(const char* p, size_t n, char quote, char sep, simd_level level) {
+#if defined(STREF_X86)
+            if (n == 64 && level >= simd_avx2) return csv_scan_avx2(p, quote, sep);
+            if (n == 64 && level >= simd_sse2) return csv_scan_sse2(p, quote, sep);
+#endif
+            (void)level;
+            return csv_scan_scalar(p, n, quote, sep);
+        }
+
+        template <typename chT>
+        csv_masks csv_scan(const chT* p, size_t n, chT quote, chT sep, simd_level) {
+            return csv_scan_scalar(p, n, quote, sep);
+        }
+
+        // bit i of the result is the parity of bits 0..i of x: with x the quotes of a block, the
+        // bits set are the ones between an opening quote and its closing quote
+        inline std::uint64_t prefix_xor(std::uint64_t x) {
+            x ^= x << 1;
+            x ^= x << 2;
+            x ^= x << 4;
+            x ^= x << 8;
+            x ^= x << 16;
+            x ^= x << 32;
+            return x;
+        }
+
+    }
+
+    // a field of a CSV record
+    //
+    // view() is the field without the quotes around it, pointing into the text. A quote inside a
+    // quoted field is written as two quotes: when escaped() is true, view() still has them doubled
+    // and str() makes the unescaped copy.
+    template <typename TT>
+    class basic_csv_field
+    {
+    private:
+        typedef basic_stref<TT> bstref;
+        typedef typename TT::char_type chT;
+
+    public:
+        const bstref& view() const { return contents; }
+        bool quoted() const { return is_quoted; }
+        bool escaped() const { return is_escaped; }
+
+        std::basic_string<chT> str() const {
+            if (!is_escaped)
+                return contents;
+            std::basic_string<chT> s;
+            s.reserve(contents.length());
+            for (const chT* p = contents.begin(); p != contents.end(); ++p) {
+                s += *p;
+                if (*p == quote && p + 1 != contents.end() && p[1] == quote)
+                    ++p;
+            }
+            return s;
+        }
+
+    private:
+        friend class basic_csv_reader<TT>;
+
+        basic_csv_field(const bstref& contents, chT quote, bool is_quoted, bool is_escaped)
+            : contents(contents), quote(quote), is_quoted(is_quoted), is_escaped(is_escaped) {}
+
+        bstref contents;
+        chT quote;
+        bool is_quoted;
+        bool is_escaped;
+    };
+
+    // the fields of a CSV record, valid until the record is read into again
+    template <typename TT>
+    class basic_csv_record
+    {
+    private:
+        typedef std::vector< basic_csv_field<TT> > fields;
+
+    public:
+        typedef typename fields::const_iterator iterator;
+        typedef iterator const_iterator;
+
+        size_t size() const { return items.size(); }
+        const basic_csv_field<TT>& operator[] (size_t index) const { return items[index]; }
+
+        iterator begin() const { return items.begin(); }
+        iterator end() const { return items.end(); }
+
+    private:
+        friend class basic_csv_reader<TT>;
+
+        fields items;
+    };
+
+    // reads the records of delimited text (RFC 4180 CSV by default) one at a time
+    //
+    // Records end with "\n" or "\r\n", fields are separated by the separator character. A field
+    // can be quoted, in which case it can contain separators, newlines and (doubled) quotes. An
+    // empty line is a record with one empty field.
+    //
+    // Quotes are found by the block (see below), not field by field, so every quote opens or
+    // closes quoting, also one in the middle of an unquoted field (which RFC 4180 doesn't allow,
+    // and other readers take literally): the separators and newlines after it, up to the next
+    // quote, are then part of the field. In ab"c,d the comma doesn't end the field: it runs on to
+    // the first separator or newline after the next quote.
+    //
+    // The text is indexed 64 code units at a time, simdjson style: one pass of vector compares
+    // finds the quotes, separators and newlines of a block, a prefix xor of the quotes tells
+    // which of them are inside quoted fields, and the separators and newlines left are the field
+    // boundaries, visited bit by bit. Nothing is copied: fields point into the text.
+    template <typename TT>
+    class basic_csv_reader
+    {
+    private:
+        typedef basic_stref<TT> bstref;
+        typedef typename TT::char_type chT;
+
+    public:
+        explicit basic_csv_reader(const bstref& text, chT separator = chT(','), chT quote = chT('"'),
+                                  detail::simd_level level = detail::cpu_simd_level())
+            : first(text.begin()), last(text.end()), scanned(text.begin()), block(text.begin()), start(text.begin()),
+              boundaries(0), in_quotes(0), done(false), sep(separator), quote(quote), level(level) {}
+
+        // read the next record, false at the end of the text
+        bool next(basic_csv_record<TT>& record) {
+            record.items.clear();
+            if (done)
+                return false;
+            for (;;) {
+                while (boundaries == 0)
+                    if (!scan()) {
+                        done = true;
+                        if (start == last && record.items.empty())
+                            return false;
+                        add(record, start, last, true);
+                        return true;
+                    }
+                const chT* p = block + detail::lowest_bit64(boundaries);
+                boundaries &= boundaries - 1;
+                bool end_of_record = *p != sep;
+                add(record, start, p, end_of_record);
+                start = p + 1;
+                if (end_of_record)
+                    return true;
+            }
+        }
+
+        // offset of the next record in the text
+        size_t offset() const { return start - first; }
+
+    private:
+        // index the next block, false if there are none left
+        bool scan() {
+            if (scanned == last)
+                return false;
+            size_t n = std::min<size_t>(last - scanned, 64);
+            detail::csv_masks m = detail::csv_scan(scanned, n, quote, sep, level);
+            std::uint64_t quoted = detail::prefix_xor(m.quotes) ^ in_quotes;
+            in_quotes = 0 - (quoted >> 63);
+            boundaries = m.separators & ~quoted;
+            if (n < 64)
+                boundaries &= (std::uint64_t(1) << n) - 1;
+            block = scanned;
+            scanned += n;
+            return true;
+        }
+
+        void add(basic_csv_record<TT>& record, const chT* begin, const chT* end, bool end_of_record) const {
+            if (end_of_record && end != begin && end[-1] == chT('\r'))
+                --end;
+            if (end == begin || *begin != quote) {
+                record.items.push_back(basic_csv_field<TT>(bstref(begin, end - begin), quote, false, false));
+                return;
+            }
+            ++begin;
+            if (end != begin && end[-1] == quote)
+                --end;
+            bool escaped = detail::find_char(begin, end, quote) != end;
+            record.items.push_back(basic_csv_field<TT>(bstref(begin, end - begin), quote, true, escaped));
+        }
+
+        const chT* first;           // the text
+        const chT* last;
+        const chT* scanned;         // start of the next block to index
+        const chT* block;           // start of the block being visited
+        const chT* start;           // start of the next field
+        std::uint64_t boundaries;   // separators and newlines in the block not visited yet
+        std::uint64_t in_quotes;    // all ones if the block before this one ended inside quotes
+        bool done;
+        chT sep;
+        chT quote;
+        detail::simd_level level;
+    };
+
+    // typedefs for CSV readers of strings and wide strings
+    typedef basic_csv_field<char_traits> csv_field;
+    typedef basic_csv_field<wchar_traits> wcsv_field;
+    typedef basic_csv_record<char_traits> csv_record;
+    typedef basic_csv_record<wchar_traits> wcsv_record;
+    typedef basic_csv_reader<char_traits> csv_reader;
+    typedef basic_csv_reader<wchar_traits> wcsv_reader;
+
+}
+
+#endif
@@ -0,0 +1,347 @@
+/*
+    Copyright (C) 2012, Ferruccio Barletta (ferruccio.barletta@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person
+    obtaining a copy of this software and associated documentation
+    files (the "Software"), to deal in the Software without
+    restriction, including without limitation the rights to use,
+    copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the
+    Software is furnished to do so, subject to the following
+    conditions:
+
+    The above copyright notice and this permission notice shall be
+    included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+    OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef EDIT_DISTANCE_H
+#define EDIT_DISTANCE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "stref.h"
+
+namespace tools {
+
+    // a substring of a text within some edit distance of a needle, see find_approximate()
+    struct approximate_match {
+        size_t offset;          // npos if there is none
+        size_t length;
+        size_t distance;
+    };
+
+    namespace detail {
+
+        // where each code unit occurs in a pattern of up to 64 of them, one bit per position
+        template <typename chT>
+        class pattern_masks
+        {
+        public:
+            pattern_masks(const chT* p, size_t m) {
+                std::fill(narrow, narrow + 256, std::uint64_t(0));
+                for (size_t i = 0; i < m; ++i) {
+                    unsigned long u = code_unit(p[i]);
+                    if (u < 256)
+                        narrow[u] |= std::uint64_t(1) << i;
+                    else
+                        wide.push_back(std::make_pair(u, std::uint64_t(1) << i));
+                }
+                std::sort(wide.begin(), wide.end());
+                size_t n = 0;
+                for (size_t i = 0; i < wide.size(); ++i) {
+                    if (n > 0 && wide[n - 1].first == wide[i].first)
+                        wide[n - 1].second |= wide[i].second;
+                    else
+                        wide[n++] = wide[i];
+                }
+                wide.resize(n);
+            }
+
+            std::uint64_t operator[] (chT ch) const {
+                unsigned long u = code_unit(ch);
+                if (u < 256)
+                    return narrow[u];
+                typename std::vector< std::pair<unsigned long, std::uint64_t> >::const_iterator it =
+                    std::lower_bound(wide.begin(), wide.end(), std::make_pair(u, std::uint64_t(0)));
+                return it != wide.end() && it->first == u ? it->second : 0;
+            }
+
+        private:
+            std::uint64_t narrow[256];
+            std::vector< std::pair<unsigned long, std::uint64_t> > wide;
+        };
+
+        // one column of Myers' bit-parallel edit distance (as formulated by Hyyrö): pv and mv are the
+        // +1 and -1 vertical differences of the column, the result the difference in its last row
+        // (pattern bit top). In search mode the first row is all 0s, otherwise 0, 1, 2...
+        inline int myers_step(std::uint64_t& pv, std::uint64_t& mv, std::uint64_t eq, std::uint64_t top, bool search) {
+            std::uint64_t xv = eq | mv;
+            std::uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+            std::uint64_t ph = mv | ~(xh | pv);
+            std::uint64_t mh = pv & xh;
+            int delta = (ph & top) != 0 ? 1 : (mh & top) != 0 ? -1 : 0;
+            ph = (ph << 1) | (search ? 0 : 1);
+            mh <<= 1;
+            pv = mh | ~(xv | ph);
+            mv = ph & xv;
+            return delta;
+        }
+
+        // the edit distance of a pattern of 1 to 64 code units and a text, or k + 1 if it's more than k:
+        // the distance can't drop by more than one per code unit left, which ends hopeless texts early
+        template <typename chT>
+        size_t myers_distance(const pattern_masks<chT>& masks, size_t m, const chT* text, size_t n, size_t k) {
+            std::uint64_t pv = ~std::uint64_t(0), mv = 0, top = std::uint64_t(1) << (m - 1);
+            size_t score = m;
+            for (size_t j = 0; j < n; ++j) {
+                score += myers_step(pv, mv, masks[text[j]], top, false);
+                if (score > k + (n - j - 1))
+                    return k + 1;
+            }
+            return score > k ? k + 1 : score;
+        }
+
+        // the same for longer strings, by dynamic programming in a band of diagonals within k of the main one
+        template <typename chT>
+        size_t banded_distance(const chT* a, size_t m, const chT* b, size_t n, size_t k) {
+            k = std::min(k, std::max(m, n));
+            const size_t inf = k + 1;
+            std::vector<size_t> prev(n + 1), cur(n + 1);
+            for (size_t j = 0; j <= n; ++j)
+                prev[j] = std::min(j, inf);
+            for (size_t i = 1; i <= m; ++i) {
+                size_t lo = i > k ? i - k : 1, hi = std::min(n, i + k);
+                cur[0] = std::min(i, inf);
+                if (lo > 1)
+                    cur[lo - 1] = inf;
+                size_t best = lo == 1 ? cur[0] : inf;
+                for (size_t j = lo; j <= hi; ++j) {
+                    size_t d = std::min(prev[j - 1] + (a[i - 1] != b[j - 1] ? 1 : 0), std::min(prev[j], cur[j - 1]) + 1);
+                    cur[j] = std::min(d, inf);
+                    best = std::min(best, cur[j]);
+                }
+                if (hi < n)
+                    cur[hi + 1] = inf;
+                if (best > k)
+                    return inf;
+                prev.swap(cur);
+            }
+            return prev[n];
+        }
+
+        template <typename chT>
+        size_t edit_distance(const chT* a, size_t m, const chT* b, size_t n, size_t k) {
+            if (m > n) {
+                std::swap(a, b);
+                std::swap(m, n);
+            }
+            if (n - m > k)
+                return k + 1;
+            if (m == 0)
+                return n;
+            if (m <= 64)
+                return myers_distance(pattern_masks<chT>(a, m), m, b, n, k);
+            return banded_distance(a, m, b, n, k);
+        }
+
+        // the end of the first substring of text within k of the needle (starting no earlier than
+        // start), or npos: Myers' search for needles of up to 64 code units, Sellers' otherwise
+        template <typename chT>
+        size_t approximate_end(const chT* text, size_t n, const chT* needle, size_t m, size_t k, size_t start) {
+            if (m <= 64) {
+                pattern_masks<chT> masks(needle, m);
+                std::uint64_t pv = ~std::uint64_t(0), mv = 0, top = std::uint64_t(1) << (m - 1);
+                size_t score = m;
+                for (size_t j = start; j < n; ++j) {
+                    score += myers_step(pv, mv, masks[text[j]], top, true);
+                    if (score <= k)
+                        return j + 1;
+                }
+                return static_cast<size_t>(-1);
+            }
+            std::vector<size_t> column(m + 1);
+            for (size_t i = 0; i <= m; ++i)
+                column[i] = i;
+            for (size_t j = start; j < n; ++j) {
+                size_t diagonal = 0;        // the first row is all 0s: a match can start anywhere
+                for (size_t i = 1; i <= m; ++i) {
+                    size_t d = std::min(diagonal + (needle[i - 1] != text[j] ? 1 : 0), std::min(column[i], column[i - 1]) + 1);
+                    diagonal = column[i];
+                    column[i] = d;
+                }
+                if (column[m] <= k)
+                    return j + 1;
+            }
+            return static_cast<size_t>(-1);
+        }
+
+#if defined(STREF_X86)
+        // edit distances of one pattern of 1 to 64 code units and four texts at once, a text per
+        // 64-bit lane: the same steps as myers_step(), with lanes whose texts have ended held as they are
+        template <typename chT>
+        STREF_TARGET("avx2") void myers_distance4_avx2(const pattern_masks<chT>& masks, size_t m, const chT* const* texts, const size_t* lengths, size_t* out) {
+            __m256i pv = _mm256_set1_epi64x(-1), mv = _mm256_setzero_si256();
+            __m256i top = _mm256_set1_epi64x(static_cast<long long>(std::uint64_t(1) << (m - 1)));
+            __m256i one = _mm256_set1_epi64x(1);
+            __m256i score = _mm256_set1_epi64x(static_cast<long long>(m));
+            __m256i ends = _mm256_setr_epi64x(static_cast<long long>(lengths[0]), static_cast<long long>(lengths[1]),
+                                              static_cast<long long>(lengths[2]), static_cast<long long>(lengths[3]));
+            size_t n = std::max(std::max(lengths[0], lengths[1]), std::max(lengths[2], lengths[3]));
+            for (size_t j = 0; j < n; ++j) {
+                __m256i eq = _mm256_setr_epi64x(static_cast<long long>(j < lengths[0] ? masks[texts[0][j]] : 0),
+                                                static_cast<long long>(j < lengths[1] ? masks[texts[1][j]] : 0),
+                                                static_cast<long long>(j < lengths[2] ? masks[texts[2][j]] : 0),
+                                                static_cast<long long>(j < lengths[3] ? masks[texts[3][j]] : 0));
+                __m256i xv = _mm256_or_si256(eq, mv);
+                __m256i xh = _mm256_or_si256(_mm256_xor_si256(_mm256_add_epi64(_mm256_and_si256(eq, pv), pv), pv), eq);
+                __m256i ph = _mm256_or_si256(mv, _mm256_andnot_si256(_mm256_or_si256(xh, pv), _mm256_set1_epi64x(-1)));
+                __m256i mh = _mm256_and_si256(pv, xh);
+                __m256i up = _mm256_cmpeq_epi64(_mm256_and_si256(ph, top), top);
+                __m256i down = _mm256_cmpeq_epi64(_mm256_and_si256(mh, top), top);
+                ph = _mm256_or_si256(_mm256_slli_epi64(ph, 1), one);
+                mh = _mm256_slli_epi64(mh, 1);
+                __m256i active = _mm256_cmpgt_epi64(ends, _mm256_set1_epi64x(static_cast<long long>(j)));
+                score = _mm256_add_epi64(score, _mm256_and_si256(active, _mm256_sub_epi64(down, up)));
+                pv = _mm256_blendv_epi8(pv, _mm256_or_si256(mh, _mm256_andnot_si256(_mm256_or_si256(xv, ph), _mm256_set1_epi64x(-1))), active);
+                mv = _mm256_blendv_epi8(mv, _mm256_and_si256(ph, xv), active);
+            }
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), score);
+        }
+#endif
+
+        // edit distances of a pattern of 1 to 64 code units and many texts, capped at k + 1: texts
+        // whose lengths differ too much are settled without looking at them, the rest four at a time
+        template <typename chT>
+        void myers_distances(const chT* p, size_t m, const chT* const* texts, const size_t* lengths, size_t count, size_t* out, size_t k,
+                             simd_level level = cpu_simd_level()) {
+            pattern_masks<chT> masks(p, m);
+            std::vector<size_t> candidates;
+            for (size_t i = 0; i < count; ++i) {
+                size_t d = lengths[i] > m ? lengths[i] - m : m - lengths[i];
+                if (d > k)
+                    out[i] = k + 1;
+                else if (lengths[i] == 0)
+                    out[i] = m;
+                else
+                    candidates.push_back(i);
+            }
+            size_t i = 0;
+#if defined(STREF_X86)
+            if (level >= simd_avx2) {
+                for (; i + 4 <= candidates.size(); i += 4) {
+                    const chT* lane_texts[4];
+                    size_t lane_lengths[4], lane_out[4];
+                    for (size_t l = 0; l < 4; ++l) {
+                        lane_texts[l] = texts[candidates[i + l]];
+                        lane_lengths[l] = lengths[candidates[i + l]];
+                    }
+                    myers_distance4_avx2(masks, m, lane_texts, lane_lengths, lane_out);
+                    for (size_t l = 0; l < 4; ++l)
+                        out[candidates[i + l]] = std::min(lane_out[l], k + 1);
+                }
+            }
+#endif
+            (void)level;
+            for (; i < candidates.size(); ++i)
+                out[candidates[i]] = myers_distance(masks, m, texts[candidates[i]], lengths[candidates[i]], k);
+        }
+
+    }
+
+    // the Levenshtein distance of two strings (insertions, deletions and substitutions of code
+    // units), or max_k + 1 if it is more than max_k
+    //
+    // If the shorter string has up to 64 code units this is Myers' bit-parallel algorithm, a column
+    // of the edit distance table per step; otherwise the table is filled in a band of width
+    // 2 * max_k + 1. Either way a bound stops the work as soon as the distance must exceed it.
+    template <typename TT>
+    size_t edit_distance(const basic_stref<TT>& a, const basic_stref<TT>& b, size_t max_k = static_cast<size_t>(-1)) {
+        if (max_k == static_cast<size_t>(-1))
+            max_k = std::max(a.length(), b.length());
+        size_t d = detail::edit_distance(a.data(), a.length(), b.data(), b.length(), max_k);
+        return d > max_k ? max_k + 1 : d;
+    }
+
+    // true if the strings are within an edit distance of k
+    template <typename TT>
+    bool within_distance(const basic_stref<TT>& a, const basic_stref<TT>& b, size_t k) {
+        return detail::edit_distance(a.data(), a.length(), b.data(), b.length(), k) <= k;
+    }
+
+    // the edit distances of query and each of [first, last) (strefs), each capped at max_k + 1 like
+    // edit_distance()'s
+    //
+    // Queries of up to 64 code units are compared with four strings at a time in the lanes of AVX2
+    // registers, after strings whose lengths rule them out have been set aside.
+    template <typename TT, typename RandomIt>
+    std::vector<size_t> edit_distances(const basic_stref<TT>& query, RandomIt first, RandomIt last, size_t max_k = static_cast<size_t>(-1)) {
+        typedef typename TT::char_type chT;
+        size_t count = last - first;
+        std::vector<size_t> out(count);
+        std::vector<const chT*> texts(count);
+        std::vector<size_t> lengths(count);
+        size_t longest = 0;
+        for (size_t i = 0; i < count; ++i) {
+            basic_stref<TT> s = first[i];
+            texts[i] = s.data();
+            lengths[i] = s.length();
+            longest = std::max(longest, s.length());
+        }
+        if (max_k == static_cast<size_t>(-1))
+            max_k = std::max(query.length(), longest);
+        if (query.length() > 0 && query.length() <= 64)
+            detail::myers_distances(query.data(), query.length(), texts.data(), lengths.data(), count, out.data(), max_k);
+        else
+            for (size_t i = 0; i < count; ++i)
+                out[i] = std::min(detail::edit_distance(query.data(), query.length(), texts[i], lengths[i], max_k), max_k + 1);
+        return out;
+    }
+
+    // the first substring of text (starting the search at start) within an edit distance of k of
+    // needle: the one which ends first and, of those ending there, the closest (then the shortest)
+    template <typename TT>
+    approximate_match find_approximate(const basic_stref<TT>& text, const basic_stref<TT>& needle, size_t k, size_t start = 0) {
+        const size_t npos = basic_stref<TT>::npos;
+        approximate_match found = { npos, 0, 0 };
+        if (start > text.length())
+            return found;
+        size_t m = needle.length();
+        if (m <= k) {
+            found.offset = start;
+            found.distance = m;
+            return found;
+        }
+        size_t end = detail::approximate_end(text.data(), text.length(), needle.data(), m, k, start);
+        if (end == npos)
+            return found;
+
+        // it starts at most m + k code units before the end
+        found.distance = k + 1;
+        size_t earliest = std::max(start, end > m + k ? end - m - k : 0);
+        for (size_t s = end - (m - k) + 1; s-- > earliest && found.distance > 0; ) {
+            size_t d = detail::edit_distance(needle.data(), m, text.data() + s, end - s, found.distance - 1);
+            if (d < found.distance) {
+                found.offset = s;
+                found.distance = d;
+            }
+        }
+        found.length = end - found.offset;
+        return found;
+    }
+
+}
+
+#endif
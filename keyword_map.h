@@ -0,0 +1,196 @@
+/*
+    Copyright (C) 2012, Ferruccio Barletta (ferruccio.barletta@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person
+    obtaining a copy of this software and associated documentation
+    files (the "Software"), to deal in the Software without
+    restriction, including without limitation the rights to use,
+    copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the
+    Software is furnished to do so, subject to the following
+    conditions:
+
+    The above copyright notice and this permission notice shall be
+    included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+    OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef KEYWORD_MAP_H
+#define KEYWORD_MAP_H
+
+#include <cstdint>
+#include <type_traits>
+
+#include "stref.h"
+
+#if !defined(_MSC_VER) && __cplusplus < 201402L
+#   error keyword_map.h requires C++14
+#endif
+
+namespace tools {
+
+    namespace detail {
+
+        constexpr size_t power_of_two_at_least(size_t n) {
+            size_t p = 1;
+            while (p < n)
+                p <<= 1;
+            return p;
+        }
+
+    }
+
+    // a fixed set of keywords mapped to ids (their positions in the list) by a perfect hash which
+    // is built at compile time
+    //
+    //     constexpr auto verbs = make_keyword_map({ "GET", "HEAD", "POST", "PUT", "DELETE" });
+    //     switch (verbs.find(verb)) {
+    //         case verbs.find("GET"): ...
+    //         case -1: ...     // not a keyword
+    //     }
+    //
+    // find() hashes the string once, which picks the only keyword it can be, then compares it with
+    // that keyword. Strings shorter or longer than all the keywords aren't even hashed.
+    //
+    // Building the map and find() are constant expressions (as in the case labels above) only with
+    // g++ 9, clang++ 9, VC++ 2019 16.5 or later: they compare strefs, which needs
+    // __builtin_is_constant_evaluated to stay off the SIMD kernels at compile time. With older
+    // compilers both work at run time only.
+    //
+    // The perfect hash is hash and displace: the string hash picks a bucket and a slot, and each
+    // bucket has its own displacement of the slots, chosen so that its keywords land in free ones.
+    template <typename TT, size_t N>
+    class basic_keyword_map
+    {
+    private:
+        typedef basic_stref<TT> bstref;
+        typedef typename TT::char_type chT;
+
+        static_assert(N > 0 && N < 0x8000, "keyword_map: 1 to 32767 keywords");
+
+        static constexpr size_t slot_count = detail::power_of_two_at_least(2 * N);
+        static constexpr size_t bucket_count = detail::power_of_two_at_least(N / 2);
+
+    public:
+        constexpr explicit basic_keyword_map(const bstref (&list)[N])
+            : words(), lengths(), slots(), displacements(), shortest(size_t(-1)), longest(0) {
+            std::uint64_t hashes[N] = {};
+            size_t sizes[bucket_count] = {};
+            for (size_t i = 0; i < N; ++i) {
+                for (size_t j = 0; j < i; ++j)
+                    if (list[j] == list[i])
+                        throw bad_stref_op("keyword_map: duplicate keyword");
+                words[i] = list[i].data();
+                lengths[i] = list[i].length();
+                shortest = std::min(shortest, lengths[i]);
+                longest = std::max(longest, lengths[i]);
+                hashes[i] = hash(list[i]);
+                ++sizes[bucket(hashes[i])];
+            }
+            for (size_t s = 0; s < slot_count; ++s)
+                slots[s] = -1;
+
+            // place the biggest buckets first, while there are plenty of free slots
+            bool placed[bucket_count] = {};
+            for (size_t n = 0; n < bucket_count; ++n) {
+                size_t b = 0;
+                for (size_t c = 0; c < bucket_count; ++c)
+                    if (!placed[c] && (placed[b] || sizes[c] > sizes[b]))
+                        b = c;
+                placed[b] = true;
+                if (sizes[b] == 0)
+                    break;
+                std::uint32_t d = 0;
+                while (!place(hashes, b, d))
+                    if (++d == 0x100000)
+                        throw bad_stref_op("keyword_map: no perfect hash found");
+                displacements[b] = d;
+            }
+        }
+
+        // the id of a keyword, -1 if s isn't one
+        constexpr int find(const bstref& s) const {
+            if (s.length() < shortest || s.length() > longest)
+                return -1;
+            std::uint64_t h = hash(s);
+            int id = slots[slot(h, displacements[bucket(h)])];
+            return id >= 0 && bstref(words[id], lengths[id]) == s ? id : -1;
+        }
+
+        constexpr bool contains(const bstref& s) const { return find(s) >= 0; }
+
+        // the keyword with this id
+        constexpr bstref operator[] (size_t id) const { return bstref(words[id], lengths[id]); }
+
+        constexpr size_t size() const { return N; }
+
+    private:
+        static constexpr std::uint64_t hash(const bstref& s) {
+            typedef typename std::make_unsigned<chT>::type unit;
+            std::uint64_t h = 0xcbf29ce484222325ull ^ s.length();
+            for (size_t i = 0; i < s.length(); ++i)
+                h = (h ^ static_cast<unit>(s[i])) * 0x100000001b3ull;
+            return h ^ (h >> 32);
+        }
+
+        static constexpr size_t bucket(std::uint64_t h) { return (h >> 40) & (bucket_count - 1); }
+
+        static constexpr size_t slot(std::uint64_t h, std::uint32_t d) {
+            std::uint32_t x = static_cast<std::uint32_t>(h) ^ (d * 0x9e3779b9u);
+            x ^= x >> 16;
+            x *= 0x85ebca6bu;
+            x ^= x >> 13;
+            x *= 0xc2b2ae35u;
+            x ^= x >> 16;
+            return x & (slot_count - 1);
+        }
+
+        // put the keywords of bucket b in their slots with displacement d, if they are all free
+        constexpr bool place(const std::uint64_t (&hashes)[N], size_t b, std::uint32_t d) {
+            size_t taken[N] = {};
+            size_t n = 0;
+            for (size_t i = 0; i < N; ++i) {
+                if (bucket(hashes[i]) != b)
+                    continue;
+                size_t s = slot(hashes[i], d);
+                if (slots[s] != -1) {
+                    while (n != 0)
+                        slots[taken[--n]] = -1;
+                    return false;
+                }
+                slots[s] = static_cast<short>(i);
+                taken[n++] = s;
+            }
+            return true;
+        }
+
+        const chT* words[N];
+        size_t lengths[N];
+        short slots[slot_count];                    // keyword ids, -1 for free slots
+        std::uint32_t displacements[bucket_count];
+        size_t shortest;
+        size_t longest;
+    };
+
+    template <size_t N> using keyword_map = basic_keyword_map<char_traits, N>;
+    template <size_t N> using wkeyword_map = basic_keyword_map<wchar_traits, N>;
+
+    // the keyword map of a list of string literals: make_keyword_map({ "GET", "PUT" })
+    template <size_t N>
+    constexpr keyword_map<N> make_keyword_map(const stref (&keywords)[N]) { return keyword_map<N>(keywords); }
+
+    template <size_t N>
+    constexpr wkeyword_map<N> make_keyword_map(const wstref (&keywords)[N]) { return wkeyword_map<N>(keywords); }
+
+}
+
+#endif
@@ -0,0 +1,265 @@
+/*
+    Copyright (C) 2012, Ferruccio Barletta (ferruccio.barletta@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person
+    obtaining a copy of this software and associated documentation
+    files (the "Software"), to deal in the Software without
+    restriction, including without limitation the rights to use,
+    copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the
+    Software is furnished to do so, subject to the following
+    conditions:
+
+    The above copyright notice and this permission notice shall be
+    included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+    OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef LINE_INDEX_H
+#define LINE_INDEX_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "stref.h"
+#include "mapped_file.h"
+#include "parallel_split.h"
+#include "thread_pool.h"
+
+namespace tools {
+
+    // index of the lines of a large text (such as a mapped_file) for random access to them
+    //
+    //     mapped_file log("app.log", mapped_file::random);
+    //     line_index index(pool, log);                 // or line_index(log, "app.log.idx") to reopen a saved one
+    //     stref line = index.line(1000000);
+    //     for (stref line : index.lines(1000000, 1000100)) ...
+    //
+    // Lines are those of basic_stref::lines(): without their "\n" or "\r\n", and a final "\n" doesn't
+    // start another line. The index keeps the offset of every sample'th line, so line(n) starts
+    // there and skips at most sample - 1 lines with the vector kernels; 8 bytes per sample lines.
+    //
+    // save() writes the index to a file, which the reopening constructor maps rather than reads
+    // (in native byte order: it is a cache, not an interchange format). Text appended since the
+    // index was built, or saved, is indexed by extend() (the reopening constructor does it itself).
+    class line_index
+    {
+    public:
+        explicit line_index(const stref& text, size_t sample = 256) : text(text.data(), 0), newlines(0) {
+            start(sample);
+            extend(text);
+        }
+
+        // the same, scanning the text on the pool's threads
+        line_index(thread_pool& pool, const stref& text, size_t sample = 256) : text(text.data(), 0), newlines(0) {
+            start(sample);
+            extend(pool, text);
+        }
+
+        // reopen an index saved for a text, which may have been appended to since: throws
+        // bad_stref_op if the index isn't one for this text (or is damaged)
+        line_index(const stref& text, const std::string& path) : text(text.data(), 0), newlines(0) {
+            std::unique_ptr<mapped_file> file(new mapped_file(path, mapped_file::random));
+            header h;
+            if (file->size() < sizeof h)
+                throw bad_stref_op("line_index: not an index");
+            std::memcpy(&h, file->contents().data(), sizeof h);
+            if (std::memcmp(h.magic, magic(), sizeof h.magic) != 0 || h.version != 1 || h.sample == 0 ||
+                file->size() != sizeof h + h.samples * sizeof(std::uint64_t) || h.samples != h.newlines / h.sample + 1)
+                throw bad_stref_op("line_index: not an index");
+            if (h.indexed > text.length() || h.head_hash != head_hash(text.data(), static_cast<size_t>(h.indexed)))
+                throw bad_stref_op("line_index: index of another text");
+            sample = h.sample;
+            this->text = stref(text.data(), static_cast<size_t>(h.indexed));
+            newlines = static_cast<size_t>(h.newlines);
+            samples = reinterpret_cast<const std::uint64_t*>(file->contents().data() + sizeof h);
+            sample_count = static_cast<size_t>(h.samples);
+            mapping = std::move(file);
+            if (text.length() > this->text.length())
+                extend(text);
+        }
+
+        line_index(line_index&& rhs)
+            : text(rhs.text), sample(rhs.sample), newlines(rhs.newlines), mapping(std::move(rhs.mapping)),
+              own(std::move(rhs.own)), samples(mapping ? rhs.samples : own.data()), sample_count(rhs.sample_count) {}
+
+        line_index(const line_index&) = delete;
+        line_index& operator= (const line_index&) = delete;
+
+        // index the text after the part already indexed: text must start with that part (usually it
+        // is the same file, mapped again after it grew)
+        void extend(const stref& longer) {
+            size_t from = begin_extend(longer);
+            newlines += scan(longer.data(), from, longer.length(), newlines, own);
+            end_extend(longer);
+        }
+
+        void extend(thread_pool& pool, const stref& longer) {
+            size_t from = begin_extend(longer);
+            size_t n = detail::chunk_count(pool, longer.length() - from);
+            std::vector<size_t> bounds(n + 1), counts(n + 1);
+            for (size_t i = 0; i <= n; ++i)
+                bounds[i] = from + (longer.length() - from) * i / n;
+            pool.run(n, [&](size_t i) { counts[i + 1] = longer.substr(bounds[i], bounds[i + 1] - bounds[i]).count('\n'); });
+            counts[0] = newlines;
+            for (size_t i = 1; i <= n; ++i)
+                counts[i] += counts[i - 1];
+            std::vector< std::vector<std::uint64_t> > found(n);
+            pool.run(n, [&](size_t i) { scan(longer.data(), bounds[i], bounds[i + 1], counts[i], found[i]); });
+            for (size_t i = 0; i < n; ++i)
+                own.insert(own.end(), found[i].begin(), found[i].end());
+            newlines = counts[n];
+            end_extend(longer);
+        }
+
+        // write the index to a file, for the reopening constructor
+        void save(const std::string& path) const {
+            header h;
+            std::memcpy(h.magic, magic(), sizeof h.magic);
+            h.version = 1;
+            h.sample = static_cast<std::uint32_t>(sample);
+            h.indexed = text.length();
+            h.newlines = newlines;
+            h.head_hash = head_hash(text.data(), text.length());
+            h.samples = sample_count;
+            std::FILE* f = std::fopen(path.c_str(), "wb");
+            if (f == 0)
+                throw std::system_error(errno, std::generic_category(), "line_index: cannot create " + path);
+            bool ok = std::fwrite(&h, sizeof h, 1, f) == 1 &&
+                      std::fwrite(samples, sizeof(std::uint64_t), sample_count, f) == sample_count;
+            int error = errno;
+            if (std::fclose(f) != 0 && ok) {
+                ok = false;
+                error = errno;
+            }
+            if (!ok)
+                throw std::system_error(error, std::generic_category(), "line_index: cannot write " + path);
+        }
+
+        // lines in the indexed text
+        size_t size() const {
+            return newlines + (text.length() > 0 && text.data()[text.length() - 1] != '\n' ? 1 : 0);
+        }
+
+        // where line n starts in the text
+        size_t offset(size_t n) const {
+            if (n >= size())
+                throw bad_stref_op("line_index: no such line");
+            const char* p = text.data() + samples[n / sample];
+            for (size_t skip = n % sample; skip > 0; --skip)
+                p = detail::find_char(p, text.end(), '\n') + 1;
+            return p - text.data();
+        }
+
+        // line n
+        stref line(size_t n) const {
+            const char* first = text.data() + offset(n);
+            const char* nl = detail::find_char(first, text.end(), '\n');
+            size_t len = nl - first;
+            if (len > 0 && nl != text.end() && first[len - 1] == '\r')
+                --len;
+            return stref(first, len);
+        }
+
+        // lines [a, b): [a, size()) if b is past the last line
+        basic_line_range<char_traits> lines(size_t a, size_t b) const {
+            b = std::min(b, size());
+            if (a >= b)
+                return stref(text.data(), 0).lines();
+            size_t first = offset(a);
+            size_t last = b == size() ? text.length() : offset(b);
+            return text.substr(first, last - first).lines();
+        }
+
+        stref indexed() const { return text; }      // the part of the text indexed
+        size_t sample_interval() const { return sample; }
+
+    private:
+        struct header {
+            char magic[8];
+            std::uint32_t version;
+            std::uint32_t sample;           // lines per sample
+            std::uint64_t indexed;          // characters of the text indexed
+            std::uint64_t newlines;         // in the indexed text
+            std::uint64_t head_hash;        // of the first 4096 characters
+            std::uint64_t samples;          // offsets of lines 0, sample, 2 * sample...: newlines / sample + 1 of them
+        };
+
+        static const char* magic() { return "STREFIDX"; }
+
+        static std::uint64_t head_hash(const char* text, size_t n) {
+            return detail::hash_bytes(text, std::min<size_t>(n, 4096));
+        }
+
+        void start(size_t lines_per_sample) {
+            if (lines_per_sample == 0 || lines_per_sample > 0xffffffffu)
+                throw bad_stref_op("line_index: invalid sample interval");
+            sample = lines_per_sample;
+            own.push_back(0);
+            samples = own.data();
+            sample_count = 1;
+        }
+
+        // add the samples of base [first, last), which has before newlines before it, to out: the
+        // start of every line whose number is a multiple of the sample interval; returns the number
+        // of newlines in [first, last)
+        size_t scan(const char* base, size_t first, size_t last, size_t before, std::vector<std::uint64_t>& out) const {
+            size_t next = sample - before % sample;     // newlines to the next sample
+            size_t seen = 0;
+            auto record = [&](const char* nl) {
+                ++seen;
+                if (--next == 0) {
+                    out.push_back(static_cast<std::uint64_t>(nl + 1 - base));
+                    next = sample;
+                }
+            };
+            detail::for_each_char(base + first, base + last, '\n', record);
+            return seen;
+        }
+
+        // new samples go to own, copied there from the mapping if the index was reopened (only the
+        // start of the indexed text is checked)
+        size_t begin_extend(const stref& longer) {
+            if (longer.length() < text.length() || !std::equal(text.begin(), text.begin() + std::min<size_t>(text.length(), 4096), longer.begin()))
+                throw bad_stref_op("line_index: the text doesn't start with the indexed text");
+            if (mapping) {
+                own.assign(samples, samples + sample_count);
+                mapping.reset();
+            }
+            return text.length();
+        }
+
+        void end_extend(const stref& longer) {
+            text = longer;
+            samples = own.data();
+            sample_count = own.size();
+        }
+
+        stref text;                             // the indexed text
+        size_t sample;                          // lines per sample
+        size_t newlines;
+        std::unique_ptr<mapped_file> mapping;   // of a reopened index, until it is extended
+        std::vector<std::uint64_t> own;
+        const std::uint64_t* samples;           // in own or the mapping
+        size_t sample_count;
+    };
+
+}
+
+#endif
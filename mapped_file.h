@@ -0,0 +1,176 @@
+/*
+    Copyright (C) 2012, Ferruccio Barletta (ferruccio.barletta@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person
+    obtaining a copy of this software and associated documentation
+    files (the "Software"), to deal in the Software without
+    restriction, including without limitation the rights to use,
+    copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the
+    Software is furnished to do so, subject to the following
+    conditions:
+
+    The above copyright notice and this permission notice shall be
+    included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+    OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+#include <system_error>
+
+#if defined(_WIN32)
+#   ifndef NOMINMAX
+#       define NOMINMAX
+#   endif
+#   include <windows.h>
+#else
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#   include <cerrno>
+#endif
+
+#include "stref.h"
+
+namespace tools {
+
+    // read-only memory mapped file, whose whole contents are available as a stref
+    //
+    // Nothing is copied: pages are read in by the OS as they are touched. The access hint tells
+    // the OS how the file will be read (madvise on POSIX, the file's scan hint on Windows).
+    // Open failures throw std::system_error. strefs into the file are valid while it is mapped.
+    class mapped_file
+    {
+    public:
+        enum access_hint { normal, sequential, random };
+
+        explicit mapped_file(const std::string& path, access_hint hint = sequential) : base(0), len(0) {
+            open(path, hint);
+        }
+
+        mapped_file(mapped_file&& rhs) : base(rhs.base), len(rhs.len) {
+#if defined(_WIN32)
+            mapping = rhs.mapping;
+#endif
+            rhs.base = 0;
+            rhs.len = 0;
+        }
+
+        mapped_file(const mapped_file&) = delete;
+        mapped_file& operator= (const mapped_file&) = delete;
+
+        ~mapped_file() { close(); }
+
+        // the whole file
+        stref contents() const { return base ? stref(base, len) : stref("", 0); }
+        operator stref() const { return contents(); }
+
+        size_t size() const { return len; }
+
+        // the lines of the file, see basic_stref::lines()
+        basic_line_range<char_traits> lines() const { return contents().lines(); }
+
+        // ask the OS to start reading [offset, offset + count) in ahead of use
+        void will_need(size_t offset, size_t count) const {
+            if (offset >= len)
+                return;
+            count = std::min(count, len - offset);
+#if defined(_WIN32)
+            (void)count;
+#else
+            size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+            size_t start = offset / page * page;
+            ::madvise(const_cast<char*>(base) + start, count + (offset - start), MADV_WILLNEED);
+#endif
+        }
+
+    private:
+#if defined(_WIN32)
+        void open(const std::string& path, access_hint hint) {
+            DWORD flags = hint == sequential ? FILE_FLAG_SEQUENTIAL_SCAN : hint == random ? FILE_FLAG_RANDOM_ACCESS : FILE_ATTRIBUTE_NORMAL;
+            HANDLE file = ::CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, flags, 0);
+            if (file == INVALID_HANDLE_VALUE)
+                throw std::system_error(::GetLastError(), std::system_category(), "mapped_file: cannot open " + path);
+            LARGE_INTEGER length;
+            if (!::GetFileSizeEx(file, &length)) {
+                DWORD error = ::GetLastError();
+                ::CloseHandle(file);
+                throw std::system_error(error, std::system_category(), "mapped_file: cannot size " + path);
+            }
+            len = static_cast<size_t>(length.QuadPart);
+            mapping = 0;
+            if (len > 0) {
+                mapping = ::CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+                if (mapping != 0)
+                    base = static_cast<const char*>(::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            }
+            DWORD error = ::GetLastError();
+            ::CloseHandle(file);
+            if (len > 0 && base == 0) {
+                if (mapping != 0)
+                    ::CloseHandle(mapping);
+                throw std::system_error(error, std::system_category(), "mapped_file: cannot map " + path);
+            }
+        }
+
+        void close() {
+            if (base != 0) {
+                ::UnmapViewOfFile(base);
+                ::CloseHandle(mapping);
+                base = 0;
+            }
+        }
+
+        HANDLE mapping;
+#else
+        void open(const std::string& path, access_hint hint) {
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                throw std::system_error(errno, std::generic_category(), "mapped_file: cannot open " + path);
+            struct stat st;
+            if (::fstat(fd, &st) != 0) {
+                int error = errno;
+                ::close(fd);
+                throw std::system_error(error, std::generic_category(), "mapped_file: cannot stat " + path);
+            }
+            len = static_cast<size_t>(st.st_size);
+            if (len > 0) {
+                void* p = ::mmap(0, len, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p == MAP_FAILED) {
+                    int error = errno;
+                    ::close(fd);
+                    throw std::system_error(error, std::generic_category(), "mapped_file: cannot map " + path);
+                }
+                base = static_cast<const char*>(p);
+                ::madvise(p, len, hint == sequential ? MADV_SEQUENTIAL : hint == random ? MADV_RANDOM : MADV_NORMAL);
+            }
+            ::close(fd);    // the mapping keeps the file open
+        }
+
+        void close() {
+            if (base != 0) {
+                ::munmap(const_cast<char*>(base), len);
+                base = 0;
+            }
+        }
+#endif
+
+        const char* base;   // null if the file is empty
+        size_t len;         // file size
+    };
+
+}
+
+#endif
@@ -0,0 +1,232 @@
+/*
+    Copyright (C) 2012, Ferruccio Barletta (ferruccio.barletta@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person
+    obtaining a copy of this software and associated documentation
+    files (the "Software"), to deal in the Software without
+    restriction, including without limitation the rights to use,
+    copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the
+    Software is furnished to do so, subject to the following
+    conditions:
+
+    The above copyright notice and this permission notice shall be
+    included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+    OTHER DEALINGS IN THE SOFTWARE.
+*/
+#ifndef MULTI_MATCHER_H
+#define MULTI_MATCHER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <initializer_list>
+#include <utility>
+#include <vector>
+
+#include "stref.h"
+
+namespace tools {
+
+    // Aho-Corasick matcher: finds every instance of any of a set of patterns in a single pass
+    //
+    // The automaton is a complete DFA stored as one dense transition table. Characters are first
+    // mapped to symbol classes (one per distinct pattern character, plus one for everything else)
+    // so each row is only as wide as the patterns' alphabet. Table entries hold the target row's
+    // offset, shifted left one bit, with the low bit set if the target state reports matches.
+    //
+    // Case-insensitive matchers fold both the patterns and the text with the traits' to_lower_case().
+    // Empty patterns never match. Patterns are copied: they need not outlive the matcher.
+    template <typename TT>
+    class basic_multi_matcher
+    {
+    private:
+        typedef basic_stref<TT> bstref;
+        typedef typename TT::char_type chT;
+        typedef std::uint32_t entry;
+
+    public:
+        // a pattern found in the text: pattern index (in construction order) and offset of its first character
+        struct match {
+            size_t id;
+            size_t offset;
+        };
+
+        template <typename Iter>
+        basic_multi_matcher(Iter first, Iter last, bool ignore_case = false) : ignore_case(ignore_case) {
+            build(std::vector<bstref>(first, last));
+        }
+
+        basic_multi_matcher(std::initializer_list<bstref> patterns, bool ignore_case = false) : ignore_case(ignore_case) {
+            build(std::vector<bstref>(patterns));
+        }
+
+        // call f(id, offset) for every match, in order of the position of their last character
+        // (matches ending at the same position: longest first)
+        template <typename F>
+        void for_each_match(const bstref& text, F f) const {
+            entry e = 0;
+            for (size_t i = 0; i < text.length(); ++i) {
+                e = delta[(e >> 1) + symbol(text.data()[i])];
+                if (e & 1)
+                    report((e >> 1) / width, i, f);
+            }
+        }
+
+        // the match that ends first (the longest of those), or {npos, npos}
+        match first_match(const bstref& text) const {
+            entry e = 0;
+            for (size_t i = 0; i < text.length(); ++i) {
+                e = delta[(e >> 1) + symbol(text.data()[i])];
+                if (e & 1) {
+                    size_t s = (e >> 1) / width;
+                    if (outputs[s].first == outputs[s].second)
+                        s = out_link[s];
+                    size_t id = ids[outputs[s].first];
+                    match m = { id, i + 1 - lengths[id] };
+                    return m;
+                }
+            }
+            match none = { npos, npos };
+            return none;
+        }
+
+        bool contains_any(const bstref& text) const { return first_match(text).id != npos; }
+
+        size_t pattern_count() const { return lengths.size(); }
+        size_t state_count() const { return out_link.size(); }
+
+        static const size_t npos = static_cast<size_t>(-1);
+
+    private:
+        static const size_t none = static_cast<size_t>(-1);
+
+        chT fold(chT ch) const { return ignore_case ? TT::to_lower_case(ch) : ch; }
+
+        size_t symbol(chT ch) const {
+            unsigned long u = detail::code_unit(ch);
+            if (u < 256)
+                return narrow_class[u];
+            u = detail::code_unit(fold(ch));
+            if (u < 256)
+                return narrow_class[u];
+            typename std::vector< std::pair<unsigned long, entry> >::const_iterator it =
+                std::lower_bound(wide_class.begin(), wide_class.end(), std::make_pair(u, entry(0)));
+            return it != wide_class.end() && it->first == u ? it->second : 0;
+        }
+
+        template <typename F>
+        void report(size_t s, size_t end, F& f) const {
+            for (; s != none; s = out_link[s])
+                for (size_t i = outputs[s].first; i < outputs[s].second; ++i)
+                    f(ids[i], end + 1 - lengths[ids[i]]);
+        }
+
+        void build(const std::vector<bstref>& patterns) {
+            // symbol classes: 0 is any character which isn't in a pattern
+            std::vector<unsigned long> alphabet;
+            for (size_t p = 0; p < patterns.size(); ++p)
+                for (size_t i = 0; i < patterns[p].length(); ++i)
+                    alphabet.push_back(detail::code_unit(fold(patterns[p].data()[i])));
+            std::sort(alphabet.begin(), alphabet.end());
+            alphabet.erase(std::unique(alphabet.begin(), alphabet.end()), alphabet.end());
+            width = alphabet.size() + 1;
+            for (size_t i = 0; i < alphabet.size(); ++i)
+                if (alphabet[i] >= 256)
+                    wide_class.push_back(std::make_pair(alphabet[i], static_cast<entry>(i + 1)));
+            for (unsigned long u = 0; u < 256; ++u) {
+                unsigned long f = detail::code_unit(fold(static_cast<chT>(u)));
+                std::vector<unsigned long>::iterator it = std::lower_bound(alphabet.begin(), alphabet.end(), f);
+                narrow_class[u] = it != alphabet.end() && *it == f ? static_cast<entry>(it - alphabet.begin() + 1) : 0;
+            }
+
+            // trie, with none for missing transitions
+            std::vector<size_t> next(width, none);
+            std::vector< std::vector<size_t> > own(1);
+            for (size_t p = 0; p < patterns.size(); ++p) {
+                lengths.push_back(patterns[p].length());
+                if (patterns[p].length() == 0)
+                    continue;
+                size_t s = 0;
+                for (size_t i = 0; i < patterns[p].length(); ++i) {
+                    size_t edge = s * width + symbol(patterns[p].data()[i]);
+                    if (next[edge] == none) {
+                        next[edge] = own.size();
+                        own.push_back(std::vector<size_t>());
+                        next.resize(next.size() + width, none);
+                    }
+                    s = next[edge];
+                }
+                own[s].push_back(p);
+            }
+
+            // breadth first: failure links turn the trie into a complete DFA
+            size_t states = own.size();
+            if (states * width > (entry(-1) >> 1))
+                throw bad_stref_op("multi_matcher: too many states");
+            std::vector<size_t> fail(states, 0), queue;
+            out_link.assign(states, none);
+            for (size_t c = 0; c < width; ++c) {
+                size_t& t = next[c];
+                if (t == none)
+                    t = 0;
+                else
+                    queue.push_back(t);
+            }
+            for (size_t q = 0; q < queue.size(); ++q) {
+                size_t s = queue[q];
+                for (size_t c = 0; c < width; ++c) {
+                    size_t& t = next[s * width + c];
+                    if (t == none) {
+                        t = next[fail[s] * width + c];
+                        continue;
+                    }
+                    size_t f = next[fail[s] * width + c];
+                    fail[t] = f;
+                    out_link[t] = own[f].empty() ? out_link[f] : f;
+                    queue.push_back(t);
+                }
+            }
+
+            // flatten the outputs and encode the table
+            outputs.resize(states);
+            for (size_t s = 0; s < states; ++s) {
+                outputs[s].first = ids.size();
+                ids.insert(ids.end(), own[s].begin(), own[s].end());
+                outputs[s].second = ids.size();
+            }
+            delta.resize(next.size());
+            for (size_t i = 0; i < next.size(); ++i) {
+                size_t t = next[i];
+                bool reports = !own[t].empty() || out_link[t] != none;
+                delta[i] = static_cast<entry>((t * width) << 1 | (reports ? 1 : 0));
+            }
+        }
+
+        bool ignore_case;
+        size_t width;                                               // symbol classes per state
+        entry narrow_class[256];                                    // symbol class of code units < 256
+        std::vector< std::pair<unsigned long, entry> > wide_class;  // symbol class of other code units, sorted
+        std::vector<entry> delta;                                   // transitions, state * width + symbol class
+        std::vector< std::pair<size_t, size_t> > outputs;           // range of ids reported by each state
+        std::vector<size_t> ids;                                    // pattern ids
+        std::vector<size_t> out_link;                               // next state on the failure chain that reports
+        std::vector<size_t> lengths;                                // pattern lengths, by id
+    };
+
+    template <typename TT> const size_t basic_multi_matcher<TT>::npos;
+    template <typename TT> const size_t basic_multi_matcher<TT>::none;
+
+    typedef basic_multi_matcher<char_traits> multi_matcher;
+    typedef basic_multi_matcher<wchar_traits> wmulti_matcher;
+
+}
+
+#endif
@@ -0,0 +1,206 @@
+/*
+    Copyright (C) 2012, Ferruccio Barletta (ferruccio.barletta@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person
+    obtaining a copy of this software and associated documentation
+    files (the "Software"), to deal in the Software without
+    restriction, including without limitation the rights to use,
+    copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the
+    Software is furnished to do so, subject to the following
+    conditions:
+
+    The above copyright notice and this permission notice shall be
+    included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+    OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef PARALLEL_SPLIT_H
+#define PARALLEL_SPLIT_H
+
+#include <algorithm>
+#include <vector>
+
+#include "stref.h"
+#include "thread_pool.h"
+
+namespace tools {
+
+    //
+    // splitting and searching large strings on a thread_pool
+    //
+    // The string is cut into chunks of at least parallel_grain characters (a few per thread, so
+    // that stealing can even out the load) and each chunk is processed by one task with the same
+    // vector kernels basic_stref uses. Strings shorter than two grains are processed on the
+    // calling thread.
+    //
+
+    enum { parallel_grain = 1 << 16 };
+
+    namespace detail {
+
+        // how many chunks to cut a string of n characters into
+        inline size_t chunk_count(const thread_pool& pool, size_t n) {
+            return std::max<size_t>(std::min<size_t>(pool.size() * 8, n / parallel_grain), 1);
+        }
+
+        // cut text into about n chunks, each of which (except the last) ends at a separator; the
+        // separators themselves are left out, so splitting each chunk in turn is splitting the text
+        template <typename TT, typename Match>
+        std::vector< basic_stref<TT> > separated_chunks(const basic_stref<TT>& text, const Match& match, size_t n) {
+            typedef typename TT::char_type chT;
+            std::vector< basic_stref<TT> > chunks;
+            size_t step = std::max<size_t>(text.length() / n, 1);
+            const chT* start = text.begin();
+            const chT* last = text.end();
+            while (size_t(last - start) > step) {
+                const chT* sep = separator<chT>::find(start + step, last, match);
+                if (sep == last)
+                    break;
+                chunks.push_back(basic_stref<TT>(start, sep - start));
+                start = sep + 1;
+            }
+            chunks.push_back(basic_stref<TT>(start, last - start));
+            return chunks;
+        }
+
+    }
+
+    // split text on a character, a character set or a predicate (the same separators as
+    // basic_stref::split), calling body(token) for every token
+    //
+    // This is the fastest way to split a large string, but body is called concurrently from the
+    // pool's threads: the tokens of a chunk arrive in order, the chunks in any order.
+    template <typename TT, typename Match, typename Body>
+    void parallel_split(thread_pool& pool, const basic_stref<TT>& text, Match match, Body body) {
+        auto chunks = detail::separated_chunks(text, match, detail::chunk_count(pool, text.length()));
+        auto emit = [&](const basic_stref<TT>& token) { body(token); };
+        pool.run(chunks.size(), [&](size_t i) { chunks[i].split(match, emit); });
+    }
+
+    // split text like parallel_split, but call body(token) on the calling thread, for every token
+    // in the order they appear in text
+    //
+    // The chunks are split in batches, one batch at a time, each chunk into its own list of tokens;
+    // then the batch's tokens are handed to body while the pool is idle.
+    template <typename TT, typename Match, typename Body>
+    void parallel_split_ordered(thread_pool& pool, const basic_stref<TT>& text, Match match, Body body) {
+        typedef basic_stref<TT> bstref;
+        auto chunks = detail::separated_chunks(text, match, detail::chunk_count(pool, text.length()));
+        size_t batch = std::min(chunks.size(), pool.size() * 4);
+        std::vector< std::vector<bstref> > tokens(batch);
+        for (size_t first = 0; first < chunks.size(); first += batch) {
+            size_t n = std::min(batch, chunks.size() - first);
+            pool.run(n, [&](size_t i) {
+                std::vector<bstref>& list = tokens[i];
+                list.clear();
+                chunks[first + i].split(match, [&](const bstref& token) { list.push_back(token); });
+            });
+            for (size_t i = 0; i < n; ++i)
+                for (const bstref& token : tokens[i])
+                    body(token);
+        }
+    }
+
+    // the number of instances of a character in text
+    template <typename TT>
+    size_t parallel_count(thread_pool& pool, const basic_stref<TT>& text, typename TT::char_type ch) {
+        size_t n = detail::chunk_count(pool, text.length());
+        std::vector<size_t> counts(n);
+        pool.run(n, [&](size_t i) {
+            size_t first = text.length() * i / n, last = text.length() * (i + 1) / n;
+            counts[i] = text.substr(first, last - first).count(ch);
+        });
+        size_t total = 0;
+        for (size_t count : counts)
+            total += count;
+        return total;
+    }
+
+    // the positions of all instances of a character in text, in increasing order
+    template <typename TT>
+    std::vector<size_t> parallel_find_all(thread_pool& pool, const basic_stref<TT>& text, typename TT::char_type ch) {
+        typedef typename TT::char_type chT;
+        size_t n = detail::chunk_count(pool, text.length());
+        std::vector< std::vector<size_t> > found(n);
+        pool.run(n, [&](size_t i) {
+            const chT* first = text.begin() + text.length() * i / n;
+            const chT* last = text.begin() + text.length() * (i + 1) / n;
+            std::vector<size_t>& list = found[i];
+            auto record = [&](const chT* p) { list.push_back(p - text.begin()); };
+            detail::for_each_char(first, last, ch, record);
+        });
+        std::vector<size_t> positions;
+        for (const auto& list : found)
+            positions.insert(positions.end(), list.begin(), list.end());
+        return positions;
+    }
+
+    // the positions of all non-overlapping instances of needle in text, the same positions as
+    // basic_stref::find_all(needle)
+    //
+    // Each chunk finds the non-overlapping instances which start in it, searching on past the end of
+    // each one as find_all does. When an instance in one chunk runs into the next, the final pass
+    // searches on from its end until it rejoins that chunk's instances (usually at once), so the
+    // text is scanned in linear time even for periodic needles such as "aaaa" in a run of 'a's.
+    template <typename TT>
+    std::vector<size_t> parallel_find_all(thread_pool& pool, const basic_stref<TT>& text, const basic_stref<TT>& needle) {
+        std::vector<size_t> positions;
+        size_t m = needle.length();
+        if (m == 0 || m > text.length())
+            return positions;
+        basic_searcher<TT> searcher(needle);
+        size_t n = detail::chunk_count(pool, text.length());
+        auto window = [&](size_t i) {
+            size_t first = text.length() * i / n, last = text.length() * (i + 1) / n;
+            return text.substr(first, last - first + m - 1);
+        };
+        std::vector< std::vector<size_t> > found(n);
+        pool.run(n, [&](size_t i) {
+            size_t first = text.length() * i / n;
+            std::vector<size_t>& list = found[i];
+            basic_stref<TT> w = window(i);
+            for (size_t pos = searcher.find(w); pos != basic_stref<TT>::npos; pos = searcher.find(w, pos + m))
+                list.push_back(first + pos);
+        });
+        size_t next = 0;
+        for (size_t i = 0; i < n; ++i) {
+            const std::vector<size_t>& list = found[i];
+            size_t first = text.length() * i / n, last = text.length() * (i + 1) / n;
+            size_t k = 0;
+            if (next > first) {
+                k = list.size();
+                basic_stref<TT> w = window(i);
+                while (next < last) {
+                    size_t pos = searcher.find(w, next - first);
+                    if (pos == basic_stref<TT>::npos)
+                        break;
+                    pos += first;
+                    k = std::lower_bound(list.begin(), list.end(), pos) - list.begin();
+                    if (k < list.size() && list[k] == pos)
+                        break;
+                    k = list.size();
+                    positions.push_back(pos);
+                    next = pos + m;
+                }
+            }
+            for (; k < list.size(); ++k) {
+                positions.push_back(list[k]);
+                next = list[k] + m;
+            }
+        }
+        return positions;
+    }
+
+}
+
+#endif
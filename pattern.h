@@ -0,0 +1,570 @@
+/*
+    Copyright (C) 2012, Ferruccio Barletta (ferruccio.barletta@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person
+    obtaining a copy of this software and associated documentation
+    files (the "Software"), to deal in the Software without
+    restriction, including without limitation the rights to use,
+    copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the
+    Software is furnished to do so, subject to the following
+    conditions:
+
+    The above copyright notice and this permission notice shall be
+    included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+    OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef PATTERN_H
+#define PATTERN_H
+
+#include <algorithm>
+#include <cstdint>
+#include <initializer_list>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "stref.h"
+
+namespace tools {
+
+    namespace detail {
+
+        // wildcard patterns compiled into one DFA that tells which of them match a whole string
+        //
+        // Each pattern is a sequence of items (a character, ?, a class or *), and the NFA state of
+        // a pattern is the set of its items that the text read so far can have reached, plus its end.
+        // The DFA's states are such sets (of every pattern's positions) and its transitions are on
+        // symbol classes: characters which no pattern tells apart share one.
+        //
+        // The DFA is built breadth first up to max_states states. Text which gets past the built
+        // states goes on by stepping the position sets themselves (still linear in the text, but
+        // slower), until it reaches a set which is a built state again. States which only a few code
+        // units leave (such as the one waiting for the E of *ERROR*) skip ahead to the next of them with
+        // the vectorized is_any_of search.
+        template <typename TT>
+        class glob_automaton
+        {
+        private:
+            typedef basic_stref<TT> bstref;
+            typedef typename TT::char_type chT;
+            typedef std::uint32_t entry;
+            typedef std::uint64_t word;
+
+        public:
+            glob_automaton(const std::vector<bstref>& patterns, bool ignore_case, size_t max_states) : ignore_case(ignore_case) {
+                for (size_t p = 0; p < patterns.size(); ++p)
+                    parse(patterns[p]);
+                build(std::max<size_t>(max_states, 1));
+            }
+
+            // call f(id) for every pattern that matches the whole text, in id order
+            template <typename F>
+            void for_each_match(const bstref& text, F f) const {
+                const chT* p = text.data();
+                const chT* last = p + text.length();
+                entry e = start;
+                for (;;) {
+                    if (e & accelerated)
+                        p = find_any(p, last, exits[(e >> 2) / width].chars());
+                    if (p == last || (e & settled))
+                        break;
+                    entry t = table[(e >> 2) + symbol(*p)];
+                    if (t == unbuilt) {
+                        entry s = (e >> 2) / width;
+                        std::vector<word> set(sets.begin() + s * words, sets.begin() + (s + 1) * words);
+                        if (!run_sets(set, s, p, last)) {
+                            report(set.data(), f);
+                            return;
+                        }
+                        t = encode(s);
+                    }
+                    e = t;
+                    ++p;
+                }
+                entry s = (e >> 2) / width;
+                for (size_t i = accepts[s]; i < accepts[s + 1]; ++i)
+                    f(accept_ids[i]);
+            }
+
+            size_t pattern_count() const { return ends.size(); }
+            size_t state_count() const { return flags.size(); }
+
+            // false if the DFA was cut short by max_states
+            bool complete() const { return std::find(table.begin(), table.end(), unbuilt) == table.end(); }
+
+        private:
+            static const entry unbuilt = static_cast<entry>(-1);
+
+            // table entries are target state * width, shifted left two bits, with these flags
+            enum { settled = 1, accelerated = 2 };
+
+            enum { max_exits = 4 };
+
+            enum item_kind { literal, any, in_class, star, end };
+
+            struct item {
+                item_kind kind;
+                unsigned long value;        // the folded code unit of a literal, the class of in_class
+            };
+
+            struct char_class {
+                std::basic_string<chT> members;                             // folded, with narrow ranges expanded
+                std::vector< std::pair<unsigned long, unsigned long> > ranges;   // ranges of wide code units (folded too)
+                bool negated;
+            };
+
+            chT fold(chT ch) const { return ignore_case ? fold_case<TT>(ch) : ch; }
+
+            size_t symbol(chT ch) const {
+                unsigned long u = code_unit(ch);
+                if (u < 256)
+                    return narrow_class[u];
+                u = code_unit(fold(ch));
+                if (u < 256)
+                    return narrow_class[u];
+                return wide_class[std::upper_bound(wide_bounds.begin(), wide_bounds.end(), u) - wide_bounds.begin() - 1];
+            }
+
+            void parse(const bstref& pattern) {
+                const chT* p = pattern.data();
+                const chT* last = p + pattern.length();
+                while (p != last) {
+                    item x = { literal, 0 };
+                    chT ch = *p++;
+                    if (ch == chT('*')) {
+                        x.kind = star;
+                        if (!items.empty() && items.back().kind == star)
+                            continue;       // ** is *
+                    }
+                    else if (ch == chT('?'))
+                        x.kind = any;
+                    else if (ch == chT('[')) {
+                        x.kind = in_class;
+                        x.value = classes.size();
+                        p = parse_class(p, last);
+                    }
+                    else {
+                        if (ch == chT('\\')) {
+                            if (p == last)
+                                throw bad_stref_op("pattern: \\ at the end of a pattern");
+                            ch = *p++;
+                        }
+                        x.value = code_unit(fold(ch));
+                    }
+                    items.push_back(x);
+                }
+                item e = { end, 0 };
+                ends.push_back(items.size());
+                items.push_back(e);
+            }
+
+            // [abc], [a-z], [!a-z] or [^a-z]; a ] right after [ (or [!) is a member
+            const chT* parse_class(const chT* p, const chT* last) {
+                char_class c;
+                c.negated = p != last && (*p == chT('!') || *p == chT('^'));
+                if (c.negated)
+                    ++p;
+                for (bool first = true; ; first = false) {
+                    if (p == last)
+                        throw bad_stref_op("pattern: [ without ]");
+                    chT lo = *p++;
+                    if (lo == chT(']') && !first)
+                        break;
+                    if (lo == chT('\\') && p != last)
+                        lo = *p++;
+                    chT hi = lo;
+                    if (p + 1 < last && *p == chT('-') && p[1] != chT(']')) {
+                        hi = p[1];
+                        p += 2;
+                        if (hi == chT('\\') && p != last)
+                            hi = *p++;
+                    }
+                    unsigned long a = code_unit(lo), b = code_unit(hi);
+                    for (unsigned long u = a; u <= b && u < 256; ++u)
+                        c.members += fold(static_cast<chT>(u));
+                    if (b >= 256 && !ignore_case)
+                        c.ranges.push_back(std::make_pair(std::max<unsigned long>(a, 256), b));
+                    else if (b >= 256)
+                        add_folded_range(c, std::max<unsigned long>(a, 256), b);
+                }
+                classes.push_back(c);
+                return p;
+            }
+
+            // the text is folded before it's looked up, so a case-insensitive class holds the folded
+            // images of its wide ranges: as ranges again, merged, except those which fold to narrow units
+            void add_folded_range(char_class& c, unsigned long a, unsigned long b) {
+                std::vector< std::pair<unsigned long, unsigned long> > folded;
+                for (unsigned long u = a; ; ++u) {
+                    unsigned long f = code_unit(fold(static_cast<chT>(u)));
+                    if (f < 256)
+                        c.members += static_cast<chT>(f);
+                    else if (!folded.empty() && f >= folded.back().first && f <= folded.back().second + 1)
+                        folded.back().second = std::max(folded.back().second, f);
+                    else
+                        folded.push_back(std::make_pair(f, f));
+                    if (u == b)
+                        break;
+                }
+                folded.insert(folded.end(), c.ranges.begin(), c.ranges.end());
+                std::sort(folded.begin(), folded.end());
+                c.ranges.clear();
+                for (size_t i = 0; i < folded.size(); ++i) {
+                    if (!c.ranges.empty() && folded[i].first <= c.ranges.back().second + 1)
+                        c.ranges.back().second = std::max(c.ranges.back().second, folded[i].second);
+                    else
+                        c.ranges.push_back(folded[i]);
+                }
+            }
+
+            // does the item (not * or end) match a folded code unit
+            bool matches(const item& x, const std::vector< is_any_of<chT> >& sets, unsigned long u) const {
+                if (x.kind == literal)
+                    return x.value == u;
+                if (x.kind == any)
+                    return true;
+                const char_class& c = classes[x.value];
+                bool in = sets[x.value](static_cast<chT>(u));
+                for (size_t r = 0; r < c.ranges.size() && !in; ++r)
+                    in = u >= c.ranges[r].first && u <= c.ranges[r].second;
+                return in != c.negated;
+            }
+
+            void build(size_t max_states) {
+                // the classes' members are final now, so their is_any_of sets can point into them
+                std::vector< is_any_of<chT> > class_sets;
+                for (size_t c = 0; c < classes.size(); ++c)
+                    class_sets.push_back(is_any_of<chT>(classes[c].members));
+
+                // symbol classes: code units which every item matches the same way
+                std::vector<unsigned long> wide_points(1, 256);
+                for (size_t i = 0; i < items.size(); ++i)
+                    if (items[i].kind == literal && items[i].value >= 256) {
+                        wide_points.push_back(items[i].value);
+                        wide_points.push_back(items[i].value + 1);
+                    }
+                for (size_t c = 0; c < classes.size(); ++c) {
+                    for (size_t i = 0; i < classes[c].members.size(); ++i)
+                        if (code_unit(classes[c].members[i]) >= 256) {
+                            wide_points.push_back(code_unit(classes[c].members[i]));
+                            wide_points.push_back(code_unit(classes[c].members[i]) + 1);
+                        }
+                    for (size_t r = 0; r < classes[c].ranges.size(); ++r) {
+                        wide_points.push_back(classes[c].ranges[r].first);
+                        wide_points.push_back(classes[c].ranges[r].second + 1);
+                    }
+                }
+                std::sort(wide_points.begin(), wide_points.end());
+                wide_points.erase(std::unique(wide_points.begin(), wide_points.end()), wide_points.end());
+                if (sizeof(chT) == 1)
+                    wide_points.resize(1);
+
+                words = (items.size() + 63) / 64;
+                std::map<std::vector<bool>, entry> signatures;
+                std::vector<unsigned long> representatives;
+                auto classify = [&](unsigned long u) {
+                    std::vector<bool> signature(items.size());
+                    for (size_t i = 0; i < items.size(); ++i)
+                        signature[i] = items[i].kind != star && items[i].kind != end && matches(items[i], class_sets, u);
+                    std::pair<typename std::map<std::vector<bool>, entry>::iterator, bool> r =
+                        signatures.insert(std::make_pair(signature, static_cast<entry>(representatives.size())));
+                    if (r.second)
+                        representatives.push_back(u);
+                    return r.first->second;
+                };
+                for (unsigned long u = 0; u < 256; ++u)
+                    narrow_class[u] = classify(code_unit(fold(static_cast<chT>(u))));
+                for (size_t i = 0; i < wide_points.size(); ++i)
+                    wide_class.push_back(classify(wide_points[i]));
+                wide_bounds.swap(wide_points);
+                width = representatives.size();
+
+                // the items each symbol moves past, and the stars
+                moves.assign(width * words, 0);
+                stars.assign(words, 0);
+                for (size_t i = 0; i < items.size(); ++i) {
+                    if (items[i].kind == star)
+                        stars[i / 64] |= word(1) << (i % 64);
+                    else if (items[i].kind != end)
+                        for (size_t s = 0; s < width; ++s)
+                            if (matches(items[i], class_sets, representatives[s]))
+                                moves[s * words + i / 64] |= word(1) << (i % 64);
+                }
+
+                // breadth first from the start of every pattern
+                std::vector<word> set(words, 0);
+                for (size_t p = 0; p < ends.size(); ++p) {
+                    size_t start = p == 0 ? 0 : ends[p - 1] + 1;
+                    set[start / 64] |= word(1) << (start % 64);
+                }
+                close(set.data());
+                std::vector<entry> delta;
+                add_state(set, delta);
+                for (size_t s = 0; s < state_count(); ++s) {
+                    bool self = true;
+                    for (size_t c = 0; c < width; ++c) {
+                        std::copy(sets.begin() + s * words, sets.begin() + (s + 1) * words, set.begin());
+                        step(set.data(), c);
+                        typename std::map<std::vector<word>, entry>::const_iterator it = state_of.find(set);
+                        entry t = it != state_of.end() ? it->second : state_count() < max_states ? add_state(set, delta) : unbuilt;
+                        delta[s * width + c] = t;
+                        self = self && t == s;
+                    }
+                    if (self)
+                        flags[s] |= settled;
+                }
+
+                // states which only a few code units leave skip to the next of them with find_any()
+                std::vector< std::basic_string<chT> > leaving(state_count());
+                for (size_t s = 0; s < state_count() && sizeof(chT) == 1; ++s) {
+                    for (unsigned long u = 0; u < 256 && leaving[s].length() <= max_exits; ++u)
+                        if (delta[s * width + narrow_class[u]] != s)
+                            leaving[s] += static_cast<chT>(u);
+                    if (!(flags[s] & settled) && leaving[s].length() <= max_exits)
+                        flags[s] |= accelerated;
+                }
+                for (size_t s = 0; s < state_count(); ++s)
+                    exits.push_back(is_any_of<chT>(leaving[s]));     // narrow: the sets don't refer to leaving
+
+                table.resize(delta.size());
+                for (size_t i = 0; i < delta.size(); ++i)
+                    table[i] = delta[i] == unbuilt ? unbuilt : encode(delta[i]);
+                start = encode(0);
+            }
+
+            entry encode(entry s) const { return static_cast<entry>(s * width) << 2 | flags[s]; }
+
+            entry add_state(const std::vector<word>& set, std::vector<entry>& delta) {
+                entry s = static_cast<entry>(state_count());
+                if ((size_t(s) + 1) * width > (unbuilt >> 2))
+                    throw bad_stref_op("pattern: too many states");
+                state_of.insert(std::make_pair(set, s));
+                sets.insert(sets.end(), set.begin(), set.end());
+                delta.resize(delta.size() + width, unbuilt);
+                flags.push_back(0);
+                for (size_t p = 0; p < ends.size(); ++p)
+                    if (set[ends[p] / 64] >> (ends[p] % 64) & 1)
+                        accept_ids.push_back(p);
+                if (accepts.empty())
+                    accepts.push_back(0);
+                accepts.push_back(accept_ids.size());
+                return s;
+            }
+
+            // a star reached is also passed by the empty string
+            void close(word* set) const {
+                for (size_t w = 0; w < words; ++w) {
+                    word pending = set[w] & stars[w];
+                    while (pending != 0) {
+                        size_t i = w * 64 + lowest_bit64(pending);
+                        pending &= pending - 1;
+                        set[(i + 1) / 64] |= word(1) << ((i + 1) % 64);
+                        if ((i + 1) % 64 != 0 && (stars[w] >> ((i + 1) % 64) & 1))
+                            pending |= word(1) << ((i + 1) % 64);
+                    }
+                }
+            }
+
+            // the positions after reading a character of symbol class c: each item it matches is
+            // passed, stars stay where they are
+            void step(word* set, size_t c) const {
+                const word* move = &moves[c * words];
+                word carry = 0;
+                for (size_t w = 0; w < words; ++w) {
+                    word passed = set[w] & move[w];
+                    set[w] = (set[w] & stars[w]) | (passed << 1) | carry;
+                    carry = passed >> 63;
+                }
+                close(set);
+            }
+
+            // go on from state s at p with the position sets: returns false at the end of the text
+            // (the final set in set), true when the set is a built state again (s, at p)
+            bool run_sets(std::vector<word>& set, entry& s, const chT*& p, const chT* last) const {
+                for (; p != last; ++p) {
+                    step(set.data(), symbol(*p));
+                    typename std::map<std::vector<word>, entry>::const_iterator it = state_of.find(set);
+                    if (it != state_of.end()) {
+                        s = it->second;
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            template <typename F>
+            void report(const word* set, F& f) const {
+                for (size_t p = 0; p < ends.size(); ++p)
+                    if (set[ends[p] / 64] >> (ends[p] % 64) & 1)
+                        f(p);
+            }
+
+            bool ignore_case;
+            std::vector<item> items;                            // every pattern's items, each followed by its end
+            std::vector<char_class> classes;
+            std::vector<size_t> ends;                           // position of each pattern's end
+            size_t words;                                       // words per position set
+            size_t width;                                       // symbol classes
+            entry narrow_class[256];                            // symbol class of code units < 256
+            std::vector<unsigned long> wide_bounds;             // folded code units >= 256 where the symbol class changes
+            std::vector<entry> wide_class;                      // symbol class from each bound on
+            std::vector<word> moves;                            // items passed, by symbol class
+            std::vector<word> stars;
+            std::vector<entry> table;                           // transitions, state * width + symbol class
+            entry start;                                        // table entry of the start state
+            std::vector<unsigned char> flags;                   // settled, accelerated
+            std::vector< is_any_of<chT> > exits;                // code units which leave each state
+            std::vector<word> sets;                             // position set of each state
+            std::map<std::vector<word>, entry> state_of;
+            std::vector<size_t> accepts;                        // range of accept_ids of each state
+            std::vector<size_t> accept_ids;                     // patterns which match if the text ends in a state
+        };
+
+        template <typename TT> const std::uint32_t glob_automaton<TT>::unbuilt;
+
+    }
+
+    // wildcard pattern, matched against whole strings in a single pass over them
+    //
+    //     pattern p("GET /api/*/users?id=*");
+    //     if (p.matches(line)) ...
+    //
+    // * matches any run of characters, ? any one character and [abc], [a-z] or [!a-z] (or [^a-z])
+    // one of (or any but) a set. \ makes the next character (also within [...]) an ordinary one.
+    // Case-insensitive patterns fold the way iequals() does. Characters are code units: ? matches
+    // one byte of a multi-byte UTF-8 character.
+    //
+    // The pattern is compiled into a DFA (see detail::glob_automaton), so matching takes time linear
+    // in the length of the text whatever the pattern, without backtracking. max_states bounds the
+    // DFA's size for patterns with many stars and ?s, at the cost of slower matching past it.
+    // Patterns are copied: they need not outlive the compiled pattern.
+    template <typename TT>
+    class basic_pattern
+    {
+    private:
+        typedef basic_stref<TT> bstref;
+
+    public:
+        explicit basic_pattern(const bstref& glob, bool ignore_case = false, size_t max_states = 4096)
+            : automaton(std::vector<bstref>(1, glob), ignore_case, max_states) {}
+
+        bool matches(const bstref& text) const {
+            bool found = false;
+            automaton.for_each_match(text, [&](size_t) { found = true; });
+            return found;
+        }
+
+        bool operator() (const bstref& text) const { return matches(text); }
+
+        size_t state_count() const { return automaton.state_count(); }
+
+    private:
+        detail::glob_automaton<TT> automaton;
+    };
+
+    typedef basic_pattern<char_traits> pattern;
+    typedef basic_pattern<wchar_traits> wpattern;
+
+    // many wildcard patterns compiled together, to find which of them match a string
+    //
+    // Patterns share DFAs, as many per DFA as fit in max_states (the states of a DFA for several
+    // patterns can be every combination of theirs), so a string is matched in one pass per DFA
+    // rather than one per pattern.
+    template <typename TT>
+    class basic_pattern_set
+    {
+    private:
+        typedef basic_stref<TT> bstref;
+        typedef detail::glob_automaton<TT> automaton;
+
+    public:
+        template <typename Iter>
+        basic_pattern_set(Iter first, Iter last, bool ignore_case = false, size_t max_states = 4096) {
+            build(std::vector<bstref>(first, last), ignore_case, max_states);
+        }
+
+        basic_pattern_set(std::initializer_list<bstref> globs, bool ignore_case = false, size_t max_states = 4096) {
+            build(std::vector<bstref>(globs), ignore_case, max_states);
+        }
+
+        // call f(id) for every pattern (index in construction order) which matches the text, in id order
+        template <typename F>
+        void for_each_match(const bstref& text, F f) const {
+            for (size_t g = 0; g < groups.size(); ++g)
+                groups[g].for_each_match(text, [&](size_t id) { f(firsts[g] + id); });
+        }
+
+        // the patterns which match the text
+        std::vector<size_t> matches(const bstref& text) const {
+            std::vector<size_t> ids;
+            for_each_match(text, [&](size_t id) { ids.push_back(id); });
+            return ids;
+        }
+
+        // the first pattern which matches the text, or npos
+        size_t first_match(const bstref& text) const {
+            size_t first = npos;
+            for (size_t g = 0; g < groups.size() && first == npos; ++g)
+                groups[g].for_each_match(text, [&](size_t id) { first = std::min(first, firsts[g] + id); });
+            return first;
+        }
+
+        bool matches_any(const bstref& text) const { return first_match(text) != npos; }
+
+        size_t pattern_count() const { return groups.empty() ? 0 : firsts.back() + groups.back().pattern_count(); }
+
+        size_t state_count() const {
+            size_t n = 0;
+            for (size_t g = 0; g < groups.size(); ++g)
+                n += groups[g].state_count();
+            return n;
+        }
+
+        static const size_t npos = static_cast<size_t>(-1);
+
+    private:
+        // the most patterns from first on whose DFA fits, found by doubling and then bisecting
+        void build(const std::vector<bstref>& globs, bool ignore_case, size_t max_states) {
+            for (size_t first = 0; first < globs.size(); first += groups.back().pattern_count()) {
+                typename std::vector<bstref>::const_iterator from = globs.begin() + first;
+                automaton group(std::vector<bstref>(from, from + 1), ignore_case, max_states);
+                size_t n = 1, over = 0;     // the first n patterns fit together, the first over don't (0: unknown)
+                while (first + n < globs.size() && n + 1 != over) {
+                    size_t m = over == 0 ? std::min(2 * n, globs.size() - first) : (n + over) / 2;
+                    automaton bigger(std::vector<bstref>(from, from + m), ignore_case, max_states);
+                    if (bigger.complete()) {
+                        group = std::move(bigger);
+                        n = m;
+                    }
+                    else
+                        over = m;
+                }
+                firsts.push_back(first);
+                groups.push_back(std::move(group));
+            }
+        }
+
+        std::vector<automaton> groups;
+        std::vector<size_t> firsts;     // id of each group's first pattern
+    };
+
+    template <typename TT> const size_t basic_pattern_set<TT>::npos;
+
+    typedef basic_pattern_set<char_traits> pattern_set;
+    typedef basic_pattern_set<wchar_traits> wpattern_set;
+
+}
+
+#endif
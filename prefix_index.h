@@ -0,0 +1,440 @@
+/*
+    Copyright (C) 2012, Ferruccio Barletta (ferruccio.barletta@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person
+    obtaining a copy of this software and associated documentation
+    files (the "Software"), to deal in the Software without
+    restriction, including without limitation the rights to use,
+    copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the
+    Software is furnished to do so, subject to the following
+    conditions:
+
+    The above copyright notice and this permission notice shall be
+    included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+    OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef PREFIX_INDEX_H
+#define PREFIX_INDEX_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "stref.h"
+
+namespace tools {
+
+    // strings mapped to values, with lookups of the longest key that a string starts with and
+    // enumeration of the keys that start with a prefix
+    //
+    //     prefix_index<handler*> routes;
+    //     routes.insert("/api/", api);
+    //     routes.insert("/api/v2/", api_v2);
+    //     auto m = routes.longest_prefix("/api/v2/users");    // m.key == "/api/v2/", *m.value == api_v2
+    //
+    // The index is an adaptive radix tree (ART): a trie over the bytes of the keys' code units (most
+    // significant first) whose nodes grow from 4 to 16, 48 and 256 children as they fill up, and which
+    // skips chains of single-child nodes by storing their bytes as the compressed path of the next
+    // node. Nodes and their children live in flat arrays and refer to each other by index.
+    //
+    // Case-insensitive indexes fold keys and strings the way istarts_with() and iequals() do, so
+    // longest_prefix(s) finds the longest key k for which s.istarts_with(k) (only for traits with
+    // fixed-width characters: not for u8stref). Keys are copied: they need not outlive the index.
+    // Value pointers and the strefs of keys the index hands out stay valid until the next insert().
+    template <typename TT, typename T>
+    class basic_prefix_index
+    {
+    private:
+        typedef basic_stref<TT> bstref;
+        typedef typename TT::char_type chT;
+
+    public:
+        // the key found by longest_prefix() and its value, null if no key was found
+        struct match {
+            bstref key;
+            const T* value;
+        };
+
+        explicit basic_prefix_index(bool ignore_case = false) : ignore_case(ignore_case) {
+            if (ignore_case && !detail::text_ops<TT>::fixed_width)
+                throw bad_stref_op("prefix_index: case-insensitive keys need fixed-width characters");
+            nodes.push_back(node());
+        }
+
+        // add a key, unless it (or, ignoring case, an equal key) is already there: returns false then
+        bool insert(const bstref& key, const T& value) {
+            key_bytes k(key, ignore_case);
+            std::uint32_t id = 0;
+            size_t pos = 0;
+            for (;;) {
+                size_t j = path_match(nodes[id], k, pos);
+                if (j < nodes[id].path_length)
+                    split(id, j);
+                pos += j;
+                if (pos == k.size()) {
+                    if (nodes[id].value != none)
+                        return false;
+                    nodes[id].value = add_entry(key, value);
+                    return true;
+                }
+                std::uint32_t child = find_child(nodes[id], k[pos]);
+                if (child == none) {
+                    node leaf;
+                    leaf.path = append_path(k, pos + 1);
+                    leaf.path_length = static_cast<std::uint32_t>(k.size() - pos - 1);
+                    leaf.value = add_entry(key, value);
+                    nodes.push_back(leaf);
+                    add_child(id, k[pos], static_cast<std::uint32_t>(nodes.size() - 1));
+                    return true;
+                }
+                id = child;
+                ++pos;
+            }
+        }
+
+        // the value of a key, null if it isn't there
+        const T* find(const bstref& key) const {
+            key_bytes k(key, ignore_case);
+            std::uint32_t id = 0;
+            for (size_t pos = 0; ; ++pos) {
+                const node& x = nodes[id];
+                if (x.path_length > k.size() - pos || path_match(x, k, pos) < x.path_length)
+                    return nullptr;
+                pos += x.path_length;
+                if (pos == k.size())
+                    return x.value != none ? &values[x.value] : nullptr;
+                id = find_child(x, k[pos]);
+                if (id == none)
+                    return nullptr;
+            }
+        }
+
+        T* find(const bstref& key) { return const_cast<T*>(static_cast<const basic_prefix_index*>(this)->find(key)); }
+
+        bool contains(const bstref& key) const { return find(key) != nullptr; }
+
+        // the longest key that s starts with
+        match longest_prefix(const bstref& s) const {
+            key_bytes k(s, ignore_case);
+            std::uint32_t id = 0, best = none;
+            for (size_t pos = 0; ; ++pos) {
+                const node& x = nodes[id];
+                if (x.path_length > k.size() - pos || path_match(x, k, pos) < x.path_length)
+                    break;
+                pos += x.path_length;
+                if (x.value != none)
+                    best = x.value;
+                if (pos == k.size() || (id = find_child(x, k[pos])) == none)
+                    break;
+            }
+            match m = { best != none ? key_of(best) : bstref(nullptr, 0), best != none ? &values[best] : nullptr };
+            return m;
+        }
+
+        // call f(key, value) for every key that starts with prefix, in the order of their (folded)
+        // code units
+        template <typename F>
+        void for_each(const bstref& prefix, F f) const {
+            key_bytes k(prefix, ignore_case);
+            std::uint32_t id = 0;
+            for (size_t pos = 0; ; ++pos) {
+                const node& x = nodes[id];
+                size_t left = k.size() - pos;
+                size_t j = path_match(x, k, pos);
+                if (left <= x.path_length) {
+                    if (j == left)
+                        visit(id, f);
+                    return;
+                }
+                if (j < x.path_length)
+                    return;
+                pos += x.path_length;
+                if ((id = find_child(x, k[pos])) == none)
+                    return;
+            }
+        }
+
+        // call f(key, value) for every key
+        template <typename F>
+        void for_each(F f) const { visit(0, f); }
+
+        size_t size() const { return values.size(); }
+        bool empty() const { return values.empty(); }
+        size_t node_count() const { return nodes.size(); }
+        bool ignores_case() const { return ignore_case; }
+
+    private:
+        static const std::uint32_t none = static_cast<std::uint32_t>(-1);
+
+        enum node_kind { leaf, node4, node16, node48, node256 };
+
+        struct node {
+            node() : path(0), path_length(0), value(none), body(none), count(0), kind(leaf) {}
+            std::uint32_t path;             // compressed path: offset of its bytes in paths
+            std::uint32_t path_length;
+            std::uint32_t value;            // entry of the key which ends after the path, none if none does
+            std::uint32_t body;             // children, in the bodies of the node's kind
+            std::uint16_t count;            // children
+            std::uint8_t kind;
+        };
+
+        // children of node4 and node16 are sorted by byte; node48 maps bytes to child slots + 1
+        struct body4 { unsigned char keys[4]; std::uint32_t children[4]; };
+        struct body16 { unsigned char keys[16]; std::uint32_t children[16]; };
+        struct body48 { unsigned char index[256]; std::uint32_t children[48]; };
+        struct body256 { std::uint32_t children[256]; };
+
+        // the bytes of a string's (folded) code units, most significant first
+        struct key_bytes {
+            key_bytes(const bstref& s, bool fold) : p(s.data()), n(s.length() * sizeof(chT)), fold(fold) {}
+
+            size_t size() const { return n; }
+
+            unsigned char operator[] (size_t i) const {
+                chT ch = p[i / sizeof(chT)];
+                unsigned long u = detail::code_unit(fold ? detail::fold_case<TT>(ch) : ch);
+                return static_cast<unsigned char>(u >> (8 * (sizeof(chT) - 1 - i % sizeof(chT))));
+            }
+
+            const chT* p;
+            size_t n;
+            bool fold;
+        };
+
+        // how many bytes of the node's path match k from pos on
+        size_t path_match(const node& x, const key_bytes& k, size_t pos) const {
+            size_t n = std::min<size_t>(x.path_length, k.size() - pos);
+            const unsigned char* path = paths.data() + x.path;
+            size_t i = 0;
+            if (sizeof(chT) == 1 && !k.fold)
+                i = detail::mismatch(reinterpret_cast<const char*>(path), reinterpret_cast<const char*>(k.p) + pos, n);
+            else
+                while (i < n && path[i] == k[pos + i])
+                    ++i;
+            return i;
+        }
+
+        std::uint32_t find_child(const node& x, unsigned char b) const {
+            switch (x.kind) {
+            case node4: {
+                const body4& body = bodies4[x.body];
+                for (size_t i = 0; i < x.count; ++i)
+                    if (body.keys[i] == b)
+                        return body.children[i];
+                return none;
+            }
+            case node16: {
+                const body16& body = bodies16[x.body];
+#if defined(STREF_X86)
+                __m128i hits = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(body.keys)), _mm_set1_epi8(static_cast<char>(b)));
+                unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(hits)) & ((1u << x.count) - 1);
+                return mask != 0 ? body.children[detail::lowest_bit(mask)] : none;
+#else
+                for (size_t i = 0; i < x.count; ++i)
+                    if (body.keys[i] == b)
+                        return body.children[i];
+                return none;
+#endif
+            }
+            case node48: {
+                const body48& body = bodies48[x.body];
+                return body.index[b] != 0 ? body.children[body.index[b] - 1] : none;
+            }
+            case node256:
+                return bodies256[x.body].children[b];
+            }
+            return none;
+        }
+
+        template <typename Body>
+        static std::uint32_t allocate(std::vector<Body>& bodies, std::vector<std::uint32_t>& free) {
+            if (!free.empty()) {
+                std::uint32_t b = free.back();
+                free.pop_back();
+                return b;
+            }
+            bodies.push_back(Body());
+            return static_cast<std::uint32_t>(bodies.size() - 1);
+        }
+
+        // insert into sorted keys, growing the node if it is full
+        void add_child(std::uint32_t id, unsigned char b, std::uint32_t child) {
+            node& x = nodes[id];
+            switch (x.kind) {
+            case leaf:
+                x.kind = node4;
+                x.body = allocate(bodies4, free4);
+                // fall through
+            case node4:
+                if (x.count < 4) {
+                    body4& body = bodies4[x.body];
+                    insert_sorted(body.keys, body.children, x.count, b, child);
+                    break;
+                }
+                {
+                    std::uint32_t grown = allocate(bodies16, free16);
+                    std::memcpy(bodies16[grown].keys, bodies4[x.body].keys, 4);
+                    std::memcpy(bodies16[grown].children, bodies4[x.body].children, 4 * sizeof(std::uint32_t));
+                    free4.push_back(x.body);
+                    x.kind = node16;
+                    x.body = grown;
+                }
+                // fall through
+            case node16:
+                if (x.count < 16) {
+                    body16& body = bodies16[x.body];
+                    insert_sorted(body.keys, body.children, x.count, b, child);
+                    break;
+                }
+                {
+                    std::uint32_t grown = allocate(bodies48, free48);
+                    body48& body = bodies48[grown];
+                    std::memset(body.index, 0, sizeof body.index);
+                    for (unsigned i = 0; i < 16; ++i) {
+                        body.index[bodies16[x.body].keys[i]] = static_cast<unsigned char>(i + 1);
+                        body.children[i] = bodies16[x.body].children[i];
+                    }
+                    free16.push_back(x.body);
+                    x.kind = node48;
+                    x.body = grown;
+                }
+                // fall through
+            case node48:
+                if (x.count < 48) {
+                    body48& body = bodies48[x.body];
+                    body.children[x.count] = child;
+                    body.index[b] = static_cast<unsigned char>(++x.count);
+                    break;
+                }
+                {
+                    bodies256.push_back(body256());
+                    body256& body = bodies256.back();
+                    const body48& old = bodies48[x.body];
+                    for (unsigned c = 0; c < 256; ++c)
+                        body.children[c] = old.index[c] != 0 ? old.children[old.index[c] - 1] : none;
+                    free48.push_back(x.body);
+                    x.kind = node256;
+                    x.body = static_cast<std::uint32_t>(bodies256.size() - 1);
+                }
+                // fall through
+            case node256:
+                bodies256[x.body].children[b] = child;
+                ++x.count;
+                break;
+            }
+        }
+
+        template <size_t N>
+        static void insert_sorted(unsigned char (&keys)[N], std::uint32_t (&children)[N], std::uint16_t& count, unsigned char b, std::uint32_t child) {
+            size_t i = count;
+            for (; i > 0 && keys[i - 1] > b; --i) {
+                keys[i] = keys[i - 1];
+                children[i] = children[i - 1];
+            }
+            keys[i] = b;
+            children[i] = child;
+            ++count;
+        }
+
+        // make the first j bytes of the node's path a node of their own, with the node as its only
+        // child (under the node keeps its index, so its parent needs no change)
+        void split(std::uint32_t id, size_t j) {
+            node rest = nodes[id];
+            rest.path += static_cast<std::uint32_t>(j + 1);
+            rest.path_length -= static_cast<std::uint32_t>(j + 1);
+            unsigned char b = paths[nodes[id].path + j];
+            nodes.push_back(rest);
+            node& x = nodes[id];
+            x.path_length = static_cast<std::uint32_t>(j);
+            x.value = x.body = none;
+            x.count = 0;
+            x.kind = leaf;
+            add_child(id, b, static_cast<std::uint32_t>(nodes.size() - 1));
+        }
+
+        std::uint32_t append_path(const key_bytes& k, size_t pos) {
+            if (paths.size() + k.size() - pos > none)
+                throw bad_stref_op("prefix_index: keys too long");
+            size_t offset = paths.size();
+            for (; pos < k.size(); ++pos)
+                paths.push_back(k[pos]);
+            return static_cast<std::uint32_t>(offset);
+        }
+
+        std::uint32_t add_entry(const bstref& key, const T& value) {
+            key_offsets.push_back(chars.size());
+            chars.insert(chars.end(), key.begin(), key.end());
+            values.push_back(value);
+            return static_cast<std::uint32_t>(values.size() - 1);
+        }
+
+        bstref key_of(std::uint32_t e) const {
+            size_t end = e + 1 < key_offsets.size() ? key_offsets[e + 1] : chars.size();
+            return bstref(chars.data() + key_offsets[e], end - key_offsets[e]);
+        }
+
+        // the keys under a node, depth first in byte order
+        template <typename F>
+        void visit(std::uint32_t id, F& f) const {
+            std::vector<std::uint32_t> stack(1, id);
+            while (!stack.empty()) {
+                const node& x = nodes[stack.back()];
+                stack.pop_back();
+                if (x.value != none)
+                    f(key_of(x.value), values[x.value]);
+                size_t first = stack.size();
+                switch (x.kind) {
+                case node4:
+                    stack.insert(stack.end(), bodies4[x.body].children, bodies4[x.body].children + x.count);
+                    break;
+                case node16:
+                    stack.insert(stack.end(), bodies16[x.body].children, bodies16[x.body].children + x.count);
+                    break;
+                case node48:
+                    for (unsigned c = 0; c < 256; ++c)
+                        if (bodies48[x.body].index[c] != 0)
+                            stack.push_back(bodies48[x.body].children[bodies48[x.body].index[c] - 1]);
+                    break;
+                case node256:
+                    for (unsigned c = 0; c < 256; ++c)
+                        if (bodies256[x.body].children[c] != none)
+                            stack.push_back(bodies256[x.body].children[c]);
+                    break;
+                }
+                std::reverse(stack.begin() + first, stack.end());
+            }
+        }
+
+        bool ignore_case;
+        std::vector<node> nodes;                        // the root is node 0
+        std::vector<body4> bodies4;
+        std::vector<body16> bodies16;
+        std::vector<body48> bodies48;
+        std::vector<body256> bodies256;
+        std::vector<std::uint32_t> free4, free16, free48;   // bodies of nodes which grew
+        std::vector<unsigned char> paths;               // compressed paths
+        std::vector<T> values;                          // by entry
+        std::vector<size_t> key_offsets;                // keys of the entries in chars
+        std::vector<chT> chars;
+    };
+
+    template <typename TT, typename T> const std::uint32_t basic_prefix_index<TT, T>::none;
+
+    template <typename T> using prefix_index = basic_prefix_index<char_traits, T>;
+    template <typename T> using wprefix_index = basic_prefix_index<wchar_traits, T>;
+
+}
+
+#endif
@@ -0,0 +1,308 @@
+/*
+    Copyright (C) 2012, Ferruccio Barletta (ferruccio.barletta@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person
+    obtaining a copy of this software and associated documentation
+    files (the "Software"), to deal in the Software without
+    restriction, including without limitation the rights to use,
+    copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the
+    Software is furnished to do so, subject to the following
+    conditions:
+
+    The above copyright notice and this permission notice shall be
+    included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+    OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef SORT_STREFS_H
+#define SORT_STREFS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+
+#include "stref.h"
+#include "thread_pool.h"
+
+namespace tools {
+
+    enum sort_case { case_sensitive, case_insensitive };
+
+    namespace detail {
+
+        inline std::uint64_t byte_swap64(std::uint64_t v) {
+#if defined(_MSC_VER)
+            return _byteswap_uint64(v);
+#else
+            return __builtin_bswap64(v);
+#endif
+        }
+
+        // Multikey quicksort (Bentley & Sedgewick) whose "characters" are 8 bytes of each string,
+        // cached in the array being sorted: partitioning compares the cached keys only, and the
+        // strings are read again (for the next 8 bytes) only by those whose keys are equal.
+        //
+        // A key is the string's code units from depth on, in the order compare() (or icompare(), folded
+        // with the traits' to_lower_case()) puts them, padded with zeros. The order of keys is the
+        // order of the strings, except that a string which ends within the key ties with one which goes
+        // on with units whose key is 0: of strings with equal keys, the ones with fewer units left
+        // come first.
+        template <typename TT, bool Fold>
+        struct string_sorter {
+            typedef basic_stref<TT> bstref;
+            typedef typename TT::char_type chT;
+            typedef typename std::make_unsigned<chT>::type unit_type;
+
+            enum { width = 8 / sizeof(chT), unit_bits = 8 * sizeof(chT), small = 16 };
+
+            struct item {
+                item() : key(0), s(nullptr, 0) {}
+                item(const bstref& s) : key(0), s(s) {}
+
+                std::uint64_t key;
+                bstref s;
+            };
+
+            // the code unit as an unsigned number in the order of compare() (chT is signed or not)
+            static std::uint64_t unit_key(chT c) {
+                if (Fold)
+                    c = fold_case<TT>(c);
+                unit_type u = static_cast<unit_type>(c);
+                if (std::is_signed<chT>::value)
+                    u ^= unit_type(1) << (unit_bits - 1);
+                return u;
+            }
+
+            static std::uint64_t key_at(const bstref& s, size_t depth) {
+                const chT* p = s.data() + depth;
+                size_t left = s.length() - depth;
+#if defined(STREF_LITTLE_ENDIAN)
+                if (sizeof(chT) == 1 && left >= 8) {
+                    std::uint64_t w;
+                    std::memcpy(&w, p, 8);
+                    if (Fold && ascii_case_folding<TT>::value && (w & 0x8080808080808080ull) == 0)
+                        return byte_swap64(ascii_lower8(w)) ^ (std::is_signed<chT>::value ? 0x8080808080808080ull : 0);
+                    if (!Fold)
+                        return byte_swap64(w) ^ (std::is_signed<chT>::value ? 0x8080808080808080ull : 0);
+                }
+#endif
+                std::uint64_t key = 0;
+                for (size_t i = 0; i < size_t(width); ++i)
+                    key = (key << (unit_bits % 64)) | (i < left ? unit_key(p[i]) : 0);
+                return key;
+            }
+
+            static void set_keys(item* first, item* last, size_t depth) {
+                for (; first != last; ++first)
+                    first->key = key_at(first->s, depth);
+            }
+
+            // compare from depth on (the keys at depth are equal)
+            static bool less_from(const item& a, const item& b, size_t depth) {
+                if (a.key != b.key)
+                    return a.key < b.key;
+                bstref x(a.s.data() + depth, a.s.length() - depth), y(b.s.data() + depth, b.s.length() - depth);
+                return Fold ? text_ops<TT>::icompare(x.data(), x.length(), y.data(), y.length()) < 0 : x.compare(y) < 0;
+            }
+
+            static void insertion_sort(item* a, size_t n, size_t depth) {
+                for (size_t i = 1; i < n; ++i) {
+                    item x = a[i];
+                    size_t j = i;
+                    for (; j > 0 && less_from(x, a[j - 1], depth); --j)
+                        a[j] = a[j - 1];
+                    a[j] = x;
+                }
+            }
+
+            static std::uint64_t median3(std::uint64_t a, std::uint64_t b, std::uint64_t c) {
+                return a < b ? (b < c ? b : a < c ? c : a) : (a < c ? a : b < c ? c : b);
+            }
+
+            // sort a[0, n) whose keys are set for depth
+            static void sort(item* a, size_t n, size_t depth) {
+                while (n > 1) {
+                    if (n < size_t(small)) {
+                        insertion_sort(a, n, depth);
+                        return;
+                    }
+                    std::uint64_t pivot = median3(a[0].key, a[n / 2].key, a[n - 1].key);
+                    size_t lt = 0, i = 0, gt = n;
+                    while (i < gt) {
+                        if (a[i].key < pivot)
+                            std::swap(a[lt++], a[i++]);
+                        else if (a[i].key > pivot)
+                            std::swap(a[i], a[--gt]);
+                        else
+                            ++i;
+                    }
+                    sort(a, lt, depth);
+                    sort(a + gt, n - gt, depth);
+
+                    // the equal keys: strings which end within the key first, shortest first (those of
+                    // the same length are equal), then the others by their next key
+                    item* first = a + lt;
+                    item* last = a + gt;
+                    item* rest = std::partition(first, last, [=](const item& x) { return x.s.length() - depth < size_t(width); });
+                    std::sort(first, rest, [](const item& x, const item& y) { return x.s.length() < y.s.length(); });
+                    depth += width;
+                    set_keys(rest, last, depth);
+                    a = rest;
+                    n = last - rest;
+                }
+            }
+
+            template <typename RandomIt>
+            static std::vector<item> items(RandomIt first, RandomIt last) {
+                std::vector<item> v;
+                v.reserve(last - first);
+                for (; first != last; ++first)
+                    v.push_back(item(*first));
+                return v;
+            }
+
+            template <typename RandomIt>
+            static void sort(RandomIt first, RandomIt last) {
+                std::vector<item> v = items(first, last);
+                set_keys(v.data(), v.data() + v.size(), 0);
+                sort(v.data(), v.size(), 0);
+                for (const item& x : v)
+                    *first++ = x.s;
+            }
+
+            // The keys at depth 0 are computed in parallel, the items are distributed into buckets
+            // of key ranges around sampled splitters (every string with a given key lands in the same
+            // bucket, so the buckets in order are sorted once each of them is) and the buckets are
+            // sorted in parallel. Many strings with the same 8 unit prefix end up in one bucket.
+            template <typename RandomIt>
+            static void sort(thread_pool& pool, RandomIt first, RandomIt last) {
+                size_t n = last - first;
+                size_t chunks = std::max<size_t>(std::min<size_t>(pool.size() * 4, n / parallel_sort_grain), 1);
+                if (chunks == 1) {
+                    sort(first, last);
+                    return;
+                }
+                std::vector<item> v(n);
+                size_t per_chunk = (n + chunks - 1) / chunks;
+                pool.run(chunks, [&](size_t c) {
+                    for (size_t i = c * per_chunk, end = std::min(n, i + per_chunk); i < end; ++i) {
+                        v[i].s = first[i];
+                        v[i].key = key_at(v[i].s, 0);
+                    }
+                });
+
+                // splitters: evenly spaced order statistics of a sample of the keys
+                size_t buckets = pool.size() * 16;
+                std::vector<std::uint64_t> sample;
+                for (size_t i = 0; i < buckets * 16; ++i)
+                    sample.push_back(v[(i * 2654435761u) % n].key);
+                std::sort(sample.begin(), sample.end());
+                std::vector<std::uint64_t> splitters;
+                for (size_t i = 1; i < buckets; ++i)
+                    if (splitters.empty() || sample[i * 16] != splitters.back())
+                        splitters.push_back(sample[i * 16]);
+                buckets = splitters.size() + 1;
+
+                // count each chunk's items per bucket, then scatter them to their place
+                std::vector<size_t> counts(chunks * buckets), bucket_of(n);
+                pool.run(chunks, [&](size_t c) {
+                    size_t* count = &counts[c * buckets];
+                    for (size_t i = c * per_chunk, end = std::min(n, i + per_chunk); i < end; ++i) {
+                        size_t b = std::upper_bound(splitters.begin(), splitters.end(), v[i].key) - splitters.begin();
+                        bucket_of[i] = b;
+                        ++count[b];
+                    }
+                });
+                std::vector<size_t> starts(buckets + 1);
+                size_t offset = 0;
+                for (size_t b = 0; b < buckets; ++b) {
+                    starts[b] = offset;
+                    for (size_t c = 0; c < chunks; ++c) {
+                        size_t count = counts[c * buckets + b];
+                        counts[c * buckets + b] = offset;
+                        offset += count;
+                    }
+                }
+                starts[buckets] = n;
+                std::vector<item> sorted(n);
+                pool.run(chunks, [&](size_t c) {
+                    size_t* next = &counts[c * buckets];
+                    for (size_t i = c * per_chunk, end = std::min(n, i + per_chunk); i < end; ++i)
+                        sorted[next[bucket_of[i]]++] = v[i];
+                });
+                pool.run(buckets, [&](size_t b) { sort(sorted.data() + starts[b], starts[b + 1] - starts[b], 0); });
+                pool.run(chunks, [&](size_t c) {
+                    for (size_t i = c * per_chunk, end = std::min(n, i + per_chunk); i < end; ++i)
+                        first[i] = sorted[i].s;
+                });
+            }
+
+            enum { parallel_sort_grain = 1 << 14 };
+        };
+
+        template <typename TT>
+        TT traits_of(const basic_stref<TT>*) { return TT(); }
+
+        // case-insensitive order of traits whose characters take a varying number of code units
+        // isn't an order of code units: those are sorted with iless_than()
+        template <typename TT, typename RandomIt>
+        typename std::enable_if<text_ops<TT>::fixed_width>::type
+        sort_folded(RandomIt first, RandomIt last, thread_pool* pool) {
+            if (pool)
+                string_sorter<TT, true>::sort(*pool, first, last);
+            else
+                string_sorter<TT, true>::sort(first, last);
+        }
+
+        template <typename TT, typename RandomIt>
+        typename std::enable_if<!text_ops<TT>::fixed_width>::type
+        sort_folded(RandomIt first, RandomIt last, thread_pool*) {
+            std::sort(first, last, [](const basic_stref<TT>& a, const basic_stref<TT>& b) { return a.iless_than(b); });
+        }
+
+        template <typename TT, typename RandomIt>
+        void sort_strefs(RandomIt first, RandomIt last, sort_case order, thread_pool* pool) {
+            if (order == case_insensitive)
+                sort_folded<TT>(first, last, pool);
+            else if (pool)
+                string_sorter<TT, false>::sort(*pool, first, last);
+            else
+                string_sorter<TT, false>::sort(first, last);
+        }
+
+    }
+
+    // sort a range of strefs into the order of operator< or, with case_insensitive, of iless_than()
+    //
+    // Much faster than std::sort for large ranges: see detail::string_sorter. The sort isn't stable,
+    // which only matters for strefs with equal contents at different addresses.
+    template <typename RandomIt>
+    void sort_strefs(RandomIt first, RandomIt last, sort_case order = case_sensitive) {
+        typedef typename std::iterator_traits<RandomIt>::value_type value_type;
+        typedef decltype(detail::traits_of(static_cast<value_type*>(nullptr))) traits;
+        detail::sort_strefs<traits>(first, last, order, nullptr);
+    }
+
+    // the same, on all the pool's threads
+    template <typename RandomIt>
+    void sort_strefs(thread_pool& pool, RandomIt first, RandomIt last, sort_case order = case_sensitive) {
+        typedef typename std::iterator_traits<RandomIt>::value_type value_type;
+        typedef decltype(detail::traits_of(static_cast<value_type*>(nullptr))) traits;
+        detail::sort_strefs<traits>(first, last, order, &pool);
+    }
+
+}
+
+#endif
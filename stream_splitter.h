@@ -0,0 +1,97 @@
+/*
+    Copyright (C) 2012, Ferruccio Barletta (ferruccio.barletta@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person
+    obtaining a copy of this software and associated documentation
+    files (the "Software"), to deal in the Software without
+    restriction, including without limitation the rights to use,
+    copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the
+    Software is furnished to do so, subject to the following
+    conditions:
+
+    The above copyright notice and this permission notice shall be
+    included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+    OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef STREAM_SPLITTER_H
+#define STREAM_SPLITTER_H
+
+#include <string>
+
+#include "stref.h"
+
+namespace tools {
+
+    // splits text which arrives in chunks (from a socket or a pipe, say) into tokens
+    //
+    // feed() each chunk in turn and finish() at the end of the input: the tokens are the ones
+    // split() would produce for the whole input. A token which lies within a chunk is passed to
+    // the body as a stref into the chunk; only the token which spans the end of a chunk is copied
+    // (into the splitter's buffer, which keeps its capacity from one chunk to the next). The
+    // tokens are valid while the body runs: chunks can be reused as soon as feed() returns.
+    //
+    // Match is the separator: a character, an is_any_of or a predicate, as for split().
+    template <typename TT, typename Match = typename TT::char_type>
+    class basic_stream_splitter
+    {
+    private:
+        typedef basic_stref<TT> bstref;
+        typedef typename TT::char_type chT;
+        typedef detail::separator<chT> sep;
+
+    public:
+        explicit basic_stream_splitter(const Match& match) : match(match) {}
+
+        // call body(token) for each token which ends in this chunk
+        template <typename Body>
+        void feed(const bstref& chunk, Body body) {
+            const chT* start = chunk.begin();
+            bool first = true;
+            auto emit = [&](const chT* end) {
+                if (first && !held.empty()) {
+                    held.append(start, end);
+                    body(bstref(held.data(), held.size()));
+                    held.clear();
+                } else
+                    body(bstref(start, end - start));
+                first = false;
+                start = end + 1;
+            };
+            sep::for_each(chunk.begin(), chunk.end(), match, emit);
+            held.append(start, chunk.end());
+        }
+
+        // call body(token) for the last token (empty if the input is empty or ends with a
+        // separator); the splitter can then be fed a new input
+        template <typename Body>
+        void finish(Body body) {
+            body(bstref(held.data(), held.size()));
+            held.clear();
+        }
+
+        // the number of characters held back, the start of a token which isn't complete yet
+        size_t pending() const { return held.size(); }
+
+    private:
+        Match match;
+        std::basic_string<chT> held;    // the start of the token spanning the chunk boundary
+    };
+
+    // typedefs for splitting string and wide string streams on a character
+    typedef basic_stream_splitter<char_traits> stream_splitter;
+    typedef basic_stream_splitter<wchar_traits> wstream_splitter;
+
+}
+
+#endif
@@ -24,6 +24,37 @@
 */
 
 #include "stref.h"
+#include "concat.h"
+#include "csv_reader.h"
+#include "edit_distance.h"
+#include "keyword_map.h"
+#include "line_index.h"
+#include "mapped_file.h"
+#include "multi_matcher.h"
+#include "parallel_split.h"
+#include "pattern.h"
+#include "prefix_index.h"
+#include "sort_strefs.h"
+#include "stref_pool.h"
+#include "stref_stats.h"
+#include "stref_table.h"
+#include "stream_splitter.h"
+#include "thread_pool.h"
+#include "transcode.h"
+#include "utf8.h"
+#include <clocale>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #define BOOST_TEST_MODULE    stref_tests
 #include <boost/test/unit_test.hpp>
@@ -128,6 +159,48 @@ BOOST_AUTO_TEST_CASE(stref_icompare) {
     BOOST_CHECK(stref("aaa").icompare(stref("AAB")) < 0);
 }
 
+BOOST_AUTO_TEST_CASE(stref_compare_long) {
+    string a(100, 'q'), b(100, 'Q');
+    wstring wa(100, L'q'), wb(100, L'Q');
+    for (int level = detail::simd_none; level <= detail::cpu_simd_level(); ++level) {
+        detail::simd_level l = static_cast<detail::simd_level>(level);
+        for (size_t i = 0; i < a.length(); ++i) {
+            string c(a);
+            c[i] = 'r';
+            BOOST_CHECK_EQUAL(detail::mismatch(a.data(), c.data(), a.length(), l), i);
+            BOOST_CHECK_EQUAL(detail::ascii_imismatch(b.data(), c.data(), b.length(), l), i);
+            c[i] = '\xe9';
+            BOOST_CHECK_EQUAL(detail::ascii_imismatch(b.data(), c.data(), b.length(), l), i);
+            wstring wc(wa);
+            wc[i] = L'\x3a3';
+            BOOST_CHECK_EQUAL(detail::mismatch(wa.data(), wc.data(), wa.length(), l), i);
+            BOOST_CHECK_EQUAL(detail::ascii_imismatch(wb.data(), wc.data(), wb.length(), l), i);
+        }
+        BOOST_CHECK_EQUAL(detail::mismatch(a.data(), a.data(), a.length(), l), a.length());
+        BOOST_CHECK_EQUAL(detail::ascii_imismatch(a.data(), b.data(), a.length(), l), a.length());
+        BOOST_CHECK_EQUAL(detail::ascii_imismatch(wa.data(), wb.data(), wa.length(), l), wa.length());
+    }
+
+    string c(a);
+    c[70] = 'a';
+    BOOST_CHECK(stref(c) < stref(a));
+    BOOST_CHECK_EQUAL(stref(a).compare(c), 'q' - 'a');
+    BOOST_CHECK(stref(a).iequals(b));
+    BOOST_CHECK(stref(c).iless_than(b));
+    BOOST_CHECK(wstref(wa).iequals(wb));
+    BOOST_CHECK(stref(a + "[").iless_than(b + "{"));    // not letters, compared as they are
+}
+
+BOOST_AUTO_TEST_CASE(stref_icompare_non_ascii) {
+    // non-ASCII characters go through the traits (in the "C" locale they only match themselves)
+    BOOST_CHECK(wstref(L"ABC\x3a3XYZ").iequals(L"abc\x3a3xyz"));
+    BOOST_CHECK(wstref(wstring(20, L'\x3a3') + L"ABCDEFGHIJ").iequals(wstring(20, L'\x3a3') + L"abcdefghij"));
+    BOOST_CHECK(!wstref(L"abc\x3a3xyz").iequals(L"abc\x3c4xyz"));
+    BOOST_CHECK(stref("caf\xe9 AU LAIT").iequals("caf\xe9 au lait"));
+    BOOST_CHECK(stref("caf\xe9").istarts_with("CAF"));
+    BOOST_CHECK(stref("\xe9t\xe9").iends_with("T\xe9"));
+}
+
 BOOST_AUTO_TEST_CASE(stref_has_any_of) {
     BOOST_CHECK(stref("abcd").has_any_of("-cf"));
     BOOST_CHECK(!stref("abcd").has_any_of("!wxzy"));
@@ -232,6 +305,182 @@ BOOST_AUTO_TEST_CASE(stref_find_any_of) {
     BOOST_CHECK_EQUAL(stref("abcde").find(is_any_of<char>("xyz")), stref::npos);
 }
 
+BOOST_AUTO_TEST_CASE(stref_rfind) {
+    BOOST_CHECK_EQUAL(stref("abcabc").rfind('b'), 4);
+    BOOST_CHECK_EQUAL(stref("abcabc").rfind('x'), stref::npos);
+    BOOST_CHECK_EQUAL(stref("").rfind('x'), stref::npos);
+    BOOST_CHECK_EQUAL(wstref(L"abcabc").rfind(L'a'), 3);
+}
+
+BOOST_AUTO_TEST_CASE(stref_find_long) {
+    // every kernel the cpu supports must agree with the scalar one, across block boundaries
+    string s(200, '.');
+    wstring ws(200, L'.');
+    for (int level = detail::simd_none; level <= detail::cpu_simd_level(); ++level) {
+        detail::simd_level l = static_cast<detail::simd_level>(level);
+        for (size_t i = 0; i < s.length(); ++i) {
+            s[i] = 'x'; ws[i] = L'x';
+            BOOST_CHECK_EQUAL(detail::find_char(s.data(), s.data() + s.length(), 'x', l) - s.data(), i);
+            BOOST_CHECK_EQUAL(detail::rfind_char(s.data(), s.data() + s.length(), 'x', l) - s.data(), i);
+            BOOST_CHECK_EQUAL(detail::find_char(ws.data(), ws.data() + ws.length(), L'x', l) - ws.data(), i);
+            BOOST_CHECK_EQUAL(detail::rfind_char(ws.data(), ws.data() + ws.length(), L'x', l) - ws.data(), i);
+            s[i] = '\xe9';
+            detail::char_set<char> set("-x\xe9", "-x\xe9" + 3);
+            BOOST_CHECK_EQUAL(detail::find_any(s.data(), s.data() + s.length(), set, l) - s.data(), i);
+            s[i] = '.'; ws[i] = L'.';
+        }
+        BOOST_CHECK(detail::find_char(s.data(), s.data() + s.length(), 'x', l) == s.data() + s.length());
+        BOOST_CHECK(detail::rfind_char(ws.data(), ws.data() + ws.length(), L'x', l) == ws.data() + ws.length());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(stref_for_each_match) {
+    string s(100, '.');
+    wstring ws(100, L'.');
+    for (size_t i = 0; i < s.length(); i += 7) {
+        s[i] = (i % 2) ? ',' : ';';
+        ws[i] = L',';
+    }
+    detail::char_set<char> set(",;", ",;" + 2);
+    for (int level = detail::simd_none; level <= detail::cpu_simd_level(); ++level) {
+        detail::simd_level l = static_cast<detail::simd_level>(level);
+        vector<size_t> narrow, any, wide;
+        auto on_narrow = [&](const char* p) { narrow.push_back(p - s.data()); };
+        auto on_any = [&](const char* p) { any.push_back(p - s.data()); };
+        auto on_wide = [&](const wchar_t* p) { wide.push_back(p - ws.data()); };
+        detail::for_each_char(s.data(), s.data() + s.length(), ',', on_narrow, l);
+        detail::for_each_any(s.data(), s.data() + s.length(), set, on_any, l);
+        detail::for_each_char(ws.data(), ws.data() + ws.length(), L',', on_wide, l);
+        BOOST_CHECK_EQUAL(narrow.size(), 7);
+        BOOST_CHECK_EQUAL(any.size(), 15);
+        BOOST_CHECK_EQUAL(wide.size(), 15);
+        for (size_t i = 0; i < any.size(); ++i) {
+            BOOST_CHECK_EQUAL(any[i], i * 7);
+            BOOST_CHECK_EQUAL(wide[i], i * 7);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(stref_has) {
+    BOOST_CHECK(stref("abcd").has('c'));
+    BOOST_CHECK(!stref("abcd").has('x'));
+    BOOST_CHECK(wstref(L"abcd").has(L'd'));
+    BOOST_CHECK(wstref(L"ab\x263a").has_any_of(L"\x263a"));
+    BOOST_CHECK(!wstref(L"abcd").has_any_of(L"\x263a"));
+}
+
+BOOST_AUTO_TEST_CASE(stref_find_substring) {
+    BOOST_CHECK_EQUAL(stref("hello, world").find("world"), 7);
+    BOOST_CHECK_EQUAL(stref("hello, world").find("o"), 4);
+    BOOST_CHECK_EQUAL(stref("hello, world").find("o", 5), 8);
+    BOOST_CHECK_EQUAL(stref("hello, world").find("worlds"), stref::npos);
+    BOOST_CHECK_EQUAL(stref("hello").find(""), 0);
+    BOOST_CHECK_EQUAL(stref("hello").find("", 5), 5);
+    BOOST_CHECK_EQUAL(stref("hello").find("", 6), stref::npos);
+    BOOST_CHECK_EQUAL(stref("hello, world").rfind("o"), 8);
+    BOOST_CHECK_EQUAL(stref("hello, world").rfind("l"), 10);
+    BOOST_CHECK_EQUAL(stref("hello, world").rfind("lo"), 3);
+    BOOST_CHECK_EQUAL(stref("hello").rfind(""), 5);
+    BOOST_CHECK_EQUAL(wstref(L"hello, world").find(L"world"), 7);
+    BOOST_CHECK(stref("hello, world").contains("o, w"));
+    BOOST_CHECK(!stref("hello, world").contains("o,w"));
+
+    // compare every engine with std::string on random strings over a small alphabet
+    unsigned seed = 12345;
+    auto random_string = [&](size_t n) {
+        string s;
+        for (size_t i = 0; i < n; ++i) {
+            seed = seed * 1103515245 + 12345;
+            s += "ab"[(seed >> 16) % 2];
+        }
+        return s;
+    };
+    for (int round = 0; round < 400; ++round) {
+        string hay = random_string(200 + round % 50), needle = random_string(1 + round % 70);
+        if (round % 3 == 0)
+            needle = hay.substr(round % 150, needle.length());
+        BOOST_CHECK_EQUAL(stref(hay).find(needle), hay.find(needle));
+        BOOST_CHECK_EQUAL(stref(hay).rfind(needle), hay.rfind(needle));
+        BOOST_CHECK_EQUAL(stref(hay).find(needle, 100), hay.find(needle, 100));
+        wstring whay(hay.begin(), hay.end()), wneedle(needle.begin(), needle.end());
+        BOOST_CHECK_EQUAL(wstref(whay).find(wneedle), whay.find(wneedle));
+        if (needle.length() >= 2) {
+            for (int level = detail::simd_none; level <= detail::cpu_simd_level(); ++level) {
+                detail::simd_level l = static_cast<detail::simd_level>(level);
+                size_t expected = hay.find(needle), rexpected = hay.rfind(needle);
+                BOOST_CHECK_EQUAL(detail::find_pair(hay.data(), hay.length(), needle.data(), needle.length(), l),
+                    expected == string::npos ? hay.length() : expected);
+                BOOST_CHECK_EQUAL(detail::rfind_pair(hay.data(), hay.length(), needle.data(), needle.length(), l),
+                    rexpected == string::npos ? hay.length() : rexpected);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(stref_find_all) {
+    vector<size_t> hits;
+    for (size_t pos : stref("abcabcaab").find_all("ab"))
+        hits.push_back(pos);
+    BOOST_CHECK_EQUAL(hits.size(), 3);
+    BOOST_CHECK_EQUAL(hits[0], 0);
+    BOOST_CHECK_EQUAL(hits[1], 3);
+    BOOST_CHECK_EQUAL(hits[2], 7);
+
+    auto r = stref("aaaaa").find_all("aa");
+    BOOST_CHECK_EQUAL(distance(r.begin(), r.end()), 2);     // non-overlapping
+    auto e = stref("aaaaa").find_all("");
+    BOOST_CHECK(e.begin() == e.end());
+}
+
+BOOST_AUTO_TEST_CASE(stref_searcher) {
+    string needle(40, 'x');
+    needle[20] = 'y';
+    searcher s(needle);
+    string hay = string(100, 'x') + needle + "zz";
+    BOOST_CHECK_EQUAL(s.find(hay), 100);
+    BOOST_CHECK_EQUAL(s.find(hay, 101), stref::npos);
+    BOOST_CHECK(s.found_in(hay));
+    BOOST_CHECK(!s.found_in(string(1000, 'x')));
+
+    wsearcher ws(L"\x3a3\x3c3");
+    BOOST_CHECK_EQUAL(ws.find(L"abc\x3a3\x3c3"), 3);
+}
+
+BOOST_AUTO_TEST_CASE(stref_at) {
+    BOOST_CHECK_EQUAL(stref("abc").at(2), 'c');
+    BOOST_CHECK_THROW(stref("abc").at(3), bad_stref_op);
+    BOOST_CHECK_EQUAL(stref("abc")[1], 'b');
+}
+
+BOOST_AUTO_TEST_CASE(stref_large_offsets) {
+    // offsets past 4GB, without touching the characters
+    const char* base = "x";
+    stref huge(base, size_t(1) << 33);
+    BOOST_CHECK_EQUAL(huge.length(), size_t(1) << 33);
+    BOOST_CHECK_EQUAL(huge.substr((size_t(1) << 32) + 5).length(), (size_t(1) << 33) - (size_t(1) << 32) - 5);
+    BOOST_CHECK(huge.compare(stref(base, 1)) > 0);
+    BOOST_CHECK(stref(base, 1).compare(huge) < 0);
+    BOOST_CHECK_EQUAL(huge.find('x', size_t(1) << 34), stref::npos);
+}
+
+BOOST_AUTO_TEST_CASE(stref_lines) {
+    vector<stref> lines;
+    for (stref line : stref("first\r\nsecond\n\nlast").lines())
+        lines.push_back(line);
+    BOOST_CHECK_EQUAL(lines.size(), 4);
+    BOOST_CHECK_EQUAL(lines[0], "first");
+    BOOST_CHECK_EQUAL(lines[1], "second");
+    BOOST_CHECK_EQUAL(lines[2], "");
+    BOOST_CHECK_EQUAL(lines[3], "last");
+
+    auto r1 = stref("one\ntwo\n").lines();
+    BOOST_CHECK_EQUAL(distance(r1.begin(), r1.end()), 2);
+    auto r2 = stref("").lines();
+    BOOST_CHECK(r2.begin() == r2.end());
+    auto r3 = wstref(L"a\nb").lines();
+    BOOST_CHECK(*++r3.begin() == L"b");
+}
+
 BOOST_AUTO_TEST_CASE(stref_split) {
     vector<stref> srv;
     stref("a,comma,separated,list").split(',', [&](stref sr) { srv.push_back(sr); });
@@ -270,6 +519,90 @@ BOOST_AUTO_TEST_CASE(stref_split_any_of) {
     stref("").split(is_any_of<char>(",:;."), [&](stref sr) { srv.push_back(sr); });
     BOOST_CHECK_EQUAL(srv.size(), 1);
     BOOST_CHECK_EQUAL(srv[0], "");
+
+    srv.clear();
+    stref(",a;").split(is_any_of<char>(",:;."), [&](stref sr) { srv.push_back(sr); });
+    BOOST_CHECK_EQUAL(srv.size(), 3);
+    BOOST_CHECK_EQUAL(srv[0], "");
+    BOOST_CHECK_EQUAL(srv[1], "a");
+    BOOST_CHECK_EQUAL(srv[2], "");
+}
+
+BOOST_AUTO_TEST_CASE(stref_split_callable) {
+    vector<stref> srv;
+    stref("a b\tc").split([](char ch) { return ch == ' ' || ch == '\t'; }, [&](stref sr) { srv.push_back(sr); });
+    BOOST_CHECK_EQUAL(srv.size(), 3);
+    BOOST_CHECK_EQUAL(srv[2], "c");
+
+    // callables are used directly, so they need not be copyable (std::function would require it)
+
+    struct semicolon {
+        semicolon() : sep(new wchar_t(L';')) {}
+        bool operator() (wchar_t ch) const { return ch == *sep; }
+        unique_ptr<wchar_t> sep;
+    };
+    BOOST_CHECK_EQUAL(wstref(L"ab;c").find(semicolon()), 2);
+
+    std::function< bool(char) > fmatch = is_any_of<char>(":");
+    BOOST_CHECK_EQUAL(stref("ab:c").find(fmatch, 1), 2);
+    BOOST_CHECK_EQUAL(stref("ab:c").find(fmatch, 3), stref::npos);
+}
+
+BOOST_AUTO_TEST_CASE(stref_split_range) {
+    vector<stref> srv;
+    for (stref sr : stref("a,comma,,list").split_range(','))
+        srv.push_back(sr);
+    BOOST_CHECK_EQUAL(srv.size(), 4);
+    BOOST_CHECK_EQUAL(srv[0], "a");
+    BOOST_CHECK_EQUAL(srv[2], "");
+    BOOST_CHECK_EQUAL(srv[3], "list");
+
+    auto r1 = stref("a,,b,c").split_range(',', 1);
+    srv.assign(r1.begin(), r1.end());
+    BOOST_CHECK_EQUAL(srv.size(), 2);
+    BOOST_CHECK_EQUAL(srv[1], ",b,c");
+
+    auto r2 = stref(",,a,,b,,c,,").split_range(',', 2, skip_empty);
+    srv.assign(r2.begin(), r2.end());
+    BOOST_CHECK_EQUAL(srv.size(), 3);
+    BOOST_CHECK_EQUAL(srv[0], "a");
+    BOOST_CHECK_EQUAL(srv[1], "b");
+    BOOST_CHECK_EQUAL(srv[2], "c,,");
+
+    auto r3 = stref("").split_range(',');
+    BOOST_CHECK_EQUAL(distance(r3.begin(), r3.end()), 1);
+    auto r4 = stref(";,").split_range(is_any_of<char>(",;"), size_t(-1), skip_empty);
+    BOOST_CHECK(r4.begin() == r4.end());
+
+    // early termination: only the first three fields are ever looked at
+    auto r5 = stref("f1 f2 f3 f4 f5").split_range([](char ch) { return ch == ' '; });
+    auto it = r5.begin();
+    advance(it, 2);
+    BOOST_CHECK_EQUAL(*it, "f3");
+    BOOST_CHECK_EQUAL(it->length(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(stref_rsplit_range) {
+    vector<stref> srv;
+    auto r1 = stref("/usr/local/bin").rsplit_range('/');
+    srv.assign(r1.begin(), r1.end());
+    BOOST_CHECK_EQUAL(srv.size(), 4);
+    BOOST_CHECK_EQUAL(srv[0], "bin");
+    BOOST_CHECK_EQUAL(srv[2], "usr");
+    BOOST_CHECK_EQUAL(srv[3], "");
+
+    auto r2 = stref("/usr/local/bin").rsplit_range('/', 1);
+    srv.assign(r2.begin(), r2.end());
+    BOOST_CHECK_EQUAL(srv.size(), 2);
+    BOOST_CHECK_EQUAL(srv[0], "bin");
+    BOOST_CHECK_EQUAL(srv[1], "/usr/local");
+
+    auto r3 = wstref(L"a; b;;c;").rsplit_range(is_any_of<wchar_t>(L"; "), 2, skip_empty);
+    vector<wstref> wsrv(r3.begin(), r3.end());
+    BOOST_CHECK_EQUAL(wsrv.size(), 3);
+    BOOST_CHECK(wsrv[0] == L"c");
+    BOOST_CHECK(wsrv[1] == L"b");
+    BOOST_CHECK(wsrv[2] == L"a");
 }
 
 BOOST_AUTO_TEST_CASE(stref_each) {
@@ -284,3 +617,1174 @@ BOOST_AUTO_TEST_CASE(stref_each_reverse) {
     BOOST_CHECK_EQUAL(s, "!tset");
 }
 
+
+BOOST_AUTO_TEST_CASE(stref_hash) {
+    string a("content-length"), b("content-length");
+    BOOST_CHECK_EQUAL(stref(a).hash(), stref(b).hash());
+    BOOST_CHECK(stref(a).hash() != stref("content-type").hash());
+    BOOST_CHECK_EQUAL(std::hash<stref>()(a), stref(b).hash());
+    BOOST_CHECK_EQUAL(std::hash<wstref>()(L"abc"), wstref(wstring(L"abc")).hash());
+
+    unordered_map<stref, int> counts;
+    stref("a,b,a,c,a").split(',', [&](stref sr) { ++counts[sr]; });
+    BOOST_CHECK_EQUAL(counts.size(), 3);
+    BOOST_CHECK_EQUAL(counts["a"], 3);
+
+    // every length, so all the block and tail cases are covered
+    string text = "The Quick Brown Fox Jumps Over The Lazy Dog, \xc9T\xc9 1234567890 ";
+    text += text;
+    for (size_t n = 0; n <= text.length(); ++n) {
+        string lower(text, 0, n);
+        for (size_t i = 0; i < n; ++i)
+            lower[i] = tools::char_traits::to_lower_case(lower[i]);
+        BOOST_CHECK(stref(text).left(n).iequals(lower));
+        BOOST_CHECK_EQUAL(stref(text).left(n).ihash(), stref(lower).ihash());
+        wstring wtext(text.begin(), text.begin() + n), wlower(lower.begin(), lower.end());
+        BOOST_CHECK_EQUAL(wstref(wtext).ihash(), wstref(wlower).ihash());
+        if (n > 0)
+            BOOST_CHECK(stref(text).left(n).hash() != stref(text).left(n - 1).hash());
+    }
+
+    unordered_set<stref, ihasher, iequal_to> headers;
+    headers.insert("Content-Type");
+    BOOST_CHECK(headers.count("content-type") == 1);
+    BOOST_CHECK(headers.count("content-types") == 0);
+}
+
+BOOST_AUTO_TEST_CASE(stref_hashed) {
+    string key("user-agent");
+    hashed_stref h1(key), h2("user-agent"), h3("user-agenT");
+    BOOST_CHECK_EQUAL(h1.hash(), stref(key).hash());
+    BOOST_CHECK(h1 == h2);
+    BOOST_CHECK(h1 != h3);
+    BOOST_CHECK(h1 == stref("user-agent"));
+    BOOST_CHECK_EQUAL(std::hash<hashed_stref>()(h2), h1.hash());
+
+    unordered_map<hashed_stref, int> m;
+    m[h1] = 1;
+    BOOST_CHECK_EQUAL(m.count(h2), 1);
+    BOOST_CHECK_EQUAL(m.count(h3), 0);
+}
+
+BOOST_AUTO_TEST_CASE(multi_matcher_matches) {
+    multi_matcher m({ "he", "she", "his", "hers", "" });
+    BOOST_CHECK_EQUAL(m.pattern_count(), 5);
+
+    vector<pair<size_t, size_t>> hits;
+    m.for_each_match("ushers", [&](size_t id, size_t offset) { hits.push_back(make_pair(id, offset)); });
+    BOOST_CHECK_EQUAL(hits.size(), 3);
+    BOOST_CHECK(hits[0] == make_pair(size_t(1), size_t(1)));    // she
+    BOOST_CHECK(hits[1] == make_pair(size_t(0), size_t(2)));    // he
+    BOOST_CHECK(hits[2] == make_pair(size_t(3), size_t(2)));    // hers
+
+    multi_matcher::match first = m.first_match("that is his");
+    BOOST_CHECK_EQUAL(first.id, 2);
+    BOOST_CHECK_EQUAL(first.offset, 8);
+    BOOST_CHECK(!m.contains_any("nothing to see"));
+    BOOST_CHECK_EQUAL(m.first_match("").id, multi_matcher::npos);
+}
+
+BOOST_AUTO_TEST_CASE(multi_matcher_ignore_case) {
+    vector<string> blocklist;
+    blocklist.push_back("DROP TABLE");
+    blocklist.push_back("<script");
+    multi_matcher m(blocklist.begin(), blocklist.end(), true);
+    BOOST_CHECK(m.contains_any("x'; drop table users"));
+    BOOST_CHECK_EQUAL(m.first_match("<p><SCRIPT>").offset, 3);
+    BOOST_CHECK(!multi_matcher(blocklist.begin(), blocklist.end()).contains_any("<SCRIPT>"));
+
+    wmulti_matcher wm({ L"\x3a3\x3a3", L"ab" });
+    size_t count = 0;
+    wm.for_each_match(L"ab\x3a3\x3a3\x3a3 AB", [&](size_t, size_t) { ++count; });
+    BOOST_CHECK_EQUAL(count, 3);
+}
+
+BOOST_AUTO_TEST_CASE(stref_pool_intern) {
+    stref_pool pool(64);
+    stref a(""), b("");
+    {
+        string s1("GET"), s2("GET");
+        a = pool.intern(s1);
+        b = pool.intern(s2);
+    }
+    BOOST_CHECK(a.data() == b.data());          // one canonical copy, which outlives the sources
+    BOOST_CHECK_EQUAL(a, "GET");
+    BOOST_CHECK_EQUAL(a.data()[3], '\0');
+    BOOST_CHECK_EQUAL(pool.size(), 1);
+
+    vector<stref> interned;
+    for (int i = 0; i < 1000; ++i)
+        interned.push_back(pool.intern(to_string(i % 500)));
+    BOOST_CHECK_EQUAL(pool.size(), 501);
+    for (int i = 0; i < 500; ++i) {
+        BOOST_CHECK(interned[i].data() == interned[i + 500].data());
+        BOOST_CHECK_EQUAL(interned[i], to_string(i));
+    }
+    BOOST_CHECK(pool.contains("499"));
+    BOOST_CHECK(!pool.contains("500"));
+    BOOST_CHECK_EQUAL(pool.intern(string(200, 'x')).length(), 200);    // longer than a block
+
+    wstref_pool wpool;
+    BOOST_CHECK(wpool.intern(wstring(L"abc")).data() == wpool.intern(L"abc").data());
+}
+
+BOOST_AUTO_TEST_CASE(stref_pool_shared) {
+    shared_stref_pool pool(4);
+    vector<stref> results[4];
+    vector<thread> threads;
+    for (int t = 0; t < 4; ++t)
+        threads.push_back(thread([&pool, &results, t] {
+            for (int i = 0; i < 1000; ++i)
+                results[t].push_back(pool.intern(to_string(i)));
+        }));
+    for (size_t t = 0; t < threads.size(); ++t)
+        threads[t].join();
+    BOOST_CHECK_EQUAL(pool.size(), 1000);
+    for (int i = 0; i < 1000; ++i)
+        for (int t = 1; t < 4; ++t)
+            BOOST_CHECK(results[t][i].data() == results[0][i].data());
+    BOOST_CHECK_THROW(shared_stref_pool(0), bad_stref_op);
+}
+
+BOOST_AUTO_TEST_CASE(mapped_file_contents) {
+    const char* path = "stref_mapped_file.tmp";
+    ofstream(path, ios::binary) << "header\r\nrow 1\nrow 2\n";
+    {
+        mapped_file f(path);
+        BOOST_CHECK_EQUAL(f.size(), 20);
+        BOOST_CHECK_EQUAL(f.contents(), "header\r\nrow 1\nrow 2\n");
+        f.will_need(8, 100);
+        vector<stref> lines(f.lines().begin(), f.lines().end());
+        BOOST_CHECK_EQUAL(lines.size(), 3);
+        BOOST_CHECK_EQUAL(lines[0], "header");
+        BOOST_CHECK_EQUAL(lines[2], "row 2");
+
+        mapped_file moved(std::move(f));
+        BOOST_CHECK_EQUAL(stref(moved).find("row 2"), 14);
+        BOOST_CHECK_EQUAL(f.size(), 0);
+    }
+    ofstream(path, ios::binary | ios::trunc);
+    {
+        mapped_file f(path, mapped_file::random);
+        BOOST_CHECK_EQUAL(f.contents().length(), 0);
+        BOOST_CHECK(f.lines().begin() == f.lines().end());
+    }
+    remove(path);
+    BOOST_CHECK_THROW(mapped_file("no such file"), std::system_error);
+}
+
+BOOST_AUTO_TEST_CASE(thread_pool_run) {
+    thread_pool pool(4);
+    BOOST_CHECK_EQUAL(pool.size(), 4);
+    vector<int> runs(1000);
+    for (int batch = 0; batch < 20; ++batch)
+        pool.run(runs.size(), [&](size_t i) { runs[i] += 1; });
+    BOOST_CHECK(count(runs.begin(), runs.end(), 20) == 1000);
+    BOOST_CHECK_THROW(pool.run(100, [](size_t i) { if (i == 50) throw runtime_error("task 50"); }), runtime_error);
+    pool.run(0, [](size_t) { BOOST_ERROR("no tasks"); });
+}
+
+BOOST_AUTO_TEST_CASE(parallel_split_tokens) {
+    string text;
+    for (int i = 0; text.length() < 3 * 1024 * 1024; ++i)
+        text += to_string(i) + ((i % 7 == 0) ? ",," : (i % 5 == 0) ? ";" : ",");
+    stref sr(text);
+    thread_pool pool(4);
+
+    vector<stref> expected;
+    sr.split(is_any_of<char>(",;"), [&](const stref& token) { expected.push_back(token); });
+    vector<stref> ordered;
+    parallel_split_ordered(pool, sr, is_any_of<char>(",;"), [&](const stref& token) { ordered.push_back(token); });
+    BOOST_CHECK(ordered.size() == expected.size() && equal(ordered.begin(), ordered.end(), expected.begin(),
+        [](const stref& a, const stref& b) { return a.data() == b.data() && a.length() == b.length(); }));
+
+    auto is_sep = [](char ch) { return ch == ',' || ch == ';'; };
+    vector<pair<const char*, size_t>> sequential, unordered;
+    sr.split(is_sep, [&](const stref& token) { sequential.push_back(make_pair(token.data(), token.length())); });
+    mutex m;
+    parallel_split(pool, sr, is_sep, [&](const stref& token) {
+        lock_guard<mutex> lock(m);
+        unordered.push_back(make_pair(token.data(), token.length()));
+    });
+    sort(sequential.begin(), sequential.end());
+    sort(unordered.begin(), unordered.end());
+    BOOST_CHECK(unordered == sequential);
+
+    vector<stref> small;
+    parallel_split_ordered(pool, stref(",a,"), ',', [&](const stref& token) { small.push_back(token); });
+    BOOST_CHECK_EQUAL(small.size(), 3);
+    BOOST_CHECK_EQUAL(small[1], "a");
+}
+
+BOOST_AUTO_TEST_CASE(parallel_count_find_all) {
+    wstring text;
+    for (int i = 0; text.length() < 1024 * 1024; ++i)
+        text += (i % 3 == 0) ? L"line\n" : L"a longer line, lined up\n";
+    wstref sr(text);
+    thread_pool pool(3);
+    BOOST_CHECK_EQUAL(parallel_count(pool, sr, L'\n'), sr.count(L'\n'));
+    vector<size_t> newlines = parallel_find_all(pool, sr, L'\n');
+    BOOST_CHECK_EQUAL(newlines.size(), sr.count(L'\n'));
+    BOOST_CHECK(newlines.back() == sr.length() - 1 && newlines[0] == 4);
+
+    // periodic needles in periodic text: instances overlap each other and the chunk boundaries
+    wstref needles[] = { L"line", L"ee", L"\na", L"nothing", L"eee", L"eeeeeeeeeeeeeeeeeeeeeeeee", L"aba", L"abaab" };
+    wstring aa(300007, L'e'), ab;
+    for (int i = 0; ab.length() < 400000; ++i)
+        ab += i % 1000 == 999 ? L"aab" : L"ab";
+    for (const wstref& needle : needles)
+        for (const wstref& haystack : { sr, wstref(aa), wstref(ab) }) {
+            vector<size_t> expected(haystack.find_all(needle).begin(), haystack.find_all(needle).end());
+            BOOST_CHECK(parallel_find_all(pool, haystack, needle) == expected);
+        }
+}
+
+BOOST_AUTO_TEST_CASE(csv_reader_fields) {
+    stref text("name,\"city, state\",note\r\n\"Smith\",\"Boston, MA\",\"said \"\"hi\"\"\"\r\n\nlast,\"multi\nline\",");
+    csv_reader reader(text);
+    csv_record record;
+
+    BOOST_CHECK(reader.next(record));
+    BOOST_CHECK_EQUAL(record.size(), 3);
+    BOOST_CHECK_EQUAL(record[1].view(), "city, state");
+    BOOST_CHECK_EQUAL(record[2].view(), "note");
+    BOOST_CHECK_EQUAL(reader.offset(), 25);
+
+    BOOST_CHECK(reader.next(record));
+    BOOST_CHECK(record[0].quoted() && !record[0].escaped());
+    BOOST_CHECK(record[1].view().data() == text.data() + 34);
+    BOOST_CHECK(record[2].escaped());
+    BOOST_CHECK_EQUAL(record[2].view(), "said \"\"hi\"\"");
+    BOOST_CHECK_EQUAL(record[2].str(), "said \"hi\"");
+
+    BOOST_CHECK(reader.next(record));
+    BOOST_CHECK_EQUAL(record.size(), 1);
+    BOOST_CHECK_EQUAL(record[0].view().length(), 0);
+
+    BOOST_CHECK(reader.next(record));
+    BOOST_CHECK_EQUAL(record.size(), 3);
+    BOOST_CHECK_EQUAL(record[1].str(), "multi\nline");
+    BOOST_CHECK_EQUAL(record[2].view().length(), 0);
+    BOOST_CHECK(!reader.next(record));
+    BOOST_CHECK(!reader.next(record));
+
+    BOOST_CHECK(!csv_reader(stref("")).next(record));
+    wcsv_reader tsv(wstref(L"a\t'b\tc'\n"), L'\t', L'\'');
+    wcsv_record row;
+    BOOST_CHECK(tsv.next(row) && row.size() == 2 && row[1].view() == L"b\tc");
+    BOOST_CHECK(!tsv.next(row));
+
+    // a quote inside an unquoted field opens quoting all the same, until the next quote
+    csv_reader stray(stref("ab\"c,d\ne\"f,g\nh,i\n"));
+    BOOST_CHECK(stray.next(record) && record.size() == 2);
+    BOOST_CHECK(!record[0].quoted() && record[0].view() == "ab\"c,d\ne\"f" && record[1].view() == "g");
+    BOOST_CHECK(stray.next(record) && record.size() == 2 && record[0].view() == "h");
+    BOOST_CHECK(!stray.next(record));
+}
+
+// fields with quotes, separators and newlines on both sides of the 64 character block boundaries
+template <typename chT, typename TT>
+void check_csv_blocks() {
+    vector<vector<basic_string<chT>>> rows;
+    basic_string<chT> text;
+    const char* samples[] = { "plain", "", "with,comma", "with \"\"quotes\"\"", "two\nlines", "crlf\r\nrow", "x" };
+    for (int r = 0; r < 300; ++r) {
+        vector<basic_string<chT>> row;
+        for (int f = 0; f <= r % 5; ++f) {
+            string sample = samples[(r * 3 + f) % 7];
+            bool quote = sample.find_first_of(",\"\n") != string::npos || (r + f) % 4 == 0;
+            string unescaped;
+            for (size_t i = 0; i < sample.length(); ++i)
+                if (!(sample[i] == '"' && i > 0 && sample[i - 1] == '"'))
+                    unescaped += sample[i];
+            row.push_back(basic_string<chT>(unescaped.begin(), unescaped.end()));
+            if (f > 0)
+                text += chT(',');
+            if (quote)
+                text += chT('"');
+            text += basic_string<chT>(sample.begin(), sample.end());
+            if (quote)
+                text += chT('"');
+        }
+        rows.push_back(row);
+        text += r % 2 ? basic_string<chT>(1, chT('\n')) : basic_string<chT>({ chT('\r'), chT('\n') });
+    }
+    for (int level = detail::simd_none; level <= detail::cpu_simd_level(); ++level) {
+        basic_csv_reader<TT> reader(text, chT(','), chT('"'), static_cast<detail::simd_level>(level));
+        basic_csv_record<TT> record;
+        size_t r = 0;
+        for (; reader.next(record); ++r) {
+            BOOST_REQUIRE(r < rows.size() && record.size() == rows[r].size());
+            for (size_t f = 0; f < record.size(); ++f)
+                BOOST_CHECK(record[f].str() == rows[r][f]);
+        }
+        BOOST_CHECK_EQUAL(r, rows.size());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(csv_reader_blocks) {
+    check_csv_blocks<char, tools::char_traits>();
+    check_csv_blocks<wchar_t, wchar_traits>();
+}
+
+BOOST_AUTO_TEST_CASE(stref_to_int) {
+    BOOST_CHECK_EQUAL(stref("42").to_int(), 42);
+    BOOST_CHECK_EQUAL(stref("-2147483648").to_int(), numeric_limits<int>::min());
+    BOOST_CHECK_EQUAL(stref("+000000000000000000000123456789012").to_int<long long>(), 123456789012ll);
+    BOOST_CHECK_EQUAL(stref("18446744073709551615").to_int<unsigned long long>(), numeric_limits<unsigned long long>::max());
+    BOOST_CHECK_EQUAL(stref("-9223372036854775808").to_int<long long>(), numeric_limits<long long>::min());
+    BOOST_CHECK_EQUAL(stref("-0").to_int<unsigned>(), 0u);
+    BOOST_CHECK_EQUAL(wstref(L"-128").to_int<signed char>(), -128);
+    BOOST_CHECK_EQUAL(stref("2147483648").try_parse<int>().error, number_out_of_range);
+    BOOST_CHECK_EQUAL(stref("18446744073709551616").try_parse<unsigned long long>().error, number_out_of_range);
+    BOOST_CHECK_EQUAL(stref("99999999999999999999").try_parse<unsigned long long>().error, number_out_of_range);
+    // 20 digits whose value wraps modulo 2^64 into the range of the top 19 checked afterwards
+    const char* wrapped[] = { "28446744073709551616", "20000000000000000000", "36893488147419103231", "18446744073709551620", "123456789012345678901" };
+    for (const char* s : wrapped)
+        BOOST_CHECK_EQUAL(stref(s).try_parse<unsigned long long>().error, number_out_of_range);
+    BOOST_CHECK_EQUAL(stref("10000000000000000000").to_int<unsigned long long>(), 10000000000000000000ull);
+    BOOST_CHECK_EQUAL(stref("1844674407370955161x").try_parse<unsigned long long>().error, invalid_number);
+    BOOST_CHECK_EQUAL(stref("18446744073709551615x").try_parse<unsigned long long>().error, invalid_number);
+    BOOST_CHECK_EQUAL(stref("-1").try_parse<unsigned>().error, number_out_of_range);
+    const char* invalid[] = { "", "-", "+", " 1", "1 ", "12345678x", "1.0", "0x10" };
+    for (const char* s : invalid)
+        BOOST_CHECK_EQUAL(stref(s).try_parse<int>().error, invalid_number);
+    BOOST_CHECK_THROW(stref("one").to_int(), bad_stref_op);
+    BOOST_CHECK(!stref("300").try_parse<unsigned char>());
+}
+
+BOOST_AUTO_TEST_CASE(stref_to_double) {
+    // exact rounding: halfway cases, subnormals, overflow and more than 19 digits
+    const char* numbers[] = {
+        "0", "-0", "3.14159", "1e22", "1e23", "9007199254740993", "2.2250738585072011e-308",
+        "4.9406564584124654e-324", "2.4703282292062328e-324", "1.7976931348623157e308",
+        "0.1000000000000000055511151231257827021181583404541015625",
+        "0.10000000000000000555111512312578270211815834045410156251", "123456789012345678901234567890",
+        ".5", "5.", "1E-5", "+1e+0", "0.000000000000000000000000000000000000000000001e45"
+    };
+    for (const char* s : numbers) {
+        double d = strtod(s, 0);
+        float f = strtof(s, 0);
+        parse_result<double> pd = stref(s).try_parse<double>();
+        parse_result<float> pf = stref(s).try_parse<float>();
+        BOOST_CHECK(pd && memcmp(&pd.value, &d, sizeof(d)) == 0);
+        BOOST_CHECK(memcmp(&pf.value, &f, sizeof(f)) == 0);
+    }
+    BOOST_CHECK_EQUAL(wstref(L"-2.5e-3").to_double(), -2.5e-3);
+    BOOST_CHECK_EQUAL(stref("-Infinity").to_double(), -numeric_limits<double>::infinity());
+    BOOST_CHECK(stref("nan").try_parse<double>().value != stref("NaN").to_double());
+    BOOST_CHECK_EQUAL(stref("1e309").try_parse<double>().error, number_out_of_range);
+    BOOST_CHECK_EQUAL(stref("1e39").try_parse<float>().error, number_out_of_range);
+    const char* invalid[] = { "", ".", "-", "e5", "1e", "1e+", "1.2.3", "1,5", " 1", "infinite" };
+    for (const char* s : invalid)
+        BOOST_CHECK_EQUAL(stref(s).try_parse<double>().error, invalid_number);
+    BOOST_CHECK_THROW(stref("1e999").to_double(), bad_stref_op);
+
+    vector<stref> column = { "1.5", "-2", "1e3", "x", "4" };
+    double values[5];
+    BOOST_CHECK_EQUAL(parse_column(column.begin(), column.end(), values), 3);
+    BOOST_CHECK_EQUAL(values[2], 1000.0);
+}
+
+BOOST_AUTO_TEST_CASE(stream_splitter_chunks) {
+    string text;
+    for (int i = 0; i < 2000; ++i)
+        text += (i % 11 == 0) ? ";;" : (i % 97 == 0) ? string(300, 'x') + "," : to_string(i * i) + ",";
+    vector<string> expected;
+    stref(text).split(is_any_of<char>(",;"), [&](const stref& token) { expected.push_back(token); });
+
+    for (size_t chunk : { 1, 7, 64, 1000, 100000 }) {
+        basic_stream_splitter<tools::char_traits, is_any_of<char>> splitter(is_any_of<char>(",;"));
+        vector<string> tokens;
+        size_t copied = 0;
+        auto body = [&](const stref& token) {
+            copied += token.data() < text.data() || token.data() >= text.data() + text.length();
+            tokens.push_back(token);
+        };
+        for (size_t i = 0; i < text.length(); i += chunk)
+            splitter.feed(stref(text).substr(i, chunk), body);
+        splitter.finish(body);
+        BOOST_CHECK(tokens == expected);
+        BOOST_CHECK(copied <= text.length() / chunk + 1);
+        BOOST_CHECK_EQUAL(splitter.pending(), 0);
+    }
+
+    wstream_splitter lines(L'\n');
+    vector<wstring> got;
+    auto body = [&](const wstref& line) { got.push_back(line); };
+    lines.feed(wstref(L"first li"), body);
+    BOOST_CHECK_EQUAL(lines.pending(), 8);
+    lines.feed(wstref(L"ne\nsecond\nthi"), body);
+    lines.feed(wstref(L"rd"), body);
+    lines.finish(body);
+    BOOST_CHECK(got.size() == 3 && got[0] == L"first line" && got[2] == L"third");
+    lines.finish(body);
+    BOOST_CHECK(got.size() == 4 && got[3].empty());
+}
+
+BOOST_AUTO_TEST_CASE(stref_stream_output) {
+    ostringstream os;
+    stref sr("hello, world");
+    os << sr.left(5) << '|' << setw(8) << sr.right(5) << '|' << left << setfill('.') << setw(7) << sr.left(5) << '|';
+    BOOST_CHECK_EQUAL(os.str(), "hello|   world|hello..|");
+    wostringstream wos;
+    wos << wstref(L"wide") << setw(2) << wstref(L"text");
+    BOOST_CHECK(wos.str() == L"widetext");
+}
+
+BOOST_AUTO_TEST_CASE(concat_join) {
+    string name("world");
+    stref greeting("hello, there");
+    BOOST_CHECK_EQUAL(concat(greeting.left(5), ", ", name, '!'), "hello, world!");
+    BOOST_CHECK_EQUAL(concat_length(greeting, "ab", 'c', name), 20);
+    BOOST_CHECK(concat(L"x", wstref(L"yz"), L'!') == L"xyz!");
+
+    string out("> ");
+    out.reserve(64);
+    const char* data = out.data();
+    concat_append(out, greeting.right(5), ' ', name);
+    BOOST_CHECK_EQUAL(out, "> there world");
+    BOOST_CHECK(out.data() == data);
+
+    char buffer[32];
+    char* end = concat_to(buffer, "key", '=', stref("value"));
+    BOOST_CHECK_EQUAL(stref(buffer, end - buffer), "key=value");
+
+    vector<stref> fields = { "a", "bc", "", "def" };
+    BOOST_CHECK_EQUAL(join(fields, ", "), "a, bc, , def");
+    BOOST_CHECK_EQUAL(join_length(fields, ", "), 12);
+    BOOST_CHECK_EQUAL(join(vector<string>(), ','), "");
+    BOOST_CHECK_EQUAL(join(vector<string>(1, "one"), ','), "one");
+    end = join_to(buffer, fields, '/');
+    BOOST_CHECK_EQUAL(stref(buffer, end - buffer), "a/bc//def");
+
+    // parts which refer to the string appended to
+    string self(40, 'z');
+    concat_append(self, self);
+    BOOST_CHECK_EQUAL(self, string(80, 'z'));
+    string t("abcdefghijklmnopqrstuvwxyz");
+    t.shrink_to_fit();
+    concat_append(t, stref(t), "x", stref(t).left(1));
+    BOOST_CHECK_EQUAL(t, "abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzxa");
+    t.shrink_to_fit();
+    vector<stref> own = { stref(t).left(3), stref(t).right(2) };
+    join_append(t, own, stref(t).substr(52, 1));
+    BOOST_CHECK_EQUAL(t, "abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzxaabcxxa");
+}
+
+BOOST_AUTO_TEST_CASE(stref_constexpr) {
+    constexpr stref hello("  hello, world ");
+    static_assert(hello.length() == 15, "length");
+    static_assert(hello.trim() == "hello, world", "trim");
+    static_assert(hello.trim().substr(7) == "world"_sr, "substr");
+    static_assert(hello.trim().left(5).compare("help") < 0, "compare");
+    static_assert(hello.trim().starts_with("hello") && hello.trim().ends_with("world"), "starts_with");
+    static_assert(hello[2] == 'h' && L"wide"_sr.right(2) == L"de", "wide");
+    static_assert("a\0b"_sr.length() == 3, "literal length");
+    BOOST_CHECK_EQUAL("x,y"_sr.find(','), 1);
+}
+
+BOOST_AUTO_TEST_CASE(keyword_map_find) {
+    static constexpr auto keywords = make_keyword_map({
+        "alignas", "alignof", "and", "asm", "auto", "bool", "break", "case", "catch", "char", "class", "const",
+        "constexpr", "const_cast", "continue", "decltype", "default", "delete", "do", "double", "dynamic_cast",
+        "else", "enum", "explicit", "export", "extern", "false", "float", "for", "friend", "goto", "if", "inline",
+        "int", "long", "mutable", "namespace", "new", "noexcept", "not", "nullptr", "operator", "or", "private",
+        "protected", "public", "register", "reinterpret_cast", "return", "short", "signed", "sizeof", "static",
+        "static_assert", "static_cast", "struct", "switch", "template", "this", "thread_local", "throw", "true",
+        "try", "typedef", "typeid", "typename", "union", "unsigned", "using", "virtual", "void", "volatile",
+        "wchar_t", "while", "xor"
+    });
+    static_assert(keywords.find("constexpr") == 12 && keywords.find("constexp") == -1, "compile time lookup");
+    for (size_t id = 0; id < keywords.size(); ++id) {
+        string copy = keywords[id];
+        BOOST_CHECK_EQUAL(keywords.find(copy), int(id));
+        copy[0] ^= 0x20;
+        BOOST_CHECK(!keywords.contains(copy));
+    }
+    const char* others[] = { "", "x", "integer", "Int", "whiles", "thread_locals", "a_very_long_identifier" };
+    for (const char* s : others)
+        BOOST_CHECK_EQUAL(keywords.find(s), -1);
+
+    constexpr auto verbs = make_keyword_map({ L"GET", L"PUT" });
+    switch (verbs.find(wstring(L"PUT"))) {
+        case verbs.find(L"GET"): BOOST_ERROR("GET"); break;
+        case verbs.find(L"PUT"): break;
+        default: BOOST_ERROR("not found");
+    }
+}
+
+// the counters only count when stref.h is compiled with STREF_STATS (make stats)
+BOOST_AUTO_TEST_CASE(stref_stats_counters) {
+#if defined(STREF_STATS)
+    const uint64_t on = 1;
+#else
+    const uint64_t on = 0;
+#endif
+    reset_stats();
+    stref csv("a, b,c");
+    size_t n = 0;
+    csv.split(',', [&](const stref& field) { n += field.trim().length(); });
+    BOOST_CHECK_EQUAL(n, 3u);
+    BOOST_CHECK_EQUAL(csv.find('c'), 5u);
+    BOOST_CHECK(csv.contains("b,c"));
+
+    thread worker([] { wstref(L"x y z").split(L' ', [](const wstref&) {}); });
+    worker.join();
+
+    stref_stats stats = snapshot_stats();
+    BOOST_CHECK_EQUAL(stats[op_split].calls, 2 * on);
+    BOOST_CHECK_EQUAL(stats[op_split].bytes, (6 + 5 * sizeof(wchar_t)) * on);
+    BOOST_CHECK_EQUAL(stats[op_split].tokens, 6 * on);
+    BOOST_CHECK_EQUAL(stats[op_trim].calls, 3 * on);
+    BOOST_CHECK_EQUAL(stats[op_trim].bytes, 1 * on);
+    BOOST_CHECK_EQUAL(stats[op_find].bytes, 6 * on);
+    BOOST_CHECK_EQUAL(stats[op_search].calls, 1 * on);
+    BOOST_CHECK_EQUAL(stats[op_search].bytes, 6 * on);
+    BOOST_CHECK_EQUAL(stats[op_icompare].calls, 0u);
+
+    reset_stats();
+    BOOST_CHECK_EQUAL(snapshot_stats()[op_split].calls, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(utf8_validation) {
+    struct { const char* text; size_t valid; } cases[] = {
+        { "plain ASCII", 11 }, { "caf\xc3\xa9", 5 }, { "\xe2\x82\xac 10", 6 }, { "\xf0\x9d\x84\x9e", 4 },
+        { "ab\x80", 2 }, { "\xc0\xaf", 0 }, { "\xc1\xbf", 0 }, { "x\xe0\x9f\xbf", 1 }, { "\xed\xa0\x80", 0 },
+        { "\xed\x9f\xbf!", 4 }, { "\xf0\x8f\xbf\xbf", 0 }, { "\xf4\x8f\xbf\xbf", 4 }, { "\xf4\x90\x80\x80", 0 },
+        { "\xf5\x80\x80\x80", 0 }, { "ok\xe2\x82", 2 }, { "\xc3\xa9\xc3", 2 }, { "\xff", 0 }
+    };
+    for (auto& c : cases) {
+        // at every offset in a long ASCII run, so that the errors fall everywhere in the vector blocks
+        for (size_t pad = 0; pad < 70; pad += 3) {
+            string text = string(pad, 'x') + c.text;
+            for (int level = detail::simd_none; level <= detail::cpu_simd_level(); ++level) {
+                const char* p = detail::utf8_validate(text.data(), text.data() + text.length(), detail::simd_level(level));
+                BOOST_CHECK_EQUAL(size_t(p - text.data()), pad + c.valid);
+            }
+        }
+        BOOST_CHECK_EQUAL(utf8_valid(stref(c.text)), c.valid == strlen(c.text));
+    }
+
+    // random mixes of valid and invalid sequences: the kernels agree with the scalar code
+    const char* pieces[] = { "a", "\xc3\xa9", "\xe2\x82\xac", "\xf0\x9d\x84\x9e", "\x80", "\xe2\x82", "\xed\xa0\x80", "0123456789" };
+    unsigned seed = 1;
+    for (int round = 0; round < 2000; ++round) {
+        string text;
+        for (int i = 0; i < 30; ++i) {
+            seed = seed * 1103515245 + 12345;
+            unsigned r = (seed >> 16) % 100;
+            text += pieces[r < 97 ? r % 4 + (r % 8 == 7 ? 4 : 0) : 4 + r % 3];
+        }
+        const char* first = text.data();
+        const char* last = first + text.length();
+        for (int level = detail::simd_none; level <= detail::cpu_simd_level(); ++level) {
+            BOOST_CHECK(detail::utf8_validate(first, last, detail::simd_level(level)) == detail::utf8_validate_scalar(first, last));
+            BOOST_CHECK_EQUAL(detail::utf8_count(first, last, detail::simd_level(level)), detail::utf8_count_scalar(first, last));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(utf8_code_points) {
+    u8stref s(u8"naïve €\U0001d11e!");
+    BOOST_CHECK_EQUAL(s.length(), 15u);
+    BOOST_CHECK_EQUAL(utf8_length(s), 9u);
+    vector<char32_t> cps(code_points(s).begin(), code_points(s).end());
+    BOOST_REQUIRE_EQUAL(cps.size(), 9u);
+    BOOST_CHECK(cps[2] == 0xef && cps[6] == 0x20ac && cps[7] == 0x1d11e && cps[8] == '!');
+    vector<char32_t> bad(code_points(stref("a\xff" "b")).begin(), code_points(stref("a\xff" "b")).end());
+    BOOST_CHECK(bad.size() == 3 && bad[1] == 0xfffd);
+
+    BOOST_CHECK(utf8_left(s, 3) == u8stref(u8"naï"));
+    BOOST_CHECK(utf8_right(s, 2) == u8stref(u8"\U0001d11e!"));
+    BOOST_CHECK(utf8_substr(s, 6, 2) == u8stref(u8"€\U0001d11e"));
+    BOOST_CHECK(utf8_substr(s, 8) == u8stref("!"));
+    BOOST_CHECK_EQUAL(utf8_substr(s, 20).length(), 0u);
+    BOOST_CHECK(utf8_left(s, 100) == s && utf8_right(s, 100) == s);
+
+    // long enough for whole blocks to be skipped
+    string text;
+    for (int i = 0; i < 100; ++i)
+        text += i % 3 == 0 ? u8"é" : i % 3 == 1 ? "x" : u8"中";
+    u8stref long_text(text);
+    for (size_t n = 0; n <= 100; n += 7) {
+        BOOST_CHECK_EQUAL(utf8_length(utf8_left(long_text, n)), n);
+        BOOST_CHECK_EQUAL(utf8_length(utf8_right(long_text, n)), n);
+        BOOST_CHECK(utf8_left(long_text, n).length() + utf8_right(long_text, 100 - n).length() == long_text.length());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(utf8_trim_and_case) {
+    u8stref padded(u8"　  text   ");
+    BOOST_CHECK(padded.trim() == u8stref("text"));
+    BOOST_CHECK(padded.trim_left() == u8stref(u8"text   "));
+    BOOST_CHECK(u8stref(u8" é ").trim() == u8stref(u8"é"));
+    // the stref version only trims ASCII white space
+    BOOST_CHECK(stref(u8" x").trim().length() == 3);
+
+    BOOST_CHECK(u8stref(u8"ΣΊΣΥΦΟΣ").iequals(u8stref(u8"σίσυφος")));
+    BOOST_CHECK(u8stref(u8"Straẞe").iequals(u8stref(u8"STRAßE")));
+    BOOST_CHECK(u8stref(u8"K").iequals(u8stref("k")));          // Kelvin sign
+    BOOST_CHECK(u8stref(u8"\U00010400").iequals(u8stref(u8"\U00010428")));
+    BOOST_CHECK(u8stref(u8"café").iless_than(u8stref(u8"CAFÉS")));
+    BOOST_CHECK(u8stref(u8"é").igreater_than(u8stref("E")));
+    BOOST_CHECK(!u8stref("abc").iequals(u8stref("abd")));
+    BOOST_CHECK(u8stref(u8"\u212aELVIN").istarts_with(u8stref(u8"kel")));
+    BOOST_CHECK(u8stref(u8"Ünïcode").iends_with(u8stref(u8"ÏCODE")));
+    BOOST_CHECK(!u8stref(u8"Ünïcode").iends_with(u8stref(u8"xÏCODE")));
+    BOOST_CHECK_EQUAL(u8stref(u8"K" "elvin degrees and then some more").ihash(), u8stref("KELVIN DEGREES AND THEN SOME MORE").ihash());
+    BOOST_CHECK_EQUAL(u8stref(u8"ÉTÉ").ihash(), u8stref(u8"été").ihash());
+    // views of the same bytes with different lengths are not equal
+    // views of the same bytes but of different lengths differ, though their lengths may fold equal
+    const char* sigma = u8"σσσΣ";
+    BOOST_CHECK(!u8stref(sigma, 6).iequals(u8stref(sigma, 4)) && u8stref(sigma, 6).inot_equals(u8stref(sigma, 4)));
+    BOOST_CHECK(u8stref(sigma, 6).icompare(u8stref(sigma, 4)) > 0 && u8stref(sigma, 4).iequals(u8stref(u8"ΣΣ")));
+    BOOST_CHECK(!iequal_to()(u8stref(sigma, 8), u8stref(sigma, 6)));
+
+    // invalid bytes are characters of their own, even stray continuation bytes at the start
+    BOOST_CHECK(u8stref("\x80\x80").icompare(u8stref("\x80\x81")) < 0);
+    BOOST_CHECK(u8stref("\x80\x81").icompare(u8stref("\x80\x80")) > 0);
+    BOOST_CHECK(u8stref("\x80\x80").iequals(u8stref("\x80\x80")));
+    BOOST_CHECK(u8stref("\xbf\x80" u8"É").iequals(u8stref("\xbf\x80" u8"é")));
+    BOOST_CHECK(!u8stref("\x80\xc3").iequals(u8stref("\x80\xc3\xa9")));
+    BOOST_CHECK(u8stref("\xc3\xff" "ABC").iequals(u8stref("\xc3\xff" "abc")));
+    BOOST_CHECK(u8stref("\x80\x80\x80x").icompare(u8stref("\x80\x80\x80y")) < 0);
+}
+
+// UTF-8 <-> UTF-16/UTF-32 at every SIMD level, with surrogates and errors in every block position
+template <typename chT>
+void check_transcoding() {
+    const char32_t chars[] = { 'a', 'Z', 0xe9, 0x3a3, 0x20ac, 0xffff, 0x1d11e, 0x10ffff };
+    unsigned seed = 7;
+    for (int round = 0; round < 300; ++round) {
+        vector<chT> units;
+        std::u32string expected;
+        for (int i = 0; i < 70; ++i) {
+            seed = seed * 1103515245 + 12345;
+            unsigned r = (seed >> 16) % 64;
+            char32_t cp = r < 48 ? char32_t('a' + r % 26) : chars[r % 8];
+            if (r == 63) {
+                units.push_back(chT(0xdc00));    // lone surrogate
+                expected += char32_t(0xfffd);
+                continue;
+            }
+            if (sizeof(chT) == 2 && cp >= 0x10000) {
+                units.push_back(chT(0xd800 + ((cp - 0x10000) >> 10)));
+                units.push_back(chT(0xdc00 + (cp & 0x3ff)));
+            } else {
+                units.push_back(chT(cp));
+            }
+            expected += cp;
+        }
+        for (int level = detail::simd_none; level <= detail::cpu_simd_level(); ++level) {
+            detail::simd_level l = detail::simd_level(level);
+            size_t bytes = detail::encoded_length(units.data(), units.data() + units.size(), l);
+            string utf8(bytes, '\0');
+            BOOST_REQUIRE_EQUAL(size_t(detail::encode_utf8(units.data(), units.data() + units.size(), &utf8[0], l) - &utf8[0]), bytes);
+            std::u32string decoded(code_points(stref(utf8)).begin(), code_points(stref(utf8)).end());
+            BOOST_CHECK(decoded == expected);
+
+            size_t n = detail::decoded_length<chT>(utf8.data(), utf8.data() + utf8.length(), l);
+            vector<chT> back(n);
+            BOOST_REQUIRE_EQUAL(size_t(detail::decode_utf8(utf8.data(), utf8.data() + utf8.length(), back.data(), l) - back.data()), n);
+            vector<chT> repaired(units);
+            for (chT& u : repaired)
+                if ((u & 0xfc00) == 0xdc00 && (&u == repaired.data() || ((&u)[-1] & 0xfc00) != 0xd800))
+                    u = chT(0xfffd);
+            BOOST_CHECK(back == repaired);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(transcode_utf16_utf32) {
+    check_transcoding<char16_t>();
+    check_transcoding<char32_t>();
+
+    // invalid UTF-8 decodes to one U+FFFD per byte
+    const char bad[] = "a\xe2\x82" "b\xff";
+    for (int level = detail::simd_none; level <= detail::cpu_simd_level(); ++level) {
+        char32_t out[8];
+        BOOST_CHECK_EQUAL(detail::decoded_length<char32_t>(bad, bad + 5, detail::simd_level(level)), 5u);
+        BOOST_REQUIRE(detail::decode_utf8(bad, bad + 5, out, detail::simd_level(level)) == out + 5);
+        BOOST_CHECK(out[0] == 'a' && out[1] == 0xfffd && out[2] == 0xfffd && out[3] == 'b' && out[4] == 0xfffd);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(transcode_wide) {
+    stref text(u8"Grüße, 世界 \U0001f600!");
+    size_t n = to_wide_length(text);
+    BOOST_CHECK_EQUAL(n, sizeof(wchar_t) == 2 ? 13u : 12u);
+    vector<wchar_t> buffer(n);
+    wstref wide = to_wide(text, buffer.data());
+    BOOST_CHECK(wide == wstref(L"Grüße, 世界 \U0001f600!"));
+    BOOST_CHECK(to_wide(text) == L"Grüße, 世界 \U0001f600!");
+    BOOST_CHECK_EQUAL(to_utf8_length(wide), text.length());
+    BOOST_CHECK(to_utf8(wide) == string(text));
+
+    wstref_pool wide_pool;
+    stref_pool pool;
+    wstref interned = to_wide(text, wide_pool);
+    BOOST_CHECK(interned == wide && interned.data() == to_wide(u8stref(text.data(), text.length()), wide_pool).data());
+    BOOST_CHECK(to_utf8(wide, pool) == text);
+    BOOST_CHECK(to_wide(stref("")).empty() && to_utf8(wstref(L"")).empty());
+}
+
+// strings of random length over a small alphabet with upper case, signed bytes and embedded nuls,
+// many of them sharing long prefixes
+template <typename chT>
+vector<basic_string<chT>> sort_test_strings(size_t n) {
+    const chT alphabet[] = { 'a', 'A', 'b', 'B', 'z', '0', '\0', chT(0x80), chT(-1), chT(0xdf) };
+    vector<basic_string<chT>> strings;
+    unsigned seed = 12345;
+    for (size_t i = 0; i < n; ++i) {
+        seed = seed * 1103515245 + 12345;
+        basic_string<chT> s(seed >> 16 & 3 ? 0 : 12, chT('p'));
+        seed = seed * 1103515245 + 12345;
+        for (size_t len = seed >> 16 & 31; len > 0; --len) {
+            seed = seed * 1103515245 + 12345;
+            s += alphabet[(seed >> 16) % 10];
+        }
+        strings.push_back(s);
+    }
+    return strings;
+}
+
+template <typename TT>
+void check_sort_strefs(size_t n, thread_pool* pool) {
+    typedef typename TT::char_type chT;
+    typedef basic_stref<TT> bstref;
+    vector<basic_string<chT>> strings = sort_test_strings<chT>(n);
+    vector<bstref> refs(strings.begin(), strings.end());
+    for (sort_case order : { case_sensitive, case_insensitive }) {
+        vector<bstref> expected = refs, sorted = refs;
+        if (order == case_sensitive)
+            sort(expected.begin(), expected.end());
+        else
+            sort(expected.begin(), expected.end(), [](const bstref& a, const bstref& b) { return a.iless_than(b); });
+        if (pool)
+            sort_strefs(*pool, sorted.begin(), sorted.end(), order);
+        else
+            sort_strefs(sorted.begin(), sorted.end(), order);
+        bool same = true;
+        for (size_t i = 0; i < n; ++i)
+            same = same && (order == case_sensitive ? sorted[i] == expected[i] : sorted[i].iequals(expected[i]));
+        BOOST_CHECK(same);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sort_strefs_order) {
+    for (size_t n : { 0, 1, 2, 15, 100, 5000 }) {
+        check_sort_strefs<tools::char_traits>(n, nullptr);
+        check_sort_strefs<wchar_traits>(n, nullptr);
+    }
+    vector<u8stref> words = { u8"\u00c9t\u00e9", u8"\u00e9T\u00c9s", u8"abc", u8"\u00c9T\u00c8" };
+    sort_strefs(words.begin(), words.end(), case_insensitive);
+    BOOST_CHECK(is_sorted(words.begin(), words.end(), [](const u8stref& a, const u8stref& b) { return a.iless_than(b); }));
+}
+
+BOOST_AUTO_TEST_CASE(sort_strefs_parallel) {
+    thread_pool pool(4);
+    check_sort_strefs<tools::char_traits>(200000, &pool);
+    check_sort_strefs<wchar_traits>(100000, &pool);
+    vector<stref> same(50000, stref("one string"));
+    sort_strefs(pool, same.begin(), same.end());
+    BOOST_CHECK(count(same.begin(), same.end(), stref("one string")) == 50000);
+}
+
+BOOST_AUTO_TEST_CASE(prefix_index_lookup) {
+    prefix_index<int> routes;
+    BOOST_CHECK(routes.longest_prefix("/api").value == nullptr);
+    BOOST_CHECK(routes.insert("/api/", 1));
+    BOOST_CHECK(routes.insert("/api/v2/", 2));
+    BOOST_CHECK(routes.insert("/", 3));
+    BOOST_CHECK(routes.insert("/apix", 4));
+    BOOST_CHECK(!routes.insert("/api/", 5));
+    BOOST_CHECK_EQUAL(routes.size(), 4);
+    BOOST_CHECK(routes.find("/api/") && *routes.find("/api/") == 1);
+    BOOST_CHECK(routes.find("/api") == nullptr && routes.find("/api/v") == nullptr && !routes.contains("/API/"));
+    prefix_index<int>::match m = routes.longest_prefix("/api/v2/users");
+    BOOST_CHECK(m.key == "/api/v2/" && *m.value == 2);
+    BOOST_CHECK(*routes.longest_prefix("/api/v1/users").value == 1);
+    BOOST_CHECK(*routes.longest_prefix("/static").value == 3);
+    BOOST_CHECK(routes.longest_prefix("api").value == nullptr);
+    vector<string> keys;
+    routes.for_each("/api", [&](const stref& key, int) { keys.push_back(key); });
+    BOOST_CHECK(keys == vector<string>({ "/api/", "/api/v2/", "/apix" }));
+    keys.clear();
+    routes.for_each("/api/v", [&](const stref& key, int) { keys.push_back(key); });
+    BOOST_CHECK(keys == vector<string>({ "/api/v2/" }));
+    *routes.find("/") = 30;
+    BOOST_CHECK(*routes.longest_prefix("/x").value == 30);
+
+    wprefix_index<int> folded(true);
+    BOOST_CHECK(folded.insert(L"/Api/", 1) && !folded.insert(L"/API/", 2));
+    BOOST_CHECK(folded.longest_prefix(L"/aPI/users").key == L"/Api/");
+    typedef basic_prefix_index<utf8_traits, int> u8prefix_index;
+    BOOST_CHECK_THROW(u8prefix_index(true), bad_stref_op);
+}
+
+// against starts_with() over every key, with enough distinct bytes to grow nodes to 256 children
+BOOST_AUTO_TEST_CASE(prefix_index_random) {
+    for (bool ignore_case : { false, true }) {
+        vector<string> keys;
+        unsigned seed = 7;
+        auto next = [&] { seed = seed * 1103515245 + 12345; return seed >> 16; };
+        for (int i = 0; i < 3000; ++i) {
+            string key(next() % 3 == 0 ? "/Ab" : "");
+            for (size_t len = next() % 6; len > 0; --len)
+                key += static_cast<char>(next() % 4 == 0 ? next() % 256 : "aAbB/"[next() % 5]);
+            keys.push_back(key);
+        }
+        prefix_index<size_t> index(ignore_case);
+        vector<string> unique;
+        for (size_t i = 0; i < keys.size(); ++i) {
+            bool fresh = find_if(unique.begin(), unique.end(), [&](const string& k) {
+                return ignore_case ? stref(k).iequals(keys[i]) : k == keys[i];
+            }) == unique.end();
+            BOOST_CHECK_EQUAL(index.insert(keys[i], i), fresh);
+            if (fresh)
+                unique.push_back(keys[i]);
+        }
+        BOOST_CHECK_EQUAL(index.size(), unique.size());
+        bool same = true;
+        for (int i = 0; i < 2000; ++i) {
+            string s = keys[next() % keys.size()];
+            for (size_t len = next() % 3; len > 0; --len)
+                s += "aB/"[next() % 3];
+            const string* best = nullptr;
+            size_t under = 0;
+            for (const string& k : unique) {
+                if ((ignore_case ? stref(s).istarts_with(k) : stref(s).starts_with(k)) && (!best || k.length() > best->length()))
+                    best = &k;
+                under += ignore_case ? stref(k).istarts_with(s) : stref(k).starts_with(s);
+            }
+            prefix_index<size_t>::match m = index.longest_prefix(s);
+            same = same && (best ? m.value && m.key == *best && keys[*m.value] == *best : !m.value);
+            same = same && (index.find(s) != nullptr) == (best && best->length() == s.length());
+            size_t found = 0;
+            index.for_each(s, [&](const stref& k, size_t) { ++found; same = same && (ignore_case ? k.istarts_with(s) : k.starts_with(s)); });
+            same = same && found == under;
+        }
+        BOOST_CHECK(same);
+        size_t n = 0;
+        index.for_each([&](const stref&, size_t) { ++n; });
+        BOOST_CHECK_EQUAL(n, unique.size());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(pattern_match) {
+    pattern p("GET /api/*/users?id=*");
+    BOOST_CHECK(p.matches("GET /api/v1/users?id=7"));
+    BOOST_CHECK(p.matches("GET /api//users&id="));
+    BOOST_CHECK(!p.matches("GET /api/v1/users"));
+    BOOST_CHECK(!p.matches("get /api/v1/users?id=7"));
+    BOOST_CHECK(pattern("get /API/*", true)("GET /api/v1"));
+    BOOST_CHECK(pattern("[a-c][!0-9]\\*[]x]").matches("bz*]"));
+    BOOST_CHECK(!pattern("[a-c][!0-9]\\*[]x]").matches("b5*x"));
+    BOOST_CHECK(pattern("").matches("") && !pattern("").matches("x") && pattern("*").matches(""));
+    BOOST_CHECK_THROW(pattern("[abc"), bad_stref_op);
+    BOOST_CHECK(wpattern(L"*[\u4e00-\u9fff]?", true).matches(L"ab\u4e16Z"));
+
+    // wide classes fold like iequals() too: the text is folded before it's looked up
+    string locale = setlocale(LC_CTYPE, nullptr);
+    if (setlocale(LC_CTYPE, "C.UTF-8")) {
+        BOOST_CHECK(wstref(L"\u042f").iequals(L"\u044f"));
+        BOOST_CHECK(wpattern(L"[\u042f]", true).matches(L"\u044f") && wpattern(L"[\u042f]", true).matches(L"\u042f"));
+        BOOST_CHECK(wpattern(L"[\u0410-\u042f]", true).matches(L"\u044f") && wpattern(L"[\u0410-\u042f]", true).matches(L"\u042f"));
+        BOOST_CHECK(!wpattern(L"[\u0410-\u042f]", true).matches(L"\u0451"));
+        BOOST_CHECK(wpattern(L"[!\u0410-\u042f]", true).matches(L"\u0451") && !wpattern(L"[!\u0410-\u042f]", true).matches(L"\u0430"));
+        BOOST_CHECK(wpattern(L"x[\u212a]", true).matches(L"Xk") && wpattern(L"[\u0100-\u017f]", true).matches(L"\u0101"));
+        BOOST_CHECK(!wpattern(L"[\u0410-\u042f]").matches(L"\u044f"));
+    }
+    setlocale(LC_CTYPE, locale.c_str());
+
+    // a DFA of 2^12 states, held to 16: the rest is matched by stepping position sets
+    string text(20000, 'a');
+    text[text.length() - 12] = 'b';
+    BOOST_CHECK(pattern("*b???????????", false, 16).matches(text));
+    BOOST_CHECK(!pattern("*b????????????", false, 16).matches(text));
+
+    pattern_set routes({ "GET /api/*", "* /api/v2/*", "POST *", "*" });
+    BOOST_CHECK(routes.matches("GET /api/v2/users") == vector<size_t>({ 0, 1, 3 }));
+    BOOST_CHECK_EQUAL(routes.first_match("POST /login"), 2);
+    BOOST_CHECK_EQUAL(pattern_set({ "a*", "b*" }).first_match("c"), pattern_set::npos);
+}
+
+// against a backtracking matcher, for patterns over a small alphabet
+bool glob_reference(const char* p, const char* pe, const char* s, const char* se) {
+    if (p == pe)
+        return s == se;
+    if (*p == '*')
+        return glob_reference(p + 1, pe, s, se) || (s != se && glob_reference(p, pe, s + 1, se));
+    if (s == se)
+        return false;
+    bool ok;
+    if (*p == '[') {
+        const char* close = find(p + 2, pe, ']');
+        ok = find(p + 1, close, *s) != close;
+        return ok && glob_reference(close + 1, pe, s + 1, se);
+    }
+    ok = *p == '?' || *p == *s;
+    return ok && glob_reference(p + 1, pe, s + 1, se);
+}
+
+BOOST_AUTO_TEST_CASE(pattern_random) {
+    unsigned seed = 99;
+    auto next = [&] { seed = seed * 1103515245 + 12345; return seed >> 16; };
+    vector<string> globs;
+    for (int i = 0; i < 300; ++i) {
+        string glob;
+        for (size_t len = next() % 8; len > 0; --len) {
+            const char* pieces[] = { "a", "b", "*", "?", "[ab]", "[bc]" };
+            glob += pieces[next() % 6];
+        }
+        globs.push_back(glob);
+    }
+    pattern_set all(globs.begin(), globs.end(), false, 64);
+    bool same = true;
+    for (size_t max_states : { 4, 4096 })
+        for (int i = 0; i < 100; ++i) {
+            pattern p(globs[i], false, max_states);
+            for (int j = 0; j < 30; ++j) {
+                string text;
+                for (size_t len = next() % 10; len > 0; --len)
+                    text += "abc"[next() % 3];
+                const string& g = globs[i];
+                same = same && p.matches(text) == glob_reference(g.data(), g.data() + g.length(), text.data(), text.data() + text.length());
+            }
+        }
+    for (int j = 0; j < 200; ++j) {
+        string text;
+        for (size_t len = next() % 10; len > 0; --len)
+            text += "abc"[next() % 3];
+        vector<size_t> expected;
+        for (size_t i = 0; i < globs.size(); ++i)
+            if (glob_reference(globs[i].data(), globs[i].data() + globs[i].length(), text.data(), text.data() + text.length()))
+                expected.push_back(i);
+        same = same && all.matches(text) == expected;
+    }
+    BOOST_CHECK(same);
+}
+
+BOOST_AUTO_TEST_CASE(stref_table_tokens) {
+    string text;
+    for (int i = 0; i < 1000; ++i)
+        text += (i % 7 == 0 ? string() : "field" + to_string(i % 13)) + (i % 50 == 49 ? "\n" : ",");
+    vector<stref> tokens;
+    stref(text).split(',', [&](const stref& token) { tokens.push_back(token); });
+    for (offset_encoding encoding : { fixed_offsets, varint_offsets }) {
+        stref_table table(text, ',', encoding);
+        BOOST_CHECK_EQUAL(table.size(), tokens.size());
+        bool same = true;
+        for (size_t i = 0; i < tokens.size(); ++i)
+            same = same && table[i] == tokens[i] && table[i].data() == tokens[i].data();
+        size_t i = 0;
+        table.for_each([&](const stref& token) { same = same && token.data() == tokens[i++].data(); });
+        BOOST_CHECK(same && i == tokens.size());
+        BOOST_CHECK(table.bytes() < tokens.size() * sizeof(stref) / (encoding == fixed_offsets ? 2 : 4) + 64);
+
+        vector<size_t> empties;
+        for (size_t j = 0; j < tokens.size(); ++j)
+            if (tokens[j].length() == 0)
+                empties.push_back(j);
+        BOOST_CHECK(table.find_all("") == empties);
+        BOOST_CHECK_EQUAL(table.count_equal("field12"), count(tokens.begin(), tokens.end(), stref("field12")));
+        BOOST_CHECK(table.filter([](const stref& t) { return t.ends_with("\nfield1"); }).size() == 2);
+        vector<size_t> hashes = table.hashes();
+        BOOST_CHECK(hashes.size() == tokens.size() && hashes[3] == tokens[3].hash());
+    }
+    BOOST_CHECK_THROW(stref_table(stref(text).left(10)).push_back(stref(text).substr(5, 10)), bad_stref_op);
+    stref_table ordered(text, varint_offsets);
+    ordered.push_back(stref(text).substr(10, 5));
+    BOOST_CHECK_THROW(ordered.push_back(stref(text).substr(12, 5)), bad_stref_op);
+
+    wstring wide(L"alpha beta\tgamma");
+    wstref_table words(wide, is_any_of<wchar_t>(L" \t"));
+    BOOST_CHECK(words.size() == 3 && words.at(2) == L"gamma");
+    BOOST_CHECK_THROW(words.at(3), bad_stref_op);
+}
+
+BOOST_AUTO_TEST_CASE(line_index_lines) {
+    string text;
+    for (int i = 0; i < 5000; ++i)
+        text += (i % 10 == 3 ? string() : "line " + to_string(i)) + (i % 7 == 0 ? "\r\n" : "\n");
+    vector<stref> expected(stref(text).lines().begin(), stref(text).lines().end());
+    thread_pool pool(3);
+    for (size_t sample : { 1, 16, 256 }) {
+        line_index serial(stref(text).left(1234), sample);
+        serial.extend(text);
+        line_index parallel(pool, text, sample);
+        BOOST_CHECK_EQUAL(serial.size(), expected.size());
+        BOOST_CHECK_EQUAL(parallel.size(), expected.size());
+        bool same = true;
+        for (size_t n = 0; n < expected.size(); ++n)
+            same = same && serial.line(n) == expected[n] && parallel.line(n).data() == expected[n].data();
+        BOOST_CHECK(same);
+    }
+    line_index index(text, 64);
+    vector<stref> some(index.lines(998, 1003).begin(), index.lines(998, 1003).end());
+    BOOST_CHECK(some == vector<stref>(expected.begin() + 998, expected.begin() + 1003));
+    BOOST_CHECK(index.lines(4998, 9999).begin() != index.lines(4998, 9999).end());
+    BOOST_CHECK(index.lines(5, 5).begin() == index.lines(5, 5).end());
+    BOOST_CHECK_THROW(index.line(5000), bad_stref_op);
+    BOOST_CHECK_EQUAL(line_index("no newline").size(), 1);
+    BOOST_CHECK_EQUAL(line_index("").size(), 0);
+    BOOST_CHECK_THROW(index.extend("other text"), bad_stref_op);
+
+    // big enough to be scanned in several chunks
+    string numbers;
+    for (int i = 0; i < 200000; ++i)
+        numbers += to_string(i) + "\n";
+    line_index numbered(pool, numbers, 100);
+    BOOST_CHECK_EQUAL(numbered.size(), 200000);
+    BOOST_CHECK(numbered.line(123456) == "123456" && numbered.line(199999) == "199999" && numbered.line(100) == "100");
+}
+
+BOOST_AUTO_TEST_CASE(line_index_saved) {
+    const char* path = "line_index_test.idx";
+    string text;
+    for (int i = 0; i < 3000; ++i)
+        text += "record " + to_string(i) + "\n";
+    line_index(stref(text).left(text.length() / 2), 100).save(path);
+
+    // reopened for the text appended to since: the new lines are indexed too
+    line_index reopened(text, path);
+    BOOST_CHECK_EQUAL(reopened.size(), 3000);
+    BOOST_CHECK(reopened.line(2999) == "record 2999" && reopened.line(10) == "record 10");
+    BOOST_CHECK_EQUAL(reopened.sample_interval(), 100);
+
+    line_index(text, 100).save(path);
+    line_index same(text, path);
+    BOOST_CHECK(same.line(1500) == "record 1500" && same.indexed().length() == text.length());
+    string other(text);
+    other[5] = 'X';
+    BOOST_CHECK_THROW(line_index(other, path), bad_stref_op);
+    remove(path);
+    BOOST_CHECK_THROW(line_index(text, "no such index"), std::system_error);
+}
+
+namespace {
+    template <typename chT>
+    size_t reference_distance(const basic_string<chT>& a, const basic_string<chT>& b) {
+        vector<size_t> row(b.length() + 1);
+        for (size_t j = 0; j <= b.length(); ++j)
+            row[j] = j;
+        for (size_t i = 1; i <= a.length(); ++i) {
+            size_t diagonal = row[0];
+            row[0] = i;
+            for (size_t j = 1; j <= b.length(); ++j) {
+                size_t d = min(diagonal + (a[i - 1] != b[j - 1] ? 1 : 0), min(row[j], row[j - 1]) + 1);
+                diagonal = row[j];
+                row[j] = d;
+            }
+        }
+        return row[b.length()];
+    }
+
+    // a random edit of s within an alphabet of 4 letters
+    string mutated(string s, int edits) {
+        for (int e = 0; e < edits; ++e) {
+            size_t at = s.empty() ? 0 : rand() % (s.length() + 1);
+            char c = "acgt"[rand() % 4];
+            switch (rand() % 3) {
+                case 0: s.insert(at, 1, c); break;
+                case 1: if (at < s.length()) s.erase(at, 1); break;
+                default: if (at < s.length()) s[at] = c; break;
+            }
+        }
+        return s;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(edit_distance_bounds) {
+    srand(25);
+    bool same = true;
+    vector<string> words;
+    for (int i = 0; i < 400; ++i) {
+        string base;
+        size_t length = i % 4 == 0 ? rand() % 150 : rand() % 70;
+        for (size_t j = 0; j < length; ++j)
+            base += "acgt"[rand() % 4];
+        string other = mutated(base, rand() % 12);
+        size_t d = reference_distance(base, other);
+        words.push_back(other);
+        same = same && edit_distance(stref(base), stref(other)) == d;
+        for (size_t k : { 0, 2, 5, 9 }) {
+            size_t bounded = edit_distance(stref(base), stref(other), k);
+            same = same && bounded == (d > k ? k + 1 : d) && within_distance(stref(base), stref(other), k) == (d <= k);
+        }
+    }
+    BOOST_CHECK(same);
+    BOOST_CHECK_EQUAL(edit_distance(stref("kitten"), stref("sitting")), 3);
+    BOOST_CHECK_EQUAL(edit_distance(stref(""), stref("abc")), 3);
+    BOOST_CHECK_EQUAL(edit_distance(wstref(L"été 中"), wstref(L"ete 中文")), 3);
+
+    // one query against many, four at a time where the cpu allows
+    vector<stref> srefs(words.begin(), words.end());
+    for (size_t q = 0; q < 40; ++q) {
+        string query = mutated(words[q], 3);
+        for (size_t k : { size_t(4), size_t(20), size_t(500) }) {
+            for (int level = detail::simd_none; level <= detail::cpu_simd_level(); ++level) {
+                vector<size_t> out(words.size());
+                vector<const char*> texts;
+                vector<size_t> lengths;
+                for (const string& w : words) {
+                    texts.push_back(w.data());
+                    lengths.push_back(w.length());
+                }
+                if (query.length() > 0 && query.length() <= 64)
+                    detail::myers_distances(query.data(), query.length(), texts.data(), lengths.data(), texts.size(), out.data(),
+                                            k, static_cast<detail::simd_level>(level));
+                else
+                    out = edit_distances(stref(query), srefs.begin(), srefs.end(), k);
+                for (size_t i = 0; i < words.size(); ++i) {
+                    size_t d = reference_distance(query, words[i]);
+                    same = same && out[i] == (d > k ? k + 1 : d);
+                }
+            }
+        }
+        vector<size_t> all = edit_distances(stref(query), srefs.begin(), srefs.end());
+        for (size_t i = 0; i < words.size(); ++i)
+            same = same && all[i] == reference_distance(query, words[i]);
+    }
+    BOOST_CHECK(same);
+}
+
+BOOST_AUTO_TEST_CASE(edit_distance_find) {
+    srand(52);
+    bool same = true;
+    for (int i = 0; i < 300; ++i) {
+        string text;
+        for (size_t j = 0, n = rand() % 300; j < n; ++j)
+            text += "acgt"[rand() % 4];
+        string needle;
+        for (size_t j = 0, n = 1 + (i % 3 == 0 ? rand() % 90 : rand() % 12); j < n; ++j)
+            needle += "acgt"[rand() % 4];
+        if (i % 2 == 0 && text.length() > needle.length())
+            text.replace(rand() % (text.length() - needle.length()), needle.length(), mutated(needle, 2));
+        size_t k = rand() % 4, start = text.empty() ? 0 : rand() % text.length();
+        approximate_match found = find_approximate(stref(text), stref(needle), k, start);
+
+        // the first end of a close enough substring, and the closest (then shortest) ending there
+        approximate_match expected = { stref::npos, 0, 0 };
+        for (size_t end = start; end <= text.length() && expected.offset == stref::npos; ++end) {
+            size_t best = k + 1;
+            for (size_t s = end + 1; s-- > start; ) {
+                size_t d = reference_distance(needle, text.substr(s, end - s));
+                if (d < best) {
+                    best = d;
+                    expected.offset = s;
+                    expected.length = end - s;
+                    expected.distance = d;
+                }
+            }
+        }
+        same = same && found.offset == expected.offset &&
+            (found.offset == stref::npos || (found.length == expected.length && found.distance == expected.distance));
+    }
+    BOOST_CHECK(same);
+    approximate_match m = find_approximate(stref("Mozilla/5.0 (Windows NT 10.0; Win64; x64)"), stref("Windos NT"), 1);
+    BOOST_CHECK(m.offset == 13 && m.length == 10 && m.distance == 1);
+    BOOST_CHECK_EQUAL(find_approximate(stref("abcdef"), stref("xyz"), 1).offset, stref::npos);
+    BOOST_CHECK_EQUAL(find_approximate(wstref(L"中文字"), wstref(L"文存"), 1).offset, 1);
+}
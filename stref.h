@@ -27,12 +27,66 @@
 #define STREF_H
 
 #include <cctype>
+#include <cfloat>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <cwctype>
 
 #include <algorithm>
+#include <cstddef>
 #include <functional>
 #include <iostream>
+#include <iterator>
+#include <limits>
 #include <string>
+#include <type_traits>
+#include <utility>
+
+// SIMD kernels are selected at runtime on x86/x64; define STREF_NO_SIMD to use the portable code only
+#if !defined(STREF_NO_SIMD)
+#   if defined(__GNUC__) && defined(__x86_64__)
+#       define STREF_X86 1
+#       define STREF_TARGET(isa) __attribute__((target(isa)))
+#       include <immintrin.h>
+#   elif defined(_MSC_VER) && defined(_M_X64)
+#       define STREF_X86 1
+#       define STREF_TARGET(isa)
+#       include <immintrin.h>
+#   endif
+#endif
+
+#if defined(_MSC_VER)
+#   include <intrin.h>
+#endif
+
+#if defined(_MSC_VER) || (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#   define STREF_LITTLE_ENDIAN 1
+#endif
+
+// C++14 relaxed constexpr: construction, comparison, substrings and trimming work at compile time
+// STREF_CONSTANT_EVALUATED() is true during constant evaluation, where the vector kernels can't be used
+// (always false if the compiler can't tell)
+#if (defined(__cpp_constexpr) && __cpp_constexpr >= 201304) || (defined(_MSC_VER) && _MSC_VER >= 1910)
+#   define STREF_CONSTEXPR constexpr
+#   if (defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 9) || (defined(__clang__) && __clang_major__ >= 9) || (defined(_MSC_VER) && _MSC_VER >= 1925)
+#       define STREF_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#   endif
+#else
+#   define STREF_CONSTEXPR
+#endif
+
+#if !defined(STREF_CONSTANT_EVALUATED)
+#   define STREF_CONSTANT_EVALUATED() false
+#endif
+
+// define STREF_STATS to count the calls, bytes and tokens of each operation (see stref_stats.h)
+#if defined(STREF_STATS)
+#   include "stref_stats.h"
+#   define STREF_COUNT(op, bytes, tokens) (STREF_CONSTANT_EVALUATED() ? (void)0 : ::tools::detail::count_op(::tools::op, (bytes), (tokens)))
+#else
+#   define STREF_COUNT(op, bytes, tokens) ((void)0)
+#endif
 
 namespace tools {
 
@@ -43,27 +97,1818 @@ namespace tools {
         bad_stref_op(const char* msg) : std::exception(), msg(msg) {}
         const char* what() { return msg; }
 
-    private:
-        const char* msg;
-    };
+    private:
+        const char* msg;
+    };
+
+    // char traits (ASCII characters are handled inline, the locale is only consulted for the others)
+    class char_traits
+    {
+    public:
+        typedef char char_type;
+
+        static STREF_CONSTEXPR char to_lower_case(char ch) {
+            return ch >= 'A' && ch <= 'Z' ? static_cast<char>(ch + ('a' - 'A'))
+                : static_cast<unsigned char>(ch) < 0x80 ? ch
+                : static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+        }
+
+        static STREF_CONSTEXPR bool is_whitespace(char ch) {
+            return ch == ' ' || (ch >= '\t' && ch <= '\r')
+                || (static_cast<unsigned char>(ch) >= 0x80 && std::isspace(static_cast<unsigned char>(ch)));
+        }
+    };
+
+    // wchar_t traits
+    class wchar_traits
+    {
+    public:
+        typedef wchar_t char_type;
+
+        static STREF_CONSTEXPR wchar_t to_lower_case(wchar_t ch) {
+            return ch >= L'A' && ch <= L'Z' ? static_cast<wchar_t>(ch + (L'a' - L'A'))
+                : (ch >= 0 && ch < 0x80) ? ch
+                : static_cast<wchar_t>(std::towlower(ch));
+        }
+
+        static STREF_CONSTEXPR bool is_whitespace(wchar_t ch) {
+            return ch == L' ' || (ch >= L'\t' && ch <= L'\r') || ((ch < 0 || ch >= 0x80) && std::iswspace(ch));
+        }
+    };
+
+    template <typename chT> class is_any_of;
+    template <typename TT, typename Match> class basic_split_range;
+    template <typename TT> class basic_searcher;
+    template <typename TT> class basic_find_range;
+    template <typename TT> class basic_line_range;
+
+    // what split_range() and rsplit_range() do with empty tokens
+    enum empty_tokens { keep_empty, skip_empty };
+
+    // number conversion results, see basic_stref::try_parse()
+    enum parse_error { no_error, invalid_number, number_out_of_range };
+
+    template <typename T>
+    struct parse_result
+    {
+        T value;
+        parse_error error;
+
+        explicit operator bool() const { return error == no_error; }
+    };
+
+    //
+    // implementation details: character search kernels
+    //
+
+    namespace detail {
+
+        // instruction set levels, in increasing order of capability
+        enum simd_level { simd_none, simd_sse2, simd_ssse3, simd_avx2 };
+
+        inline simd_level detect_simd_level() {
+#if defined(STREF_X86) && defined(_MSC_VER)
+            int info[4];
+            __cpuid(info, 0);
+            int max_leaf = info[0];
+            __cpuid(info, 1);
+            bool ssse3 = (info[2] & (1 << 9)) != 0;
+            bool avx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0;
+            bool avx2 = false;
+            if (max_leaf >= 7 && avx && (_xgetbv(0) & 6) == 6) {
+                __cpuidex(info, 7, 0);
+                avx2 = (info[1] & (1 << 5)) != 0;
+            }
+            return avx2 ? simd_avx2 : ssse3 ? simd_ssse3 : simd_sse2;
+#elif defined(STREF_X86)
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2")) return simd_avx2;
+            if (__builtin_cpu_supports("ssse3")) return simd_ssse3;
+            return simd_sse2;
+#else
+            return simd_none;
+#endif
+        }
+
+        // the best instruction set level supported by this cpu (detected once)
+        inline simd_level cpu_simd_level() {
+            static const simd_level level = detect_simd_level();
+            return level;
+        }
+
+        // traits whose to_lower_case() agrees with plain ASCII case folding for ASCII characters
+        template <typename TT> struct ascii_case_folding : std::false_type {};
+        template <> struct ascii_case_folding<char_traits> : std::true_type {};
+        template <> struct ascii_case_folding<wchar_traits> : std::true_type {};
+
+        // index of the lowest/highest set bit (v != 0)
+        inline unsigned lowest_bit(unsigned v) {
+#if defined(_MSC_VER)
+            unsigned long i;
+            _BitScanForward(&i, v);
+            return i;
+#else
+            return __builtin_ctz(v);
+#endif
+        }
+
+        inline unsigned highest_bit(unsigned v) {
+#if defined(_MSC_VER)
+            unsigned long i;
+            _BitScanReverse(&i, v);
+            return i;
+#else
+            return 31 - __builtin_clz(v);
+#endif
+        }
+
+        inline unsigned lowest_bit64(std::uint64_t v) {
+#if defined(_MSC_VER) && defined(_M_X64)
+            unsigned long i;
+            _BitScanForward64(&i, v);
+            return i;
+#elif defined(_MSC_VER)
+            unsigned lo = static_cast<unsigned>(v);
+            return lo != 0 ? lowest_bit(lo) : 32 + lowest_bit(static_cast<unsigned>(v >> 32));
+#else
+            return __builtin_ctzll(v);
+#endif
+        }
+
+        // code unit value used to index character set tables
+        inline unsigned long code_unit(char ch) { return static_cast<unsigned char>(ch); }
+        template <typename chT> unsigned long code_unit(chT ch) { return static_cast<unsigned long>(ch); }
+
+        // set of characters, with a bitmap for code units < 256 and nibble tables for the shuffle kernels
+        template <typename chT>
+        class char_set
+        {
+        public:
+            char_set(const chT* first, const chT* last) : wide_first(first), wide_last(last), has_high(false), has_wide(false) {
+                std::fill(bits, bits + 8, 0u);
+                std::fill(lo_ascii, lo_ascii + 16, 0);
+                std::fill(lo_high, lo_high + 16, 0);
+                for (const chT* p = first; p != last; ++p) {
+                    unsigned long u = code_unit(*p);
+                    if (u >= 256) {
+                        has_wide = true;
+                        continue;
+                    }
+                    bits[u >> 5] |= 1u << (u & 31);
+                    if (u < 128)
+                        lo_ascii[u & 15] |= static_cast<unsigned char>(1u << (u >> 4));
+                    else {
+                        lo_high[u & 15] |= static_cast<unsigned char>(1u << ((u >> 4) - 8));
+                        has_high = true;
+                    }
+                }
+            }
+
+            bool contains(chT ch) const {
+                unsigned long u = code_unit(ch);
+                if (u < 256)
+                    return ((bits[u >> 5] >> (u & 31)) & 1) != 0;
+                return has_wide && std::find(wide_first, wide_last, ch) != wide_last;
+            }
+
+            // lo_ascii[n] has bit h set if (h << 4 | n) is in the set, lo_high[n] the same for h - 8
+            unsigned char lo_ascii[16];
+            unsigned char lo_high[16];
+
+            const chT* wide_first;      // the original set, searched for code units >= 256
+            const chT* wide_last;
+            unsigned bits[8];
+            bool has_high;              // any members in 0x80..0xff
+            bool has_wide;              // any members >= 0x100
+        };
+
+        // true if F can be called with a chT and returns something testable (is_any_of has its own overloads)
+        template <typename F, typename chT>
+        class is_char_predicate
+        {
+        private:
+            template <typename G>
+            static auto test(int) -> decltype(static_cast<bool>(std::declval<G&>()(std::declval<chT>())), std::true_type());
+            template <typename G>
+            static std::false_type test(...);
+
+            template <typename G> struct is_set : std::false_type {};
+            template <typename G> struct is_set< is_any_of<G> > : std::true_type {};
+
+        public:
+            static const bool value = decltype(test<F>(0))::value && !is_set<F>::value;
+        };
+
+        //
+        // hashing (wyhash)
+        //
+
+        inline std::uint64_t wymix(std::uint64_t a, std::uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+            __extension__ typedef unsigned __int128 product;
+            product r = static_cast<product>(a) * b;
+            return static_cast<std::uint64_t>(r) ^ static_cast<std::uint64_t>(r >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+            std::uint64_t hi, lo = _umul128(a, b, &hi);
+            return lo ^ hi;
+#else
+            std::uint64_t ha = a >> 32, hb = b >> 32, la = a & 0xffffffffu, lb = b & 0xffffffffu;
+            std::uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+            std::uint64_t t = rl + (rm0 << 32), c = t < rl;
+            std::uint64_t lo = t + (rm1 << 32);
+            c += lo < t;
+            return lo ^ (rh + (rm0 >> 32) + (rm1 >> 32) + c);
+#endif
+        }
+
+        inline std::uint64_t read64(const unsigned char* p) { std::uint64_t v; std::memcpy(&v, p, 8); return v; }
+        inline std::uint64_t read32(const unsigned char* p) { std::uint32_t v; std::memcpy(&v, p, 4); return v; }
+
+        static const std::uint64_t hash_secret[4] = {
+            0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull
+        };
+
+        inline std::uint64_t hash_bytes(const void* data, size_t len, std::uint64_t seed = 0) {
+            const unsigned char* p = static_cast<const unsigned char*>(data);
+            const std::uint64_t* s = hash_secret;
+            std::uint64_t a, b;
+            seed ^= wymix(seed ^ s[0], s[1]);
+            if (len <= 16) {
+                if (len >= 4) {
+                    a = (read32(p) << 32) | read32(p + ((len >> 3) << 2));
+                    b = (read32(p + len - 4) << 32) | read32(p + len - 4 - ((len >> 3) << 2));
+                } else if (len > 0) {
+                    a = (static_cast<std::uint64_t>(p[0]) << 16) | (static_cast<std::uint64_t>(p[len >> 1]) << 8) | p[len - 1];
+                    b = 0;
+                } else
+                    a = b = 0;
+            } else {
+                size_t i = len;
+                if (i > 48) {
+                    std::uint64_t see1 = seed, see2 = seed;
+                    do {
+                        seed = wymix(read64(p) ^ s[1], read64(p + 8) ^ seed);
+                        see1 = wymix(read64(p + 16) ^ s[2], read64(p + 24) ^ see1);
+                        see2 = wymix(read64(p + 32) ^ s[3], read64(p + 40) ^ see2);
+                        p += 48;
+                        i -= 48;
+                    } while (i > 48);
+                    seed ^= see1 ^ see2;
+                }
+                for (; i > 16; i -= 16, p += 16)
+                    seed = wymix(read64(p) ^ s[1], read64(p + 8) ^ seed);
+                a = read64(p + i - 16);
+                b = read64(p + i - 8);
+            }
+            return wymix(s[1] ^ len, wymix(a ^ s[1], b ^ seed));
+        }
+
+        // ASCII lower case of 8 ASCII bytes at once
+        inline std::uint64_t ascii_lower8(std::uint64_t w) {
+            const std::uint64_t ones = 0x0101010101010101ull;
+            std::uint64_t upper = (w + (0x80 - 'A') * ones) & ~(w + (0x80 - 'Z' - 1) * ones) & (0x80 * ones);
+            return w | (upper >> 2);
+        }
+
+        // code unit folded the way icompare() folds it
+        template <typename TT>
+        typename TT::char_type fold_case(typename TT::char_type ch) {
+            unsigned long u = code_unit(ch);
+            if (ascii_case_folding<TT>::value && u < 128)
+                return u - 'A' < 26 ? static_cast<typename TT::char_type>(u + ('a' - 'A')) : ch;
+            return TT::to_lower_case(ch);
+        }
+
+        // hash of the case folded string: agrees with icompare(), folds 16 bytes at a time
+        template <typename TT>
+        std::uint64_t ihash_units(const typename TT::char_type* p, size_t n) {
+            typedef typename TT::char_type chT;
+            const size_t per_block = 16 / sizeof(chT);
+            const std::uint64_t high_bits = 0x8080808080808080ull;
+            std::uint64_t state = hash_secret[0] ^ wymix(hash_secret[0], hash_secret[1]);
+            unsigned char block[16];
+            for (size_t i = 0; i < n; i += per_block) {
+                size_t count = std::min(per_block, n - i);
+                std::memset(block, 0, sizeof(block));
+                std::memcpy(block, p + i, count * sizeof(chT));
+                std::uint64_t a = read64(block), b = read64(block + 8);
+                if (sizeof(chT) == 1 && ascii_case_folding<TT>::value && ((a | b) & high_bits) == 0) {
+                    a = ascii_lower8(a);
+                    b = ascii_lower8(b);
+                } else {
+                    chT folded[per_block];
+                    for (size_t j = 0; j < count; ++j)
+                        folded[j] = fold_case<TT>(p[i + j]);
+                    std::memcpy(block, folded, count * sizeof(chT));
+                    a = read64(block);
+                    b = read64(block + 8);
+                }
+                state = wymix(a ^ hash_secret[1], b ^ state);
+            }
+            return wymix(hash_secret[1] ^ n, wymix(state ^ hash_secret[2], hash_secret[3]));
+        }
+
+        //
+        // portable kernels
+        //
+
+        template <typename chT>
+        const chT* find_char_scalar(const chT* first, const chT* last, chT ch) {
+            for (; first != last; ++first)
+                if (*first == ch)
+                    return first;
+            return last;
+        }
+
+        template <typename chT>
+        const chT* rfind_char_scalar(const chT* first, const chT* last, chT ch) {
+            for (const chT* p = last; p != first; --p)
+                if (p[-1] == ch)
+                    return p - 1;
+            return last;
+        }
+
+        // index of the first code unit that differs, n if none do
+        template <typename chT>
+        STREF_CONSTEXPR size_t mismatch_scalar(const chT* a, const chT* b, size_t n) {
+            size_t i = 0;
+            while (i < n && a[i] == b[i])
+                ++i;
+            return i;
+        }
+
+        // index of the first code unit that differs after ASCII case folding, or that is not ASCII
+        template <typename chT>
+        size_t ascii_imismatch_scalar(const chT* a, const chT* b, size_t n) {
+            for (size_t i = 0; i < n; ++i) {
+                unsigned long c1 = code_unit(a[i]), c2 = code_unit(b[i]);
+                if (c1 >= 128 || c2 >= 128)
+                    return i;
+                if (c1 - 'A' < 26) c1 += 'a' - 'A';
+                if (c2 - 'A' < 26) c2 += 'a' - 'A';
+                if (c1 != c2)
+                    return i;
+            }
+            return n;
+        }
+
+        template <typename chT>
+        const chT* find_any_scalar(const chT* first, const chT* last, const char_set<chT>& set) {
+            for (; first != last; ++first)
+                if (set.contains(*first))
+                    return first;
+            return last;
+        }
+
+        // substring search for needles of length m >= 2: candidates must match the needle's first
+        // and last characters before the rest is compared; returns the match index or n
+        template <typename chT>
+        bool matches_inner(const chT* h, const chT* needle, size_t m) {
+            return std::memcmp(h + 1, needle + 1, (m - 2) * sizeof(chT)) == 0;
+        }
+
+        template <typename chT>
+        size_t find_pair_scalar(const chT* h, size_t n, const chT* needle, size_t m) {
+            for (size_t i = 0; n >= m && i <= n - m; ++i)
+                if (h[i] == needle[0] && h[i + m - 1] == needle[m - 1] && matches_inner(h + i, needle, m))
+                    return i;
+            return n;
+        }
+
+        // the same, for candidates in [0, end), last one first
+        template <typename chT>
+        size_t rfind_pair_scalar(const chT* h, size_t n, const chT* needle, size_t m, size_t end) {
+            for (size_t i = end; i > 0; --i)
+                if (h[i - 1] == needle[0] && h[i + m - 2] == needle[m - 1] && matches_inner(h + i - 1, needle, m))
+                    return i - 1;
+            return n;
+        }
+
+        // Crochemore-Perrin two-way string matching, linear in the length of the haystack
+        // with a bad character shift (by code unit & 0xff) to skip ahead on mismatches
+        template <typename chT>
+        class two_way
+        {
+        public:
+            two_way() : needle(0), l(0) {}
+
+            two_way(const chT* needle, size_t l) : needle(needle), l(l) {
+                std::fill(bytes, bytes + 8, 0u);
+                for (size_t i = 0; i < l; ++i) {
+                    unsigned long c = code_unit(needle[i]) & 0xff;
+                    bytes[c >> 5] |= 1u << (c & 31);
+                    shift[c] = i + 1;
+                }
+
+                // critical factorization: the larger of the maximal suffixes for both orderings
+                size_t p0, p;
+                ms = maximal_suffix(false, p0);
+                size_t ms2 = maximal_suffix(true, p);
+                if (ms2 + 1 > ms + 1)
+                    ms = ms2;
+                else
+                    p = p0;
+
+                if (std::equal(needle, needle + ms + 1, needle + p)) {
+                    period = p;         // periodic needle: remember how much of it is known to match
+                    mem0 = l - p;
+                } else {
+                    period = std::max(ms, l - ms - 1) + 1;
+                    mem0 = 0;
+                }
+            }
+
+            // index of the first match in h[0, n), n if there is none (l > 0)
+            size_t search(const chT* h, size_t n) const {
+                const chT* first = h;
+                size_t mem = 0;
+                while (static_cast<size_t>(first + n - h) >= l) {
+                    unsigned long c = code_unit(h[l - 1]) & 0xff;
+                    if (((bytes[c >> 5] >> (c & 31)) & 1) == 0) {
+                        h += l;
+                        mem = 0;
+                        continue;
+                    }
+                    size_t k = l - shift[c];
+                    if (k != 0) {
+                        h += std::max(k, mem);
+                        mem = 0;
+                        continue;
+                    }
+                    // compare the right half, then the left half
+                    for (k = std::max(ms + 1, mem); k < l && needle[k] == h[k]; ++k)
+                        ;
+                    if (k < l) {
+                        h += k - ms;
+                        mem = 0;
+                        continue;
+                    }
+                    for (k = ms + 1; k > mem && needle[k - 1] == h[k - 1]; --k)
+                        ;
+                    if (k <= mem)
+                        return h - first;
+                    h += period;
+                    mem = mem0;
+                }
+                return n;
+            }
+
+        private:
+            // start of the maximal suffix (minus one, may wrap to -1) and its period
+            size_t maximal_suffix(bool reversed, size_t& p) const {
+                size_t ip = size_t(-1), jp = 0, k = 1;
+                p = 1;
+                while (jp + k < l) {
+                    unsigned long a = code_unit(needle[ip + k]), b = code_unit(needle[jp + k]);
+                    if (a == b) {
+                        if (k == p) {
+                            jp += p;
+                            k = 1;
+                        } else
+                            ++k;
+                    } else if (reversed ? a < b : a > b) {
+                        jp += k;
+                        k = 1;
+                        p = jp - ip;
+                    } else {
+                        ip = jp++;
+                        k = p = 1;
+                    }
+                }
+                return ip;
+            }
+
+            const chT* needle;
+            size_t l;           // needle length
+            size_t ms;          // critical position - 1
+            size_t period;      // shift after a full match attempt
+            size_t mem0;        // length known to match after shifting by the period
+            unsigned bytes[8];  // code units (& 0xff) present in the needle
+            size_t shift[256];  // 1 + last position of each code unit (& 0xff) in the needle
+        };
+
+#if defined(STREF_X86)
+        //
+        // SSE2/SSSE3/AVX2 kernels
+        //
+
+        // per code unit width comparisons
+        template <size_t W> struct simd_ops;
+
+        template <> struct simd_ops<1> {
+            STREF_TARGET("sse2") static __m128i splat(int v) { return _mm_set1_epi8(static_cast<char>(v)); }
+            STREF_TARGET("sse2") static __m128i eq(__m128i a, __m128i b) { return _mm_cmpeq_epi8(a, b); }
+            STREF_TARGET("avx2") static __m256i splat256(int v) { return _mm256_set1_epi8(static_cast<char>(v)); }
+            STREF_TARGET("avx2") static __m256i eq256(__m256i a, __m256i b) { return _mm256_cmpeq_epi8(a, b); }
+            STREF_TARGET("sse2") static __m128i gt(__m128i a, __m128i b) { return _mm_cmpgt_epi8(a, b); }
+            STREF_TARGET("avx2") static __m256i gt256(__m256i a, __m256i b) { return _mm256_cmpgt_epi8(a, b); }
+        };
+
+        template <> struct simd_ops<2> {
+            STREF_TARGET("sse2") static __m128i splat(int v) { return _mm_set1_epi16(static_cast<short>(v)); }
+            STREF_TARGET("sse2") static __m128i eq(__m128i a, __m128i b) { return _mm_cmpeq_epi16(a, b); }
+            STREF_TARGET("avx2") static __m256i splat256(int v) { return _mm256_set1_epi16(static_cast<short>(v)); }
+            STREF_TARGET("avx2") static __m256i eq256(__m256i a, __m256i b) { return _mm256_cmpeq_epi16(a, b); }
+            STREF_TARGET("sse2") static __m128i gt(__m128i a, __m128i b) { return _mm_cmpgt_epi16(a, b); }
+            STREF_TARGET("avx2") static __m256i gt256(__m256i a, __m256i b) { return _mm256_cmpgt_epi16(a, b); }
+        };
+
+        template <> struct simd_ops<4> {
+            STREF_TARGET("sse2") static __m128i splat(int v) { return _mm_set1_epi32(v); }
+            STREF_TARGET("sse2") static __m128i eq(__m128i a, __m128i b) { return _mm_cmpeq_epi32(a, b); }
+            STREF_TARGET("avx2") static __m256i splat256(int v) { return _mm256_set1_epi32(v); }
+            STREF_TARGET("avx2") static __m256i eq256(__m256i a, __m256i b) { return _mm256_cmpeq_epi32(a, b); }
+            STREF_TARGET("sse2") static __m128i gt(__m128i a, __m128i b) { return _mm_cmpgt_epi32(a, b); }
+            STREF_TARGET("avx2") static __m256i gt256(__m256i a, __m256i b) { return _mm256_cmpgt_epi32(a, b); }
+        };
+
+        template <typename chT>
+        STREF_TARGET("sse2") const chT* find_char_sse2(const chT* first, const chT* last, chT ch) {
+            typedef simd_ops<sizeof(chT)> ops;
+            const size_t step = 16 / sizeof(chT);
+            const __m128i needle = ops::splat(static_cast<int>(ch));
+            for (; static_cast<size_t>(last - first) >= step; first += step) {
+                __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+                unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(ops::eq(block, needle)));
+                if (mask != 0)
+                    return first + lowest_bit(mask) / sizeof(chT);
+            }
+            return find_char_scalar(first, last, ch);
+        }
+
+        template <typename chT>
+        STREF_TARGET("avx2") const chT* find_char_avx2(const chT* first, const chT* last, chT ch) {
+            typedef simd_ops<sizeof(chT)> ops;
+            const size_t step = 32 / sizeof(chT);
+            const __m256i needle = ops::splat256(static_cast<int>(ch));
+            for (; static_cast<size_t>(last - first) >= step; first += step) {
+                __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first));
+                unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(ops::eq256(block, needle)));
+                if (mask != 0)
+                    return first + lowest_bit(mask) / sizeof(chT);
+            }
+            return find_char_scalar(first, last, ch);
+        }
+
+        template <typename chT>
+        STREF_TARGET("sse2") const chT* rfind_char_sse2(const chT* first, const chT* last, chT ch) {
+            typedef simd_ops<sizeof(chT)> ops;
+            const size_t step = 16 / sizeof(chT);
+            const __m128i needle = ops::splat(static_cast<int>(ch));
+            const chT* end = last;
+            for (; static_cast<size_t>(last - first) >= step; ) {
+                last -= step;
+                __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(last));
+                unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(ops::eq(block, needle)));
+                if (mask != 0)
+                    return last + highest_bit(mask) / sizeof(chT);
+            }
+            const chT* p = rfind_char_scalar(first, last, ch);
+            return p != last ? p : end;
+        }
+
+        template <typename chT>
+        STREF_TARGET("avx2") const chT* rfind_char_avx2(const chT* first, const chT* last, chT ch) {
+            typedef simd_ops<sizeof(chT)> ops;
+            const size_t step = 32 / sizeof(chT);
+            const __m256i needle = ops::splat256(static_cast<int>(ch));
+            const chT* end = last;
+            for (; static_cast<size_t>(last - first) >= step; ) {
+                last -= step;
+                __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(last));
+                unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(ops::eq256(block, needle)));
+                if (mask != 0)
+                    return last + highest_bit(mask) / sizeof(chT);
+            }
+            const chT* p = rfind_char_scalar(first, last, ch);
+            return p != last ? p : end;
+        }
+
+        // nibble table lookup: a byte is in the set if lo_table[low nibble] & hi_table[high nibble] != 0
+        STREF_TARGET("ssse3") inline const char* find_any_ssse3(const char* first, const char* last, const char_set<char>& set) {
+            const __m128i lo_ascii = _mm_loadu_si128(reinterpret_cast<const __m128i*>(set.lo_ascii));
+            const __m128i lo_high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(set.lo_high));
+            const __m128i hi_ascii = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0);
+            const __m128i hi_high = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 4, 8, 16, 32, 64, -128);
+            const __m128i nibble = _mm_set1_epi8(0x0f);
+            const __m128i zero = _mm_setzero_si128();
+            for (; last - first >= 16; first += 16) {
+                __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+                __m128i lo = _mm_and_si128(block, nibble);
+                __m128i hi = _mm_and_si128(_mm_srli_epi16(block, 4), nibble);
+                __m128i hits = _mm_and_si128(_mm_shuffle_epi8(lo_ascii, lo), _mm_shuffle_epi8(hi_ascii, hi));
+                if (set.has_high)
+                    hits = _mm_or_si128(hits, _mm_and_si128(_mm_shuffle_epi8(lo_high, lo), _mm_shuffle_epi8(hi_high, hi)));
+                unsigned mask = ~static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(hits, zero))) & 0xffff;
+                if (mask != 0)
+                    return first + lowest_bit(mask);
+            }
+            return find_any_scalar(first, last, set);
+        }
+
+        STREF_TARGET("avx2") inline const char* find_any_avx2(const char* first, const char* last, const char_set<char>& set) {
+            const __m256i lo_ascii = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(set.lo_ascii)));
+            const __m256i lo_high = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(set.lo_high)));
+            const __m256i hi_ascii = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0,
+                                                      1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0);
+            const __m256i hi_high = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 4, 8, 16, 32, 64, -128,
+                                                     0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 4, 8, 16, 32, 64, -128);
+            const __m256i nibble = _mm256_set1_epi8(0x0f);
+            const __m256i zero = _mm256_setzero_si256();
+            for (; last - first >= 32; first += 32) {
+                __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first));
+                __m256i lo = _mm256_and_si256(block, nibble);
+                __m256i hi = _mm256_and_si256(_mm256_srli_epi16(block, 4), nibble);
+                __m256i hits = _mm256_and_si256(_mm256_shuffle_epi8(lo_ascii, lo), _mm256_shuffle_epi8(hi_ascii, hi));
+                if (set.has_high)
+                    hits = _mm256_or_si256(hits, _mm256_and_si256(_mm256_shuffle_epi8(lo_high, lo), _mm256_shuffle_epi8(hi_high, hi)));
+                unsigned mask = ~static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hits, zero)));
+                if (mask != 0)
+                    return first + lowest_bit(mask);
+            }
+            return find_any_ssse3(first, last, set);
+        }
+
+        template <typename chT>
+        STREF_TARGET("sse2") size_t mismatch_sse2(const chT* a, const chT* b, size_t n) {
+            typedef simd_ops<sizeof(chT)> ops;
+            const size_t step = 16 / sizeof(chT);
+            size_t i = 0;
+            for (; n - i >= step; i += step) {
+                __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+                __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+                unsigned mask = ~static_cast<unsigned>(_mm_movemask_epi8(ops::eq(x, y))) & 0xffff;
+                if (mask != 0)
+                    return i + lowest_bit(mask) / sizeof(chT);
+            }
+            return i + mismatch_scalar(a + i, b + i, n - i);
+        }
+
+        template <typename chT>
+        STREF_TARGET("avx2") size_t mismatch_avx2(const chT* a, const chT* b, size_t n) {
+            typedef simd_ops<sizeof(chT)> ops;
+            const size_t step = 32 / sizeof(chT);
+            size_t i = 0;
+            for (; n - i >= step; i += step) {
+                __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+                __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+                unsigned mask = ~static_cast<unsigned>(_mm256_movemask_epi8(ops::eq256(x, y)));
+                if (mask != 0)
+                    return i + lowest_bit(mask) / sizeof(chT);
+            }
+            return i + mismatch_sse2(a + i, b + i, n - i);
+        }
+
+        // ASCII case folding: 'A'..'Z' get 0x20 added; units outside 0..0x7f are flagged instead
+        template <typename chT>
+        STREF_TARGET("sse2") __m128i fold_ascii_sse2(__m128i x) {
+            typedef simd_ops<sizeof(chT)> ops;
+            __m128i upper = _mm_and_si128(ops::gt(x, ops::splat('A' - 1)), ops::gt(ops::splat('Z' + 1), x));
+            return _mm_or_si128(x, _mm_and_si128(upper, ops::splat(0x20)));
+        }
+
+        template <typename chT>
+        STREF_TARGET("sse2") __m128i non_ascii_sse2(__m128i x) {
+            typedef simd_ops<sizeof(chT)> ops;
+            return _mm_andnot_si128(ops::eq(_mm_and_si128(x, ops::splat(~0x7f)), _mm_setzero_si128()), _mm_set1_epi8(-1));
+        }
+
+        template <typename chT>
+        STREF_TARGET("sse2") size_t ascii_imismatch_sse2(const chT* a, const chT* b, size_t n) {
+            typedef simd_ops<sizeof(chT)> ops;
+            const size_t step = 16 / sizeof(chT);
+            size_t i = 0;
+            for (; n - i >= step; i += step) {
+                __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+                __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+                __m128i same = ops::eq(fold_ascii_sse2<chT>(x), fold_ascii_sse2<chT>(y));
+                __m128i stop = _mm_or_si128(_mm_or_si128(non_ascii_sse2<chT>(x), non_ascii_sse2<chT>(y)), _mm_xor_si128(same, _mm_set1_epi8(-1)));
+                unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(stop));
+                if (mask != 0)
+                    return i + lowest_bit(mask) / sizeof(chT);
+            }
+            return i + ascii_imismatch_scalar(a + i, b + i, n - i);
+        }
+
+        template <typename chT>
+        STREF_TARGET("avx2") __m256i fold_ascii_avx2(__m256i x) {
+            typedef simd_ops<sizeof(chT)> ops;
+            __m256i upper = _mm256_and_si256(ops::gt256(x, ops::splat256('A' - 1)), ops::gt256(ops::splat256('Z' + 1), x));
+            return _mm256_or_si256(x, _mm256_and_si256(upper, ops::splat256(0x20)));
+        }
+
+        template <typename chT>
+        STREF_TARGET("avx2") __m256i non_ascii_avx2(__m256i x) {
+            typedef simd_ops<sizeof(chT)> ops;
+            return _mm256_andnot_si256(ops::eq256(_mm256_and_si256(x, ops::splat256(~0x7f)), _mm256_setzero_si256()), _mm256_set1_epi8(-1));
+        }
+
+        template <typename chT>
+        STREF_TARGET("avx2") size_t ascii_imismatch_avx2(const chT* a, const chT* b, size_t n) {
+            typedef simd_ops<sizeof(chT)> ops;
+            const size_t step = 32 / sizeof(chT);
+            size_t i = 0;
+            for (; n - i >= step; i += step) {
+                __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+                __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+                __m256i same = ops::eq256(fold_ascii_avx2<chT>(x), fold_ascii_avx2<chT>(y));
+                __m256i stop = _mm256_or_si256(_mm256_or_si256(non_ascii_avx2<chT>(x), non_ascii_avx2<chT>(y)), _mm256_xor_si256(same, _mm256_set1_epi8(-1)));
+                unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(stop));
+                if (mask != 0)
+                    return i + lowest_bit(mask) / sizeof(chT);
+            }
+            return i + ascii_imismatch_sse2(a + i, b + i, n - i);
+        }
+
+        // bits of a movemask result that mark whole code units
+        template <size_t W> struct unit_bits;
+        template <> struct unit_bits<1> { static const unsigned mask = 0xffffffffu; };
+        template <> struct unit_bits<2> { static const unsigned mask = 0x55555555u; };
+        template <> struct unit_bits<4> { static const unsigned mask = 0x11111111u; };
+
+        // call f(p) for every match in a block mask
+        template <typename chT, typename F>
+        void for_each_bit(const chT* block, unsigned mask, F& f) {
+            for (mask &= unit_bits<sizeof(chT)>::mask; mask != 0; mask &= mask - 1)
+                f(block + lowest_bit(mask) / sizeof(chT));
+        }
+
+        template <typename chT, typename F>
+        STREF_TARGET("sse2") void for_each_char_sse2(const chT* first, const chT* last, chT ch, F& f) {
+            typedef simd_ops<sizeof(chT)> ops;
+            const size_t step = 16 / sizeof(chT);
+            const __m128i needle = ops::splat(static_cast<int>(ch));
+            for (; static_cast<size_t>(last - first) >= step; first += step) {
+                __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+                for_each_bit(first, static_cast<unsigned>(_mm_movemask_epi8(ops::eq(block, needle))), f);
+            }
+            for (; first != last; ++first)
+                if (*first == ch)
+                    f(first);
+        }
+
+        template <typename chT, typename F>
+        STREF_TARGET("avx2") void for_each_char_avx2(const chT* first, const chT* last, chT ch, F& f) {
+            typedef simd_ops<sizeof(chT)> ops;
+            const size_t step = 32 / sizeof(chT);
+            const __m256i needle = ops::splat256(static_cast<int>(ch));
+            for (; static_cast<size_t>(last - first) >= step; first += step) {
+                __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first));
+                for_each_bit(first, static_cast<unsigned>(_mm256_movemask_epi8(ops::eq256(block, needle))), f);
+            }
+            for_each_char_sse2(first, last, ch, f);
+        }
+
+        template <typename F>
+        STREF_TARGET("ssse3") void for_each_any_ssse3(const char* first, const char* last, const char_set<char>& set, F& f) {
+            for (const char* p = first; p != last; first = p) {
+                p = find_any_ssse3(first, last, set);
+                if (p == last)
+                    break;
+                f(p++);
+            }
+        }
+
+        template <typename F>
+        STREF_TARGET("avx2") void for_each_any_avx2(const char* first, const char* last, const char_set<char>& set, F& f) {
+            const __m256i lo_ascii = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(set.lo_ascii)));
+            const __m256i lo_high = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(set.lo_high)));
+            const __m256i hi_ascii = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0,
+                                                      1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0);
+            const __m256i hi_high = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 4, 8, 16, 32, 64, -128,
+                                                     0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 4, 8, 16, 32, 64, -128);
+            const __m256i nibble = _mm256_set1_epi8(0x0f);
+            const __m256i zero = _mm256_setzero_si256();
+            for (; last - first >= 32; first += 32) {
+                __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first));
+                __m256i lo = _mm256_and_si256(block, nibble);
+                __m256i hi = _mm256_and_si256(_mm256_srli_epi16(block, 4), nibble);
+                __m256i hits = _mm256_and_si256(_mm256_shuffle_epi8(lo_ascii, lo), _mm256_shuffle_epi8(hi_ascii, hi));
+                if (set.has_high)
+                    hits = _mm256_or_si256(hits, _mm256_and_si256(_mm256_shuffle_epi8(lo_high, lo), _mm256_shuffle_epi8(hi_high, hi)));
+                for_each_bit(first, ~static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hits, zero))), f);
+            }
+            for (; first != last; ++first)
+                if (set.contains(*first))
+                    f(first);
+        }
+
+        template <typename chT>
+        STREF_TARGET("sse2") size_t find_pair_sse2(const chT* h, size_t n, const chT* needle, size_t m) {
+            typedef simd_ops<sizeof(chT)> ops;
+            const size_t step = 16 / sizeof(chT);
+            const __m128i first = ops::splat(static_cast<int>(needle[0]));
+            const __m128i last = ops::splat(static_cast<int>(needle[m - 1]));
+            size_t i = 0;
+            for (; n >= m && n - m + 1 - i >= step; i += step) {
+                __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(h + i));
+                __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(h + i + m - 1));
+                unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_and_si128(ops::eq(a, first), ops::eq(b, last))));
+                for (mask &= unit_bits<sizeof(chT)>::mask; mask != 0; mask &= mask - 1) {
+                    size_t j = i + lowest_bit(mask) / sizeof(chT);
+                    if (matches_inner(h + j, needle, m))
+                        return j;
+                }
+            }
+            size_t r = find_pair_scalar(h + i, n - i, needle, m);
+            return r == n - i ? n : i + r;
+        }
+
+        template <typename chT>
+        STREF_TARGET("avx2") size_t find_pair_avx2(const chT* h, size_t n, const chT* needle, size_t m) {
+            typedef simd_ops<sizeof(chT)> ops;
+            const size_t step = 32 / sizeof(chT);
+            const __m256i first = ops::splat256(static_cast<int>(needle[0]));
+            const __m256i last = ops::splat256(static_cast<int>(needle[m - 1]));
+            size_t i = 0;
+            for (; n >= m && n - m + 1 - i >= step; i += step) {
+                __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(h + i));
+                __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(h + i + m - 1));
+                unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_and_si256(ops::eq256(a, first), ops::eq256(b, last))));
+                for (mask &= unit_bits<sizeof(chT)>::mask; mask != 0; mask &= mask - 1) {
+                    size_t j = i + lowest_bit(mask) / sizeof(chT);
+                    if (matches_inner(h + j, needle, m))
+                        return j;
+                }
+            }
+            size_t r = find_pair_sse2(h + i, n - i, needle, m);
+            return r == n - i ? n : i + r;
+        }
+
+        template <typename chT>
+        STREF_TARGET("sse2") size_t rfind_pair_sse2(const chT* h, size_t n, const chT* needle, size_t m) {
+            typedef simd_ops<sizeof(chT)> ops;
+            const size_t step = 16 / sizeof(chT);
+            const __m128i first = ops::splat(static_cast<int>(needle[0]));
+            const __m128i last = ops::splat(static_cast<int>(needle[m - 1]));
+            size_t end = n >= m ? n - m + 1 : 0;
+            for (; end >= step; end -= step) {
+                size_t i = end - step;
+                __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(h + i));
+                __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(h + i + m - 1));
+                unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_and_si128(ops::eq(a, first), ops::eq(b, last))));
+                for (mask &= unit_bits<sizeof(chT)>::mask; mask != 0; mask ^= 1u << highest_bit(mask)) {
+                    size_t j = i + highest_bit(mask) / sizeof(chT);
+                    if (matches_inner(h + j, needle, m))
+                        return j;
+                }
+            }
+            return rfind_pair_scalar(h, n, needle, m, end);
+        }
+
+        template <typename chT>
+        STREF_TARGET("avx2") size_t rfind_pair_avx2(const chT* h, size_t n, const chT* needle, size_t m) {
+            typedef simd_ops<sizeof(chT)> ops;
+            const size_t step = 32 / sizeof(chT);
+            const __m256i first = ops::splat256(static_cast<int>(needle[0]));
+            const __m256i last = ops::splat256(static_cast<int>(needle[m - 1]));
+            size_t end = n >= m ? n - m + 1 : 0;
+            for (; end >= step; end -= step) {
+                size_t i = end - step;
+                __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(h + i));
+                __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(h + i + m - 1));
+                unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_and_si256(ops::eq256(a, first), ops::eq256(b, last))));
+                for (mask &= unit_bits<sizeof(chT)>::mask; mask != 0; mask ^= 1u << highest_bit(mask)) {
+                    size_t j = i + highest_bit(mask) / sizeof(chT);
+                    if (matches_inner(h + j, needle, m))
+                        return j;
+                }
+            }
+            size_t r = rfind_pair_sse2(h, end + m - 1, needle, m);
+            return r == end + m - 1 ? n : r;
+        }
+#endif
+
+        //
+        // dispatchers: pick the best kernel for the given instruction set level
+        //
+
+        template <typename chT>
+        const chT* find_char(const chT* first, const chT* last, chT ch, simd_level level = cpu_simd_level()) {
+#if defined(STREF_X86)
+            if (level >= simd_avx2) return find_char_avx2(first, last, ch);
+            if (level >= simd_sse2) return find_char_sse2(first, last, ch);
+#endif
+            (void)level;
+            return find_char_scalar(first, last, ch);
+        }
+
+        template <typename chT>
+        const chT* rfind_char(const chT* first, const chT* last, chT ch, simd_level level = cpu_simd_level()) {
+#if defined(STREF_X86)
+            if (level >= simd_avx2) return rfind_char_avx2(first, last, ch);
+            if (level >= simd_sse2) return rfind_char_sse2(first, last, ch);
+#endif
+            (void)level;
+            return rfind_char_scalar(first, last, ch);
+        }
+
+        template <typename chT>
+        size_t mismatch(const chT* a, const chT* b, size_t n, simd_level level = cpu_simd_level()) {
+#if defined(STREF_X86)
+            if (level >= simd_avx2) return mismatch_avx2(a, b, n);
+            if (level >= simd_sse2) return mismatch_sse2(a, b, n);
+#endif
+            (void)level;
+            return mismatch_scalar(a, b, n);
+        }
+
+        template <typename chT>
+        size_t ascii_imismatch(const chT* a, const chT* b, size_t n, simd_level level = cpu_simd_level()) {
+#if defined(STREF_X86)
+            if (level >= simd_avx2) return ascii_imismatch_avx2(a, b, n);
+            if (level >= simd_sse2) return ascii_imismatch_sse2(a, b, n);
+#endif
+            (void)level;
+            return ascii_imismatch_scalar(a, b, n);
+        }
+
+        inline const char* find_any(const char* first, const char* last, const char_set<char>& set, simd_level level = cpu_simd_level()) {
+#if defined(STREF_X86)
+            if (level >= simd_avx2) return find_any_avx2(first, last, set);
+            if (level >= simd_ssse3) return find_any_ssse3(first, last, set);
+#endif
+            (void)level;
+            return find_any_scalar(first, last, set);
+        }
+
+        template <typename chT>
+        const chT* find_any(const chT* first, const chT* last, const char_set<chT>& set, simd_level = cpu_simd_level()) {
+            return find_any_scalar(first, last, set);
+        }
+
+        // call f(p) for every position p in [first, last) that matches
+        template <typename chT, typename F>
+        void for_each_char(const chT* first, const chT* last, chT ch, F& f, simd_level level = cpu_simd_level()) {
+#if defined(STREF_X86)
+            if (level >= simd_avx2) return for_each_char_avx2(first, last, ch, f);
+            if (level >= simd_sse2) return for_each_char_sse2(first, last, ch, f);
+#endif
+            (void)level;
+            for (; first != last; ++first)
+                if (*first == ch)
+                    f(first);
+        }
+
+        template <typename F>
+        void for_each_any(const char* first, const char* last, const char_set<char>& set, F& f, simd_level level = cpu_simd_level()) {
+#if defined(STREF_X86)
+            if (level >= simd_avx2) return for_each_any_avx2(first, last, set, f);
+            if (level >= simd_ssse3) return for_each_any_ssse3(first, last, set, f);
+#endif
+            (void)level;
+            for (; first != last; ++first)
+                if (set.contains(*first))
+                    f(first);
+        }
+
+        template <typename chT, typename F>
+        void for_each_any(const chT* first, const chT* last, const char_set<chT>& set, F& f, simd_level = cpu_simd_level()) {
+            for (; first != last; ++first)
+                if (set.contains(*first))
+                    f(first);
+        }
+
+        template <typename chT>
+        size_t find_pair(const chT* h, size_t n, const chT* needle, size_t m, simd_level level = cpu_simd_level()) {
+#if defined(STREF_X86)
+            if (level >= simd_avx2) return find_pair_avx2(h, n, needle, m);
+            if (level >= simd_sse2) return find_pair_sse2(h, n, needle, m);
+#endif
+            (void)level;
+            return find_pair_scalar(h, n, needle, m);
+        }
+
+        template <typename chT>
+        size_t rfind_pair(const chT* h, size_t n, const chT* needle, size_t m, simd_level level = cpu_simd_level()) {
+#if defined(STREF_X86)
+            if (level >= simd_avx2) return rfind_pair_avx2(h, n, needle, m);
+            if (level >= simd_sse2) return rfind_pair_sse2(h, n, needle, m);
+#endif
+            (void)level;
+            return rfind_pair_scalar(h, n, needle, m, n >= m ? n - m + 1 : 0);
+        }
+
+        //
+        // number parsing
+        //
+
+        inline bool is_digit(unsigned long u) { return u - '0' < 10; }
+
+        // SWAR parsing of 8 ASCII digits at once (little endian only)
+        inline bool eight_digits(const char* p, std::uint64_t& v) {
+#if defined(STREF_LITTLE_ENDIAN)
+            std::memcpy(&v, p, 8);
+            return ((v & 0xf0f0f0f0f0f0f0f0ull) | (((v + 0x0606060606060606ull) & 0xf0f0f0f0f0f0f0f0ull) >> 4)) == 0x3333333333333333ull;
+#else
+            (void)p;
+            (void)v;
+            return false;
+#endif
+        }
+
+        template <typename chT>
+        bool eight_digits(const chT*, std::uint64_t&) { return false; }
+
+        // the value of 8 digits checked by eight_digits()
+        inline std::uint32_t eight_digits_value(std::uint64_t v) {
+            v -= 0x3030303030303030ull;
+            v = v * 10 + (v >> 8);
+            v = (((v & 0x000000ff000000ffull) * (100 + (1000000ull << 32))) +
+                 (((v >> 16) & 0x000000ff000000ffull) * (1 + (10000ull << 32)))) >> 32;
+            return static_cast<std::uint32_t>(v);
+        }
+
+        // accumulate the digits at p into w (modulo 2^64), returning the end of the digits
+        template <typename chT>
+        const chT* accumulate_digits(const chT* p, const chT* last, std::uint64_t& w) {
+            std::uint64_t v;
+            while (last - p >= 8 && eight_digits(p, v)) {
+                w = w * 100000000 + eight_digits_value(v);
+                p += 8;
+            }
+            for (; p != last && is_digit(code_unit(*p)); ++p)
+                w = w * 10 + (code_unit(*p) - '0');
+            return p;
+        }
+
+        // the magnitude of an unsigned decimal integer: digits only, no sign or white space
+        template <typename chT>
+        parse_error parse_magnitude(const chT* p, const chT* last, std::uint64_t& value) {
+            if (p == last)
+                return invalid_number;
+            while (p != last && *p == chT('0'))
+                ++p;
+            // 19 digits always fit: a 20th may overflow, so it's only added after a check
+            std::uint64_t w = 0;
+            p = accumulate_digits(p, last - p > 19 ? p + 19 : last, w);
+            const chT* rest = p;
+            while (p != last && is_digit(code_unit(*p)))
+                ++p;
+            if (p != last)
+                return invalid_number;
+            if (rest != last) {
+                unsigned digit = static_cast<unsigned>(code_unit(*rest) - '0');
+                if (last - rest > 1 || w > 1844674407370955161ull || (w == 1844674407370955161ull && digit > 5))
+                    return number_out_of_range;
+                w = w * 10 + digit;
+            }
+            value = w;
+            return no_error;
+        }
+
+        template <typename T, typename chT>
+        parse_error parse_integer(const chT* p, const chT* last, T& value) {
+            bool negative = p != last && *p == chT('-');
+            if (p != last && (*p == chT('-') || *p == chT('+')))
+                ++p;
+            std::uint64_t u = 0;
+            parse_error error = parse_magnitude(p, last, u);
+            if (error != no_error)
+                return error;
+            typedef typename std::make_unsigned<T>::type unsigned_type;
+            const std::uint64_t max = static_cast<unsigned_type>(std::numeric_limits<T>::max());
+            if (negative && u != 0) {
+                if (!std::numeric_limits<T>::is_signed)
+                    return number_out_of_range;
+                if (u - 1 > max)
+                    return number_out_of_range;
+                value = static_cast<T>(-static_cast<T>(u - 1) - 1);
+            } else {
+                if (u > max)
+                    return number_out_of_range;
+                value = static_cast<T>(u);
+            }
+            return no_error;
+        }
+
+        // IEEE binary32/binary64 parameters for the Eisel-Lemire algorithm
+        template <typename T> struct binary_format;
+
+        template <> struct binary_format<double> {
+            typedef std::uint64_t bits;
+            enum { mantissa_bits = 52, minimum_exponent = -1023, infinite_power = 0x7ff,
+                   min_round_to_even = -4, max_round_to_even = 23, smallest_power = -342, largest_power = 308,
+                   max_exact_power = 22 };
+            static double exact_power(int q) {
+                static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                                 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+                return powers[q];
+            }
+            static double slow_parse(const char* s) { return std::strtod(s, 0); }
+        };
+
+        template <> struct binary_format<float> {
+            typedef std::uint32_t bits;
+            enum { mantissa_bits = 23, minimum_exponent = -127, infinite_power = 0xff,
+                   min_round_to_even = -17, max_round_to_even = 10, smallest_power = -65, largest_power = 38,
+                   max_exact_power = 10 };
+            static float exact_power(int q) {
+                static const float powers[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+                return powers[q];
+            }
+            static float slow_parse(const char* s) { return std::strtof(s, 0); }
+        };
+
+        // the high and low 64 bits of a * b
+        inline std::uint64_t multiply_128(std::uint64_t a, std::uint64_t b, std::uint64_t& low) {
+#if defined(__SIZEOF_INT128__)
+            __extension__ typedef unsigned __int128 product;
+            product r = static_cast<product>(a) * b;
+            low = static_cast<std::uint64_t>(r);
+            return static_cast<std::uint64_t>(r >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+            std::uint64_t high;
+            low = _umul128(a, b, &high);
+            return high;
+#else
+            std::uint64_t ha = a >> 32, hb = b >> 32, la = a & 0xffffffffu, lb = b & 0xffffffffu;
+            std::uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+            std::uint64_t t = rl + (rm0 << 32), c = t < rl;
+            low = t + (rm1 << 32);
+            c += low < t;
+            return rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+        }
+
+        inline unsigned leading_zeros64(std::uint64_t v) {
+#if defined(_MSC_VER) && defined(_M_X64)
+            unsigned long i;
+            _BitScanReverse64(&i, v);
+            return 63 - i;
+#elif defined(_MSC_VER)
+            unsigned hi = static_cast<unsigned>(v >> 32);
+            return hi != 0 ? 31 - highest_bit(hi) : 63 - highest_bit(static_cast<unsigned>(v));
+#else
+            return __builtin_clzll(v);
+#endif
+        }
+
+        // 5^q for q in [-342, 308], normalized to 128 bits (truncated for q >= 0, rounded up for q < 0)
+        inline const std::uint64_t* powers_of_five() {
+            static const std::uint64_t powers[] = {
+            0xeef453d6923bd65aull, 0x113faa2906a13b3full, 0x9558b4661b6565f8ull, 0x4ac7ca59a424c507ull,
+            0xbaaee17fa23ebf76ull, 0x5d79bcf00d2df649ull, 0xe95a99df8ace6f53ull, 0xf4d82c2c107973dcull,
+            0x91d8a02bb6c10594ull, 0x79071b9b8a4be869ull, 0xb64ec836a47146f9ull, 0x9748e2826cdee284ull,
+            0xe3e27a444d8d98b7ull, 0xfd1b1b2308169b25ull, 0x8e6d8c6ab0787f72ull, 0xfe30f0f5e50e20f7ull,
+            0xb208ef855c969f4full, 0xbdbd2d335e51a935ull, 0xde8b2b66b3bc4723ull, 0xad2c788035e61382ull,
+            0x8b16fb203055ac76ull, 0x4c3bcb5021afcc31ull, 0xaddcb9e83c6b1793ull, 0xdf4abe242a1bbf3dull,
+            0xd953e8624b85dd78ull, 0xd71d6dad34a2af0dull, 0x87d4713d6f33aa6bull, 0x8672648c40e5ad68ull,
+            0xa9c98d8ccb009506ull, 0x680efdaf511f18c2ull, 0xd43bf0effdc0ba48ull, 0x0212bd1b2566def2ull,
+            0x84a57695fe98746dull, 0x014bb630f7604b57ull, 0xa5ced43b7e3e9188ull, 0x419ea3bd35385e2dull,
+            0xcf42894a5dce35eaull, 0x52064cac828675b9ull, 0x818995ce7aa0e1b2ull, 0x7343efebd1940993ull,
+            0xa1ebfb4219491a1full, 0x1014ebe6c5f90bf8ull, 0xca66fa129f9b60a6ull, 0xd41a26e077774ef6ull,
+            0xfd00b897478238d0ull, 0x8920b098955522b4ull, 0x9e20735e8cb16382ull, 0x55b46e5f5d5535b0ull,
+            0xc5a890362fddbc62ull, 0xeb2189f734aa831dull, 0xf712b443bbd52b7bull, 0xa5e9ec7501d523e4ull,
+            0x9a6bb0aa55653b2dull, 0x47b233c92125366eull, 0xc1069cd4eabe89f8ull, 0x999ec0bb696e840aull,
+            0xf148440a256e2c76ull, 0xc00670ea43ca250dull, 0x96cd2a865764dbcaull, 0x380406926a5e5728ull,
+            0xbc807527ed3e12bcull, 0xc605083704f5ecf2ull, 0xeba09271e88d976bull, 0xf7864a44c633682eull,
+            0x93445b8731587ea3ull, 0x7ab3ee6afbe0211dull, 0xb8157268fdae9e4cull, 0x5960ea05bad82964ull,
+            0xe61acf033d1a45dfull, 0x6fb92487298e33bdull, 0x8fd0c16206306babull, 0xa5d3b6d479f8e056ull,
+            0xb3c4f1ba87bc8696ull, 0x8f48a4899877186cull, 0xe0b62e2929aba83cull, 0x331acdabfe94de87ull,
+            0x8c71dcd9ba0b4925ull, 0x9ff0c08b7f1d0b14ull, 0xaf8e5410288e1b6full, 0x07ecf0ae5ee44dd9ull,
+            0xdb71e91432b1a24aull, 0xc9e82cd9f69d6150ull, 0x892731ac9faf056eull, 0xbe311c083a225cd2ull,
+            0xab70fe17c79ac6caull, 0x6dbd630a48aaf406ull, 0xd64d3d9db981787dull, 0x092cbbccdad5b108ull,
+            0x85f0468293f0eb4eull, 0x25bbf56008c58ea5ull, 0xa76c582338ed2621ull, 0xaf2af2b80af6f24eull,
+            0xd1476e2c07286faaull, 0x1af5af660db4aee1ull, 0x82cca4db847945caull, 0x50d98d9fc890ed4dull,
+            0xa37fce126597973cull, 0xe50ff107bab528a0ull, 0xcc5fc196fefd7d0cull, 0x1e53ed49a96272c8ull,
+            0xff77b1fcbebcdc4full, 0x25e8e89c13bb0f7aull, 0x9faacf3df73609b1ull, 0x77b191618c54e9acull,
+            0xc795830d75038c1dull, 0xd59df5b9ef6a2417ull, 0xf97ae3d0d2446f25ull, 0x4b0573286b44ad1dull,
+            0x9becce62836ac577ull, 0x4ee367f9430aec32ull, 0xc2e801fb244576d5ull, 0x229c41f793cda73full,
+            0xf3a20279ed56d48aull, 0x6b43527578c1110full, 0x9845418c345644d6ull, 0x830a13896b78aaa9ull,
+            0xbe5691ef416bd60cull, 0x23cc986bc656d553ull, 0xedec366b11c6cb8full, 0x2cbfbe86b7ec8aa8ull,
+            0x94b3a202eb1c3f39ull, 0x7bf7d71432f3d6a9ull, 0xb9e08a83a5e34f07ull, 0xdaf5ccd93fb0cc53ull,
+            0xe858ad248f5c22c9ull, 0xd1b3400f8f9cff68ull, 0x91376c36d99995beull, 0x23100809b9c21fa1ull,
+            0xb58547448ffffb2dull, 0xabd40a0c2832a78aull, 0xe2e69915b3fff9f9ull, 0x16c90c8f323f516cull,
+            0x8dd01fad907ffc3bull, 0xae3da7d97f6792e3ull, 0xb1442798f49ffb4aull, 0x99cd11cfdf41779cull,
+            0xdd95317f31c7fa1dull, 0x40405643d711d583ull, 0x8a7d3eef7f1cfc52ull, 0x482835ea666b2572ull,
+            0xad1c8eab5ee43b66ull, 0xda3243650005eecfull, 0xd863b256369d4a40ull, 0x90bed43e40076a82ull,
+            0x873e4f75e2224e68ull, 0x5a7744a6e804a291ull, 0xa90de3535aaae202ull, 0x711515d0a205cb36ull,
+            0xd3515c2831559a83ull, 0x0d5a5b44ca873e03ull, 0x8412d9991ed58091ull, 0xe858790afe9486c2ull,
+            0xa5178fff668ae0b6ull, 0x626e974dbe39a872ull, 0xce5d73ff402d98e3ull, 0xfb0a3d212dc8128full,
+            0x80fa687f881c7f8eull, 0x7ce66634bc9d0b99ull, 0xa139029f6a239f72ull, 0x1c1fffc1ebc44e80ull,
+            0xc987434744ac874eull, 0xa327ffb266b56220ull, 0xfbe9141915d7a922ull, 0x4bf1ff9f0062baa8ull,
+            0x9d71ac8fada6c9b5ull, 0x6f773fc3603db4a9ull, 0xc4ce17b399107c22ull, 0xcb550fb4384d21d3ull,
+            0xf6019da07f549b2bull, 0x7e2a53a146606a48ull, 0x99c102844f94e0fbull, 0x2eda7444cbfc426dull,
+            0xc0314325637a1939ull, 0xfa911155fefb5308ull, 0xf03d93eebc589f88ull, 0x793555ab7eba27caull,
+            0x96267c7535b763b5ull, 0x4bc1558b2f3458deull, 0xbbb01b9283253ca2ull, 0x9eb1aaedfb016f16ull,
+            0xea9c227723ee8bcbull, 0x465e15a979c1cadcull, 0x92a1958a7675175full, 0x0bfacd89ec191ec9ull,
+            0xb749faed14125d36ull, 0xcef980ec671f667bull, 0xe51c79a85916f484ull, 0x82b7e12780e7401aull,
+            0x8f31cc0937ae58d2ull, 0xd1b2ecb8b0908810ull, 0xb2fe3f0b8599ef07ull, 0x861fa7e6dcb4aa15ull,
+            0xdfbdcece67006ac9ull, 0x67a791e093e1d49aull, 0x8bd6a141006042bdull, 0xe0c8bb2c5c6d24e0ull,
+            0xaecc49914078536dull, 0x58fae9f773886e18ull, 0xda7f5bf590966848ull, 0xaf39a475506a899eull,
+            0x888f99797a5e012dull, 0x6d8406c952429603ull, 0xaab37fd7d8f58178ull, 0xc8e5087ba6d33b83ull,
+            0xd5605fcdcf32e1d6ull, 0xfb1e4a9a90880a64ull, 0x855c3be0a17fcd26ull, 0x5cf2eea09a55067full,
+            0xa6b34ad8c9dfc06full, 0xf42faa48c0ea481eull, 0xd0601d8efc57b08bull, 0xf13b94daf124da26ull,
+            0x823c12795db6ce57ull, 0x76c53d08d6b70858ull, 0xa2cb1717b52481edull, 0x54768c4b0c64ca6eull,
+            0xcb7ddcdda26da268ull, 0xa9942f5dcf7dfd09ull, 0xfe5d54150b090b02ull, 0xd3f93b35435d7c4cull,
+            0x9efa548d26e5a6e1ull, 0xc47bc5014a1a6dafull, 0xc6b8e9b0709f109aull, 0x359ab6419ca1091bull,
+            0xf867241c8cc6d4c0ull, 0xc30163d203c94b62ull, 0x9b407691d7fc44f8ull, 0x79e0de63425dcf1dull,
+            0xc21094364dfb5636ull, 0x985915fc12f542e4ull, 0xf294b943e17a2bc4ull, 0x3e6f5b7b17b2939dull,
+            0x979cf3ca6cec5b5aull, 0xa705992ceecf9c42ull, 0xbd8430bd08277231ull, 0x50c6ff782a838353ull,
+            0xece53cec4a314ebdull, 0xa4f8bf5635246428ull, 0x940f4613ae5ed136ull, 0x871b7795e136be99ull,
+            0xb913179899f68584ull, 0x28e2557b59846e3full, 0xe757dd7ec07426e5ull, 0x331aeada2fe589cfull,
+            0x9096ea6f3848984full, 0x3ff0d2c85def7621ull, 0xb4bca50b065abe63ull, 0x0fed077a756b53a9ull,
+            0xe1ebce4dc7f16dfbull, 0xd3e8495912c62894ull, 0x8d3360f09cf6e4bdull, 0x64712dd7abbbd95cull,
+            0xb080392cc4349decull, 0xbd8d794d96aacfb3ull, 0xdca04777f541c567ull, 0xecf0d7a0fc5583a0ull,
+            0x89e42caaf9491b60ull, 0xf41686c49db57244ull, 0xac5d37d5b79b6239ull, 0x311c2875c522ced5ull,
+            0xd77485cb25823ac7ull, 0x7d633293366b828bull, 0x86a8d39ef77164bcull, 0xae5dff9c02033197ull,
+            0xa8530886b54dbdebull, 0xd9f57f830283fdfcull, 0xd267caa862a12d66ull, 0xd072df63c324fd7bull,
+            0x8380dea93da4bc60ull, 0x4247cb9e59f71e6dull, 0xa46116538d0deb78ull, 0x52d9be85f074e608ull,
+            0xcd795be870516656ull, 0x67902e276c921f8bull, 0x806bd9714632dff6ull, 0x00ba1cd8a3db53b6ull,
+            0xa086cfcd97bf97f3ull, 0x80e8a40eccd228a4ull, 0xc8a883c0fdaf7df0ull, 0x6122cd128006b2cdull,
+            0xfad2a4b13d1b5d6cull, 0x796b805720085f81ull, 0x9cc3a6eec6311a63ull, 0xcbe3303674053bb0ull,
+            0xc3f490aa77bd60fcull, 0xbedbfc4411068a9cull, 0xf4f1b4d515acb93bull, 0xee92fb5515482d44ull,
+            0x991711052d8bf3c5ull, 0x751bdd152d4d1c4aull, 0xbf5cd54678eef0b6ull, 0xd262d45a78a0635dull,
+            0xef340a98172aace4ull, 0x86fb897116c87c34ull, 0x9580869f0e7aac0eull, 0xd45d35e6ae3d4da0ull,
+            0xbae0a846d2195712ull, 0x8974836059cca109ull, 0xe998d258869facd7ull, 0x2bd1a438703fc94bull,
+            0x91ff83775423cc06ull, 0x7b6306a34627ddcfull, 0xb67f6455292cbf08ull, 0x1a3bc84c17b1d542ull,
+            0xe41f3d6a7377eecaull, 0x20caba5f1d9e4a93ull, 0x8e938662882af53eull, 0x547eb47b7282ee9cull,
+            0xb23867fb2a35b28dull, 0xe99e619a4f23aa43ull, 0xdec681f9f4c31f31ull, 0x6405fa00e2ec94d4ull,
+            0x8b3c113c38f9f37eull, 0xde83bc408dd3dd04ull, 0xae0b158b4738705eull, 0x9624ab50b148d445ull,
+            0xd98ddaee19068c76ull, 0x3badd624dd9b0957ull, 0x87f8a8d4cfa417c9ull, 0xe54ca5d70a80e5d6ull,
+            0xa9f6d30a038d1dbcull, 0x5e9fcf4ccd211f4cull, 0xd47487cc8470652bull, 0x7647c3200069671full,
+            0x84c8d4dfd2c63f3bull, 0x29ecd9f40041e073ull, 0xa5fb0a17c777cf09ull, 0xf468107100525890ull,
+            0xcf79cc9db955c2ccull, 0x7182148d4066eeb4ull, 0x81ac1fe293d599bfull, 0xc6f14cd848405530ull,
+            0xa21727db38cb002full, 0xb8ada00e5a506a7cull, 0xca9cf1d206fdc03bull, 0xa6d90811f0e4851cull,
+            0xfd442e4688bd304aull, 0x908f4a166d1da663ull, 0x9e4a9cec15763e2eull, 0x9a598e4e043287feull,
+            0xc5dd44271ad3cdbaull, 0x40eff1e1853f29fdull, 0xf7549530e188c128ull, 0xd12bee59e68ef47cull,
+            0x9a94dd3e8cf578b9ull, 0x82bb74f8301958ceull, 0xc13a148e3032d6e7ull, 0xe36a52363c1faf01ull,
+            0xf18899b1bc3f8ca1ull, 0xdc44e6c3cb279ac1ull, 0x96f5600f15a7b7e5ull, 0x29ab103a5ef8c0b9ull,
+            0xbcb2b812db11a5deull, 0x7415d448f6b6f0e7ull, 0xebdf661791d60f56ull, 0x111b495b3464ad21ull,
+            0x936b9fcebb25c995ull, 0xcab10dd900beec34ull, 0xb84687c269ef3bfbull, 0x3d5d514f40eea742ull,
+            0xe65829b3046b0afaull, 0x0cb4a5a3112a5112ull, 0x8ff71a0fe2c2e6dcull, 0x47f0e785eaba72abull,
+            0xb3f4e093db73a093ull, 0x59ed216765690f56ull, 0xe0f218b8d25088b8ull, 0x306869c13ec3532cull,
+            0x8c974f7383725573ull, 0x1e414218c73a13fbull, 0xafbd2350644eeacfull, 0xe5d1929ef90898faull,
+            0xdbac6c247d62a583ull, 0xdf45f746b74abf39ull, 0x894bc396ce5da772ull, 0x6b8bba8c328eb783ull,
+            0xab9eb47c81f5114full, 0x066ea92f3f326564ull, 0xd686619ba27255a2ull, 0xc80a537b0efefebdull,
+            0x8613fd0145877585ull, 0xbd06742ce95f5f36ull, 0xa798fc4196e952e7ull, 0x2c48113823b73704ull,
+            0xd17f3b51fca3a7a0ull, 0xf75a15862ca504c5ull, 0x82ef85133de648c4ull, 0x9a984d73dbe722fbull,
+            0xa3ab66580d5fdaf5ull, 0xc13e60d0d2e0ebbaull, 0xcc963fee10b7d1b3ull, 0x318df905079926a8ull,
+            0xffbbcfe994e5c61full, 0xfdf17746497f7052ull, 0x9fd561f1fd0f9bd3ull, 0xfeb6ea8bedefa633ull,
+            0xc7caba6e7c5382c8ull, 0xfe64a52ee96b8fc0ull, 0xf9bd690a1b68637bull, 0x3dfdce7aa3c673b0ull,
+            0x9c1661a651213e2dull, 0x06bea10ca65c084eull, 0xc31bfa0fe5698db8ull, 0x486e494fcff30a62ull,
+            0xf3e2f893dec3f126ull, 0x5a89dba3c3efccfaull, 0x986ddb5c6b3a76b7ull, 0xf89629465a75e01cull,
+            0xbe89523386091465ull, 0xf6bbb397f1135823ull, 0xee2ba6c0678b597full, 0x746aa07ded582e2cull,
+            0x94db483840b717efull, 0xa8c2a44eb4571cdcull, 0xba121a4650e4ddebull, 0x92f34d62616ce413ull,
+            0xe896a0d7e51e1566ull, 0x77b020baf9c81d17ull, 0x915e2486ef32cd60ull, 0x0ace1474dc1d122eull,
+            0xb5b5ada8aaff80b8ull, 0x0d819992132456baull, 0xe3231912d5bf60e6ull, 0x10e1fff697ed6c69ull,
+            0x8df5efabc5979c8full, 0xca8d3ffa1ef463c1ull, 0xb1736b96b6fd83b3ull, 0xbd308ff8a6b17cb2ull,
+            0xddd0467c64bce4a0ull, 0xac7cb3f6d05ddbdeull, 0x8aa22c0dbef60ee4ull, 0x6bcdf07a423aa96bull,
+            0xad4ab7112eb3929dull, 0x86c16c98d2c953c6ull, 0xd89d64d57a607744ull, 0xe871c7bf077ba8b7ull,
+            0x87625f056c7c4a8bull, 0x11471cd764ad4972ull, 0xa93af6c6c79b5d2dull, 0xd598e40d3dd89bcfull,
+            0xd389b47879823479ull, 0x4aff1d108d4ec2c3ull, 0x843610cb4bf160cbull, 0xcedf722a585139baull,
+            0xa54394fe1eedb8feull, 0xc2974eb4ee658828ull, 0xce947a3da6a9273eull, 0x733d226229feea32ull,
+            0x811ccc668829b887ull, 0x0806357d5a3f525full, 0xa163ff802a3426a8ull, 0xca07c2dcb0cf26f7ull,
+            0xc9bcff6034c13052ull, 0xfc89b393dd02f0b5ull, 0xfc2c3f3841f17c67ull, 0xbbac2078d443ace2ull,
+            0x9d9ba7832936edc0ull, 0xd54b944b84aa4c0dull, 0xc5029163f384a931ull, 0x0a9e795e65d4df11ull,
+            0xf64335bcf065d37dull, 0x4d4617b5ff4a16d5ull, 0x99ea0196163fa42eull, 0x504bced1bf8e4e45ull,
+            0xc06481fb9bcf8d39ull, 0xe45ec2862f71e1d6ull, 0xf07da27a82c37088ull, 0x5d767327bb4e5a4cull,
+            0x964e858c91ba2655ull, 0x3a6a07f8d510f86full, 0xbbe226efb628afeaull, 0x890489f70a55368bull,
+            0xeadab0aba3b2dbe5ull, 0x2b45ac74ccea842eull, 0x92c8ae6b464fc96full, 0x3b0b8bc90012929dull,
+            0xb77ada0617e3bbcbull, 0x09ce6ebb40173744ull, 0xe55990879ddcaabdull, 0xcc420a6a101d0515ull,
+            0x8f57fa54c2a9eab6ull, 0x9fa946824a12232dull, 0xb32df8e9f3546564ull, 0x47939822dc96abf9ull,
+            0xdff9772470297ebdull, 0x59787e2b93bc56f7ull, 0x8bfbea76c619ef36ull, 0x57eb4edb3c55b65aull,
+            0xaefae51477a06b03ull, 0xede622920b6b23f1ull, 0xdab99e59958885c4ull, 0xe95fab368e45ecedull,
+            0x88b402f7fd75539bull, 0x11dbcb0218ebb414ull, 0xaae103b5fcd2a881ull, 0xd652bdc29f26a119ull,
+            0xd59944a37c0752a2ull, 0x4be76d3346f0495full, 0x857fcae62d8493a5ull, 0x6f70a4400c562ddbull,
+            0xa6dfbd9fb8e5b88eull, 0xcb4ccd500f6bb952ull, 0xd097ad07a71f26b2ull, 0x7e2000a41346a7a7ull,
+            0x825ecc24c873782full, 0x8ed400668c0c28c8ull, 0xa2f67f2dfa90563bull, 0x728900802f0f32faull,
+            0xcbb41ef979346bcaull, 0x4f2b40a03ad2ffb9ull, 0xfea126b7d78186bcull, 0xe2f610c84987bfa8ull,
+            0x9f24b832e6b0f436ull, 0x0dd9ca7d2df4d7c9ull, 0xc6ede63fa05d3143ull, 0x91503d1c79720dbbull,
+            0xf8a95fcf88747d94ull, 0x75a44c6397ce912aull, 0x9b69dbe1b548ce7cull, 0xc986afbe3ee11abaull,
+            0xc24452da229b021bull, 0xfbe85badce996168ull, 0xf2d56790ab41c2a2ull, 0xfae27299423fb9c3ull,
+            0x97c560ba6b0919a5ull, 0xdccd879fc967d41aull, 0xbdb6b8e905cb600full, 0x5400e987bbc1c920ull,
+            0xed246723473e3813ull, 0x290123e9aab23b68ull, 0x9436c0760c86e30bull, 0xf9a0b6720aaf6521ull,
+            0xb94470938fa89bceull, 0xf808e40e8d5b3e69ull, 0xe7958cb87392c2c2ull, 0xb60b1d1230b20e04ull,
+            0x90bd77f3483bb9b9ull, 0xb1c6f22b5e6f48c2ull, 0xb4ecd5f01a4aa828ull, 0x1e38aeb6360b1af3ull,
+            0xe2280b6c20dd5232ull, 0x25c6da63c38de1b0ull, 0x8d590723948a535full, 0x579c487e5a38ad0eull,
+            0xb0af48ec79ace837ull, 0x2d835a9df0c6d851ull, 0xdcdb1b2798182244ull, 0xf8e431456cf88e65ull,
+            0x8a08f0f8bf0f156bull, 0x1b8e9ecb641b58ffull, 0xac8b2d36eed2dac5ull, 0xe272467e3d222f3full,
+            0xd7adf884aa879177ull, 0x5b0ed81dcc6abb0full, 0x86ccbb52ea94baeaull, 0x98e947129fc2b4e9ull,
+            0xa87fea27a539e9a5ull, 0x3f2398d747b36224ull, 0xd29fe4b18e88640eull, 0x8eec7f0d19a03aadull,
+            0x83a3eeeef9153e89ull, 0x1953cf68300424acull, 0xa48ceaaab75a8e2bull, 0x5fa8c3423c052dd7ull,
+            0xcdb02555653131b6ull, 0x3792f412cb06794dull, 0x808e17555f3ebf11ull, 0xe2bbd88bbee40bd0ull,
+            0xa0b19d2ab70e6ed6ull, 0x5b6aceaeae9d0ec4ull, 0xc8de047564d20a8bull, 0xf245825a5a445275ull,
+            0xfb158592be068d2eull, 0xeed6e2f0f0d56712ull, 0x9ced737bb6c4183dull, 0x55464dd69685606bull,
+            0xc428d05aa4751e4cull, 0xaa97e14c3c26b886ull, 0xf53304714d9265dfull, 0xd53dd99f4b3066a8ull,
+            0x993fe2c6d07b7fabull, 0xe546a8038efe4029ull, 0xbf8fdb78849a5f96ull, 0xde98520472bdd033ull,
+            0xef73d256a5c0f77cull, 0x963e66858f6d4440ull, 0x95a8637627989aadull, 0xdde7001379a44aa8ull,
+            0xbb127c53b17ec159ull, 0x5560c018580d5d52ull, 0xe9d71b689dde71afull, 0xaab8f01e6e10b4a6ull,
+            0x9226712162ab070dull, 0xcab3961304ca70e8ull, 0xb6b00d69bb55c8d1ull, 0x3d607b97c5fd0d22ull,
+            0xe45c10c42a2b3b05ull, 0x8cb89a7db77c506aull, 0x8eb98a7a9a5b04e3ull, 0x77f3608e92adb242ull,
+            0xb267ed1940f1c61cull, 0x55f038b237591ed3ull, 0xdf01e85f912e37a3ull, 0x6b6c46dec52f6688ull,
+            0x8b61313bbabce2c6ull, 0x2323ac4b3b3da015ull, 0xae397d8aa96c1b77ull, 0xabec975e0a0d081aull,
+            0xd9c7dced53c72255ull, 0x96e7bd358c904a21ull, 0x881cea14545c7575ull, 0x7e50d64177da2e54ull,
+            0xaa242499697392d2ull, 0xdde50bd1d5d0b9e9ull, 0xd4ad2dbfc3d07787ull, 0x955e4ec64b44e864ull,
+            0x84ec3c97da624ab4ull, 0xbd5af13bef0b113eull, 0xa6274bbdd0fadd61ull, 0xecb1ad8aeacdd58eull,
+            0xcfb11ead453994baull, 0x67de18eda5814af2ull, 0x81ceb32c4b43fcf4ull, 0x80eacf948770ced7ull,
+            0xa2425ff75e14fc31ull, 0xa1258379a94d028dull, 0xcad2f7f5359a3b3eull, 0x096ee45813a04330ull,
+            0xfd87b5f28300ca0dull, 0x8bca9d6e188853fcull, 0x9e74d1b791e07e48ull, 0x775ea264cf55347eull,
+            0xc612062576589ddaull, 0x95364afe032a819eull, 0xf79687aed3eec551ull, 0x3a83ddbd83f52205ull,
+            0x9abe14cd44753b52ull, 0xc4926a9672793543ull, 0xc16d9a0095928a27ull, 0x75b7053c0f178294ull,
+            0xf1c90080baf72cb1ull, 0x5324c68b12dd6339ull, 0x971da05074da7beeull, 0xd3f6fc16ebca5e04ull,
+            0xbce5086492111aeaull, 0x88f4bb1ca6bcf585ull, 0xec1e4a7db69561a5ull, 0x2b31e9e3d06c32e6ull,
+            0x9392ee8e921d5d07ull, 0x3aff322e62439fd0ull, 0xb877aa3236a4b449ull, 0x09befeb9fad487c3ull,
+            0xe69594bec44de15bull, 0x4c2ebe687989a9b4ull, 0x901d7cf73ab0acd9ull, 0x0f9d37014bf60a11ull,
+            0xb424dc35095cd80full, 0x538484c19ef38c95ull, 0xe12e13424bb40e13ull, 0x2865a5f206b06fbaull,
+            0x8cbccc096f5088cbull, 0xf93f87b7442e45d4ull, 0xafebff0bcb24aafeull, 0xf78f69a51539d749ull,
+            0xdbe6fecebdedd5beull, 0xb573440e5a884d1cull, 0x89705f4136b4a597ull, 0x31680a88f8953031ull,
+            0xabcc77118461cefcull, 0xfdc20d2b36ba7c3eull, 0xd6bf94d5e57a42bcull, 0x3d32907604691b4dull,
+            0x8637bd05af6c69b5ull, 0xa63f9a49c2c1b110ull, 0xa7c5ac471b478423ull, 0x0fcf80dc33721d54ull,
+            0xd1b71758e219652bull, 0xd3c36113404ea4a9ull, 0x83126e978d4fdf3bull, 0x645a1cac083126eaull,
+            0xa3d70a3d70a3d70aull, 0x3d70a3d70a3d70a4ull, 0xccccccccccccccccull, 0xcccccccccccccccdull,
+            0x8000000000000000ull, 0x0000000000000000ull, 0xa000000000000000ull, 0x0000000000000000ull,
+            0xc800000000000000ull, 0x0000000000000000ull, 0xfa00000000000000ull, 0x0000000000000000ull,
+            0x9c40000000000000ull, 0x0000000000000000ull, 0xc350000000000000ull, 0x0000000000000000ull,
+            0xf424000000000000ull, 0x0000000000000000ull, 0x9896800000000000ull, 0x0000000000000000ull,
+            0xbebc200000000000ull, 0x0000000000000000ull, 0xee6b280000000000ull, 0x0000000000000000ull,
+            0x9502f90000000000ull, 0x0000000000000000ull, 0xba43b74000000000ull, 0x0000000000000000ull,
+            0xe8d4a51000000000ull, 0x0000000000000000ull, 0x9184e72a00000000ull, 0x0000000000000000ull,
+            0xb5e620f480000000ull, 0x0000000000000000ull, 0xe35fa931a0000000ull, 0x0000000000000000ull,
+            0x8e1bc9bf04000000ull, 0x0000000000000000ull, 0xb1a2bc2ec5000000ull, 0x0000000000000000ull,
+            0xde0b6b3a76400000ull, 0x0000000000000000ull, 0x8ac7230489e80000ull, 0x0000000000000000ull,
+            0xad78ebc5ac620000ull, 0x0000000000000000ull, 0xd8d726b7177a8000ull, 0x0000000000000000ull,
+            0x878678326eac9000ull, 0x0000000000000000ull, 0xa968163f0a57b400ull, 0x0000000000000000ull,
+            0xd3c21bcecceda100ull, 0x0000000000000000ull, 0x84595161401484a0ull, 0x0000000000000000ull,
+            0xa56fa5b99019a5c8ull, 0x0000000000000000ull, 0xcecb8f27f4200f3aull, 0x0000000000000000ull,
+            0x813f3978f8940984ull, 0x4000000000000000ull, 0xa18f07d736b90be5ull, 0x5000000000000000ull,
+            0xc9f2c9cd04674edeull, 0xa400000000000000ull, 0xfc6f7c4045812296ull, 0x4d00000000000000ull,
+            0x9dc5ada82b70b59dull, 0xf020000000000000ull, 0xc5371912364ce305ull, 0x6c28000000000000ull,
+            0xf684df56c3e01bc6ull, 0xc732000000000000ull, 0x9a130b963a6c115cull, 0x3c7f400000000000ull,
+            0xc097ce7bc90715b3ull, 0x4b9f100000000000ull, 0xf0bdc21abb48db20ull, 0x1e86d40000000000ull,
+            0x96769950b50d88f4ull, 0x1314448000000000ull, 0xbc143fa4e250eb31ull, 0x17d955a000000000ull,
+            0xeb194f8e1ae525fdull, 0x5dcfab0800000000ull, 0x92efd1b8d0cf37beull, 0x5aa1cae500000000ull,
+            0xb7abc627050305adull, 0xf14a3d9e40000000ull, 0xe596b7b0c643c719ull, 0x6d9ccd05d0000000ull,
+            0x8f7e32ce7bea5c6full, 0xe4820023a2000000ull, 0xb35dbf821ae4f38bull, 0xdda2802c8a800000ull,
+            0xe0352f62a19e306eull, 0xd50b2037ad200000ull, 0x8c213d9da502de45ull, 0x4526f422cc340000ull,
+            0xaf298d050e4395d6ull, 0x9670b12b7f410000ull, 0xdaf3f04651d47b4cull, 0x3c0cdd765f114000ull,
+            0x88d8762bf324cd0full, 0xa5880a69fb6ac800ull, 0xab0e93b6efee0053ull, 0x8eea0d047a457a00ull,
+            0xd5d238a4abe98068ull, 0x72a4904598d6d880ull, 0x85a36366eb71f041ull, 0x47a6da2b7f864750ull,
+            0xa70c3c40a64e6c51ull, 0x999090b65f67d924ull, 0xd0cf4b50cfe20765ull, 0xfff4b4e3f741cf6dull,
+            0x82818f1281ed449full, 0xbff8f10e7a8921a4ull, 0xa321f2d7226895c7ull, 0xaff72d52192b6a0dull,
+            0xcbea6f8ceb02bb39ull, 0x9bf4f8a69f764490ull, 0xfee50b7025c36a08ull, 0x02f236d04753d5b4ull,
+            0x9f4f2726179a2245ull, 0x01d762422c946590ull, 0xc722f0ef9d80aad6ull, 0x424d3ad2b7b97ef5ull,
+            0xf8ebad2b84e0d58bull, 0xd2e0898765a7deb2ull, 0x9b934c3b330c8577ull, 0x63cc55f49f88eb2full,
+            0xc2781f49ffcfa6d5ull, 0x3cbf6b71c76b25fbull, 0xf316271c7fc3908aull, 0x8bef464e3945ef7aull,
+            0x97edd871cfda3a56ull, 0x97758bf0e3cbb5acull, 0xbde94e8e43d0c8ecull, 0x3d52eeed1cbea317ull,
+            0xed63a231d4c4fb27ull, 0x4ca7aaa863ee4bddull, 0x945e455f24fb1cf8ull, 0x8fe8caa93e74ef6aull,
+            0xb975d6b6ee39e436ull, 0xb3e2fd538e122b44ull, 0xe7d34c64a9c85d44ull, 0x60dbbca87196b616ull,
+            0x90e40fbeea1d3a4aull, 0xbc8955e946fe31cdull, 0xb51d13aea4a488ddull, 0x6babab6398bdbe41ull,
+            0xe264589a4dcdab14ull, 0xc696963c7eed2dd1ull, 0x8d7eb76070a08aecull, 0xfc1e1de5cf543ca2ull,
+            0xb0de65388cc8ada8ull, 0x3b25a55f43294bcbull, 0xdd15fe86affad912ull, 0x49ef0eb713f39ebeull,
+            0x8a2dbf142dfcc7abull, 0x6e3569326c784337ull, 0xacb92ed9397bf996ull, 0x49c2c37f07965404ull,
+            0xd7e77a8f87daf7fbull, 0xdc33745ec97be906ull, 0x86f0ac99b4e8dafdull, 0x69a028bb3ded71a3ull,
+            0xa8acd7c0222311bcull, 0xc40832ea0d68ce0cull, 0xd2d80db02aabd62bull, 0xf50a3fa490c30190ull,
+            0x83c7088e1aab65dbull, 0x792667c6da79e0faull, 0xa4b8cab1a1563f52ull, 0x577001b891185938ull,
+            0xcde6fd5e09abcf26ull, 0xed4c0226b55e6f86ull, 0x80b05e5ac60b6178ull, 0x544f8158315b05b4ull,
+            0xa0dc75f1778e39d6ull, 0x696361ae3db1c721ull, 0xc913936dd571c84cull, 0x03bc3a19cd1e38e9ull,
+            0xfb5878494ace3a5full, 0x04ab48a04065c723ull, 0x9d174b2dcec0e47bull, 0x62eb0d64283f9c76ull,
+            0xc45d1df942711d9aull, 0x3ba5d0bd324f8394ull, 0xf5746577930d6500ull, 0xca8f44ec7ee36479ull,
+            0x9968bf6abbe85f20ull, 0x7e998b13cf4e1ecbull, 0xbfc2ef456ae276e8ull, 0x9e3fedd8c321a67eull,
+            0xefb3ab16c59b14a2ull, 0xc5cfe94ef3ea101eull, 0x95d04aee3b80ece5ull, 0xbba1f1d158724a12ull,
+            0xbb445da9ca61281full, 0x2a8a6e45ae8edc97ull, 0xea1575143cf97226ull, 0xf52d09d71a3293bdull,
+            0x924d692ca61be758ull, 0x593c2626705f9c56ull, 0xb6e0c377cfa2e12eull, 0x6f8b2fb00c77836cull,
+            0xe498f455c38b997aull, 0x0b6dfb9c0f956447ull, 0x8edf98b59a373fecull, 0x4724bd4189bd5eacull,
+            0xb2977ee300c50fe7ull, 0x58edec91ec2cb657ull, 0xdf3d5e9bc0f653e1ull, 0x2f2967b66737e3edull,
+            0x8b865b215899f46cull, 0xbd79e0d20082ee74ull, 0xae67f1e9aec07187ull, 0xecd8590680a3aa11ull,
+            0xda01ee641a708de9ull, 0xe80e6f4820cc9495ull, 0x884134fe908658b2ull, 0x3109058d147fdcddull,
+            0xaa51823e34a7eedeull, 0xbd4b46f0599fd415ull, 0xd4e5e2cdc1d1ea96ull, 0x6c9e18ac7007c91aull,
+            0x850fadc09923329eull, 0x03e2cf6bc604ddb0ull, 0xa6539930bf6bff45ull, 0x84db8346b786151cull,
+            0xcfe87f7cef46ff16ull, 0xe612641865679a63ull, 0x81f14fae158c5f6eull, 0x4fcb7e8f3f60c07eull,
+            0xa26da3999aef7749ull, 0xe3be5e330f38f09dull, 0xcb090c8001ab551cull, 0x5cadf5bfd3072cc5ull,
+            0xfdcb4fa002162a63ull, 0x73d9732fc7c8f7f6ull, 0x9e9f11c4014dda7eull, 0x2867e7fddcdd9afaull,
+            0xc646d63501a1511dull, 0xb281e1fd541501b8ull, 0xf7d88bc24209a565ull, 0x1f225a7ca91a4226ull,
+            0x9ae757596946075full, 0x3375788de9b06958ull, 0xc1a12d2fc3978937ull, 0x0052d6b1641c83aeull,
+            0xf209787bb47d6b84ull, 0xc0678c5dbd23a49aull, 0x9745eb4d50ce6332ull, 0xf840b7ba963646e0ull,
+            0xbd176620a501fbffull, 0xb650e5a93bc3d898ull, 0xec5d3fa8ce427affull, 0xa3e51f138ab4cebeull,
+            0x93ba47c980e98cdfull, 0xc66f336c36b10137ull, 0xb8a8d9bbe123f017ull, 0xb80b0047445d4184ull,
+            0xe6d3102ad96cec1dull, 0xa60dc059157491e5ull, 0x9043ea1ac7e41392ull, 0x87c89837ad68db2full,
+            0xb454e4a179dd1877ull, 0x29babe4598c311fbull, 0xe16a1dc9d8545e94ull, 0xf4296dd6fef3d67aull,
+            0x8ce2529e2734bb1dull, 0x1899e4a65f58660cull, 0xb01ae745b101e9e4ull, 0x5ec05dcff72e7f8full,
+            0xdc21a1171d42645dull, 0x76707543f4fa1f73ull, 0x899504ae72497ebaull, 0x6a06494a791c53a8ull,
+            0xabfa45da0edbde69ull, 0x0487db9d17636892ull, 0xd6f8d7509292d603ull, 0x45a9d2845d3c42b6ull,
+            0x865b86925b9bc5c2ull, 0x0b8a2392ba45a9b2ull, 0xa7f26836f282b732ull, 0x8e6cac7768d7141eull,
+            0xd1ef0244af2364ffull, 0x3207d795430cd926ull, 0x8335616aed761f1full, 0x7f44e6bd49e807b8ull,
+            0xa402b9c5a8d3a6e7ull, 0x5f16206c9c6209a6ull, 0xcd036837130890a1ull, 0x36dba887c37a8c0full,
+            0x802221226be55a64ull, 0xc2494954da2c9789ull, 0xa02aa96b06deb0fdull, 0xf2db9baa10b7bd6cull,
+            0xc83553c5c8965d3dull, 0x6f92829494e5acc7ull, 0xfa42a8b73abbf48cull, 0xcb772339ba1f17f9ull,
+            0x9c69a97284b578d7ull, 0xff2a760414536efbull, 0xc38413cf25e2d70dull, 0xfef5138519684abaull,
+            0xf46518c2ef5b8cd1ull, 0x7eb258665fc25d69ull, 0x98bf2f79d5993802ull, 0xef2f773ffbd97a61ull,
+            0xbeeefb584aff8603ull, 0xaafb550ffacfd8faull, 0xeeaaba2e5dbf6784ull, 0x95ba2a53f983cf38ull,
+            0x952ab45cfa97a0b2ull, 0xdd945a747bf26183ull, 0xba756174393d88dfull, 0x94f971119aeef9e4ull,
+            0xe912b9d1478ceb17ull, 0x7a37cd5601aab85dull, 0x91abb422ccb812eeull, 0xac62e055c10ab33aull,
+            0xb616a12b7fe617aaull, 0x577b986b314d6009ull, 0xe39c49765fdf9d94ull, 0xed5a7e85fda0b80bull,
+            0x8e41ade9fbebc27dull, 0x14588f13be847307ull, 0xb1d219647ae6b31cull, 0x596eb2d8ae258fc8ull,
+            0xde469fbd99a05fe3ull, 0x6fca5f8ed9aef3bbull, 0x8aec23d680043beeull, 0x25de7bb9480d5854ull,
+            0xada72ccc20054ae9ull, 0xaf561aa79a10ae6aull, 0xd910f7ff28069da4ull, 0x1b2ba1518094da04ull,
+            0x87aa9aff79042286ull, 0x90fb44d2f05d0842ull, 0xa99541bf57452b28ull, 0x353a1607ac744a53ull,
+            0xd3fa922f2d1675f2ull, 0x42889b8997915ce8ull, 0x847c9b5d7c2e09b7ull, 0x69956135febada11ull,
+            0xa59bc234db398c25ull, 0x43fab9837e699095ull, 0xcf02b2c21207ef2eull, 0x94f967e45e03f4bbull,
+            0x8161afb94b44f57dull, 0x1d1be0eebac278f5ull, 0xa1ba1ba79e1632dcull, 0x6462d92a69731732ull,
+            0xca28a291859bbf93ull, 0x7d7b8f7503cfdcfeull, 0xfcb2cb35e702af78ull, 0x5cda735244c3d43eull,
+            0x9defbf01b061adabull, 0x3a0888136afa64a7ull, 0xc56baec21c7a1916ull, 0x088aaa1845b8fdd0ull,
+            0xf6c69a72a3989f5bull, 0x8aad549e57273d45ull, 0x9a3c2087a63f6399ull, 0x36ac54e2f678864bull,
+            0xc0cb28a98fcf3c7full, 0x84576a1bb416a7ddull, 0xf0fdf2d3f3c30b9full, 0x656d44a2a11c51d5ull,
+            0x969eb7c47859e743ull, 0x9f644ae5a4b1b325ull, 0xbc4665b596706114ull, 0x873d5d9f0dde1feeull,
+            0xeb57ff22fc0c7959ull, 0xa90cb506d155a7eaull, 0x9316ff75dd87cbd8ull, 0x09a7f12442d588f2ull,
+            0xb7dcbf5354e9beceull, 0x0c11ed6d538aeb2full, 0xe5d3ef282a242e81ull, 0x8f1668c8a86da5faull,
+            0x8fa475791a569d10ull, 0xf96e017d694487bcull, 0xb38d92d760ec4455ull, 0x37c981dcc395a9acull,
+            0xe070f78d3927556aull, 0x85bbe253f47b1417ull, 0x8c469ab843b89562ull, 0x93956d7478ccec8eull,
+            0xaf58416654a6babbull, 0x387ac8d1970027b2ull, 0xdb2e51bfe9d0696aull, 0x06997b05fcc0319eull,
+            0x88fcf317f22241e2ull, 0x441fece3bdf81f03ull, 0xab3c2fddeeaad25aull, 0xd527e81cad7626c3ull,
+            0xd60b3bd56a5586f1ull, 0x8a71e223d8d3b074ull, 0x85c7056562757456ull, 0xf6872d5667844e49ull,
+            0xa738c6bebb12d16cull, 0xb428f8ac016561dbull, 0xd106f86e69d785c7ull, 0xe13336d701beba52ull,
+            0x82a45b450226b39cull, 0xecc0024661173473ull, 0xa34d721642b06084ull, 0x27f002d7f95d0190ull,
+            0xcc20ce9bd35c78a5ull, 0x31ec038df7b441f4ull, 0xff290242c83396ceull, 0x7e67047175a15271ull,
+            0x9f79a169bd203e41ull, 0x0f0062c6e984d386ull, 0xc75809c42c684dd1ull, 0x52c07b78a3e60868ull,
+            0xf92e0c3537826145ull, 0xa7709a56ccdf8a82ull, 0x9bbcc7a142b17ccbull, 0x88a66076400bb691ull,
+            0xc2abf989935ddbfeull, 0x6acff893d00ea435ull, 0xf356f7ebf83552feull, 0x0583f6b8c4124d43ull,
+            0x98165af37b2153deull, 0xc3727a337a8b704aull, 0xbe1bf1b059e9a8d6ull, 0x744f18c0592e4c5cull,
+            0xeda2ee1c7064130cull, 0x1162def06f79df73ull, 0x9485d4d1c63e8be7ull, 0x8addcb5645ac2ba8ull,
+            0xb9a74a0637ce2ee1ull, 0x6d953e2bd7173692ull, 0xe8111c87c5c1ba99ull, 0xc8fa8db6ccdd0437ull,
+            0x910ab1d4db9914a0ull, 0x1d9c9892400a22a2ull, 0xb54d5e4a127f59c8ull, 0x2503beb6d00cab4bull,
+            0xe2a0b5dc971f303aull, 0x2e44ae64840fd61dull, 0x8da471a9de737e24ull, 0x5ceaecfed289e5d2ull,
+            0xb10d8e1456105dadull, 0x7425a83e872c5f47ull, 0xdd50f1996b947518ull, 0xd12f124e28f77719ull,
+            0x8a5296ffe33cc92full, 0x82bd6b70d99aaa6full, 0xace73cbfdc0bfb7bull, 0x636cc64d1001550bull,
+            0xd8210befd30efa5aull, 0x3c47f7e05401aa4eull, 0x8714a775e3e95c78ull, 0x65acfaec34810a71ull,
+            0xa8d9d1535ce3b396ull, 0x7f1839a741a14d0dull, 0xd31045a8341ca07cull, 0x1ede48111209a050ull,
+            0x83ea2b892091e44dull, 0x934aed0aab460432ull, 0xa4e4b66b68b65d60ull, 0xf81da84d5617853full,
+            0xce1de40642e3f4b9ull, 0x36251260ab9d668eull, 0x80d2ae83e9ce78f3ull, 0xc1d72b7c6b426019ull,
+            0xa1075a24e4421730ull, 0xb24cf65b8612f81full, 0xc94930ae1d529cfcull, 0xdee033f26797b627ull,
+            0xfb9b7cd9a4a7443cull, 0x169840ef017da3b1ull, 0x9d412e0806e88aa5ull, 0x8e1f289560ee864eull,
+            0xc491798a08a2ad4eull, 0xf1a6f2bab92a27e2ull, 0xf5b5d7ec8acb58a2ull, 0xae10af696774b1dbull,
+            0x9991a6f3d6bf1765ull, 0xacca6da1e0a8ef29ull, 0xbff610b0cc6edd3full, 0x17fd090a58d32af3ull,
+            0xeff394dcff8a948eull, 0xddfc4b4cef07f5b0ull, 0x95f83d0a1fb69cd9ull, 0x4abdaf101564f98eull,
+            0xbb764c4ca7a4440full, 0x9d6d1ad41abe37f1ull, 0xea53df5fd18d5513ull, 0x84c86189216dc5edull,
+            0x92746b9be2f8552cull, 0x32fd3cf5b4e49bb4ull, 0xb7118682dbb66a77ull, 0x3fbc8c33221dc2a1ull,
+            0xe4d5e82392a40515ull, 0x0fabaf3feaa5334aull, 0x8f05b1163ba6832dull, 0x29cb4d87f2a7400eull,
+            0xb2c71d5bca9023f8ull, 0x743e20e9ef511012ull, 0xdf78e4b2bd342cf6ull, 0x914da9246b255416ull,
+            0x8bab8eefb6409c1aull, 0x1ad089b6c2f7548eull, 0xae9672aba3d0c320ull, 0xa184ac2473b529b1ull,
+            0xda3c0f568cc4f3e8ull, 0xc9e5d72d90a2741eull, 0x8865899617fb1871ull, 0x7e2fa67c7a658892ull,
+            0xaa7eebfb9df9de8dull, 0xddbb901b98feeab7ull, 0xd51ea6fa85785631ull, 0x552a74227f3ea565ull,
+            0x8533285c936b35deull, 0xd53a88958f87275full, 0xa67ff273b8460356ull, 0x8a892abaf368f137ull,
+            0xd01fef10a657842cull, 0x2d2b7569b0432d85ull, 0x8213f56a67f6b29bull, 0x9c3b29620e29fc73ull,
+            0xa298f2c501f45f42ull, 0x8349f3ba91b47b8full, 0xcb3f2f7642717713ull, 0x241c70a936219a73ull,
+            0xfe0efb53d30dd4d7ull, 0xed238cd383aa0110ull, 0x9ec95d1463e8a506ull, 0xf4363804324a40aaull,
+            0xc67bb4597ce2ce48ull, 0xb143c6053edcd0d5ull, 0xf81aa16fdc1b81daull, 0xdd94b7868e94050aull,
+            0x9b10a4e5e9913128ull, 0xca7cf2b4191c8326ull, 0xc1d4ce1f63f57d72ull, 0xfd1c2f611f63a3f0ull,
+            0xf24a01a73cf2dccfull, 0xbc633b39673c8cecull, 0x976e41088617ca01ull, 0xd5be0503e085d813ull,
+            0xbd49d14aa79dbc82ull, 0x4b2d8644d8a74e18ull, 0xec9c459d51852ba2ull, 0xddf8e7d60ed1219eull,
+            0x93e1ab8252f33b45ull, 0xcabb90e5c942b503ull, 0xb8da1662e7b00a17ull, 0x3d6a751f3b936243ull,
+            0xe7109bfba19c0c9dull, 0x0cc512670a783ad4ull, 0x906a617d450187e2ull, 0x27fb2b80668b24c5ull,
+            0xb484f9dc9641e9daull, 0xb1f9f660802dedf6ull, 0xe1a63853bbd26451ull, 0x5e7873f8a0396973ull,
+            0x8d07e33455637eb2ull, 0xdb0b487b6423e1e8ull, 0xb049dc016abc5e5full, 0x91ce1a9a3d2cda62ull,
+            0xdc5c5301c56b75f7ull, 0x7641a140cc7810fbull, 0x89b9b3e11b6329baull, 0xa9e904c87fcb0a9dull,
+            0xac2820d9623bf429ull, 0x546345fa9fbdcd44ull, 0xd732290fbacaf133ull, 0xa97c177947ad4095ull,
+            0x867f59a9d4bed6c0ull, 0x49ed8eabcccc485dull, 0xa81f301449ee8c70ull, 0x5c68f256bfff5a74ull,
+            0xd226fc195c6a2f8cull, 0x73832eec6fff3111ull, 0x83585d8fd9c25db7ull, 0xc831fd53c5ff7eabull,
+            0xa42e74f3d032f525ull, 0xba3e7ca8b77f5e55ull, 0xcd3a1230c43fb26full, 0x28ce1bd2e55f35ebull,
+            0x80444b5e7aa7cf85ull, 0x7980d163cf5b81b3ull, 0xa0555e361951c366ull, 0xd7e105bcc332621full,
+            0xc86ab5c39fa63440ull, 0x8dd9472bf3fefaa7ull, 0xfa856334878fc150ull, 0xb14f98f6f0feb951ull,
+            0x9c935e00d4b9d8d2ull, 0x6ed1bf9a569f33d3ull, 0xc3b8358109e84f07ull, 0x0a862f80ec4700c8ull,
+            0xf4a642e14c6262c8ull, 0xcd27bb612758c0faull, 0x98e7e9cccfbd7dbdull, 0x8038d51cb897789cull,
+            0xbf21e44003acdd2cull, 0xe0470a63e6bd56c3ull, 0xeeea5d5004981478ull, 0x1858ccfce06cac74ull,
+            0x95527a5202df0ccbull, 0x0f37801e0c43ebc8ull, 0xbaa718e68396cffdull, 0xd30560258f54e6baull,
+            0xe950df20247c83fdull, 0x47c6b82ef32a2069ull, 0x91d28b7416cdd27eull, 0x4cdc331d57fa5441ull,
+            0xb6472e511c81471dull, 0xe0133fe4adf8e952ull, 0xe3d8f9e563a198e5ull, 0x58180fddd97723a6ull,
+            0x8e679c2f5e44ff8full, 0x570f09eaa7ea7648ull
+            };
+            return powers;
+        }
+
+        // Eisel-Lemire: w * 10^q (w != 0) rounded to nearest even, as the biased exponent and the
+        // mantissa fields of a T (the 128 bit product is always precise enough: Mushtak and Lemire,
+        // "Fast number parsing without fallback")
+        template <typename T>
+        void eisel_lemire(std::int64_t q, std::uint64_t w, std::int32_t& power2, std::uint64_t& mantissa) {
+            typedef binary_format<T> format;
+            const int mantissa_bits = format::mantissa_bits;
+            mantissa = 0;
+            power2 = 0;
+            if (q < format::smallest_power)
+                return;
+            if (q > format::largest_power) {
+                power2 = format::infinite_power;
+                return;
+            }
+            unsigned lz = leading_zeros64(w);
+            w <<= lz;
+
+            // w times the 128 bit truncated power of five (the second half only when it matters)
+            const std::uint64_t* power = powers_of_five() + 2 * (q + 342);
+            std::uint64_t low, high = multiply_128(w, power[0], low);
+            const std::uint64_t precision_mask = ~std::uint64_t(0) >> (mantissa_bits + 3);
+            if ((high & precision_mask) == precision_mask) {
+                std::uint64_t low2, high2 = multiply_128(w, power[1], low2);
+                (void)low2;
+                low += high2;
+                if (high2 > low)
+                    ++high;
+            }
+
+            int upper = static_cast<int>(high >> 63);
+            int shift = upper + 64 - mantissa_bits - 3;
+            mantissa = high >> shift;
+            power2 = static_cast<std::int32_t>((((152170 + 65536) * q) >> 16) + 63 + upper - lz - format::minimum_exponent);
+            if (power2 <= 0) {
+                // subnormal
+                if (-power2 + 1 >= 64) {
+                    mantissa = 0;
+                    power2 = 0;
+                    return;
+                }
+                mantissa >>= -power2 + 1;
+                mantissa += mantissa & 1;
+                mantissa >>= 1;
+                power2 = mantissa < (std::uint64_t(1) << mantissa_bits) ? 0 : 1;
+                return;
+            }
+            // exactly halfway between two floats (only possible for small powers): round to even
+            if (low <= 1 && q >= format::min_round_to_even && q <= format::max_round_to_even &&
+                (mantissa & 3) == 1 && (mantissa << shift) == high)
+                mantissa &= ~std::uint64_t(1);
+            mantissa += mantissa & 1;
+            mantissa >>= 1;
+            if (mantissa >= (std::uint64_t(2) << mantissa_bits)) {
+                mantissa = std::uint64_t(1) << mantissa_bits;
+                ++power2;
+            }
+            mantissa &= ~(std::uint64_t(1) << mantissa_bits);
+            if (power2 >= format::infinite_power) {
+                power2 = format::infinite_power;
+                mantissa = 0;
+            }
+        }
+
+        // inf, infinity or nan in any case
+        template <typename T, typename chT>
+        parse_error parse_special(const chT* p, const chT* last, bool negative, T& value) {
+            static const char* names[] = { "inf", "infinity", "nan" };
+            for (int i = 0; i < 3; ++i) {
+                const char* name = names[i];
+                const chT* s = p;
+                for (; s != last && *name != 0 && (code_unit(*s) | 0x20) == static_cast<unsigned char>(*name); ++s, ++name)
+                    ;
+                if (s == last && *name == 0) {
+                    value = i < 2 ? std::numeric_limits<T>::infinity() : std::numeric_limits<T>::quiet_NaN();
+                    if (negative)
+                        value = -value;
+                    return no_error;
+                }
+            }
+            return invalid_number;
+        }
+
+        // decimal to binary conversion of the digits in [first, last) (a '.' may be among them) times 10^exponent,
+        // for the rare numbers Eisel-Lemire can't round because they have more than 19 significant digits:
+        // the digits are handed to strtod/strtof as an integer with an exponent, so the locale's decimal point
+        // doesn't matter. Digits past the 767th can only break ties, a 768th digit of 1 stands in for them.
+        template <typename T, typename chT>
+        T parse_long_decimal(const chT* first, const chT* last, std::int64_t exponent) {
+            char buffer[800];
+            size_t n = 0;
+            bool fraction = false, sticky = false;
+            for (; first != last; ++first) {
+                if (*first == chT('.'))
+                    fraction = true;
+                else if (n == 0 && *first == chT('0'))
+                    exponent -= fraction;
+                else if (n < 767) {
+                    buffer[n++] = static_cast<char>(*first);
+                    exponent -= fraction;
+                } else {
+                    exponent += !fraction;
+                    sticky = sticky || *first != chT('0');
+                }
+            }
+            if (sticky) {
+                buffer[n++] = '1';
+                --exponent;
+            }
+            buffer[n++] = 'e';
+            if (exponent < 0) {
+                buffer[n++] = '-';
+                exponent = -exponent;
+            }
+            char digits[24];
+            size_t d = 0;
+            do {
+                digits[d++] = static_cast<char>('0' + exponent % 10);
+                exponent /= 10;
+            } while (exponent != 0);
+            while (d != 0)
+                buffer[n++] = digits[--d];
+            buffer[n] = 0;
+            return binary_format<T>::slow_parse(buffer);
+        }
+
+        // [+-]digits[.digits][(e|E)[+-]digits], inf, infinity or nan, correctly rounded
+        template <typename T, typename chT>
+        parse_error parse_float(const chT* p, const chT* last, T& value) {
+            typedef binary_format<T> format;
+            bool negative = p != last && *p == chT('-');
+            if (p != last && (*p == chT('-') || *p == chT('+')))
+                ++p;
+
+            // the digits, accumulated into w (modulo 2^64 if there are more than 19)
+            const chT* start = p;
+            std::uint64_t w = 0;
+            p = accumulate_digits(p, last, w);
+            const chT* integer_end = p;
+            const chT* fraction = p;
+            if (p != last && *p == chT('.')) {
+                fraction = ++p;
+                p = accumulate_digits(p, last, w);
+            }
+            const chT* fraction_end = p;
+            std::int64_t digits = (integer_end - start) + (fraction_end - fraction);
+            if (digits == 0)
+                return fraction_end == start ? parse_special(start, last, negative, value) : invalid_number;
+
+            std::int64_t exponent = 0;
+            if (p != last && (*p == chT('e') || *p == chT('E'))) {
+                bool negative_exponent = ++p != last && *p == chT('-');
+                if (p != last && (*p == chT('-') || *p == chT('+')))
+                    ++p;
+                if (p == last || !is_digit(code_unit(*p)))
+                    return invalid_number;
+                for (; p != last && is_digit(code_unit(*p)); ++p)
+                    if (exponent < 0x10000)
+                        exponent = exponent * 10 + (code_unit(*p) - '0');
+                if (negative_exponent)
+                    exponent = -exponent;
+            }
+            if (p != last)
+                return invalid_number;
+
+            // more than 19 significant digits: keep the first 19
+            std::int64_t q = exponent - (fraction_end - fraction);
+            bool truncated = false;
+            if (digits > 19) {
+                for (const chT* s = start; s != fraction_end && (*s == chT('0') || *s == chT('.')); ++s)
+                    digits -= *s == chT('0');
+                if (digits > 19) {
+                    truncated = true;
+                    w = 0;
+                    const chT* s = start;
+                    for (; w < 1000000000000000000ull && s != integer_end; ++s)
+                        w = w * 10 + (code_unit(*s) - '0');
+                    if (s != integer_end)
+                        q = exponent + (integer_end - s);
+                    else {
+                        for (s = fraction; w < 1000000000000000000ull && s != fraction_end; ++s)
+                            w = w * 10 + (code_unit(*s) - '0');
+                        q = exponent - (s - fraction);
+                    }
+                }
+            }
+
+            // Clinger's fast path: w and 10^|q| are exact, so there is only one rounding
+#if !defined(FLT_EVAL_METHOD) || FLT_EVAL_METHOD == 0
+            if (!truncated && q >= -format::max_exact_power && q <= format::max_exact_power &&
+                w <= (std::uint64_t(1) << (format::mantissa_bits + 1))) {
+                T v = static_cast<T>(w);
+                v = q < 0 ? v / format::exact_power(static_cast<int>(-q)) : v * format::exact_power(static_cast<int>(q));
+                value = negative ? -v : v;
+                return no_error;
+            }
+#endif
+            std::int32_t power2 = 0;
+            std::uint64_t mantissa = 0;
+            if (w != 0)
+                eisel_lemire<T>(q, w, power2, mantissa);
+            if (truncated) {
+                // the dropped digits are worth less than 1 in the last digit kept
+                std::int32_t power2_up;
+                std::uint64_t mantissa_up;
+                eisel_lemire<T>(q, w + 1, power2_up, mantissa_up);
+                if (power2_up != power2 || mantissa_up != mantissa) {
+                    T v = parse_long_decimal<T>(start, fraction_end, exponent);
+                    value = negative ? -v : v;
+                    return v == std::numeric_limits<T>::infinity() ? number_out_of_range : no_error;
+                }
+            }
+            typename format::bits bits = static_cast<typename format::bits>(
+                mantissa | (static_cast<std::uint64_t>(power2) << format::mantissa_bits) |
+                (static_cast<std::uint64_t>(negative) << (sizeof(T) * 8 - 1)));
+            std::memcpy(&value, &bits, sizeof(T));
+            return power2 == format::infinite_power ? number_out_of_range : no_error;
+        }
+
+        template <typename T, typename chT>
+        parse_error parse_number(const chT* p, const chT* last, T& value, std::true_type) {
+            return parse_float(p, last, value);
+        }
+
+        template <typename T, typename chT>
+        parse_error parse_number(const chT* p, const chT* last, T& value, std::false_type) {
+            return parse_integer(p, last, value);
+        }
+
+        template <typename T, typename chT>
+        parse_error parse_number(const chT* p, const chT* last, T& value) {
+            return parse_number(p, last, value, std::is_floating_point<T>());
+        }
+
+        // forward and reverse separator searches for a character, a character set or a predicate
+        template <typename chT>
+        struct separator
+        {
+            static bool matches(chT c, chT ch) { return c == ch; }
+            static const chT* find(const chT* first, const chT* last, chT ch) { return find_char(first, last, ch); }
+            static const chT* rfind(const chT* first, const chT* last, chT ch) { return rfind_char(first, last, ch); }
+
+            template <typename F>
+            static void for_each(const chT* first, const chT* last, chT ch, F& f) { for_each_char(first, last, ch, f); }
+
+            static bool matches(chT c, const is_any_of<chT>& match) { return match(c); }
+            static const chT* find(const chT* first, const chT* last, const is_any_of<chT>& match) {
+                return find_any(first, last, match.chars());
+            }
+
+            template <typename F>
+            static void for_each(const chT* first, const chT* last, const is_any_of<chT>& match, F& f) {
+                for_each_any(first, last, match.chars(), f);
+            }
+
+            template <typename Match>
+            static bool matches(chT c, const Match& match) { return match(c); }
+
+            template <typename Match>
+            static const chT* find(const chT* first, const chT* last, const Match& match) {
+                for (; first != last; ++first)
+                    if (match(*first))
+                        return first;
+                return last;
+            }
+
+            template <typename Match, typename F>
+            static void for_each(const chT* first, const chT* last, const Match& match, F& f) {
+                for (; first != last; ++first)
+                    if (match(*first))
+                        f(first);
+            }
+
+            template <typename Match>
+            static const chT* rfind(const chT* first, const chT* last, const Match& match) {
+                for (const chT* p = last; p != first; --p)
+                    if (match(p[-1]))
+                        return p - 1;
+                return last;
+            }
+        };
+
+        // the operations which look at whole characters rather than code units: white space,
+        // case-insensitive comparison and hashing. Traits whose characters can take more than one
+        // code unit specialize it (see utf8.h).
+        template <typename TT>
+        struct text_ops {
+            typedef typename TT::char_type chT;
+
+            // strings which differ in length can't be equal, even ignoring case
+            enum { fixed_width = 1 };
+
+            // first character which isn't white space, or last
+            static STREF_CONSTEXPR const chT* skip_whitespace(const chT* first, const chT* last) {
+                while (first != last && TT::is_whitespace(*first))
+                    ++first;
+                return first;
+            }
+
+            // end of the characters before the trailing white space
+            static STREF_CONSTEXPR const chT* skip_whitespace_back(const chT* first, const chT* last) {
+                while (last != first && TT::is_whitespace(last[-1]))
+                    --last;
+                return last;
+            }
+
+            // ASCII letters are folded in bulk, the traits' to_lower_case() is only used for other characters
+            static int icompare(const chT* a, size_t na, const chT* b, size_t nb) {
+                size_t len = std::min(na, nb);
+                for (size_t i = 0; i < len; ++i) {
+                    if (ascii_case_folding<TT>::value)
+                        if ((i += ascii_imismatch(a + i, b + i, len - i)) == len)
+                            break;
+                    chT c1 = TT::to_lower_case(a[i]), c2 = TT::to_lower_case(b[i]);
+                    if (c1 != c2) return c1 - c2;
+                }
+                return na == nb ? 0 : na < nb ? -1 : 1;
+            }
 
-    // char traits
-    class char_traits
-    {
-    public:
-        typedef char char_type;
-        static char to_lower_case(char ch) { return std::tolower(ch); }
-        static bool is_whitespace(char ch) { return !!std::isspace(ch); }
-    };
+            // the text at the start or end of a which matches b ignoring case, or nullptr
+            static const chT* iprefix(const chT* a, size_t na, const chT* b, size_t nb) {
+                return na >= nb && icompare(a, nb, b, nb) == 0 ? a : nullptr;
+            }
 
-    // wchar_t traits
-    class wchar_traits
-    {
-    public:
-        typedef wchar_t char_type;
-        static wchar_t to_lower_case(wchar_t ch) { return std::towlower(ch); }
-        static bool is_whitespace(wchar_t ch) { return !!std::iswspace(ch); }
-    };
+            static const chT* isuffix(const chT* a, size_t na, const chT* b, size_t nb) {
+                return na >= nb && icompare(a + na - nb, nb, b, nb) == 0 ? a + na - nb : nullptr;
+            }
+
+            static std::uint64_t ihash(const chT* p, size_t n) { return ihash_units<TT>(p, n); }
+        };
+
+    }
 
     // basic string reference
     template <typename TT>
@@ -74,32 +1919,32 @@ namespace tools {
         typedef typename TT::char_type chT;
 
     public:
-        basic_stref<TT>(const bstref& sr) : ref(sr.ref), len(sr.len) {}
-        basic_stref<TT>(const chT* str) : ref(str), len(0) { while (str[len] != 0) ++len; }
-        basic_stref<TT>(const chT* str, size_t len) : ref(str), len(len) {}
+        constexpr basic_stref<TT>(const bstref& sr) : ref(sr.ref), len(sr.len) {}
+        STREF_CONSTEXPR basic_stref<TT>(const chT* str) : ref(str), len(length_of(str)) {}
+        constexpr basic_stref<TT>(const chT* str, size_t len) : ref(str), len(len) {}
         basic_stref<TT>(const std::basic_string<chT>& str) : ref(str.data()), len(str.length()) {}
 
-        bstref& operator= (const bstref& sr) {
+        STREF_CONSTEXPR bstref& operator= (const bstref& sr) {
             ref = sr.ref;
             len = sr.len;
             return *this;
         }
 
-        chT operator[] (int index) const { return _at(index); }
+        constexpr chT operator[] (size_t index) const { return _at(index); }
 
-        chT at(int index) const {
-            if (index < 0 || index >= length())
+        STREF_CONSTEXPR chT at(size_t index) const {
+            if (index >= length())
                 throw bad_stref_op("at(): invalid index");
-            return _at[index];
+            return _at(index);
         }
 
-        chT front() const {
+        STREF_CONSTEXPR chT front() const {
             if (length() == 0)
                 throw bad_stref_op("front(): length == 0");
             return _front();
         }
 
-        chT back() const {
+        STREF_CONSTEXPR chT back() const {
             if (length() == 0)
                 throw bad_stref_op("back(): length == 0");
             return _back();
@@ -109,42 +1954,43 @@ namespace tools {
         //  relational operators
         //
 
-        int compare(const bstref& rhs) const {
+        STREF_CONSTEXPR int compare(const bstref& rhs) const {
             size_t len = std::min(length(), rhs.length());
-            for (size_t i = 0; i < len; ++i)
-                if (_at(i) != rhs._at(i))
-                    return _at(i) - rhs._at(i);
-            return length() == rhs.length() ? 0 : length() - rhs.length();
+            STREF_COUNT(op_compare, len * sizeof(chT), 0);
+            size_t i = STREF_CONSTANT_EVALUATED() ? detail::mismatch_scalar(ref, rhs.ref, len) : detail::mismatch(ref, rhs.ref, len);
+            if (i < len)
+                return _at(i) - rhs._at(i);
+            return length() == rhs.length() ? 0 : length() < rhs.length() ? -1 : 1;
         }
 
-        bool operator== (const bstref& rhs) const {
+        STREF_CONSTEXPR bool operator== (const bstref& rhs) const {
+            STREF_COUNT(op_equals, len == rhs.len ? len * sizeof(chT) : 0, 0);
             if (len != rhs.len) return false;    // different lengths, cannot be equal
+            if (STREF_CONSTANT_EVALUATED()) return detail::mismatch_scalar(ref, rhs.ref, len) == len;
             if (ref == rhs.ref) return true;    // same object (+same length), must be equal
-            return compare(rhs) == 0;
+            return std::memcmp(ref, rhs.ref, len * sizeof(chT)) == 0;
         }
 
-        bool operator!= (const bstref& rhs) const {
-            if (len != rhs.len) return true;    // different lengths, must be unequal
-            if (ref == rhs.ref) return false;    // same object (+same length), cannot be unequal
-            return compare(rhs) != 0;
+        STREF_CONSTEXPR bool operator!= (const bstref& rhs) const {
+            return !(*this == rhs);
         }
 
-        bool operator< (const bstref& rhs) const {
+        STREF_CONSTEXPR bool operator< (const bstref& rhs) const {
             if (ref == rhs.ref && len < rhs.len) return true;   // same string, shorter
             return compare(rhs) < 0;
         }
 
-        bool operator<= (const bstref& rhs) const {
+        STREF_CONSTEXPR bool operator<= (const bstref& rhs) const {
             if (ref == rhs.ref && len <= rhs.len) return true;  // same string, equal length or shorter
             return compare(rhs) <= 0;
         }
 
-        bool operator> (const bstref& rhs) const {
+        STREF_CONSTEXPR bool operator> (const bstref& rhs) const {
             if (ref == rhs.ref && rhs.len > len) return true;   // same string, longer
             return compare(rhs) > 0;
         }
 
-        bool operator>= (const bstref& rhs) const {
+        STREF_CONSTEXPR bool operator>= (const bstref& rhs) const {
             if (ref == rhs.ref && rhs.len >= len) return true;  // same string, equal length or longer
             return compare(rhs) >= 0;
         }
@@ -154,23 +2000,19 @@ namespace tools {
         //
 
         int icompare(const bstref& rhs) const {
-            size_t len = std::min(length(), rhs.length());
-            for (size_t i = 0; i < len; ++i) {
-                chT c1 = to_lower_case(_at(i)), c2 = to_lower_case(rhs._at(i));
-                if (c1 != c2) return c1 - c2;            
-            }
-            return length() == rhs.length() ? 0 : length() - rhs.length();
+            STREF_COUNT(op_icompare, std::min(len, rhs.len) * sizeof(chT), 0);
+            return detail::text_ops<TT>::icompare(ref, len, rhs.ref, rhs.len);
         }
 
         bool iequals(const bstref& rhs) const {
-            if (len != rhs.len) return false;    // different lengths, cannot be equal
-            if (ref == rhs.ref) return true;    // same object (+same length), must be equal
+            if (detail::text_ops<TT>::fixed_width && len != rhs.len) return false;    // different lengths, cannot be equal
+            if (ref == rhs.ref && len == rhs.len) return true;    // same object and length, must be equal
             return icompare(rhs) == 0;
         }
 
         bool inot_equals(const bstref& rhs) const {
-            if (len != rhs.len) return true;    // different lengths, must be unequal
-            if (ref == rhs.ref) return false;    // same object (+same length), cannot be unequal
+            if (detail::text_ops<TT>::fixed_width && len != rhs.len) return true;    // different lengths, must be unequal
+            if (ref == rhs.ref && len == rhs.len) return false;    // same object and length, cannot be unequal
             return icompare(rhs) != 0;
         }
 
@@ -198,7 +2040,7 @@ namespace tools {
         // predicates
         //
 
-        bool starts_with(const bstref& rhs) const {
+        STREF_CONSTEXPR bool starts_with(const bstref& rhs) const {
             if (rhs.length() == 0) return true;            // everything starts with an empty string
             if (length() < rhs.length()) return false;    // "starts with" string is longer than tested string
             return left(rhs.length()) == rhs;
@@ -206,11 +2048,10 @@ namespace tools {
 
         bool istarts_with(const bstref& rhs) const {
             if (rhs.length() == 0) return true;            // everything starts with an empty string
-            if (length() < rhs.length()) return false;    // "starts with" string is longer than tested string
-            return left(rhs.length()).icompare(rhs) == 0;
+            return detail::text_ops<TT>::iprefix(ref, len, rhs.ref, rhs.len) != nullptr;
         }
 
-        bool ends_with(const bstref& rhs) const {
+        STREF_CONSTEXPR bool ends_with(const bstref& rhs) const {
             if (rhs.length() == 0) return true;            // everything ends with an empty string
             if (length() < rhs.length()) return false;    // "ends with" string is longer than tested string
             return right(rhs.length()) == rhs;
@@ -218,87 +2059,140 @@ namespace tools {
 
         bool iends_with(const bstref& rhs) const {
             if (rhs.length() == 0) return true;            // everything ends with an empty string
-            if (length() < rhs.length()) return false;    // "ends with" string is longer than tested string
-            return right(rhs.length()).icompare(rhs) == 0;
+            return detail::text_ops<TT>::isuffix(ref, len, rhs.ref, rhs.len) != nullptr;
         }
 
         bool has(const chT ch) const {
-            for (size_t i = 0; i < len; ++i)
-                if (_at(i) == ch)
-                    return true;
-            return false;
+            return detail::find_char(begin(), end(), ch) != end();
         }
 
         bool has_any_of(const bstref& charset) const {
-            for (size_t i = 0; i < len; ++i)
-                if (std::find(charset.begin(), charset.end(), _at(i)) != charset.end())
-                    return true;
-            return false;
+            detail::char_set<chT> set(charset.begin(), charset.end());
+            return detail::find_any(begin(), end(), set) != end();
         }
 
         //
         // string algorithms
         //
 
-        bstref substr(size_t offset, size_t len) const {
+        STREF_CONSTEXPR bstref substr(size_t offset, size_t len) const {
             return offset >= length()
                 ? bstref(ref, 0)
                 : bstref(ref + offset, std::min(len, this->len - offset));
         }
 
-        bstref substr(size_t offset) const {
+        STREF_CONSTEXPR bstref substr(size_t offset) const {
             return offset >= len
                 ? bstref(ref, 0)
                 : bstref(ref + offset, len - offset);
         }
 
-        bstref left(size_t len) const {
+        STREF_CONSTEXPR bstref left(size_t len) const {
             return substr(0, len);
         }
 
-        bstref middle(size_t from, size_t to) const {
+        STREF_CONSTEXPR bstref middle(size_t from, size_t to) const {
             if (to >= len) to = len - 1;
             return from > to
                 ? bstref(ref, 0)
                 : bstref(ref + from, to - from + 1);
         }
 
-        bstref right(size_t len) const {
+        STREF_CONSTEXPR bstref right(size_t len) const {
             len = std::min(len, length());
             return substr(length() - len, len);
         }
 
-        bstref trim_left() const {
-            bstref s(*this);
-            while (s.length() > 0 && is_whitespace(s._front()))
-                ++s.ref, --s.len;
+        STREF_CONSTEXPR bstref trim_left() const {
+            bstref s = skip_left();
+            STREF_COUNT(op_trim, (len - s.len) * sizeof(chT), 0);
             return s;
         }
 
-        bstref trim_right() const {
-            bstref s(*this);
-            while (s.length() > 0 && is_whitespace(s._back()))
-                --s.len;
+        STREF_CONSTEXPR bstref trim_right() const {
+            bstref s = skip_right();
+            STREF_COUNT(op_trim, (len - s.len) * sizeof(chT), 0);
             return s;
         }
 
-        bstref trim() const { return trim_left().trim_right(); }
+        STREF_CONSTEXPR bstref trim() const {
+            bstref s = skip_left().skip_right();
+            STREF_COUNT(op_trim, (len - s.len) * sizeof(chT), 0);
+            return s;
+        }
 
         //
         // find the first instance of one or more characters
         //
 
-        enum { npos = -1 };
+        static const size_t npos = static_cast<size_t>(-1);
 
-        int find(std::function< bool(chT) > match, int start = 0) const {
-            for (size_t i = start; i < len; ++i)
-                if (match(_at(i)))
-                    return i;
-            return npos;
+        size_t find(std::function< bool(chT) > match, size_t start = 0) const {
+            return find_match(match, start);
+        }
+
+        // any callable predicate, called directly rather than through std::function
+        template <typename Match>
+        typename std::enable_if<detail::is_char_predicate<Match, chT>::value, size_t>::type
+        find(Match match, size_t start = 0) const {
+            return find_match(match, start);
+        }
+
+        size_t find(chT ch, size_t start = 0) const {
+            if (start >= len)
+                return npos;
+            const chT* p = detail::find_char(ref + start, end(), ch);
+            STREF_COUNT(op_find, (p - ref - start + (p != end())) * sizeof(chT), 0);
+            return p != end() ? p - ref : npos;
+        }
+
+        size_t find(const is_any_of<chT>& match, size_t start = 0) const {
+            if (start >= len)
+                return npos;
+            const chT* p = detail::find_any(ref + start, end(), match.chars());
+            STREF_COUNT(op_find, (p - ref - start + (p != end())) * sizeof(chT), 0);
+            return p != end() ? p - ref : npos;
+        }
+
+        //
+        // find the last instance of a character
+        //
+
+        size_t rfind(chT ch) const {
+            const chT* p = detail::rfind_char(begin(), end(), ch);
+            return p != end() ? p - ref : npos;
+        }
+
+        // the number of instances of a character
+        size_t count(chT ch) const {
+            size_t n = 0;
+            auto tally = [&](const chT*) { ++n; };
+            detail::for_each_char(begin(), end(), ch, tally);
+            return n;
         }
 
-        int find(chT ch, int start = 0) const {
-            return find(chmatch(ch), start);
+        //
+        // substring search (use a basic_searcher to search for the same needle many times)
+        //
+
+        size_t find(const bstref& needle, size_t start = 0) const {
+            return basic_searcher<TT>(needle).find(*this, start);
+        }
+
+        size_t rfind(const bstref& needle) const {
+            if (needle.length() <= 1)
+                return needle.length() == 0 ? len : rfind(needle._front());
+            size_t i = detail::rfind_pair(ref, len, needle.ref, needle.len);
+            return i != len ? i : npos;
+        }
+
+        bool contains(const bstref& needle) const {
+            return find(needle) != npos;
+        }
+
+        // the positions of all non-overlapping instances of needle
+        basic_find_range<TT> find_all(const bstref& needle) const {
+            return basic_find_range<TT>(*this, needle);
         }
 
         //
@@ -306,16 +2200,72 @@ namespace tools {
         //
 
         void split(std::function< bool(chT) > match, std::function< void(const bstref& sr) > body) const {
-            int start = 0, pos = find(match, start);
-            while (pos != npos) {
-                body(middle(start, pos - 1));
-                pos = find(match, start = pos + 1);
-            }
-            body(substr(start));
+            split_at(match, body);
+        }
+
+        void split(const is_any_of<chT>& match, std::function< void(const bstref& sr) > body) const {
+            split_on(match, body);
         }
 
         void split(chT ch, std::function< void(const bstref& sr) > body) const {
-            split(chmatch(ch), body);
+            split_on(ch, body);
+        }
+
+        // any callable predicate and body, called directly rather than through std::function
+        template <typename Match, typename Body>
+        typename std::enable_if<detail::is_char_predicate<Match, chT>::value>::type
+        split(Match match, Body body) const {
+            split_at(match, body);
+        }
+
+        template <typename Body>
+        void split(const is_any_of<chT>& match, Body body) const {
+            split_on(match, body);
+        }
+
+        template <typename Body>
+        void split(chT ch, Body body) const {
+            split_on(ch, body);
+        }
+
+        //
+        // lazily split a string: a forward range of tokens, produced as it is iterated
+        //   max_splits: the number of separators to split on, the rest of the string is the last token
+        //   empties: skip_empty drops empty tokens (they don't count toward max_splits)
+        // rsplit_range() works from the end of the string, producing the tokens in reverse order
+        //
+
+        basic_split_range<TT, chT> split_range(chT ch, size_t max_splits = size_t(-1), empty_tokens empties = keep_empty) const {
+            return basic_split_range<TT, chT>(*this, ch, max_splits, empties, false);
+        }
+
+        basic_split_range<TT, is_any_of<chT>> split_range(const is_any_of<chT>& match, size_t max_splits = size_t(-1), empty_tokens empties = keep_empty) const {
+            return basic_split_range<TT, is_any_of<chT>>(*this, match, max_splits, empties, false);
+        }
+
+        template <typename Match>
+        typename std::enable_if<detail::is_char_predicate<Match, chT>::value, basic_split_range<TT, Match>>::type
+        split_range(Match match, size_t max_splits = size_t(-1), empty_tokens empties = keep_empty) const {
+            return basic_split_range<TT, Match>(*this, match, max_splits, empties, false);
+        }
+
+        basic_split_range<TT, chT> rsplit_range(chT ch, size_t max_splits = size_t(-1), empty_tokens empties = keep_empty) const {
+            return basic_split_range<TT, chT>(*this, ch, max_splits, empties, true);
+        }
+
+        basic_split_range<TT, is_any_of<chT>> rsplit_range(const is_any_of<chT>& match, size_t max_splits = size_t(-1), empty_tokens empties = keep_empty) const {
+            return basic_split_range<TT, is_any_of<chT>>(*this, match, max_splits, empties, true);
+        }
+
+        template <typename Match>
+        typename std::enable_if<detail::is_char_predicate<Match, chT>::value, basic_split_range<TT, Match>>::type
+        rsplit_range(Match match, size_t max_splits = size_t(-1), empty_tokens empties = keep_empty) const {
+            return basic_split_range<TT, Match>(*this, match, max_splits, empties, true);
+        }
+
+        // the lines of a string, without their "\n" or "\r\n" terminators (a final terminator doesn't start another line)
+        basic_line_range<TT> lines() const {
+            return basic_line_range<TT>(*this);
         }
 
         //
@@ -323,64 +2273,268 @@ namespace tools {
         //
 
         void each(std::function< void(chT ch) > body) const {
+            STREF_COUNT(op_each, len * sizeof(chT), 0);
             for (size_t i = 0; i < len; ++i)
                 body(ref[i]);
         }
 
         void each_reverse(std::function< void(chT ch) > body) const {
+            STREF_COUNT(op_each, len * sizeof(chT), 0);
+            for (size_t i = len; i > 0; --i)
+                body(ref[i - 1]);
+        }
+
+        template <typename Body>
+        void each(Body body) const {
+            STREF_COUNT(op_each, len * sizeof(chT), 0);
+            for (size_t i = 0; i < len; ++i)
+                body(ref[i]);
+        }
+
+        template <typename Body>
+        void each_reverse(Body body) const {
+            STREF_COUNT(op_each, len * sizeof(chT), 0);
             for (size_t i = len; i > 0; --i)
                 body(ref[i - 1]);
         }
 
+        //
+        // number conversion: the whole string is the number, without white space around it
+        //   integers: [+-]digits
+        //   floating point: [+-]digits[.digits][(e|E)[+-]digits], inf, infinity or nan (in any case)
+        // The conversions don't allocate or look at the locale, and floating point results are
+        // correctly rounded. try_parse() reports errors in its result, to_int() and to_double()
+        // throw bad_stref_op.
+        //
+
+        template <typename T>
+        parse_result<T> try_parse() const {
+            static_assert(std::is_arithmetic<T>::value && !std::is_same<T, bool>::value && !std::is_same<T, long double>::value,
+                          "try_parse<T>: T must be an integer type, float or double");
+            parse_result<T> result = { T(), no_error };
+            STREF_COUNT(op_parse, len * sizeof(chT), 0);
+            result.error = detail::parse_number(ref, ref + len, result.value);
+            return result;
+        }
+
+        template <typename T = int>
+        T to_int() const {
+            static_assert(std::is_integral<T>::value, "to_int<T>: T must be an integer type");
+            return parsed(try_parse<T>());
+        }
+
+        double to_double() const {
+            return parsed(try_parse<double>());
+        }
+
+        //
+        // hashing: hash() for exact comparisons, ihash() agrees with iequals()
+        //
+
+        size_t hash() const {
+            STREF_COUNT(op_hash, len * sizeof(chT), 0);
+            return static_cast<size_t>(detail::hash_bytes(ref, len * sizeof(chT)));
+        }
+
+        size_t ihash() const {
+            STREF_COUNT(op_hash, len * sizeof(chT), 0);
+            return static_cast<size_t>(detail::text_ops<TT>::ihash(ref, len));
+        }
+
         // implicit cast to std::basic_string<chT>
         operator std::basic_string<chT>() const { return std::basic_string<chT>(data(), length()); }
 
         // readonly access to internal members
-        const chT* data() const { return ref; }
-        size_t length() const { return len; }
+        constexpr const chT* data() const { return ref; }
+        constexpr size_t length() const { return len; }
         
         // useful for STL algorithms
-        const chT* begin() const { return ref; }
-        const chT* end() const { return ref + len; }
+        constexpr const chT* begin() const { return ref; }
+        constexpr const chT* end() const { return ref + len; }
 
     private:
         // unchecked access to individual characters
-        chT _at(int index) const { return ref[index]; }
-        chT _front() const { return ref[0]; }
-        chT _back() const { return ref[length() - 1]; }
-
-        // traits methods
-        chT to_lower_case(chT ch) const { return TT::to_lower_case(ch); }
-        chT is_whitespace(chT ch) const { return TT::is_whitespace(ch); }
-
-        struct chmatch {
-            chmatch(chT ch) : ch(ch) {}
-            bool operator() (chT c) const { return c == ch; }
-            chT ch;
-        };
+        constexpr chT _at(size_t index) const { return ref[index]; }
+        constexpr chT _front() const { return ref[0]; }
+        constexpr chT _back() const { return ref[length() - 1]; }
+
+        // length of a C string (strlen & co. at run time)
+        static STREF_CONSTEXPR size_t length_of(const chT* str) {
+            if (!STREF_CONSTANT_EVALUATED())
+                return std::char_traits<chT>::length(str);
+            size_t n = 0;
+            while (str[n] != 0)
+                ++n;
+            return n;
+        }
+
+        // trims which aren't counted as operations of their own
+        STREF_CONSTEXPR bstref skip_left() const {
+            const chT* first = detail::text_ops<TT>::skip_whitespace(ref, ref + len);
+            return bstref(first, ref + len - first);
+        }
+
+        STREF_CONSTEXPR bstref skip_right() const {
+            return bstref(ref, detail::text_ops<TT>::skip_whitespace_back(ref, ref + len) - ref);
+        }
+
+        template <typename T>
+        static T parsed(const parse_result<T>& result) {
+            if (result.error == invalid_number)
+                throw bad_stref_op("not a number");
+            if (result.error == number_out_of_range)
+                throw bad_stref_op("number out of range");
+            return result.value;
+        }
+
+        // linear search with a predicate
+        template <typename Match>
+        size_t find_match(Match& match, size_t start) const {
+            size_t i = start;
+            while (i < len && !match(_at(i)))
+                ++i;
+            STREF_COUNT(op_find, (i - start + (i < len)) * sizeof(chT), 0);
+            return i < len ? i : npos;
+        }
+
+        // split on each separator found by a predicate
+        template <typename Match, typename Body>
+        void split_at(Match& match, Body& body) const {
+            size_t start = 0, tokens = 1;
+            for (size_t pos = start; pos < len; ++pos)
+                if (match(_at(pos))) {
+                    body(bstref(ref + start, pos - start));
+                    start = pos + 1, ++tokens;
+                }
+            body(bstref(ref + start, len - start));
+            STREF_COUNT(op_split, len * sizeof(chT), tokens);
+        }
+
+        // split on a character or character set, visiting each block's separators at once
+        template <typename Body>
+        void split_on(chT ch, Body& body) const {
+            const chT* start = ref;
+            size_t tokens = 1;
+            auto emit = [&](const chT* sep) { body(bstref(start, sep - start)); start = sep + 1, ++tokens; };
+            detail::for_each_char(begin(), end(), ch, emit);
+            body(bstref(start, end() - start));
+            STREF_COUNT(op_split, len * sizeof(chT), tokens);
+        }
+
+        template <typename Body>
+        void split_on(const is_any_of<chT>& match, Body& body) const {
+            const chT* start = ref;
+            size_t tokens = 1;
+            auto emit = [&](const chT* sep) { body(bstref(start, sep - start)); start = sep + 1, ++tokens; };
+            detail::for_each_any(begin(), end(), match.chars(), emit);
+            body(bstref(start, end() - start));
+            STREF_COUNT(op_split, len * sizeof(chT), tokens);
+        }
 
         const chT*    ref;    // original string data
         size_t        len;    // string length
     };
 
+    template <typename TT> const size_t basic_stref<TT>::npos;
+
     // typedefs for string and wide-string references
     typedef basic_stref<char_traits> stref;
     typedef basic_stref<wchar_traits> wstref;
 
+    // "text"_sr and L"text"_sr are strefs whose length is known at compile time (comparing them at
+    // compile time takes a compiler with __builtin_is_constant_evaluated: g++ 9, clang++ 9, VC++ 2019 16.5)
+    inline namespace literals {
+        constexpr stref operator"" _sr(const char* str, size_t len) { return stref(str, len); }
+        constexpr wstref operator"" _sr(const wchar_t* str, size_t len) { return wstref(str, len); }
+    }
+
+    // parse a column of numbers: the strefs in [first, last) into out[0], out[1], ... (see try_parse()),
+    // stopping at the first one which isn't a valid T; returns the number of values parsed
+    template <typename T, typename Iterator>
+    size_t parse_column(Iterator first, Iterator last, T* out) {
+        size_t n = 0;
+        for (; first != last; ++first, ++n)
+            if (detail::parse_number(first->begin(), first->end(), out[n]) != no_error)
+                break;
+        return n;
+    }
+
+    // string reference that carries its hash: lookups don't rehash, and unequal hashes reject
+    // equality tests without looking at the characters
+    template <typename TT>
+    class basic_hashed_stref : public basic_stref<TT>
+    {
+    private:
+        typedef basic_stref<TT> bstref;
+        typedef typename TT::char_type chT;
+
+    public:
+        basic_hashed_stref(const bstref& sr) : bstref(sr), h(sr.hash()) {}
+        basic_hashed_stref(const chT* str) : bstref(str), h(bstref::hash()) {}
+        basic_hashed_stref(const chT* str, size_t len) : bstref(str, len), h(bstref::hash()) {}
+        basic_hashed_stref(const std::basic_string<chT>& str) : bstref(str), h(bstref::hash()) {}
+
+        size_t hash() const { return h; }
+
+        using bstref::operator==;
+        using bstref::operator!=;
+
+        bool operator== (const basic_hashed_stref& rhs) const {
+            return h == rhs.h && bstref::operator==(rhs);
+        }
+
+        bool operator!= (const basic_hashed_stref& rhs) const {
+            return !(*this == rhs);
+        }
+
+    private:
+        size_t h;
+    };
+
+    typedef basic_hashed_stref<char_traits> hashed_stref;
+    typedef basic_hashed_stref<wchar_traits> hashed_wstref;
+
+    // case-insensitive hash and equality, for unordered containers keyed by iequals()
+    struct ihasher {
+        template <typename TT>
+        size_t operator() (const basic_stref<TT>& s) const { return s.ihash(); }
+    };
+
+    struct iequal_to {
+        template <typename TT>
+        bool operator() (const basic_stref<TT>& lhs, const basic_stref<TT>& rhs) const { return lhs.iequals(rhs); }
+    };
+
+    namespace detail {
+
+        // write a string with a single write, padded to the stream's width like std::string
+        template <typename chT>
+        std::basic_ostream<chT>& write_padded(std::basic_ostream<chT>& os, const chT* s, size_t n) {
+            std::streamsize width = os.width(), pad = width > std::streamsize(n) ? width - std::streamsize(n) : 0;
+            bool left = (os.flags() & std::ios_base::adjustfield) == std::ios_base::left;
+            for (std::streamsize i = 0; !left && i < pad; ++i)
+                os.put(os.fill());
+            os.write(s, static_cast<std::streamsize>(n));
+            for (std::streamsize i = 0; left && i < pad; ++i)
+                os.put(os.fill());
+            os.width(0);
+            return os;
+        }
+
+    }
+
     // write narrow stref to narrow stream
     inline std::ostream& operator<<(std::ostream& os, const stref& s) {
-        for (size_t i = 0; i < s.length(); ++i)
-            os << s[i];
-        return os;
+        STREF_COUNT(op_output, s.length(), 0);
+        return detail::write_padded(os, s.data(), s.length());
     }
 
     // write wide stref to wide stream
     inline std::wostream& operator<<(std::wostream& os, const wstref& s) {
-        for (size_t i = 0; i < s.length(); ++i)
-            os << s[i];
-        return os;
+        STREF_COUNT(op_output, s.length() * sizeof(wchar_t), 0);
+        return detail::write_padded(os, s.data(), s.length());
     }
-    
+
     // is_any_of(chT) functor
     template <typename chT>
     class is_any_of
@@ -389,14 +2543,334 @@ namespace tools {
         template <typename T> struct _traits { typedef T char_type; };
             
     public:
-        is_any_of(basic_stref<_traits<chT>> sr) : sr(sr) {}
+        is_any_of(basic_stref<_traits<chT>> sr) : set(sr.begin(), sr.end()) {}
 
         bool operator() (chT ch) const {
-            return std::find(sr.begin(), sr.end(), ch) != sr.end();
+            return set.contains(ch);
+        }
+
+        // lookup tables used by the vectorized searches
+        const detail::char_set<chT>& chars() const { return set; }
+
+    private:
+        detail::char_set<chT> set;
+    };
+
+    // substring searcher: the needle is preprocessed once, so it can be searched for in many haystacks
+    // short needles are found by comparing the first and last characters of a vector block of candidates
+    // at a time, long ones with the two-way algorithm (linear time)
+    // the needle's contents must outlive the searcher
+    template <typename TT>
+    class basic_searcher
+    {
+    private:
+        typedef basic_stref<TT> bstref;
+        typedef typename TT::char_type chT;
+
+    public:
+        enum { long_needle = 32 };
+
+        explicit basic_searcher(const bstref& needle)
+            : pattern(needle), engine(needle.length() >= long_needle ? detail::two_way<chT>(needle.data(), needle.length()) : detail::two_way<chT>()) {}
+
+        // position of the first instance of the needle at or after start, or npos
+        size_t find(const bstref& haystack, size_t start = 0) const {
+            size_t m = pattern.length();
+            if (start > haystack.length())
+                return bstref::npos;
+            if (m == 0)
+                return start;
+            const chT* h = haystack.data() + start;
+            size_t n = haystack.length() - start, i;
+            if (m == 1)
+                i = detail::find_char(h, h + n, pattern.data()[0]) - h;
+            else if (m < long_needle)
+                i = detail::find_pair(h, n, pattern.data(), m);
+            else
+                i = engine.search(h, n);
+            STREF_COUNT(op_search, (i != n ? i + m : n) * sizeof(chT), 0);
+            return i != n ? start + i : bstref::npos;
         }
 
+        bool found_in(const bstref& haystack) const { return find(haystack) != bstref::npos; }
+
+        const bstref& needle() const { return pattern; }
+
+    private:
+        bstref pattern;
+        detail::two_way<chT> engine;    // only set up for long needles
+    };
+
+    typedef basic_searcher<char_traits> searcher;
+    typedef basic_searcher<wchar_traits> wsearcher;
+
+    // forward range of the positions of a needle in a haystack, see basic_stref::find_all()
+    // iterators refer to the range, which must outlive them
+    template <typename TT>
+    class basic_find_range
+    {
+    private:
+        typedef basic_stref<TT> bstref;
+
+    public:
+        class iterator
+        {
+        public:
+            typedef std::forward_iterator_tag iterator_category;
+            typedef size_t value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const size_t* pointer;
+            typedef const size_t& reference;
+
+            iterator() : range(0), pos(bstref::npos) {}
+
+            reference operator* () const { return pos; }
+
+            iterator& operator++ () {
+                next(pos + range->match.needle().length());
+                return *this;
+            }
+
+            iterator operator++ (int) {
+                iterator it(*this);
+                ++*this;
+                return it;
+            }
+
+            bool operator== (const iterator& rhs) const { return pos == rhs.pos; }
+            bool operator!= (const iterator& rhs) const { return pos != rhs.pos; }
+
+        private:
+            friend class basic_find_range;
+
+            explicit iterator(const basic_find_range* range) : range(range) {
+                next(range->match.needle().length() == 0 ? bstref::npos : 0);
+            }
+
+            void next(size_t start) {
+                pos = start == bstref::npos ? start : range->match.find(range->haystack, start);
+            }
+
+            const basic_find_range* range;
+            size_t pos;                         // npos for the end iterator
+        };
+
+        typedef iterator const_iterator;
+
+        basic_find_range(const bstref& haystack, const bstref& needle) : haystack(haystack), match(needle) {}
+
+        iterator begin() const { return iterator(this); }
+        iterator end() const { return iterator(); }
+
+    private:
+        bstref haystack;
+        basic_searcher<TT> match;
+    };
+
+    // forward range of the tokens of a string, see basic_stref::split_range()
+    // iterators refer to the range, which must outlive them
+    template <typename TT, typename Match>
+    class basic_split_range
+    {
+    private:
+        typedef basic_stref<TT> bstref;
+        typedef typename TT::char_type chT;
+        typedef detail::separator<chT> sep;
+
+    public:
+        class iterator
+        {
+        public:
+            typedef std::forward_iterator_tag iterator_category;
+            typedef bstref value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const bstref* pointer;
+            typedef const bstref& reference;
+
+            iterator() : range(0), token(0, 0), pos(0), splits(0), more(false) {}
+
+            reference operator* () const { return token; }
+            pointer operator-> () const { return &token; }
+
+            iterator& operator++ () {
+                advance();
+                return *this;
+            }
+
+            iterator operator++ (int) {
+                iterator it(*this);
+                advance();
+                return it;
+            }
+
+            bool operator== (const iterator& rhs) const {
+                return range == rhs.range && (range == 0 || (token.data() == rhs.token.data() && more == rhs.more));
+            }
+
+            bool operator!= (const iterator& rhs) const { return !(*this == rhs); }
+
+        private:
+            friend class basic_split_range;
+
+            explicit iterator(const basic_split_range* range)
+                : range(range), token(0, 0), pos(range->reverse ? range->source.end() : range->source.begin()), splits(0), more(true) {
+                advance();
+            }
+
+            void advance() {
+                const chT* first = range->source.begin();
+                const chT* last = range->source.end();
+                for (;;) {
+                    if (!more) {
+                        range = 0;      // becomes the end iterator
+                        return;
+                    }
+                    if (splits == range->max_splits) {
+                        // the rest of the string is the last token
+                        if (range->reverse) {
+                            while (range->skip && pos != first && sep::matches(pos[-1], range->match))
+                                --pos;
+                            token = bstref(first, pos - first);
+                        } else {
+                            while (range->skip && pos != last && sep::matches(*pos, range->match))
+                                ++pos;
+                            token = bstref(pos, last - pos);
+                        }
+                        more = false;
+                    } else if (range->reverse) {
+                        const chT* p = sep::rfind(first, pos, range->match);
+                        if (p == pos) {
+                            token = bstref(first, pos - first);
+                            more = false;
+                        } else {
+                            token = bstref(p + 1, pos - p - 1);
+                            pos = p;
+                        }
+                    } else {
+                        const chT* p = sep::find(pos, last, range->match);
+                        token = bstref(pos, p - pos);
+                        if (p == last)
+                            more = false;
+                        else
+                            pos = p + 1;
+                    }
+                    if (range->skip && token.length() == 0)
+                        continue;
+                    if (more)
+                        ++splits;
+                    return;
+                }
+            }
+
+            const basic_split_range* range;     // null for the end iterator
+            bstref token;                       // current token
+            const chT* pos;                     // start (end, if reversed) of the unsplit part of the string
+            size_t splits;                      // separators split on so far
+            bool more;                          // there is at least one more token
+        };
+
+        typedef iterator const_iterator;
+
+        basic_split_range(const bstref& source, const Match& match, size_t max_splits, empty_tokens empties, bool reverse)
+            : source(source), match(match), max_splits(max_splits), skip(empties == skip_empty), reverse(reverse) {}
+
+        iterator begin() const { return iterator(this); }
+        iterator end() const { return iterator(); }
+
+    private:
+        bstref source;
+        Match match;
+        size_t max_splits;
+        bool skip;
+        bool reverse;
+    };
+
+
+    // forward range of the lines of a string, see basic_stref::lines()
+    template <typename TT>
+    class basic_line_range
+    {
+    private:
+        typedef basic_stref<TT> bstref;
+        typedef typename TT::char_type chT;
+
+    public:
+        class iterator
+        {
+        public:
+            typedef std::forward_iterator_tag iterator_category;
+            typedef bstref value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const bstref* pointer;
+            typedef const bstref& reference;
+
+            iterator() : line(0, 0), next(0), last(0) {}
+
+            reference operator* () const { return line; }
+            pointer operator-> () const { return &line; }
+
+            iterator& operator++ () {
+                advance();
+                return *this;
+            }
+
+            iterator operator++ (int) {
+                iterator it(*this);
+                advance();
+                return it;
+            }
+
+            bool operator== (const iterator& rhs) const { return next == rhs.next; }
+            bool operator!= (const iterator& rhs) const { return next != rhs.next; }
+
+        private:
+            friend class basic_line_range;
+
+            explicit iterator(const bstref& text) : line(0, 0), next(text.begin()), last(text.end()) {
+                advance();
+            }
+
+            void advance() {
+                if (next == last) {
+                    next = 0;       // becomes the end iterator
+                    return;
+                }
+                const chT* nl = detail::find_char(next, last, static_cast<chT>('\n'));
+                size_t n = nl - next;
+                if (n > 0 && nl != last && next[n - 1] == static_cast<chT>('\r'))
+                    --n;
+                line = bstref(next, n);
+                next = nl == last ? last : nl + 1;
+            }
+
+            bstref line;
+            const chT* next;        // start of the next line, null for the end iterator
+            const chT* last;
+        };
+
+        typedef iterator const_iterator;
+
+        explicit basic_line_range(const bstref& text) : text(text) {}
+
+        iterator begin() const { return text.length() == 0 ? iterator() : iterator(text); }
+        iterator end() const { return iterator(); }
+
     private:
-        basic_stref<_traits<chT>> sr;
+        bstref text;
+    };
+
+}
+
+namespace std {
+
+    template <typename TT>
+    struct hash< tools::basic_stref<TT> > {
+        size_t operator() (const tools::basic_stref<TT>& s) const { return s.hash(); }
+    };
+
+    template <typename TT>
+    struct hash< tools::basic_hashed_stref<TT> > {
+        size_t operator() (const tools::basic_hashed_stref<TT>& s) const { return s.hash(); }
     };
 
 }
@@ -0,0 +1,222 @@
+/*
+    Copyright (C) 2012, Ferruccio Barletta (ferruccio.barletta@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person
+    obtaining a copy of this software and associated documentation
+    files (the "Software"), to deal in the Software without
+    restriction, including without limitation the rights to use,
+    copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the
+    Software is furnished to do so, subject to the following
+    conditions:
+
+    The above copyright notice and this permission notice shall be
+    included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+    OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef STREF_POOL_H
+#define STREF_POOL_H
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "stref.h"
+
+namespace tools {
+
+    // string interning pool
+    //
+    // intern() copies a string into the pool the first time it is seen and returns the pool's copy
+    // (the canonical stref) every time after that. Canonical strefs stay valid for the lifetime of
+    // the pool, and equal ones share the same data, so comparing them never looks at the characters.
+    //
+    // Characters are bump allocated from large blocks and each copy is followed by a 0, so data()
+    // of a canonical stref is also a C string. Lookups use an open addressing (linear probing) table
+    // which stores each string's hash, so growing it doesn't rehash anything.
+    template <typename TT>
+    class basic_stref_pool
+    {
+    private:
+        typedef basic_stref<TT> bstref;
+        typedef typename TT::char_type chT;
+
+    public:
+        explicit basic_stref_pool(size_t block_size = 65536)
+            : block_size(block_size), next(0), left(0), count(0), used(0), slots(16) {}
+
+        basic_stref_pool(basic_stref_pool&& rhs)
+            : block_size(rhs.block_size), blocks(std::move(rhs.blocks)), next(rhs.next), left(rhs.left),
+              count(rhs.count), used(rhs.used), slots(std::move(rhs.slots)) {
+            rhs.clear();
+        }
+
+        basic_stref_pool(const basic_stref_pool&) = delete;
+        basic_stref_pool& operator= (const basic_stref_pool&) = delete;
+
+        // the canonical copy of s
+        bstref intern(const bstref& s) {
+            return intern(s, s.hash());
+        }
+
+        // the same, with a hash that was already computed by s.hash()
+        bstref intern(const bstref& s, size_t h) {
+            slot* p = probe(s, h);
+            if (p->ref != 0)
+                return bstref(p->ref, p->len);
+            p->ref = copy(s);
+            p->len = s.length();
+            p->hash = h;
+            bstref canonical(p->ref, p->len);
+            if (++count * 4 > slots.size() * 3)
+                grow();
+            return canonical;
+        }
+
+        // true if s has been interned
+        bool contains(const bstref& s) const {
+            return const_cast<basic_stref_pool*>(this)->probe(s, s.hash())->ref != 0;
+        }
+
+        size_t size() const { return count; }                   // distinct strings
+        size_t bytes() const { return used * sizeof(chT); }     // characters stored, including terminators
+
+        // forget every string: canonical strefs handed out so far become invalid
+        void clear() {
+            blocks.clear();
+            next = 0;
+            left = count = used = 0;
+            std::vector<slot>(16).swap(slots);
+        }
+
+    private:
+        struct slot {
+            slot() : ref(0), len(0), hash(0) {}
+            const chT* ref;     // null for an empty slot
+            size_t len;
+            size_t hash;
+        };
+
+        // the slot holding s, or the empty slot where it belongs
+        slot* probe(const bstref& s, size_t h) {
+            size_t mask = slots.size() - 1;
+            for (size_t i = h & mask; ; i = (i + 1) & mask) {
+                slot& p = slots[i];
+                if (p.ref == 0 || (p.hash == h && p.len == s.length() && std::equal(s.begin(), s.end(), p.ref)))
+                    return &p;
+            }
+        }
+
+        void grow() {
+            std::vector<slot> old(slots.size() * 2);
+            old.swap(slots);
+            size_t mask = slots.size() - 1;
+            for (size_t i = 0; i < old.size(); ++i) {
+                if (old[i].ref == 0)
+                    continue;
+                size_t j = old[i].hash & mask;
+                while (slots[j].ref != 0)
+                    j = (j + 1) & mask;
+                slots[j] = old[i];
+            }
+        }
+
+        // copy s and a terminating 0 into the current block, starting a new one if it won't fit
+        const chT* copy(const bstref& s) {
+            size_t n = s.length() + 1;
+            if (n > left) {
+                size_t size = std::max(n, block_size);
+                blocks.push_back(std::unique_ptr<chT[]>(new chT[size]));
+                next = blocks.back().get();
+                left = size;
+            }
+            chT* p = next;
+            std::copy(s.begin(), s.end(), p);
+            p[s.length()] = chT();
+            next += n;
+            left -= n;
+            used += n;
+            return p;
+        }
+
+        size_t block_size;                              // characters per block
+        std::vector< std::unique_ptr<chT[]> > blocks;
+        chT* next;                                      // free space in the current block
+        size_t left;
+        size_t count;
+        size_t used;
+        std::vector<slot> slots;                        // size is a power of 2
+    };
+
+    typedef basic_stref_pool<char_traits> stref_pool;
+    typedef basic_stref_pool<wchar_traits> wstref_pool;
+
+    // thread-safe interning pool: strings are spread over independently locked shards by hash,
+    // so equal strings always meet in the same shard and still share one canonical copy
+    template <typename TT>
+    class basic_shared_stref_pool
+    {
+    private:
+        typedef basic_stref<TT> bstref;
+
+    public:
+        explicit basic_shared_stref_pool(size_t shard_count = 16, size_t block_size = 65536) {
+            if (shard_count == 0)
+                throw bad_stref_op("shared_stref_pool: no shards");
+            for (size_t i = 0; i < shard_count; ++i)
+                shards.push_back(std::unique_ptr<shard>(new shard(block_size)));
+        }
+
+        bstref intern(const bstref& s) {
+            size_t h = s.hash();
+            shard& sh = pick(h);
+            std::lock_guard<std::mutex> lock(sh.mutex);
+            return sh.pool.intern(s, h);
+        }
+
+        bool contains(const bstref& s) const {
+            shard& sh = pick(s.hash());
+            std::lock_guard<std::mutex> lock(sh.mutex);
+            return sh.pool.contains(s);
+        }
+
+        size_t size() const {
+            size_t n = 0;
+            for (size_t i = 0; i < shards.size(); ++i) {
+                std::lock_guard<std::mutex> lock(shards[i]->mutex);
+                n += shards[i]->pool.size();
+            }
+            return n;
+        }
+
+    private:
+        struct shard {
+            explicit shard(size_t block_size) : pool(block_size) {}
+            std::mutex mutex;
+            basic_stref_pool<TT> pool;
+        };
+
+        // the shard is picked by the high bits, the shard's table uses the low ones
+        shard& pick(size_t h) const {
+            return *shards[(h >> (sizeof(size_t) * 8 - 16)) % shards.size()];
+        }
+
+        std::vector< std::unique_ptr<shard> > shards;
+    };
+
+    typedef basic_shared_stref_pool<char_traits> shared_stref_pool;
+    typedef basic_shared_stref_pool<wchar_traits> shared_wstref_pool;
+
+}
+
+#endif
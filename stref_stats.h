@@ -0,0 +1,178 @@
+/*
+    Copyright (C) 2012, Ferruccio Barletta (ferruccio.barletta@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person
+    obtaining a copy of this software and associated documentation
+    files (the "Software"), to deal in the Software without
+    restriction, including without limitation the rights to use,
+    copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the
+    Software is furnished to do so, subject to the following
+    conditions:
+
+    The above copyright notice and this permission notice shall be
+    included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+    OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef STREF_STATS_H
+#define STREF_STATS_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+namespace tools {
+
+    // stref operation counters, for finding out which string operations a program spends its time in
+    //
+    // #define STREF_STATS before including stref.h to count, for each operation, the calls, the bytes
+    // examined and the tokens produced. Without it the counting code isn't compiled and the counters
+    // stay at zero. Each thread counts in its own block without synchronization; snapshot_stats()
+    // adds up the blocks (those of finished threads included), reset_stats() starts over. Counting
+    // only happens at run time, constant evaluation isn't counted.
+
+    enum stref_op {
+        op_compare,     // compare() and the relational operators
+        op_equals,      // == and !=
+        op_icompare,    // icompare() and the case-insensitive operators
+        op_find,        // find() with a character, character set or predicate
+        op_search,      // substring search: find(), contains(), find_all(), basic_searcher
+        op_split,       // split() (tokens: the tokens produced)
+        op_trim,        // trim(), trim_left(), trim_right() (bytes: the white space removed)
+        op_each,        // each(), each_reverse()
+        op_parse,       // try_parse(), to_int(), to_double()
+        op_hash,        // hash(), ihash()
+        op_output,      // operator<<
+        stref_op_count
+    };
+
+    struct op_stats {
+        std::uint64_t calls;
+        std::uint64_t bytes;
+        std::uint64_t tokens;
+    };
+
+    struct stref_stats {
+        op_stats ops[stref_op_count];
+
+        const op_stats& operator[](stref_op op) const { return ops[op]; }
+
+        static const char* name(stref_op op) {
+            static const char* const names[stref_op_count] = {
+                "compare", "equals", "icompare", "find", "search", "split", "trim", "each", "parse", "hash", "output"
+            };
+            return names[op];
+        }
+    };
+
+    namespace detail {
+
+        // the counters of one thread: only their thread writes them (so no read-modify-write is
+        // needed), base holds their values at the last reset. Blocks are never freed, a thread
+        // which finishes leaves its counts behind and its block to the next thread.
+        struct stats_block {
+            std::atomic<std::uint64_t> counts[stref_op_count][3];
+            std::atomic<std::uint64_t> base[stref_op_count][3];
+            std::atomic<bool> in_use;
+            stats_block* next;
+        };
+
+        inline std::atomic<stats_block*>& stats_blocks() {
+            static std::atomic<stats_block*> head(nullptr);
+            return head;
+        }
+
+        inline stats_block* acquire_stats_block() {
+            std::atomic<stats_block*>& head = stats_blocks();
+            for (stats_block* block = head.load(std::memory_order_acquire); block != nullptr; block = block->next) {
+                bool free = false;
+                if (!block->in_use.load(std::memory_order_relaxed) && block->in_use.compare_exchange_strong(free, true, std::memory_order_acquire))
+                    return block;
+            }
+            stats_block* block = new stats_block;
+            for (int op = 0; op < stref_op_count; ++op)
+                for (int i = 0; i < 3; ++i)
+                    block->counts[op][i].store(0, std::memory_order_relaxed), block->base[op][i].store(0, std::memory_order_relaxed);
+            block->in_use.store(true, std::memory_order_relaxed);
+            block->next = head.load(std::memory_order_relaxed);
+            while (!head.compare_exchange_weak(block->next, block, std::memory_order_release, std::memory_order_relaxed))
+                ;
+            return block;
+        }
+
+        // holds the thread's block, and hands it back when the thread finishes
+        struct stats_owner {
+            stats_owner() : block(acquire_stats_block()) {}
+            ~stats_owner() { block->in_use.store(false, std::memory_order_release); }
+            stats_block* block;
+        };
+
+        inline void add(std::atomic<std::uint64_t>& counter, std::uint64_t n) {
+            counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+
+        inline void count_op(stref_op op, size_t bytes, size_t tokens) {
+            static thread_local stats_owner owner;
+            std::atomic<std::uint64_t>* counts = owner.block->counts[op];
+            add(counts[0], 1);
+            add(counts[1], bytes);
+            add(counts[2], tokens);
+        }
+
+    }
+
+    // the counts since the last reset, summed over all threads
+    inline stref_stats snapshot_stats() {
+        stref_stats stats = {};
+        for (detail::stats_block* block = detail::stats_blocks().load(std::memory_order_acquire); block != nullptr; block = block->next)
+            for (int op = 0; op < stref_op_count; ++op) {
+                std::uint64_t* totals = &stats.ops[op].calls;
+                for (int i = 0; i < 3; ++i)
+                    totals[i] += block->counts[op][i].load(std::memory_order_relaxed) - block->base[op][i].load(std::memory_order_relaxed);
+            }
+        return stats;
+    }
+
+    // start counting from zero (counts made while it runs may or may not survive it)
+    inline void reset_stats() {
+        for (detail::stats_block* block = detail::stats_blocks().load(std::memory_order_acquire); block != nullptr; block = block->next)
+            for (int op = 0; op < stref_op_count; ++op)
+                for (int i = 0; i < 3; ++i)
+                    block->base[op][i].store(block->counts[op][i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+
+    // one line per operation which was used: name, calls, bytes, tokens
+    inline void write_stats(FILE* out, const stref_stats& stats) {
+        std::fprintf(out, "%-10s %14s %16s %14s\n", "operation", "calls", "bytes", "tokens");
+        for (int op = 0; op < stref_op_count; ++op)
+            if (stats.ops[op].calls != 0)
+                std::fprintf(out, "%-10s %14llu %16llu %14llu\n", stref_stats::name(stref_op(op)),
+                             static_cast<unsigned long long>(stats.ops[op].calls),
+                             static_cast<unsigned long long>(stats.ops[op].bytes),
+                             static_cast<unsigned long long>(stats.ops[op].tokens));
+    }
+
+    namespace detail {
+        inline void write_stats_to_stderr() { write_stats(stderr, snapshot_stats()); }
+    }
+
+    // write the counts to stderr when the program exits (once, however often it's called)
+    inline void dump_stats_at_exit() {
+        static bool registered = std::atexit(detail::write_stats_to_stderr) == 0;
+        (void)registered;
+    }
+
+}
+
+#endif
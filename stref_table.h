@@ -0,0 +1,288 @@
+/*
+    Copyright (C) 2012, Ferruccio Barletta (ferruccio.barletta@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person
+    obtaining a copy of this software and associated documentation
+    files (the "Software"), to deal in the Software without
+    restriction, including without limitation the rights to use,
+    copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the
+    Software is furnished to do so, subject to the following
+    conditions:
+
+    The above copyright notice and this permission notice shall be
+    included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+    OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef STREF_TABLE_H
+#define STREF_TABLE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "stref.h"
+
+namespace tools {
+
+    // how a stref_table stores token offsets
+    //   fixed_offsets: 32 bits of offset and 32 of length per token (40 bits of offset in bases of
+    //       4G characters or more), with random access in constant time
+    //   varint_offsets: the gap since the end of the previous token and the length, as varints
+    //       (typically 2 bytes per token); tokens must be added in order, without overlapping,
+    //       and random access decodes up to 63 tokens
+    enum offset_encoding { fixed_offsets, varint_offsets };
+
+    // tokens of one base string, stored as offset and length pairs rather than as strefs
+    //
+    //     stref_table fields(text, ',');       // text split at commas
+    //     stref third = fields[2];
+    //     size_t empties = fields.count_equal("");
+    //
+    // Fixed offsets take half the memory of a vector of strefs, varint offsets typically an eighth.
+    // Tokens are strefs into the base again when they are read, so the base must outlive the table.
+    // The batch operations run over the offset and length arrays rather than a token at a time.
+    template <typename TT>
+    class basic_stref_table
+    {
+    private:
+        typedef basic_stref<TT> bstref;
+        typedef typename TT::char_type chT;
+
+    public:
+        explicit basic_stref_table(const bstref& base, offset_encoding encoding = fixed_offsets)
+            : base_ref(base), encoding_(encoding), count(0), last_end(0) {
+            check_base();
+        }
+
+        // the tokens of text split at a separator (all of them, empty tokens included)
+        basic_stref_table(const bstref& text, chT ch, offset_encoding encoding = fixed_offsets)
+            : base_ref(text), encoding_(encoding), count(0), last_end(0) {
+            check_base();
+            text.split(ch, [this](const bstref& token) { append(token); });
+        }
+
+        basic_stref_table(const bstref& text, const is_any_of<chT>& match, offset_encoding encoding = fixed_offsets)
+            : base_ref(text), encoding_(encoding), count(0), last_end(0) {
+            check_base();
+            text.split(match, [this](const bstref& token) { append(token); });
+        }
+
+        // add a token, which must be part of the base (and, with varint offsets, start at or after
+        // the end of the previous token)
+        void push_back(const bstref& token) {
+            size_t offset = static_cast<size_t>(token.data() - base_ref.data());
+            if (token.data() < base_ref.data() || offset > base_ref.length() || token.length() > base_ref.length() - offset)
+                throw bad_stref_op("stref_table: token outside the base");
+            if (encoding_ == varint_offsets && offset < last_end)
+                throw bad_stref_op("stref_table: varint offsets need tokens in order");
+            append(token);
+        }
+
+        void reserve(size_t n) {
+            if (encoding_ == fixed_offsets) {
+                offsets.reserve(n);
+                lengths.reserve(n);
+                if (base_ref.length() > 0xffffffffu)
+                    high.reserve(n);
+            }
+        }
+
+        bstref operator[] (size_t i) const {
+            if (encoding_ == fixed_offsets)
+                return bstref(base_ref.data() + offset_of(i), lengths[i]);
+            const unsigned char* p = packed.data() + block_bytes[i / block];
+            size_t end = block_ends[i / block], offset = 0, length = 0;
+            for (size_t n = i % block + 1; n > 0; --n) {
+                offset = end + get_varint(p);
+                length = get_varint(p);
+                end = offset + length;
+            }
+            return bstref(base_ref.data() + offset, length);
+        }
+
+        bstref at(size_t i) const {
+            if (i >= count)
+                throw bad_stref_op("stref_table: invalid index");
+            return (*this)[i];
+        }
+
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+        bstref base() const { return base_ref; }
+        offset_encoding encoding() const { return encoding_; }
+
+        // memory used by the tokens' offsets and lengths
+        size_t bytes() const {
+            return offsets.size() * sizeof(std::uint32_t) + high.size() + lengths.size() * sizeof(std::uint32_t) +
+                   packed.size() + (block_bytes.size() + block_ends.size()) * sizeof(size_t);
+        }
+
+        // call f(token) for every token, in order
+        template <typename F>
+        void for_each(F f) const {
+            if (encoding_ == fixed_offsets) {
+                for (size_t i = 0; i < count; ++i)
+                    f(bstref(base_ref.data() + offset_of(i), lengths[i]));
+                return;
+            }
+            const unsigned char* p = packed.data();
+            size_t end = 0;
+            for (size_t i = 0; i < count; ++i) {
+                size_t offset = end + get_varint(p);
+                size_t length = get_varint(p);
+                f(bstref(base_ref.data() + offset, length));
+                end = offset + length;
+            }
+        }
+
+        //
+        // batch operations: results are token indexes, in order
+        //
+
+        // the tokens for which pred(token) is true
+        template <typename Pred>
+        std::vector<size_t> filter(Pred pred) const {
+            std::vector<size_t> found;
+            size_t i = 0;
+            for_each([&](const bstref& token) {
+                if (pred(token))
+                    found.push_back(i);
+                ++i;
+            });
+            return found;
+        }
+
+        // the tokens equal to s
+        std::vector<size_t> find_all(const bstref& s) const {
+            std::vector<size_t> found;
+            each_equal(s, [&](size_t i) { found.push_back(i); });
+            return found;
+        }
+
+        // the number of tokens equal to s
+        size_t count_equal(const bstref& s) const {
+            size_t n = 0;
+            each_equal(s, [&](size_t) { ++n; });
+            return n;
+        }
+
+        // the hash() of every token
+        std::vector<size_t> hashes() const {
+            std::vector<size_t> h;
+            h.reserve(count);
+            for_each([&](const bstref& token) { h.push_back(token.hash()); });
+            return h;
+        }
+
+    private:
+        enum { block = 64 };    // tokens per varint block
+
+        // add a token known to be in the base (and in order)
+        // lengths are 32 bits (splitting a base of 4G characters or more can make longer tokens)
+        void append(const bstref& token) {
+            if (token.length() > 0xffffffffu)
+                throw bad_stref_op("stref_table: token too long");
+            size_t offset = static_cast<size_t>(token.data() - base_ref.data());
+            if (encoding_ == fixed_offsets) {
+                offsets.push_back(static_cast<std::uint32_t>(offset));
+                if (base_ref.length() > 0xffffffffu)
+                    high.push_back(static_cast<unsigned char>(static_cast<std::uint64_t>(offset) >> 32));
+                lengths.push_back(static_cast<std::uint32_t>(token.length()));
+            }
+            else {
+                if (count % block == 0) {
+                    block_bytes.push_back(packed.size());
+                    block_ends.push_back(last_end);
+                }
+                put_varint(offset - last_end);
+                put_varint(token.length());
+                last_end = offset + token.length();
+            }
+            ++count;
+        }
+
+        void check_base() const {
+            if (static_cast<std::uint64_t>(base_ref.length()) >> 40 != 0)
+                throw bad_stref_op("stref_table: base longer than 2^40 characters");
+        }
+
+        size_t offset_of(size_t i) const {
+            return high.empty() ? offsets[i] : static_cast<size_t>(static_cast<std::uint64_t>(high[i]) << 32 | offsets[i]);
+        }
+
+        // fixed offsets: a block of lengths at a time is compared to s's in a loop which compiles to
+        // vector compares, leaving a mask of the tokens whose contents need comparing
+        template <typename F>
+        void each_equal(const bstref& s, F f) const {
+            if (encoding_ == varint_offsets) {
+                size_t i = 0;
+                for_each([&](const bstref& token) {
+                    if (token == s)
+                        f(i);
+                    ++i;
+                });
+                return;
+            }
+            if (s.length() > 0xffffffffu)
+                return;
+            std::uint32_t n = static_cast<std::uint32_t>(s.length());
+            const std::uint32_t* len = lengths.data();
+            for (size_t first = 0; first < count; first += block) {
+                size_t m = std::min<size_t>(block, count - first);
+                std::uint64_t mask = 0;
+                for (size_t j = 0; j < m; ++j)
+                    mask |= static_cast<std::uint64_t>(len[first + j] == n) << j;
+                for (; mask != 0; mask &= mask - 1) {
+                    size_t i = first + detail::lowest_bit64(mask);
+                    if (std::equal(s.begin(), s.end(), base_ref.data() + offset_of(i)))
+                        f(i);
+                }
+            }
+        }
+
+        void put_varint(size_t v) {
+            for (; v >= 0x80; v >>= 7)
+                packed.push_back(static_cast<unsigned char>(v | 0x80));
+            packed.push_back(static_cast<unsigned char>(v));
+        }
+
+        static size_t get_varint(const unsigned char*& p) {
+            size_t v = *p & 0x7f;
+            for (unsigned shift = 7; *p++ & 0x80; shift += 7)
+                v |= static_cast<size_t>(*p & 0x7f) << shift;
+            return v;
+        }
+
+        bstref base_ref;
+        offset_encoding encoding_;
+        size_t count;
+
+        // fixed offsets
+        std::vector<std::uint32_t> offsets;     // low 32 bits
+        std::vector<unsigned char> high;        // bits 32 to 39, for bases of 4G characters or more
+        std::vector<std::uint32_t> lengths;
+
+        // varint offsets
+        std::vector<unsigned char> packed;      // gap since the previous token's end and length, per token
+        std::vector<size_t> block_bytes;        // where each block of tokens starts in packed
+        std::vector<size_t> block_ends;         // end of the token before each block
+        size_t last_end;
+    };
+
+    typedef basic_stref_table<char_traits> stref_table;
+    typedef basic_stref_table<wchar_traits> wstref_table;
+
+}
+
+#endif
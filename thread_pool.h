@@ -0,0 +1,203 @@
+/*
+    Copyright (C) 2012, Ferruccio Barletta (ferruccio.barletta@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person
+    obtaining a copy of this software and associated documentation
+    files (the "Software"), to deal in the Software without
+    restriction, including without limitation the rights to use,
+    copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the
+    Software is furnished to do so, subject to the following
+    conditions:
+
+    The above copyright notice and this permission notice shall be
+    included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+    OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tools {
+
+    // fixed set of worker threads which run batches of indexed tasks
+    //
+    // run(n, task) calls task(i) once for each i in [0, n) and returns when they have all finished.
+    // The calling thread works on the batch too. Each thread starts with an equal share of the
+    // indices and, when it runs out, steals half of what is left from another thread, so uneven
+    // tasks don't leave threads idle. The first exception thrown by a task is rethrown by run(),
+    // once the batch is done (tasks which haven't started by then are skipped).
+    //
+    // One batch runs at a time: a task must not call run() on the pool that is running it.
+    class thread_pool
+    {
+    public:
+        // threads: the total number of threads, counting the caller of run() (0 means one per core)
+        explicit thread_pool(size_t threads = 0)
+            : task(0), failed(false), busy(0), generation(0), stopping(false) {
+            if (threads == 0)
+                threads = std::max(std::thread::hardware_concurrency(), 1u);
+            shares.reset(new share[threads]);
+            for (size_t i = 1; i < threads; ++i)
+                workers.push_back(std::thread(&thread_pool::work, this, i));
+        }
+
+        thread_pool(const thread_pool&) = delete;
+        thread_pool& operator= (const thread_pool&) = delete;
+
+        ~thread_pool() {
+            {
+                std::lock_guard<std::mutex> lock(m);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (auto& worker : workers)
+                worker.join();
+        }
+
+        // the number of threads which run a batch
+        size_t size() const { return workers.size() + 1; }
+
+        void run(size_t n, const std::function< void(size_t) >& f) {
+            std::lock_guard<std::mutex> one_batch(running);
+            if (workers.empty() || n <= 1) {
+                for (size_t i = 0; i < n; ++i)
+                    f(i);
+                return;
+            }
+            size_t threads = size();
+            for (size_t i = 0; i < threads; ++i) {
+                shares[i].first = n * i / threads;
+                shares[i].last = n * (i + 1) / threads;
+            }
+            task = &f;
+            failed = false;
+            error = std::exception_ptr();
+            {
+                std::lock_guard<std::mutex> lock(m);
+                busy = workers.size();
+                ++generation;
+            }
+            wake.notify_all();
+            drain(0);
+            {
+                std::unique_lock<std::mutex> lock(m);
+                done.wait(lock, [&] { return busy == 0; });
+            }
+            task = 0;
+            if (error)
+                std::rethrow_exception(error);
+        }
+
+    private:
+        // the indices a thread has yet to run, padded to keep each on its own cache line
+        struct share {
+            std::mutex m;
+            size_t first, last;
+            char pad[64];
+        };
+
+        void work(size_t self) {
+            size_t seen = 0;
+            for (;;) {
+                {
+                    std::unique_lock<std::mutex> lock(m);
+                    wake.wait(lock, [&] { return stopping || generation != seen; });
+                    if (stopping)
+                        return;
+                    seen = generation;
+                }
+                drain(self);
+                std::lock_guard<std::mutex> lock(m);
+                if (--busy == 0)
+                    done.notify_one();
+            }
+        }
+
+        // run this thread's share, then steal from the others until there is nothing left
+        void drain(size_t self) {
+            size_t i;
+            while (next(self, i) || steal(self, i)) {
+                if (failed)
+                    continue;
+                try {
+                    (*task)(i);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(m);
+                    if (!failed)
+                        error = std::current_exception();
+                    failed = true;
+                }
+            }
+        }
+
+        bool next(size_t self, size_t& i) {
+            share& own = shares[self];
+            std::lock_guard<std::mutex> lock(own.m);
+            if (own.first == own.last)
+                return false;
+            i = own.first++;
+            return true;
+        }
+
+        // take the upper half of another thread's share: run its first index, keep the rest
+        bool steal(size_t self, size_t& i) {
+            size_t threads = size();
+            for (size_t k = 1; k < threads; ++k) {
+                share& victim = shares[(self + k) % threads];
+                size_t first, last;
+                {
+                    std::lock_guard<std::mutex> lock(victim.m);
+                    if (victim.first == victim.last)
+                        continue;
+                    first = victim.first + (victim.last - victim.first) / 2;
+                    last = victim.last;
+                    victim.last = first;
+                }
+                share& own = shares[self];
+                std::lock_guard<std::mutex> lock(own.m);
+                own.first = first + 1;
+                own.last = last;
+                i = first;
+                return true;
+            }
+            return false;
+        }
+
+        std::vector<std::thread> workers;
+        std::unique_ptr<share[]> shares;            // one per thread, the caller's is shares[0]
+        std::mutex running;                         // held for the duration of a batch
+
+        const std::function< void(size_t) >* task;  // the batch being run
+        std::atomic<bool> failed;                   // a task has thrown: skip the rest
+        std::exception_ptr error;
+
+        std::mutex m;                               // guards busy, generation and stopping
+        std::condition_variable wake, done;
+        size_t busy;                                // workers still on the current batch
+        size_t generation;                          // bumped for each batch
+        bool stopping;
+    };
+
+}
+
+#endif
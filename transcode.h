@@ -0,0 +1,430 @@
+/*
+    Copyright (C) 2012, Ferruccio Barletta (ferruccio.barletta@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person
+    obtaining a copy of this software and associated documentation
+    files (the "Software"), to deal in the Software without
+    restriction, including without limitation the rights to use,
+    copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the
+    Software is furnished to do so, subject to the following
+    conditions:
+
+    The above copyright notice and this permission notice shall be
+    included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+    OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef TRANSCODE_H
+#define TRANSCODE_H
+
+#include <string>
+#include <vector>
+
+#include "stref.h"
+#include "stref_pool.h"
+#include "utf8.h"
+
+namespace tools {
+
+    namespace detail {
+
+        // Conversions between UTF-8 and UTF-16 or UTF-32 code units (chosen by the size of chT, so
+        // wchar_t is UTF-16 on Windows and UTF-32 elsewhere). Anything which isn't a valid character
+        // becomes U+FFFD: each byte of an invalid UTF-8 sequence, an unpaired UTF-16 surrogate, a
+        // UTF-32 surrogate or a value above U+10FFFF. The kernels copy runs of ASCII a block at a
+        // time and convert the other characters one by one.
+
+        // the code units of cp (a character or a 0xdc00 + byte error from utf8_decode())
+        template <typename chT>
+        chT* put_units(char32_t cp, chT* out) {
+            if (cp - 0xdc00 < 0x100)
+                cp = 0xfffd;
+            if (sizeof(chT) == 2 && cp >= 0x10000) {
+                *out++ = static_cast<chT>(0xd800 + ((cp - 0x10000) >> 10));
+                *out++ = static_cast<chT>(0xdc00 + (cp & 0x3ff));
+            } else {
+                *out++ = static_cast<chT>(cp);
+            }
+            return out;
+        }
+
+        // decode the UTF-8 characters which start before stop (ASCII and two byte sequences inline)
+        template <typename chT>
+        chT* decode_utf8_until(const char*& first, const char* stop, const char* last, chT* out) {
+            while (first < stop) {
+                unsigned c = static_cast<unsigned char>(first[0]);
+                if (c < 0x80) {
+                    *out++ = static_cast<chT>(c);
+                    ++first;
+                } else if (c - 0xc2 < 0x1e && last - first >= 2 && is_continuation(first[1])) {
+                    *out++ = static_cast<chT>(((c & 0x1f) << 6) | (static_cast<unsigned char>(first[1]) & 0x3f));
+                    first += 2;
+                } else {
+                    size_t n;
+                    out = put_units(utf8_decode(first, last, n), out);
+                    first += n;
+                }
+            }
+            return out;
+        }
+
+        template <typename chT>
+        chT* decode_utf8_scalar(const char* first, const char* last, chT* out) {
+            while (first != last) {
+                if (static_cast<unsigned char>(*first) < 0x80)
+                    *out++ = static_cast<chT>(*first++);
+                else
+                    out = decode_utf8_until(first, first + 1, last, out);
+            }
+            return out;
+        }
+
+        // the character at p (p < last), its length in code units in n; 0xfffd if it isn't valid
+        template <typename chT>
+        char32_t get_units(const chT* p, const chT* last, size_t& n) {
+            n = 1;
+            std::uint32_t u = static_cast<std::uint32_t>(p[0]);
+            if (sizeof(chT) == 2) {
+                u &= 0xffff;
+                if (u - 0xd800 >= 0x800)
+                    return u;
+                std::uint32_t next = last - p > 1 ? static_cast<std::uint32_t>(p[1]) & 0xffff : 0;
+                if (u < 0xdc00 && next - 0xdc00 < 0x400) {
+                    n = 2;
+                    return 0x10000 + ((u - 0xd800) << 10) + (next - 0xdc00);
+                }
+                return 0xfffd;
+            }
+            return u - 0xd800 < 0x800 || u > 0x10ffff ? 0xfffd : u;
+        }
+
+        template <typename chT>
+        char* encode_utf8_until(const chT*& first, const chT* stop, const chT* last, char* out) {
+            while (first < stop) {
+                std::uint32_t u = static_cast<std::uint32_t>(*first);
+                if (u < 0x80) {
+                    *out++ = static_cast<char>(u);
+                    ++first;
+                } else if (u < 0x800) {
+                    out[0] = static_cast<char>(0xc0 | (u >> 6));
+                    out[1] = static_cast<char>(0x80 | (u & 0x3f));
+                    out += 2, ++first;
+                } else {
+                    size_t n;
+                    out += utf8_encode(get_units(first, last, n), out);
+                    first += n;
+                }
+            }
+            return out;
+        }
+
+        template <typename chT>
+        char* encode_utf8_scalar(const chT* first, const chT* last, char* out) {
+            while (first != last) {
+                if (static_cast<std::uint32_t>(*first) < 0x80)
+                    *out++ = static_cast<char>(*first++);
+                else
+                    out = encode_utf8_until(first, first + 1, last, out);
+            }
+            return out;
+        }
+
+        // the exact output lengths
+        template <typename chT>
+        size_t decoded_length_scalar(const char* first, const char* last) {
+            size_t units = 0;
+            while (first != last) {
+                size_t n;
+                char32_t cp = utf8_decode(first, last, n);
+                units += sizeof(chT) == 2 && cp >= 0x10000 && cp - 0xdc00 >= 0x100 ? 2 : 1;
+                first += n;
+            }
+            return units;
+        }
+
+        template <typename chT>
+        size_t encoded_length_scalar(const chT* first, const chT* last) {
+            size_t bytes = 0;
+            while (first != last) {
+                size_t n;
+                char32_t cp = get_units(first, last, n);
+                bytes += cp < 0x80 ? 1 : cp < 0x800 ? 2 : cp < 0x10000 ? 3 : 4;
+                first += n;
+            }
+            return bytes;
+        }
+
+        // valid UTF-8 decodes to a code unit for each character, and a second one for each
+        // four byte sequence in UTF-16; the rest is counted one character at a time
+        template <typename chT>
+        size_t decoded_length(const char* first, const char* last, simd_level level = cpu_simd_level()) {
+            const char* valid = utf8_validate(first, last, level);
+            size_t units = utf8_count(first, valid, level);
+            if (sizeof(chT) == 2)
+                for (const char* p = first; p != valid; ++p)
+                    units += static_cast<unsigned char>(*p) >= 0xf0;
+            return units + decoded_length_scalar<chT>(valid, last);
+        }
+
+#if defined(STREF_X86)
+        // store the 16 ASCII bytes in v as code units
+        template <typename chT>
+        STREF_TARGET("sse2") void widen_ascii_sse2(__m128i v, chT* out) {
+            const __m128i zero = _mm_setzero_si128();
+            __m128i lo = _mm_unpacklo_epi8(v, zero), hi = _mm_unpackhi_epi8(v, zero);
+            if (sizeof(chT) == 2) {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out), lo);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 8), hi);
+            } else {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi16(lo, zero));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4), _mm_unpackhi_epi16(lo, zero));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 8), _mm_unpacklo_epi16(hi, zero));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 12), _mm_unpackhi_epi16(hi, zero));
+            }
+        }
+
+        template <typename chT>
+        STREF_TARGET("sse2") chT* decode_utf8_sse2(const char* first, const char* last, chT* out) {
+            while (last - first >= 16) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+                if (_mm_movemask_epi8(v) == 0) {
+                    widen_ascii_sse2(v, out);
+                    first += 16, out += 16;
+                } else {
+                    out = decode_utf8_until(first, first + 16, last, out);
+                }
+            }
+            return decode_utf8_scalar(first, last, out);
+        }
+
+        template <typename chT>
+        STREF_TARGET("avx2") chT* decode_utf8_avx2(const char* first, const char* last, chT* out) {
+            while (last - first >= 32) {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first));
+                if (_mm256_movemask_epi8(v) == 0) {
+                    __m128i lo = _mm256_castsi256_si128(v), hi = _mm256_extracti128_si256(v, 1);
+                    if (sizeof(chT) == 2) {
+                        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_cvtepu8_epi16(lo));
+                        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 16), _mm256_cvtepu8_epi16(hi));
+                    } else {
+                        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_cvtepu8_epi32(lo));
+                        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 8), _mm256_cvtepu8_epi32(_mm_srli_si128(lo, 8)));
+                        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 16), _mm256_cvtepu8_epi32(hi));
+                        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 24), _mm256_cvtepu8_epi32(_mm_srli_si128(hi, 8)));
+                    }
+                    first += 32, out += 32;
+                } else {
+                    out = decode_utf8_until(first, first + 32, last, out);
+                }
+            }
+            return decode_utf8_sse2(first, last, out);
+        }
+
+        // 16 code units as bytes, if they're all ASCII (a zero mask otherwise)
+        template <typename chT>
+        STREF_TARGET("sse2") int narrow_ascii_sse2(const chT* p, __m128i& bytes) {
+            const __m128i* v = reinterpret_cast<const __m128i*>(p);
+            __m128i words;
+            if (sizeof(chT) == 2) {
+                __m128i a = _mm_loadu_si128(v), b = _mm_loadu_si128(v + 1);
+                words = _mm_or_si128(a, b);
+                bytes = _mm_packus_epi16(a, b);
+            } else {
+                __m128i a = _mm_loadu_si128(v), b = _mm_loadu_si128(v + 1), c = _mm_loadu_si128(v + 2), d = _mm_loadu_si128(v + 3);
+                words = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+                bytes = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+            }
+            return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(words, _mm_set1_epi32(~0x7f)), _mm_setzero_si128())) == 0xffff;
+        }
+
+        template <typename chT>
+        STREF_TARGET("sse2") char* encode_utf8_sse2(const chT* first, const chT* last, char* out) {
+            while (last - first >= 16) {
+                __m128i bytes;
+                if (narrow_ascii_sse2(first, bytes)) {
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), bytes);
+                    first += 16, out += 16;
+                } else {
+                    out = encode_utf8_until(first, first + 16, last, out);
+                }
+            }
+            return encode_utf8_scalar(first, last, out);
+        }
+
+        template <typename chT>
+        STREF_TARGET("avx2") char* encode_utf8_avx2(const chT* first, const chT* last, char* out) {
+            while (last - first >= 32) {
+                const __m256i* v = reinterpret_cast<const __m256i*>(first);
+                __m256i words, bytes;
+                if (sizeof(chT) == 2) {
+                    __m256i a = _mm256_loadu_si256(v), b = _mm256_loadu_si256(v + 1);
+                    words = _mm256_or_si256(a, b);
+                    // packing works within 128 bit lanes: put the quadwords back in order
+                    bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8);
+                } else {
+                    __m256i a = _mm256_loadu_si256(v), b = _mm256_loadu_si256(v + 1), c = _mm256_loadu_si256(v + 2), d = _mm256_loadu_si256(v + 3);
+                    words = _mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(c, d));
+                    bytes = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d)),
+                                                        _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+                }
+                if (_mm256_testz_si256(words, _mm256_set1_epi32(~0x7f))) {
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), bytes);
+                    first += 32, out += 32;
+                } else {
+                    out = encode_utf8_until(first, first + 32, last, out);
+                }
+            }
+            return encode_utf8_sse2(first, last, out);
+        }
+
+        // UTF-8 length of 16 code units: blocks which hold surrogates (or UTF-32 values which aren't
+        // characters) are left to the scalar code, the others are counted with compares (-1 each)
+        // summed in vector lanes, which are added up every 2048 blocks
+        template <typename chT>
+        STREF_TARGET("sse2") size_t encoded_length_sse2(const chT* first, const chT* last) {
+            size_t bytes = 0;
+            while (last - first >= 16) {
+                __m128i sums = _mm_setzero_si128();
+                size_t blocks = 0;
+                for (; blocks < 2048 && last - first >= 16; first += 16) {
+                    const __m128i* v = reinterpret_cast<const __m128i*>(first);
+                    __m128i counts = _mm_setzero_si128(), odd = _mm_setzero_si128();
+                    if (sizeof(chT) == 2) {
+                        // 3 bytes per unit, less 1 below 0x80 and 1 below 0x800
+                        for (int i = 0; i < 2; ++i) {
+                            __m128i u = _mm_loadu_si128(v + i), high = _mm_and_si128(u, _mm_set1_epi16(short(0xf800)));
+                            counts = _mm_add_epi16(counts, _mm_cmpeq_epi16(_mm_and_si128(u, _mm_set1_epi16(short(0xff80))), _mm_setzero_si128()));
+                            counts = _mm_add_epi16(counts, _mm_cmpeq_epi16(high, _mm_setzero_si128()));
+                            odd = _mm_or_si128(odd, _mm_cmpeq_epi16(high, _mm_set1_epi16(short(0xd800))));
+                        }
+                        counts = _mm_madd_epi16(counts, _mm_set1_epi16(1));
+                    } else {
+                        // 1 byte per unit, plus 1 above 0x7f, 0x7ff and 0xffff
+                        for (int i = 0; i < 4; ++i) {
+                            __m128i u = _mm_loadu_si128(v + i);
+                            counts = _mm_add_epi32(counts, _mm_cmpgt_epi32(u, _mm_set1_epi32(0x7f)));
+                            counts = _mm_add_epi32(counts, _mm_cmpgt_epi32(u, _mm_set1_epi32(0x7ff)));
+                            counts = _mm_add_epi32(counts, _mm_cmpgt_epi32(u, _mm_set1_epi32(0xffff)));
+                            odd = _mm_or_si128(odd, _mm_or_si128(_mm_cmpgt_epi32(u, _mm_set1_epi32(0x10ffff)), _mm_cmplt_epi32(u, _mm_setzero_si128())));
+                            odd = _mm_or_si128(odd, _mm_cmpeq_epi32(_mm_and_si128(u, _mm_set1_epi32(~0x7ff)), _mm_set1_epi32(0xd800)));
+                        }
+                    }
+                    if (_mm_movemask_epi8(odd) != 0) {
+                        // a surrogate pair split by the end of the block counts as two errors (3 + 3 bytes) but is 4 bytes
+                        bytes += encoded_length_scalar(first, first + 16);
+                        if (sizeof(chT) == 2 && last - first > 16 && (first[15] & 0xfc00) == 0xd800 && (first[16] & 0xfc00) == 0xdc00)
+                            bytes -= 2;
+                        continue;
+                    }
+                    sums = _mm_add_epi32(sums, counts);
+                    ++blocks;
+                }
+                sums = _mm_add_epi32(sums, _mm_shuffle_epi32(sums, 0x4e));
+                sums = _mm_add_epi32(sums, _mm_shuffle_epi32(sums, 0xb1));
+                std::ptrdiff_t total = _mm_cvtsi128_si32(sums);
+                bytes += sizeof(chT) == 2 ? blocks * 48 + total : blocks * 16 - total;
+            }
+            return bytes + encoded_length_scalar(first, last);
+        }
+#endif
+
+        template <typename chT>
+        chT* decode_utf8(const char* first, const char* last, chT* out, simd_level level = cpu_simd_level()) {
+#if defined(STREF_X86)
+            if (level >= simd_avx2) return decode_utf8_avx2(first, last, out);
+            if (level >= simd_sse2) return decode_utf8_sse2(first, last, out);
+#endif
+            (void)level;
+            return decode_utf8_scalar(first, last, out);
+        }
+
+        template <typename chT>
+        char* encode_utf8(const chT* first, const chT* last, char* out, simd_level level = cpu_simd_level()) {
+#if defined(STREF_X86)
+            if (level >= simd_avx2) return encode_utf8_avx2(first, last, out);
+            if (level >= simd_sse2) return encode_utf8_sse2(first, last, out);
+#endif
+            (void)level;
+            return encode_utf8_scalar(first, last, out);
+        }
+
+        template <typename chT>
+        size_t encoded_length(const chT* first, const chT* last, simd_level level = cpu_simd_level()) {
+#if defined(STREF_X86)
+            if (level >= simd_sse2) return encoded_length_sse2(first, last);
+#endif
+            (void)level;
+            return encoded_length_scalar(first, last);
+        }
+
+    }
+
+    //
+    // UTF-8 <-> wide strings (UTF-16 or UTF-32, as wchar_t is), see detail::decode_utf8()
+    //
+    // to_wide_length() and to_utf8_length() are the exact lengths of the results, so the caller
+    // can provide the buffers: to_wide(s, out) and to_utf8(ws, out) write the conversion there and
+    // return a stref to it. The other overloads return a new string or intern the result in a pool.
+    //
+
+    template <typename TT>
+    size_t to_wide_length(const basic_stref<TT>& s) {
+        static_assert(sizeof(typename TT::char_type) == 1, "to_wide_length: UTF-8 text is made of bytes");
+        return detail::decoded_length<wchar_t>(s.begin(), s.end());
+    }
+
+    // out has room for to_wide_length(s) characters
+    template <typename TT>
+    wstref to_wide(const basic_stref<TT>& s, wchar_t* out) {
+        static_assert(sizeof(typename TT::char_type) == 1, "to_wide: UTF-8 text is made of bytes");
+        return wstref(out, detail::decode_utf8(s.begin(), s.end(), out) - out);
+    }
+
+    template <typename TT>
+    std::wstring to_wide(const basic_stref<TT>& s) {
+        std::wstring ws(to_wide_length(s), L'\0');
+        if (!ws.empty())
+            to_wide(s, &ws[0]);
+        return ws;
+    }
+
+    template <typename TT>
+    wstref to_wide(const basic_stref<TT>& s, wstref_pool& pool) {
+        std::vector<wchar_t> buffer(to_wide_length(s) + 1);
+        return pool.intern(to_wide(s, buffer.data()));
+    }
+
+    inline size_t to_utf8_length(const wstref& ws) {
+        return detail::encoded_length(ws.begin(), ws.end());
+    }
+
+    // out has room for to_utf8_length(ws) bytes
+    inline stref to_utf8(const wstref& ws, char* out) {
+        return stref(out, detail::encode_utf8(ws.begin(), ws.end(), out) - out);
+    }
+
+    inline std::string to_utf8(const wstref& ws) {
+        std::string s(to_utf8_length(ws), '\0');
+        if (!s.empty())
+            to_utf8(ws, &s[0]);
+        return s;
+    }
+
+    inline stref to_utf8(const wstref& ws, stref_pool& pool) {
+        std::vector<char> buffer(to_utf8_length(ws) + 1);
+        return pool.intern(to_utf8(ws, buffer.data()));
+    }
+
+}
+
+#endif
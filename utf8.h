@@ -0,0 +1,669 @@
+/*
+    Copyright (C) 2012, Ferruccio Barletta (ferruccio.barletta@gmail.com)
+
+    Permission is hereby granted, free of charge, to any person
+    obtaining a copy of this software and associated documentation
+    files (the "Software"), to deal in the Software without
+    restriction, including without limitation the rights to use,
+    copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the
+    Software is furnished to do so, subject to the following
+    conditions:
+
+    The above copyright notice and this permission notice shall be
+    included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+    OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <cstdint>
+#include <iterator>
+
+#include "stref.h"
+
+namespace tools {
+
+    // UTF-8 traits: the code units are bytes, and on its own a byte is only a letter or white space
+    // if it's ASCII, so the operations which work a code unit at a time (find, split, starts_with...)
+    // never split or change a multi-byte character. trim(), icompare() and ihash() work on whole
+    // characters: they trim Unicode white space and compare with simple Unicode case folding.
+    // length() and the offsets are in bytes, utf8_length(), utf8_substr() & co. count characters.
+    class utf8_traits
+    {
+    public:
+        typedef char char_type;
+
+        static STREF_CONSTEXPR char to_lower_case(char ch) {
+            return ch >= 'A' && ch <= 'Z' ? static_cast<char>(ch + ('a' - 'A')) : ch;
+        }
+
+        static STREF_CONSTEXPR bool is_whitespace(char ch) {
+            return ch == ' ' || (ch >= '\t' && ch <= '\r');
+        }
+    };
+
+    typedef basic_stref<utf8_traits> u8stref;
+
+    namespace detail {
+
+        template <> struct ascii_case_folding<utf8_traits> : std::true_type {};
+
+        inline bool is_continuation(char c) { return (static_cast<unsigned char>(c) & 0xc0) == 0x80; }
+
+        // the character at p (p < last) and its length in bytes. A byte which doesn't start a valid
+        // sequence decodes on its own as 0xdc00 + byte: a lone surrogate, which UTF-8 can't encode.
+        inline char32_t utf8_decode(const char* p, const char* last, size_t& n) {
+            unsigned c = static_cast<unsigned char>(p[0]);
+            n = 1;
+            if (c < 0x80)
+                return c;
+            size_t avail = last - p;
+            unsigned lo = 0x80, hi = 0xbf;
+            if (c >= 0xc2 && c < 0xe0) {
+                n = 2;
+            } else if (c >= 0xe0 && c < 0xf0) {
+                n = 3;
+                if (c == 0xe0) lo = 0xa0;
+                if (c == 0xed) hi = 0x9f;
+            } else if (c >= 0xf0 && c < 0xf5) {
+                n = 4;
+                if (c == 0xf0) lo = 0x90;
+                if (c == 0xf4) hi = 0x8f;
+            } else {
+                return 0xdc00 + c;
+            }
+            unsigned c1 = avail > 1 ? static_cast<unsigned char>(p[1]) : 0;
+            bool valid = avail >= n && c1 >= lo && c1 <= hi;
+            for (size_t i = 2; valid && i < n; ++i)
+                valid = is_continuation(p[i]);
+            if (!valid) {
+                n = 1;
+                return 0xdc00 + c;
+            }
+            char32_t cp = c & (0x7f >> n);
+            for (size_t i = 1; i < n; ++i)
+                cp = (cp << 6) | (static_cast<unsigned char>(p[i]) & 0x3f);
+            return cp;
+        }
+
+        // UTF-8 encoding of cp (surrogates included) into out[0..4), returns its length
+        inline size_t utf8_encode(char32_t cp, char* out) {
+            if (cp < 0x80) {
+                out[0] = static_cast<char>(cp);
+                return 1;
+            }
+            if (cp < 0x800) {
+                out[0] = static_cast<char>(0xc0 | (cp >> 6));
+                out[1] = static_cast<char>(0x80 | (cp & 0x3f));
+                return 2;
+            }
+            if (cp < 0x10000) {
+                out[0] = static_cast<char>(0xe0 | (cp >> 12));
+                out[1] = static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+                out[2] = static_cast<char>(0x80 | (cp & 0x3f));
+                return 3;
+            }
+            out[0] = static_cast<char>(0xf0 | (cp >> 18));
+            out[1] = static_cast<char>(0x80 | ((cp >> 12) & 0x3f));
+            out[2] = static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+            out[3] = static_cast<char>(0x80 | (cp & 0x3f));
+            return 4;
+        }
+
+        //
+        // validation: the kernels return the start of the first invalid sequence, or last
+        //
+
+        inline const char* utf8_validate_scalar(const char* first, const char* last) {
+            while (first != last) {
+                if (last - first >= 8) {
+                    std::uint64_t w;
+                    std::memcpy(&w, first, 8);
+                    if ((w & 0x8080808080808080ull) == 0) {
+                        first += 8;
+                        continue;
+                    }
+                }
+                size_t n;
+                if (utf8_decode(first, last, n) - 0xdc00 < 0x100)
+                    return first;
+                first += n;
+            }
+            return last;
+        }
+
+        // where the scalar code takes over from a kernel which stopped at p: the start of the
+        // character p is in, if it began in the last three bytes
+        inline const char* utf8_resume(const char* first, const char* p) {
+            for (int k = 1; k <= 3 && p - k >= first; ++k) {
+                unsigned char c = static_cast<unsigned char>(p[-k]);
+                if (c >= 0xc0)
+                    return p - k;
+                if (c < 0x80)
+                    break;
+            }
+            return p;
+        }
+
+#if defined(STREF_X86)
+        // The vector kernels classify each byte from its high nibble and the two nibbles of the byte
+        // before it (three table lookups), which catches every error involving two bytes; the third
+        // and fourth bytes of long sequences are checked against the bytes two and three back.
+        // (J. Keiser and D. Lemire, "Validating UTF-8 in less than one instruction per byte", 2021)
+        enum {
+            utf8_too_short = 1 << 0, utf8_too_long = 1 << 1, utf8_overlong_3 = 1 << 2, utf8_too_large = 1 << 3,
+            utf8_surrogate = 1 << 4, utf8_overlong_2 = 1 << 5, utf8_too_large_1000 = 1 << 6, utf8_overlong_4 = 1 << 6,
+            utf8_two_conts = 1 << 7, utf8_carry = utf8_too_short | utf8_too_long | utf8_two_conts
+        };
+
+        STREF_TARGET("ssse3") inline __m128i utf8_byte_1_high() {
+            return _mm_setr_epi8(
+                utf8_too_long, utf8_too_long, utf8_too_long, utf8_too_long,
+                utf8_too_long, utf8_too_long, utf8_too_long, utf8_too_long,
+                char(utf8_two_conts), char(utf8_two_conts), char(utf8_two_conts), char(utf8_two_conts),
+                utf8_too_short | utf8_overlong_2,
+                utf8_too_short,
+                utf8_too_short | utf8_overlong_3 | utf8_surrogate,
+                utf8_too_short | utf8_too_large | utf8_too_large_1000 | utf8_overlong_4);
+        }
+
+        STREF_TARGET("ssse3") inline __m128i utf8_byte_1_low() {
+            return _mm_setr_epi8(
+                char(utf8_carry | utf8_overlong_3 | utf8_overlong_2 | utf8_overlong_4),
+                char(utf8_carry | utf8_overlong_2),
+                char(utf8_carry),
+                char(utf8_carry),
+                char(utf8_carry | utf8_too_large),
+                char(utf8_carry | utf8_too_large | utf8_too_large_1000),
+                char(utf8_carry | utf8_too_large | utf8_too_large_1000),
+                char(utf8_carry | utf8_too_large | utf8_too_large_1000),
+                char(utf8_carry | utf8_too_large | utf8_too_large_1000),
+                char(utf8_carry | utf8_too_large | utf8_too_large_1000),
+                char(utf8_carry | utf8_too_large | utf8_too_large_1000),
+                char(utf8_carry | utf8_too_large | utf8_too_large_1000),
+                char(utf8_carry | utf8_too_large | utf8_too_large_1000),
+                char(utf8_carry | utf8_too_large | utf8_too_large_1000 | utf8_surrogate),
+                char(utf8_carry | utf8_too_large | utf8_too_large_1000),
+                char(utf8_carry | utf8_too_large | utf8_too_large_1000));
+        }
+
+        STREF_TARGET("ssse3") inline __m128i utf8_byte_2_high() {
+            return _mm_setr_epi8(
+                utf8_too_short, utf8_too_short, utf8_too_short, utf8_too_short,
+                utf8_too_short, utf8_too_short, utf8_too_short, utf8_too_short,
+                char(utf8_too_long | utf8_overlong_2 | utf8_two_conts | utf8_overlong_3 | utf8_too_large_1000 | utf8_overlong_4),
+                char(utf8_too_long | utf8_overlong_2 | utf8_two_conts | utf8_overlong_3 | utf8_too_large),
+                char(utf8_too_long | utf8_overlong_2 | utf8_two_conts | utf8_surrogate | utf8_too_large),
+                char(utf8_too_long | utf8_overlong_2 | utf8_two_conts | utf8_surrogate | utf8_too_large),
+                utf8_too_short, utf8_too_short, utf8_too_short, utf8_too_short);
+        }
+
+        // the error bits of block in, given prev1..3, the bytes 1..3 positions before each of its bytes
+        STREF_TARGET("ssse3") inline __m128i utf8_errors_ssse3(__m128i in, __m128i prev1, __m128i prev2, __m128i prev3) {
+            const __m128i low_nibble = _mm_set1_epi8(0x0f);
+            __m128i special = _mm_and_si128(
+                _mm_and_si128(_mm_shuffle_epi8(utf8_byte_1_high(), _mm_and_si128(_mm_srli_epi16(prev1, 4), low_nibble)),
+                              _mm_shuffle_epi8(utf8_byte_1_low(), _mm_and_si128(prev1, low_nibble))),
+                _mm_shuffle_epi8(utf8_byte_2_high(), _mm_and_si128(_mm_srli_epi16(in, 4), low_nibble)));
+            __m128i third = _mm_subs_epu8(prev2, _mm_set1_epi8(char(0xe0 - 0x80)));     // >= 0x80 for 111xxxxx
+            __m128i fourth = _mm_subs_epu8(prev3, _mm_set1_epi8(char(0xf0 - 0x80)));    // >= 0x80 for 1111xxxx
+            __m128i must_continue = _mm_and_si128(_mm_or_si128(third, fourth), _mm_set1_epi8(char(0x80)));
+            return _mm_xor_si128(must_continue, special);
+        }
+
+        STREF_TARGET("ssse3") inline const char* utf8_validate_ssse3(const char* first, const char* last) {
+            __m128i prev = _mm_setzero_si128();
+            const char* p = first;
+            for (; last - p >= 16; p += 16) {
+                __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+                if (_mm_movemask_epi8(_mm_or_si128(in, prev)) != 0) {
+                    __m128i errors = utf8_errors_ssse3(in, _mm_alignr_epi8(in, prev, 15), _mm_alignr_epi8(in, prev, 14), _mm_alignr_epi8(in, prev, 13));
+                    if (_mm_movemask_epi8(_mm_cmpeq_epi8(errors, _mm_setzero_si128())) != 0xffff)
+                        break;
+                }
+                prev = in;
+            }
+            return utf8_validate_scalar(utf8_resume(first, p), last);
+        }
+
+        STREF_TARGET("avx2") inline __m256i utf8_errors_avx2(__m256i in, __m256i prev1, __m256i prev2, __m256i prev3) {
+            const __m256i low_nibble = _mm256_set1_epi8(0x0f);
+            __m256i byte_1_high = _mm256_broadcastsi128_si256(utf8_byte_1_high());
+            __m256i byte_1_low = _mm256_broadcastsi128_si256(utf8_byte_1_low());
+            __m256i byte_2_high = _mm256_broadcastsi128_si256(utf8_byte_2_high());
+            __m256i special = _mm256_and_si256(
+                _mm256_and_si256(_mm256_shuffle_epi8(byte_1_high, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), low_nibble)),
+                                 _mm256_shuffle_epi8(byte_1_low, _mm256_and_si256(prev1, low_nibble))),
+                _mm256_shuffle_epi8(byte_2_high, _mm256_and_si256(_mm256_srli_epi16(in, 4), low_nibble)));
+            __m256i third = _mm256_subs_epu8(prev2, _mm256_set1_epi8(char(0xe0 - 0x80)));
+            __m256i fourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8(char(0xf0 - 0x80)));
+            __m256i must_continue = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8(char(0x80)));
+            return _mm256_xor_si256(must_continue, special);
+        }
+
+        STREF_TARGET("avx2") inline const char* utf8_validate_avx2(const char* first, const char* last) {
+            __m256i prev = _mm256_setzero_si256();
+            const char* p = first;
+            for (; last - p >= 32; p += 32) {
+                __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+                if (_mm256_movemask_epi8(_mm256_or_si256(in, prev)) != 0) {
+                    // prev's high lane followed by in's low lane, for the bytes before each lane
+                    __m256i shifted = _mm256_permute2x128_si256(prev, in, 0x21);
+                    __m256i errors = utf8_errors_avx2(in, _mm256_alignr_epi8(in, shifted, 15), _mm256_alignr_epi8(in, shifted, 14), _mm256_alignr_epi8(in, shifted, 13));
+                    if (!_mm256_testz_si256(errors, errors))
+                        break;
+                }
+                prev = in;
+            }
+            return utf8_validate_scalar(utf8_resume(first, p), last);
+        }
+#endif
+
+        inline const char* utf8_validate(const char* first, const char* last, simd_level level = cpu_simd_level()) {
+#if defined(STREF_X86)
+            if (level >= simd_avx2) return utf8_validate_avx2(first, last);
+            if (level >= simd_ssse3) return utf8_validate_ssse3(first, last);
+#endif
+            (void)level;
+            return utf8_validate_scalar(first, last);
+        }
+
+        //
+        // counting: the number of bytes which aren't continuation bytes (the number of characters,
+        // if the text is valid)
+        //
+
+        inline size_t utf8_count_scalar(const char* first, const char* last) {
+            size_t n = 0;
+            for (; first != last; ++first)
+                n += !is_continuation(*first);
+            return n;
+        }
+
+#if defined(STREF_X86)
+        // continuation bytes are -128..-65 as signed bytes; the compare results (-1 each) are summed
+        // in byte lanes for up to 255 blocks at a time, then added up with psadbw
+        STREF_TARGET("sse2") inline size_t utf8_count_sse2(const char* first, const char* last) {
+            const __m128i limit = _mm_set1_epi8(-65);
+            size_t n = 0;
+            while (last - first >= 16) {
+                __m128i sums = _mm_setzero_si128();
+                for (int i = 0; i < 255 && last - first >= 16; ++i, first += 16)
+                    sums = _mm_sub_epi8(sums, _mm_cmpgt_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(first)), limit));
+                __m128i total = _mm_sad_epu8(sums, _mm_setzero_si128());
+                n += static_cast<size_t>(_mm_cvtsi128_si32(total)) + static_cast<size_t>(_mm_extract_epi16(total, 4));
+            }
+            return n + utf8_count_scalar(first, last);
+        }
+
+        STREF_TARGET("avx2") inline size_t utf8_count_avx2(const char* first, const char* last) {
+            const __m256i limit = _mm256_set1_epi8(-65);
+            size_t n = 0;
+            while (last - first >= 32) {
+                __m256i sums = _mm256_setzero_si256();
+                for (int i = 0; i < 255 && last - first >= 32; ++i, first += 32)
+                    sums = _mm256_sub_epi8(sums, _mm256_cmpgt_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(first)), limit));
+                __m256i total = _mm256_sad_epu8(sums, _mm256_setzero_si256());
+                __m128i half = _mm_add_epi64(_mm256_castsi256_si128(total), _mm256_extracti128_si256(total, 1));
+                n += static_cast<size_t>(_mm_cvtsi128_si32(half)) + static_cast<size_t>(_mm_extract_epi16(half, 4));
+            }
+            return n + utf8_count_sse2(first, last);
+        }
+#endif
+
+        inline size_t utf8_count(const char* first, const char* last, simd_level level = cpu_simd_level()) {
+#if defined(STREF_X86)
+            if (level >= simd_avx2) return utf8_count_avx2(first, last);
+            if (level >= simd_sse2) return utf8_count_sse2(first, last);
+#endif
+            (void)level;
+            return utf8_count_scalar(first, last);
+        }
+
+        // the start of the character n characters after first (or last), skipping whole blocks
+        // which hold no more than n characters
+        inline const char* utf8_advance(const char* first, const char* last, size_t n) {
+            const size_t block = 64;
+            for (size_t count; last - first >= std::ptrdiff_t(block) && (count = utf8_count(first, first + block)) <= n; first += block)
+                n -= count;
+            for (; first != last; ++first)
+                if (!is_continuation(*first) && n-- == 0)
+                    break;
+            return first;
+        }
+
+        // the start of the n-th character before last (or first)
+        inline const char* utf8_retreat(const char* first, const char* last, size_t n) {
+            const size_t block = 64;
+            for (size_t count; n > 0 && last - first >= std::ptrdiff_t(block) && (count = utf8_count(last - block, last)) < n; last -= block)
+                n -= count;
+            while (n > 0 && last != first)
+                if (!is_continuation(*--last))
+                    --n;
+            return last;
+        }
+
+        //
+        // Unicode character properties
+        //
+
+        inline bool is_unicode_whitespace(char32_t cp) {
+            if (cp < 0x80)
+                return cp == ' ' || (cp >= '\t' && cp <= '\r');
+            return cp == 0x85 || cp == 0xa0 || cp == 0x1680 || (cp >= 0x2000 && cp <= 0x200a)
+                || cp == 0x2028 || cp == 0x2029 || cp == 0x202f || cp == 0x205f || cp == 0x3000;
+        }
+
+        // simple case folding (the C and S mappings of the Unicode CaseFolding table, version 14):
+        // runs of count characters, stride apart, which fold to the character delta away
+        struct case_fold_run {
+            std::uint32_t first;
+            std::uint16_t count;
+            std::uint16_t stride;
+            std::int32_t delta;
+        };
+
+        inline char32_t fold_code_point(char32_t cp) {
+            if (cp < 0x80)
+                return cp - 'A' < 26 ? cp + ('a' - 'A') : cp;
+            static const case_fold_run runs[] = {
+                { 0x00b5, 1, 1, 775 }, { 0x00c0, 23, 1, 32 }, { 0x00d8, 7, 1, 32 }, { 0x0100, 24, 2, 1 },
+                { 0x0132, 3, 2, 1 }, { 0x0139, 8, 2, 1 }, { 0x014a, 23, 2, 1 }, { 0x0178, 1, 1, -121 },
+                { 0x0179, 3, 2, 1 }, { 0x017f, 1, 1, -268 }, { 0x0181, 1, 1, 210 }, { 0x0182, 2, 2, 1 },
+                { 0x0186, 1, 1, 206 }, { 0x0187, 1, 1, 1 }, { 0x0189, 2, 1, 205 }, { 0x018b, 1, 1, 1 },
+                { 0x018e, 1, 1, 79 }, { 0x018f, 1, 1, 202 }, { 0x0190, 1, 1, 203 }, { 0x0191, 1, 1, 1 },
+                { 0x0193, 1, 1, 205 }, { 0x0194, 1, 1, 207 }, { 0x0196, 1, 1, 211 }, { 0x0197, 1, 1, 209 },
+                { 0x0198, 1, 1, 1 }, { 0x019c, 1, 1, 211 }, { 0x019d, 1, 1, 213 }, { 0x019f, 1, 1, 214 },
+                { 0x01a0, 3, 2, 1 }, { 0x01a6, 1, 1, 218 }, { 0x01a7, 1, 1, 1 }, { 0x01a9, 1, 1, 218 },
+                { 0x01ac, 1, 1, 1 }, { 0x01ae, 1, 1, 218 }, { 0x01af, 1, 1, 1 }, { 0x01b1, 2, 1, 217 },
+                { 0x01b3, 2, 2, 1 }, { 0x01b7, 1, 1, 219 }, { 0x01b8, 1, 1, 1 }, { 0x01bc, 1, 1, 1 },
+                { 0x01c4, 1, 1, 2 }, { 0x01c5, 1, 1, 1 }, { 0x01c7, 1, 1, 2 }, { 0x01c8, 1, 1, 1 },
+                { 0x01ca, 1, 1, 2 }, { 0x01cb, 9, 2, 1 }, { 0x01de, 9, 2, 1 }, { 0x01f1, 1, 1, 2 },
+                { 0x01f2, 2, 2, 1 }, { 0x01f6, 1, 1, -97 }, { 0x01f7, 1, 1, -56 }, { 0x01f8, 20, 2, 1 },
+                { 0x0220, 1, 1, -130 }, { 0x0222, 9, 2, 1 }, { 0x023a, 1, 1, 10795 }, { 0x023b, 1, 1, 1 },
+                { 0x023d, 1, 1, -163 }, { 0x023e, 1, 1, 10792 }, { 0x0241, 1, 1, 1 }, { 0x0243, 1, 1, -195 },
+                { 0x0244, 1, 1, 69 }, { 0x0245, 1, 1, 71 }, { 0x0246, 5, 2, 1 }, { 0x0345, 1, 1, 116 },
+                { 0x0370, 2, 2, 1 }, { 0x0376, 1, 1, 1 }, { 0x037f, 1, 1, 116 }, { 0x0386, 1, 1, 38 },
+                { 0x0388, 3, 1, 37 }, { 0x038c, 1, 1, 64 }, { 0x038e, 2, 1, 63 }, { 0x0391, 17, 1, 32 },
+                { 0x03a3, 9, 1, 32 }, { 0x03c2, 1, 1, 1 }, { 0x03cf, 1, 1, 8 }, { 0x03d0, 1, 1, -30 },
+                { 0x03d1, 1, 1, -25 }, { 0x03d5, 1, 1, -15 }, { 0x03d6, 1, 1, -22 }, { 0x03d8, 12, 2, 1 },
+                { 0x03f0, 1, 1, -54 }, { 0x03f1, 1, 1, -48 }, { 0x03f4, 1, 1, -60 }, { 0x03f5, 1, 1, -64 },
+                { 0x03f7, 1, 1, 1 }, { 0x03f9, 1, 1, -7 }, { 0x03fa, 1, 1, 1 }, { 0x03fd, 3, 1, -130 },
+                { 0x0400, 16, 1, 80 }, { 0x0410, 32, 1, 32 }, { 0x0460, 17, 2, 1 }, { 0x048a, 27, 2, 1 },
+                { 0x04c0, 1, 1, 15 }, { 0x04c1, 7, 2, 1 }, { 0x04d0, 48, 2, 1 }, { 0x0531, 38, 1, 48 },
+                { 0x10a0, 38, 1, 7264 }, { 0x10c7, 1, 1, 7264 }, { 0x10cd, 1, 1, 7264 }, { 0x13f8, 6, 1, -8 },
+                { 0x1c80, 1, 1, -6222 }, { 0x1c81, 1, 1, -6221 }, { 0x1c82, 1, 1, -6212 }, { 0x1c83, 2, 1, -6210 },
+                { 0x1c85, 1, 1, -6211 }, { 0x1c86, 1, 1, -6204 }, { 0x1c87, 1, 1, -6180 }, { 0x1c88, 1, 1, 35267 },
+                { 0x1c90, 43, 1, -3008 }, { 0x1cbd, 3, 1, -3008 }, { 0x1e00, 75, 2, 1 }, { 0x1e9b, 1, 1, -58 },
+                { 0x1e9e, 1, 1, -7615 }, { 0x1ea0, 48, 2, 1 }, { 0x1f08, 8, 1, -8 }, { 0x1f18, 6, 1, -8 },
+                { 0x1f28, 8, 1, -8 }, { 0x1f38, 8, 1, -8 }, { 0x1f48, 6, 1, -8 }, { 0x1f59, 4, 2, -8 },
+                { 0x1f68, 8, 1, -8 }, { 0x1f88, 8, 1, -8 }, { 0x1f98, 8, 1, -8 }, { 0x1fa8, 8, 1, -8 },
+                { 0x1fb8, 2, 1, -8 }, { 0x1fba, 2, 1, -74 }, { 0x1fbc, 1, 1, -9 }, { 0x1fbe, 1, 1, -7173 },
+                { 0x1fc8, 4, 1, -86 }, { 0x1fcc, 1, 1, -9 }, { 0x1fd8, 2, 1, -8 }, { 0x1fda, 2, 1, -100 },
+                { 0x1fe8, 2, 1, -8 }, { 0x1fea, 2, 1, -112 }, { 0x1fec, 1, 1, -7 }, { 0x1ff8, 2, 1, -128 },
+                { 0x1ffa, 2, 1, -126 }, { 0x1ffc, 1, 1, -9 }, { 0x2126, 1, 1, -7517 }, { 0x212a, 1, 1, -8383 },
+                { 0x212b, 1, 1, -8262 }, { 0x2132, 1, 1, 28 }, { 0x2160, 16, 1, 16 }, { 0x2183, 1, 1, 1 },
+                { 0x24b6, 26, 1, 26 }, { 0x2c00, 48, 1, 48 }, { 0x2c60, 1, 1, 1 }, { 0x2c62, 1, 1, -10743 },
+                { 0x2c63, 1, 1, -3814 }, { 0x2c64, 1, 1, -10727 }, { 0x2c67, 3, 2, 1 }, { 0x2c6d, 1, 1, -10780 },
+                { 0x2c6e, 1, 1, -10749 }, { 0x2c6f, 1, 1, -10783 }, { 0x2c70, 1, 1, -10782 }, { 0x2c72, 1, 1, 1 },
+                { 0x2c75, 1, 1, 1 }, { 0x2c7e, 2, 1, -10815 }, { 0x2c80, 50, 2, 1 }, { 0x2ceb, 2, 2, 1 },
+                { 0x2cf2, 1, 1, 1 }, { 0xa640, 23, 2, 1 }, { 0xa680, 14, 2, 1 }, { 0xa722, 7, 2, 1 },
+                { 0xa732, 31, 2, 1 }, { 0xa779, 2, 2, 1 }, { 0xa77d, 1, 1, -35332 }, { 0xa77e, 5, 2, 1 },
+                { 0xa78b, 1, 1, 1 }, { 0xa78d, 1, 1, -42280 }, { 0xa790, 2, 2, 1 }, { 0xa796, 10, 2, 1 },
+                { 0xa7aa, 1, 1, -42308 }, { 0xa7ab, 1, 1, -42319 }, { 0xa7ac, 1, 1, -42315 }, { 0xa7ad, 1, 1, -42305 },
+                { 0xa7ae, 1, 1, -42308 }, { 0xa7b0, 1, 1, -42258 }, { 0xa7b1, 1, 1, -42282 }, { 0xa7b2, 1, 1, -42261 },
+                { 0xa7b3, 1, 1, 928 }, { 0xa7b4, 8, 2, 1 }, { 0xa7c4, 1, 1, -48 }, { 0xa7c5, 1, 1, -42307 },
+                { 0xa7c6, 1, 1, -35384 }, { 0xa7c7, 2, 2, 1 }, { 0xa7d0, 1, 1, 1 }, { 0xa7d6, 2, 2, 1 },
+                { 0xa7f5, 1, 1, 1 }, { 0xab70, 80, 1, -38864 }, { 0xff21, 26, 1, 32 }, { 0x10400, 40, 1, 40 },
+                { 0x104b0, 36, 1, 40 }, { 0x10570, 11, 1, 39 }, { 0x1057c, 15, 1, 39 }, { 0x1058c, 7, 1, 39 },
+                { 0x10594, 2, 1, 39 }, { 0x10c80, 51, 1, 64 }, { 0x118a0, 32, 1, 32 }, { 0x16e40, 32, 1, 32 },
+                { 0x1e900, 34, 1, 34 }
+            };
+            const case_fold_run* run = std::upper_bound(std::begin(runs), std::end(runs), cp,
+                [](char32_t c, const case_fold_run& r) { return c < r.first; });
+            if (run == std::begin(runs))
+                return cp;
+            --run;
+            std::uint32_t offset = cp - run->first;
+            if (offset >= std::uint32_t(run->count) * run->stride || offset % run->stride != 0)
+                return cp;
+            return static_cast<char32_t>(std::int32_t(cp) + run->delta);
+        }
+
+        // the whole-character operations for UTF-8: ASCII is handled inline (and compared 16 or 32
+        // bytes at a time), other characters are decoded
+        template <>
+        struct text_ops<utf8_traits> {
+            // "K" (the Kelvin sign) is three bytes, "k" one
+            enum { fixed_width = 0 };
+
+            static const char* skip_whitespace(const char* first, const char* last) {
+                while (first != last) {
+                    size_t n = 1;
+                    char32_t cp = static_cast<unsigned char>(*first) < 0x80 ? char32_t(*first) : utf8_decode(first, last, n);
+                    if (!is_unicode_whitespace(cp))
+                        break;
+                    first += n;
+                }
+                return first;
+            }
+
+            static const char* skip_whitespace_back(const char* first, const char* last) {
+                while (last != first) {
+                    const char* p = last - 1;
+                    while (p != first && last - p < 4 && is_continuation(*p))
+                        --p;
+                    size_t n;
+                    char32_t cp = utf8_decode(p, last, n);
+                    if (p + n != last || !is_unicode_whitespace(cp))
+                        break;
+                    last = p;
+                }
+                return last;
+            }
+
+            static int icompare(const char* a, size_t na, const char* b, size_t nb) {
+                size_t i = 0, j = 0;
+                for (;;) {
+                    // the bytes skipped are ASCII, so i and j stay at the start of a character
+                    size_t k = ascii_imismatch(a + i, b + j, std::min(na - i, nb - j));
+                    i += k, j += k;
+                    // identical bytes are skipped in bulk, back to the start of the character they end in
+                    // (but no further than where they began: stray continuation bytes may come first)
+                    if ((k = mismatch(a + i, b + j, std::min(na - i, nb - j))) != 0) {
+                        i += k, j += k;
+                        while (k != 0 && ((i < na && is_continuation(a[i])) || (j < nb && is_continuation(b[j]))))
+                            --i, --j, --k;
+                    }
+                    if (i == na || j == nb)
+                        return i == na && j == nb ? 0 : i == na ? -1 : 1;
+                    size_t la, lb;
+                    char32_t ca = utf8_decode(a + i, a + na, la), cb = utf8_decode(b + j, b + nb, lb);
+                    if (ca != cb) {
+                        ca = fold_code_point(ca), cb = fold_code_point(cb);
+                        if (ca != cb)
+                            return ca < cb ? -1 : 1;
+                    }
+                    i += la, j += lb;
+                }
+            }
+
+            // simple case folding maps one character to one character, so a prefix or suffix which
+            // matches b has as many characters as b
+            static const char* iprefix(const char* a, size_t na, const char* b, size_t nb) {
+                const char* last = utf8_advance(a, a + na, utf8_count(b, b + nb));
+                return icompare(a, last - a, b, nb) == 0 ? a : nullptr;
+            }
+
+            static const char* isuffix(const char* a, size_t na, const char* b, size_t nb) {
+                const char* first = utf8_retreat(a, a + na, utf8_count(b, b + nb));
+                return icompare(first, a + na - first, b, nb) == 0 ? first : nullptr;
+            }
+
+            // hash of the case folded text, re-encoded: strings which icompare() equal hash the same
+            // even if their folded characters had encodings of different lengths
+            static std::uint64_t ihash(const char* p, size_t n) {
+                const char* last = p + n;
+                std::uint64_t state = hash_secret[0] ^ wymix(hash_secret[0], hash_secret[1]);
+                unsigned char block[16];
+                size_t fill = 0, total = 0;
+                while (p != last) {
+                    if (fill == 0 && last - p >= 16) {
+                        std::uint64_t x = read64(reinterpret_cast<const unsigned char*>(p)), y = read64(reinterpret_cast<const unsigned char*>(p + 8));
+                        if (((x | y) & 0x8080808080808080ull) == 0) {
+                            state = wymix(ascii_lower8(x) ^ hash_secret[1], ascii_lower8(y) ^ state);
+                            p += 16, total += 16;
+                            continue;
+                        }
+                    }
+                    size_t len;
+                    char encoded[4];
+                    size_t m = utf8_encode(fold_code_point(utf8_decode(p, last, len)), encoded);
+                    p += len, total += m;
+                    for (size_t i = 0; i < m; ++i) {
+                        block[fill++] = static_cast<unsigned char>(encoded[i]);
+                        if (fill == 16) {
+                            state = wymix(read64(block) ^ hash_secret[1], read64(block + 8) ^ state);
+                            fill = 0;
+                        }
+                    }
+                }
+                if (fill != 0) {
+                    std::memset(block + fill, 0, 16 - fill);
+                    state = wymix(read64(block) ^ hash_secret[1], read64(block + 8) ^ state);
+                }
+                return wymix(hash_secret[1] ^ total, wymix(state ^ hash_secret[2], hash_secret[3]));
+            }
+        };
+
+    }
+
+    // the characters of UTF-8 text, as a forward range of char32_t
+    // (a byte which doesn't start a valid sequence is a U+FFFD replacement character of its own)
+    template <typename TT>
+    class basic_code_point_range
+    {
+    private:
+        typedef basic_stref<TT> bstref;
+
+    public:
+        class iterator
+        {
+        public:
+            typedef std::forward_iterator_tag iterator_category;
+            typedef char32_t value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const char32_t* pointer;
+            typedef char32_t reference;
+
+            iterator() : p(nullptr), last(nullptr), n(0), cp(0) {}
+            iterator(const char* p, const char* last) : p(p), last(last), n(0), cp(0) { decode(); }
+
+            char32_t operator*() const { return cp; }
+
+            iterator& operator++() {
+                p += n;
+                decode();
+                return *this;
+            }
+
+            iterator operator++(int) {
+                iterator it(*this);
+                ++*this;
+                return it;
+            }
+
+            bool operator== (const iterator& rhs) const { return p == rhs.p; }
+            bool operator!= (const iterator& rhs) const { return p != rhs.p; }
+
+            // the character's bytes
+            bstref bytes() const { return bstref(p, n); }
+
+        private:
+            void decode() {
+                if (p == last)
+                    return;
+                cp = detail::utf8_decode(p, last, n);
+                if (cp - 0xdc00 < 0x100)
+                    cp = 0xfffd;
+            }
+
+            const char* p;
+            const char* last;
+            size_t n;
+            char32_t cp;
+        };
+
+        explicit basic_code_point_range(const bstref& text) : text(text) {}
+
+        iterator begin() const { return iterator(text.begin(), text.end()); }
+        iterator end() const { return iterator(text.end(), text.end()); }
+
+    private:
+        bstref text;
+    };
+
+    //
+    // UTF-8 functions: they take any stref of bytes (stref or u8stref), and count in characters
+    //
+
+    template <typename TT>
+    basic_code_point_range<TT> code_points(const basic_stref<TT>& s) {
+        static_assert(sizeof(typename TT::char_type) == 1, "code_points: UTF-8 text is made of bytes");
+        return basic_code_point_range<TT>(s);
+    }
+
+    // the length in bytes of the longest valid UTF-8 prefix
+    template <typename TT>
+    size_t utf8_valid_length(const basic_stref<TT>& s) {
+        static_assert(sizeof(typename TT::char_type) == 1, "utf8_valid_length: UTF-8 text is made of bytes");
+        return detail::utf8_validate(s.begin(), s.end()) - s.begin();
+    }
+
+    template <typename TT>
+    bool utf8_valid(const basic_stref<TT>& s) {
+        return utf8_valid_length(s) == s.length();
+    }
+
+    // the number of characters (of valid UTF-8: otherwise it counts the bytes which aren't continuation bytes)
+    template <typename TT>
+    size_t utf8_length(const basic_stref<TT>& s) {
+        static_assert(sizeof(typename TT::char_type) == 1, "utf8_length: UTF-8 text is made of bytes");
+        return detail::utf8_count(s.begin(), s.end());
+    }
+
+    // substrings which start and end on character boundaries, with the offset and lengths in characters
+    template <typename TT>
+    basic_stref<TT> utf8_substr(const basic_stref<TT>& s, size_t offset, size_t count = size_t(-1)) {
+        static_assert(sizeof(typename TT::char_type) == 1, "utf8_substr: UTF-8 text is made of bytes");
+        const char* first = detail::utf8_advance(s.begin(), s.end(), offset);
+        const char* last = detail::utf8_advance(first, s.end(), count);
+        return basic_stref<TT>(first, last - first);
+    }
+
+    template <typename TT>
+    basic_stref<TT> utf8_left(const basic_stref<TT>& s, size_t count) {
+        return utf8_substr(s, 0, count);
+    }
+
+    template <typename TT>
+    basic_stref<TT> utf8_right(const basic_stref<TT>& s, size_t count) {
+        static_assert(sizeof(typename TT::char_type) == 1, "utf8_right: UTF-8 text is made of bytes");
+        const char* first = detail::utf8_retreat(s.begin(), s.end(), count);
+        return basic_stref<TT>(first, s.end() - first);
+    }
+
+}
+
+#endif